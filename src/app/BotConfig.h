@@ -49,10 +49,28 @@
 #define BOT_PIN_MOTOR_RIGHT_INPUT1 (31)
 #define BOT_PIN_MOTOR_RIGHT_INPUT2 (29)
 
-// If software PWM is enabled for motors, then their speed can be controlled.
+// If software or hardware PWM is enabled for motors, then their speed can be controlled.
 // If not enabled, then only state (i.e. rotate or not) and direction.
 // #define BOT_MOTORS_ENABLE_SOFT_PWM
 
+// Hardware PWM takes priority over the software one and does not load CPU, but requires
+// motors' enable pins to be on PWM0 (phys 12 or 32) and PWM1 (phys 33 or 35) channels.
+// Note: it conflicts with analog audio output, which uses the same PWM peripheral.
+// #define BOT_MOTORS_ENABLE_HARD_PWM
+
+// Divisor of 19.2 MHz PWM clock - with range of 100 it makes 4 kHz PWM frequency
+#define BOT_MOTORS_PWM_CLOCK_DIVISOR (48)
+
+// Power increases by that much every ramp interval (ms) when speed can be controlled, so motors
+// accelerate smoothly instead of drawing current spikes. Slowing down and stopping are immediate.
+// Step of 100 disables ramping.
+#define BOT_MOTORS_RAMP_STEP     (10)
+#define BOT_MOTORS_RAMP_INTERVAL (20)
+
+// Time (ms) motors keep running after the last received command - clients must keep sending commands
+// while the bot needs to move, so it stops soon after connection with them is lost (0 - never stop)
+#define BOT_MOTORS_COMMAND_TIMEOUT (500)
+
 // ===== Distance measurements (HC-SR04 sensor in use) =====
 
 // Tells if the bot is equipped with ultrasonic sensor for distance measurements
@@ -61,4 +79,23 @@
 #define BOT_PIN_ULTRASONIC_TRIGGER (22)
 #define BOT_PIN_ULTRASONIC_ECHO    (37)
 
+// Number of the latest measurements to take median of (1-31)
+#define BOT_DISTANCE_MEDIAN_WINDOW (5)
+
+// Weight of new median value in the exponential moving average of distance, (0, 1] - 1 means no smoothing
+#define BOT_DISTANCE_SMOOTHING_FACTOR (1.0f)
+
+// Measurements differing from the median by more than that (cm) are ignored as outliers - 0 to keep all
+#define BOT_DISTANCE_OUTLIER_THRESHOLD (0.0f)
+
+// ===== Collision avoidance (requires distance measurements) =====
+
+// Tells if the bot limits its forward speed by itself when approaching obstacles
+#define BOT_COLLISION_AVOIDANCE_ENABLE
+
+// Distance (cm) to start slowing down at and to stop moving forward at. Without PWM motors
+// either run at full power or stop, so the bot stops once it is half way between the two.
+#define BOT_COLLISION_SLOW_DISTANCE (40.0f)
+#define BOT_COLLISION_STOP_DISTANCE (20.0f)
+
 #endif // PIREXBOT_CONFIG_H
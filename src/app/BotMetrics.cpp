@@ -0,0 +1,289 @@
+/*
+    PiRexBot - remote controlled bot based on RaspberryPi
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "BotMetrics.hpp"
+
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+using namespace std;
+using namespace std::chrono;
+
+// Prefix of all reported metrics
+#define METRICS_PREFIX "pirexbot_"
+
+namespace Private
+{
+    // Private implementation details for the BotMetrics
+    class BotMetricsData
+    {
+    public:
+        shared_ptr<XRaspiCamera>                           Camera;
+        XWebServer&                                        Server;
+        vector<pair<string, const XVideoSourceToWeb*>>     VideoProfiles;
+        const XMotionDetector*                             MotionDetector;
+        const XAsyncVideoSourceListenerChain*              AsyncListeners;
+        const XSharedFrameExporter*                        SharedFrameExporter;
+
+        // frames count at the time of previous request, to calculate current frame rate
+        mutable mutex                                      Sync;
+        mutable uint32_t                                   LastFramesCount;
+        mutable steady_clock::time_point                   LastFramesTime;
+
+    public:
+        BotMetricsData( const shared_ptr<XRaspiCamera>& camera, XWebServer& server ) :
+            Camera( camera ), Server( server ), VideoProfiles( ), MotionDetector( nullptr ), AsyncListeners( nullptr ),
+            SharedFrameExporter( nullptr ), Sync( ), LastFramesCount( 0 ), LastFramesTime( steady_clock::now( ) )
+        {
+        }
+
+        void CollectCameraMetrics( PropertyMap& metrics ) const;
+        void CollectVideoMetrics( PropertyMap& metrics ) const;
+        void CollectMotionMetrics( PropertyMap& metrics ) const;
+        void CollectListenerMetrics( PropertyMap& metrics ) const;
+        void CollectSharedFrameMetrics( PropertyMap& metrics ) const;
+        void CollectWebMetrics( PropertyMap& metrics ) const;
+    };
+}
+
+// Format floating point value of a metric
+static string FormatValue( double value )
+{
+    char buffer[32];
+
+    sprintf( buffer, "%g", value );
+
+    return string( buffer );
+}
+
+BotMetrics::BotMetrics( const shared_ptr<XRaspiCamera>& camera, XWebServer& server ) :
+    mData( new Private::BotMetricsData( camera, server ) )
+{
+}
+
+BotMetrics::~BotMetrics( )
+{
+    delete mData;
+}
+
+// Add video source to web streamer to report its encoding metrics
+void BotMetrics::AddVideoProfile( const string& profileName, const XVideoSourceToWeb& video2web )
+{
+    mData->VideoProfiles.push_back( pair<string, const XVideoSourceToWeb*>( profileName, &video2web ) );
+}
+
+// Set motion detector to report its metrics
+void BotMetrics::SetMotionDetector( const XMotionDetector& motionDetector )
+{
+    mData->MotionDetector = &motionDetector;
+}
+
+// Set chain of asynchronous listeners to report their metrics
+void BotMetrics::SetAsyncListeners( const XAsyncVideoSourceListenerChain& listeners )
+{
+    mData->AsyncListeners = &listeners;
+}
+
+// Set exporter of raw frames into shared memory to report its metrics
+void BotMetrics::SetSharedFrameExporter( const XSharedFrameExporter& exporter )
+{
+    mData->SharedFrameExporter = &exporter;
+}
+
+// Get the specified metric
+XError BotMetrics::GetProperty( const string& propertyName, string& value ) const
+{
+    PropertyMap           metrics    = GetAllProperties( );
+    PropertyMap::iterator itProperty = metrics.find( propertyName );
+    XError                ret        = XError::UnknownProperty;
+
+    if ( itProperty != metrics.end( ) )
+    {
+        value = itProperty->second;
+        ret   = XError::Success;
+    }
+
+    return ret;
+}
+
+// Get all metrics
+PropertyMap BotMetrics::GetAllProperties( ) const
+{
+    PropertyMap metrics;
+
+    mData->CollectCameraMetrics( metrics );
+    mData->CollectVideoMetrics( metrics );
+    mData->CollectMotionMetrics( metrics );
+    mData->CollectListenerMetrics( metrics );
+    mData->CollectSharedFrameMetrics( metrics );
+    mData->CollectWebMetrics( metrics );
+
+    return metrics;
+}
+
+namespace Private
+{
+
+// Collect metrics of the camera - frames captured/lost and current frame rate
+void BotMetricsData::CollectCameraMetrics( PropertyMap& metrics ) const
+{
+    lock_guard<mutex>        lock( Sync );
+    uint32_t                 framesCount = Camera->FramesReceived( );
+    steady_clock::time_point now         = steady_clock::now( );
+    double                   elapsed     = duration_cast<microseconds>( now - LastFramesTime ).count( ) / 1000000.0;
+    double                   fps         = 0;
+
+    // frames counter is reset when camera restarts
+    if ( ( framesCount >= LastFramesCount ) && ( elapsed > 0 ) )
+    {
+        fps = ( framesCount - LastFramesCount ) / elapsed;
+    }
+
+    LastFramesCount = framesCount;
+    LastFramesTime  = now;
+
+    metrics[METRICS_PREFIX "camera_frames_total"]          = to_string( framesCount );
+    metrics[METRICS_PREFIX "camera_fps"]                   = FormatValue( fps );
+    metrics[METRICS_PREFIX "camera_dropped_buffers_total"] = to_string( Camera->BuffersDropped( ) );
+    metrics[METRICS_PREFIX "camera_capture_suspended"]     = ( Camera->IsCaptureSuspended( ) ) ? "1" : "0";
+    metrics[METRICS_PREFIX "camera_reconfigurations_total"] = to_string( Camera->ReconfigurationsCount( ) );
+
+    // frames and buffers of every enabled stream, which tell if buffer pools are deep enough
+    vector<pair<string, XRaspiCameraStreamStats>> streams;
+
+    streams.push_back( pair<string, XRaspiCameraStreamStats>( "primary", Camera->PrimaryStreamStats( ) ) );
+    if ( Camera->SecondaryWidth( ) != 0 )
+    {
+        streams.push_back( pair<string, XRaspiCameraStreamStats>( "secondary", Camera->SecondaryStreamStats( ) ) );
+    }
+    if ( Camera->IsH264EncodingEnabled( ) )
+    {
+        streams.push_back( pair<string, XRaspiCameraStreamStats>( "h264", Camera->H264StreamStats( ) ) );
+    }
+    if ( Camera->IsRawStreamEnabled( ) )
+    {
+        streams.push_back( pair<string, XRaspiCameraStreamStats>( "raw", Camera->RawStreamStats( ) ) );
+    }
+
+    for ( auto stream : streams )
+    {
+        const XRaspiCameraStreamStats& stats  = stream.second;
+        string                         labels = "{stream=\"" + stream.first + "\"}";
+
+        metrics[METRICS_PREFIX "camera_stream_buffers" + labels]                  = to_string( stats.BuffersCount );
+        metrics[METRICS_PREFIX "camera_stream_buffers_in_use" + labels]           = to_string( stats.BuffersInUse );
+        metrics[METRICS_PREFIX "camera_stream_max_buffers_in_use" + labels]       = to_string( stats.MaxBuffersInUse );
+        metrics[METRICS_PREFIX "camera_stream_buffer_starvations_total" + labels] = to_string( stats.BufferStarvations );
+        metrics[METRICS_PREFIX "camera_stream_frames_captured_total" + labels]    = to_string( stats.FramesCaptured );
+        metrics[METRICS_PREFIX "camera_stream_frames_delivered_total" + labels]   = to_string( stats.FramesDelivered );
+        metrics[METRICS_PREFIX "camera_stream_frames_dropped_total" + labels]     = to_string( stats.FramesDropped );
+    }
+}
+
+// Collect metrics of JPEG encoding for all video profiles
+void BotMetricsData::CollectVideoMetrics( PropertyMap& metrics ) const
+{
+    for ( auto profile : VideoProfiles )
+    {
+        string labels = "profile=\"" + profile.first + "\"";
+
+        profile.second->EncodeTimeHistogram( ).ToPrometheus( metrics, METRICS_PREFIX "jpeg_encode_seconds", labels, 1000000.0 );
+        profile.second->FrameSizeHistogram( ).ToPrometheus( metrics, METRICS_PREFIX "jpeg_frame_bytes", labels );
+    }
+}
+
+// Collect metrics of motion detection - current state, number of detected motions and time taken by analysis
+void BotMetricsData::CollectMotionMetrics( PropertyMap& metrics ) const
+{
+    if ( MotionDetector != nullptr )
+    {
+        metrics[METRICS_PREFIX "motion_detected"]              = ( MotionDetector->IsMotionDetected( ) ) ? "1" : "0";
+        metrics[METRICS_PREFIX "motion_level_percent"]         = FormatValue( MotionDetector->MotionLevel( ) );
+        metrics[METRICS_PREFIX "motion_events_total"]          = to_string( MotionDetector->MotionEventsCount( ) );
+        metrics[METRICS_PREFIX "motion_analysed_frames_total"] = to_string( MotionDetector->FramesAnalysed( ) );
+
+        MotionDetector->AnalysisTimeHistogram( ).ToPrometheus( metrics, METRICS_PREFIX "motion_analysis_seconds", "", 1000000.0 );
+    }
+}
+
+// Collect metrics of camera listeners running on their own threads - frames they got and missed
+void BotMetricsData::CollectListenerMetrics( PropertyMap& metrics ) const
+{
+    if ( AsyncListeners != nullptr )
+    {
+        for ( size_t i = 0, n = AsyncListeners->ListenersCount( ); i < n; i++ )
+        {
+            string labels = "listener=\"" + AsyncListeners->ListenerName( i ) + "\"";
+
+            metrics[METRICS_PREFIX "listener_frames_total{" + labels + "}"]         = to_string( AsyncListeners->FramesDelivered( i ) );
+            metrics[METRICS_PREFIX "listener_dropped_frames_total{" + labels + "}"] = to_string( AsyncListeners->FramesDropped( i ) );
+        }
+    }
+}
+
+// Collect metrics of raw frames export into shared memory - frames published/skipped and time taken by it
+void BotMetricsData::CollectSharedFrameMetrics( PropertyMap& metrics ) const
+{
+    if ( SharedFrameExporter != nullptr )
+    {
+        metrics[METRICS_PREFIX "shm_frames_published_total"] = to_string( SharedFrameExporter->FramesPublished( ) );
+        metrics[METRICS_PREFIX "shm_frames_skipped_total"]   = to_string( SharedFrameExporter->FramesSkipped( ) );
+
+        SharedFrameExporter->PublishTimeHistogram( ).ToPrometheus( metrics, METRICS_PREFIX "shm_publish_seconds", "", 1000000.0 );
+    }
+}
+
+// Collect metrics of web server and its request handlers
+void BotMetricsData::CollectWebMetrics( PropertyMap& metrics ) const
+{
+    map<string, XWebHandlerStats> handlersStats = Server.HandlersStats( );
+
+    for ( auto handlerStats : handlersStats )
+    {
+        const XWebHandlerStats& stats    = handlerStats.second;
+        string                  labels   = "uri=\"" + handlerStats.first + "\"";
+        string                  latency  = METRICS_PREFIX "http_request_duration_seconds";
+        uint64_t                requests = 0;
+
+        metrics[METRICS_PREFIX "http_requests_total{" + labels + "}"]    = to_string( stats.RequestsCount );
+        metrics[METRICS_PREFIX "http_sent_bytes_total{" + labels + "}"]  = to_string( stats.BytesSent );
+        metrics[METRICS_PREFIX "http_connections{" + labels + "}"]       = to_string( stats.ActiveConnections );
+        metrics[METRICS_PREFIX "http_queued_bytes{" + labels + "}"]      = to_string( stats.QueuedBytes );
+        metrics[METRICS_PREFIX "http_max_queued_bytes{" + labels + "}"]  = to_string( stats.MaxQueuedBytes );
+
+        for ( uint32_t i = 0; i < XWebHandlerStats::LatencyBucketsCount; i++ )
+        {
+            string bound = ( i < XWebHandlerStats::LatencyBucketsCount - 1 ) ?
+                           FormatValue( XWebHandlerStats::LatencyBucketBounds[i] / 1000000.0 ) : string( "+Inf" );
+
+            requests += stats.LatencyHistogram[i];
+            metrics[latency + "_bucket{" + labels + ",le=\"" + bound + "\"}"] = to_string( requests );
+        }
+
+        metrics[latency + "_sum{" + labels + "}"]   = FormatValue( stats.LatencySum / 1000000.0 );
+        metrics[latency + "_count{" + labels + "}"] = to_string( requests );
+    }
+
+    Server.EventHandlingTimeHistogram( ).ToPrometheus( metrics, METRICS_PREFIX "web_event_handling_seconds", "", 1000000.0 );
+}
+
+} // namespace Private
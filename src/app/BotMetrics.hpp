@@ -0,0 +1,67 @@
+/*
+    PiRexBot - remote controlled bot based on RaspberryPi
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef BOT_METRICS_HPP
+#define BOT_METRICS_HPP
+
+#include <memory>
+#include <IObjectInformation.hpp>
+
+#include "XRaspiCamera.hpp"
+#include "XVideoSourceToWeb.hpp"
+#include "XMotionDetector.hpp"
+#include "XAsyncVideoSourceListenerChain.hpp"
+#include "XSharedFrameExporter.hpp"
+#include "XWebServer.hpp"
+
+namespace Private
+{
+    class BotMetricsData;
+}
+
+// Class collecting performance metrics of the bot's camera, JPEG encoding and web server,
+// which are provided as properties named in Prometheus format
+class BotMetrics : public IObjectInformation
+{
+public:
+    BotMetrics( const std::shared_ptr<XRaspiCamera>& camera, XWebServer& server );
+    ~BotMetrics( );
+
+    // Add video source to web streamer to report its encoding metrics with the specified profile label
+    void AddVideoProfile( const std::string& profileName, const XVideoSourceToWeb& video2web );
+
+    // Set motion detector to report its detection state and analysis time
+    void SetMotionDetector( const XMotionDetector& motionDetector );
+
+    // Set chain of listeners getting camera's frames on their own threads to report frames they missed
+    void SetAsyncListeners( const XAsyncVideoSourceListenerChain& listeners );
+
+    // Set exporter of raw frames into shared memory to report frames it published and time taken by it
+    void SetSharedFrameExporter( const XSharedFrameExporter& exporter );
+
+    // IObjectInformation implementation
+    XError GetProperty( const std::string& propertyName, std::string& value ) const;
+    std::map<std::string, std::string> GetAllProperties( ) const;
+
+private:
+    Private::BotMetricsData* mData;
+};
+
+#endif // BOT_METRICS_HPP
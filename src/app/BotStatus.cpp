@@ -0,0 +1,78 @@
+/*
+    PiRexBot - remote controlled bot based on RaspberryPi
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "BotStatus.hpp"
+
+using namespace std;
+
+static const char* SubsystemStateName( SubsystemState state )
+{
+    return ( state == SubsystemState::Ready ) ? "ready" : ( state == SubsystemState::Failed ) ? "failed" : "starting";
+}
+
+BotStatus::BotStatus( const PropertyMap& info ) :
+    info( info ), subsystems( )
+{
+}
+
+// Add subsystem to report state of
+void BotStatus::AddSubsystem( const string& name, const function<SubsystemState( )>& getState )
+{
+    subsystems.push_back( make_pair( name, getState ) );
+}
+
+// Get the specified property of the bot
+XError BotStatus::GetProperty( const string& propertyName, string& value ) const
+{
+    PropertyMap           properties = GetAllProperties( );
+    PropertyMap::iterator itProperty = properties.find( propertyName );
+    XError                ret        = XError::UnknownProperty;
+
+    if ( itProperty != properties.end( ) )
+    {
+        value = itProperty->second;
+        ret   = XError::Success;
+    }
+
+    return ret;
+}
+
+// Get all properties of the bot - the static ones and current state of its subsystems
+PropertyMap BotStatus::GetAllProperties( ) const
+{
+    PropertyMap properties = info;
+    bool        ready      = true;
+
+    for ( const auto& subsystem : subsystems )
+    {
+        SubsystemState state = subsystem.second( );
+
+        properties[subsystem.first + "State"] = SubsystemStateName( state );
+
+        if ( state == SubsystemState::Starting )
+        {
+            ready = false;
+        }
+    }
+
+    properties["ready"] = ( ready ) ? "true" : "false";
+
+    return properties;
+}
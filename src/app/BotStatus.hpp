@@ -0,0 +1,57 @@
+/*
+    PiRexBot - remote controlled bot based on RaspberryPi
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef BOT_STATUS_HPP
+#define BOT_STATUS_HPP
+
+#include <functional>
+#include <vector>
+#include <IObjectInformation.hpp>
+
+// State of a subsystem brought up in background when the bot starts
+enum class SubsystemState
+{
+    Starting,
+    Ready,
+    Failed
+};
+
+// Information about the bot along with state of its subsystems. Web server and motors are available right
+// after start, while camera, sensors, etc. get ready in background - their state is provided as "<name>State"
+// property ("starting", "ready" or "failed") and "ready" property is "true" once none of them is starting.
+class BotStatus : public IObjectInformation
+{
+public:
+    BotStatus( const PropertyMap& info );
+
+    // Add subsystem to report state of (to be done before the object is used) - the function is called
+    // on every request to get subsystem's current state
+    void AddSubsystem( const std::string& name, const std::function<SubsystemState( )>& getState );
+
+    // IObjectInformation implementation
+    XError GetProperty( const std::string& propertyName, std::string& value ) const;
+    PropertyMap GetAllProperties( ) const;
+
+private:
+    PropertyMap info;
+    std::vector<std::pair<std::string, std::function<SubsystemState( )>>> subsystems;
+};
+
+#endif // BOT_STATUS_HPP
@@ -0,0 +1,47 @@
+/*
+    PiRexBot - remote controlled bot based on RaspberryPi
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "CollisionGuard.hpp"
+
+using namespace std;
+
+CollisionGuard::CollisionGuard( const shared_ptr<MotorsController>& motorsController, float stopDistance, float slowDistance ) :
+    motorsController( motorsController ), stopDistance( stopDistance ),
+    slowDistance( ( slowDistance > stopDistance ) ? slowDistance : stopDistance )
+{
+}
+
+// Update power limit of motors from the new distance measurement
+void CollisionGuard::OnDistanceMeasured( float distance )
+{
+    uint8_t limit = 100;
+
+    if ( distance <= stopDistance )
+    {
+        limit = 0;
+    }
+    else if ( distance < slowDistance )
+    {
+        // linear slow down between the two distances
+        limit = static_cast<uint8_t>( ( distance - stopDistance ) * 100.0f / ( slowDistance - stopDistance ) );
+    }
+
+    motorsController->SetForwardPowerLimit( limit );
+}
@@ -0,0 +1,45 @@
+/*
+    PiRexBot - remote controlled bot based on RaspberryPi
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef COLLISION_GUARD_HPP
+#define COLLISION_GUARD_HPP
+
+#include <memory>
+#include "MotorsController.hpp"
+
+// Limits power of motors for moving forward depending on distance to obstacle ahead - the bot slows down
+// when getting closer than the "slow" distance and is not allowed to move forward below the "stop" one.
+// Meant to get distance measurements straight from DistanceController, so it reacts right after a
+// measurement whatever happens to the connection with the client controlling the bot.
+class CollisionGuard
+{
+public:
+    CollisionGuard( const std::shared_ptr<MotorsController>& motorsController, float stopDistance, float slowDistance );
+
+    // Update power limit of motors from the new distance measurement (cm)
+    void OnDistanceMeasured( float distance );
+
+private:
+    std::shared_ptr<MotorsController> motorsController;
+    float stopDistance;
+    float slowDistance;
+};
+
+#endif // COLLISION_GUARD_HPP
@@ -22,11 +22,17 @@
 #include "BotConfig.h"
 
 #include <stdint.h>
-#include <vector>
-#include <list>
+#include <string.h>
+#include <math.h>
 #include <algorithm>
+#include <atomic>
 #include <mutex>
 #include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
 #include <wiringPi.h>
 
 #include "XManualResetEvent.hpp"
@@ -36,25 +42,83 @@ using namespace std;
 // Time (microseconds) to wait for distance measurement
 #define MEASUREMENT_TIMEOUT_US  (15000)
 
-// History length to calculate median distance
-#define MEASUREMENT_HISTOTY_LENGTH (5)
-
-const static string  PROP_LAST_DISTANCE    = "lastDistance";
-const static string  PROP_MEDIAN_DISTANCE  = "medianDistance";
-
-const static list<string> SupportedProperties = { PROP_LAST_DISTANCE, PROP_MEDIAN_DISTANCE };
+// GPIO character device to get echo pin's edge events from (with kernel time stamps)
+#define ECHO_GPIO_CHIP_DEVICE   "/dev/gpiochip0"
 
 namespace Private
 {
+    // Median of the specified number of the latest values. Keeps the values in arrival order and
+    // sorted, so adding a value takes binary search plus a short move instead of sorting everything.
+    class RollingMedian
+    {
+    private:
+        float    Values[DistanceController::MaxMedianWindow];
+        float    Sorted[DistanceController::MaxMedianWindow];
+        uint32_t Window;
+        uint32_t Count;
+        uint32_t NextIndex;
+
+    public:
+        RollingMedian( uint32_t window ) :
+            Window( 1 ), Count( 0 ), NextIndex( 0 )
+        {
+            Reset( window );
+        }
+
+        // Forget all values and set new window size
+        void Reset( uint32_t window )
+        {
+            Window    = std::min( std::max( window, 1u ), DistanceController::MaxMedianWindow );
+            Count     = 0;
+            NextIndex = 0;
+        }
+
+        uint32_t Size( ) const { return Count; }
+        bool IsFull( ) const { return ( Count == Window ); }
+
+        // Add new value replacing the oldest one if window is full
+        void Add( float value )
+        {
+            if ( Count == Window )
+            {
+                float* oldest = std::lower_bound( Sorted, Sorted + Count, Values[NextIndex] );
+
+                memmove( oldest, oldest + 1, ( Sorted + Count - oldest - 1 ) * sizeof( float ) );
+                Count--;
+            }
+
+            float* position = std::upper_bound( Sorted, Sorted + Count, value );
+
+            memmove( position + 1, position, ( Sorted + Count - position ) * sizeof( float ) );
+            *position = value;
+            Count++;
+
+            Values[NextIndex] = value;
+            NextIndex         = ( NextIndex + 1 ) % Window;
+        }
+
+        // Median of the values (the upper one for even count)
+        float Median( ) const
+        {
+            return ( Count == 0 ) ? 0.0f : Sorted[Count / 2];
+        }
+    };
+
     // Private implementation details for the DistanceController
     class DistanceControllerData
     {
     public:
-        float                   LastDistance;
-        float                   MedianDistance;
-
-        vector<float>           MeasurementHistory;
-        int                     NextHistoryIndex;
+        // values are updated by measurements thread and read by anyone
+        atomic<float>           LastDistance;
+        atomic<float>           MedianDistance;
+        atomic<float>           SmoothedDistance;
+
+        uint32_t                MedianWindow;
+        RollingMedian           Median;
+        float                   SmoothingFactor;
+        float                   OutlierThreshold;
+        uint32_t                OutliersInRow;
+        function<void( float )> MeasurementHandler;
 
         recursive_mutex         Sync;
         thread                  ControlThread;
@@ -63,7 +127,9 @@ namespace Private
 
     public:
         DistanceControllerData( ) :
-            LastDistance( 0 ), MedianDistance( 0 ), MeasurementHistory( ), NextHistoryIndex( 0 ),
+            LastDistance( 0.0f ), MedianDistance( 0.0f ), SmoothedDistance( 0.0f ),
+            MedianWindow( 5 ), Median( MedianWindow ), SmoothingFactor( 1.0f ), OutlierThreshold( 0.0f ), OutliersInRow( 0 ),
+            MeasurementHandler( ),
             Sync( ), ControlThread( ), NeedToStop( ), Running( false )
         {
         }
@@ -73,10 +139,32 @@ namespace Private
         bool IsRunning( );
         void RunMeasurementLoop( );
 
+    private:
+        int  OpenEchoEvents( );
+        bool MeasureByEvents( int eventsFd, uint32_t* echoLength );
+        bool MeasureByPolling( uint32_t* echoLength );
+        void AddMeasurement( float distance );
+        void TriggerMeasurement( );
+
+    public:
+
         static void ControlThreadHanlder( DistanceControllerData* me );
     };
 }
 
+const uint32_t DistanceController::MaxMedianWindow;
+
+// Properties of the distance sensor - all are measured and so read only
+const XPropertyTable<DistanceController> DistanceController::PropertyTable =
+{
+    { { "lastDistance", "Last Distance", XPropertyType::Float, 0, 0, 0, nullptr, 0 },
+      []( const DistanceController& sensor ) -> double { return sensor.mData->LastDistance; }, nullptr },
+    { { "medianDistance", "Median Distance", XPropertyType::Float, 0, 0, 0, nullptr, 0 },
+      []( const DistanceController& sensor ) -> double { return sensor.mData->MedianDistance; }, nullptr },
+    { { "smoothedDistance", "Smoothed Distance", XPropertyType::Float, 0, 0, 0, nullptr, 0 },
+      []( const DistanceController& sensor ) -> double { return sensor.mData->SmoothedDistance; }, nullptr }
+};
+
 DistanceController::DistanceController( ) :
     mData( new Private::DistanceControllerData )
 {
@@ -105,61 +193,90 @@ bool DistanceController::IsRunning( )
     return mData->IsRunning( );
 }
 
-// Value of the last measurement
-float DistanceController::Distance( )
+// Get/Set number of the latest measurements to take median of
+uint32_t DistanceController::MedianWindow( ) const
 {
+    return mData->MedianWindow;
 }
-
-// Median value of the distance
-float DistanceController::MedianDistance( )
+void DistanceController::SetMedianWindow( uint32_t window )
 {
+    lock_guard<recursive_mutex> lock( mData->Sync );
+
+    if ( !mData->IsRunning( ) )
+    {
+        mData->MedianWindow = std::min( std::max( window, 1u ), MaxMedianWindow );
+    }
 }
 
-// Get property of the object
-XError DistanceController::GetProperty( const string& propertyName, string& value ) const
+// Get/Set weight of new median value in the exponential moving average of distance
+float DistanceController::SmoothingFactor( ) const
+{
+    return mData->SmoothingFactor;
+}
+void DistanceController::SetSmoothingFactor( float factor )
 {
-    XError ret = XError::Success;
-    float  numericValue;
+    lock_guard<recursive_mutex> lock( mData->Sync );
 
-    if ( propertyName == PROP_LAST_DISTANCE )
+    if ( ( !mData->IsRunning( ) ) && ( factor > 0.0f ) && ( factor <= 1.0f ) )
     {
-        numericValue = mData->LastDistance;
+        mData->SmoothingFactor = factor;
     }
-    else if ( propertyName == PROP_MEDIAN_DISTANCE )
+}
+
+// Get/Set difference from median distance (cm), which makes a measurement an outlier
+float DistanceController::OutlierThreshold( ) const
+{
+    return mData->OutlierThreshold;
+}
+void DistanceController::SetOutlierThreshold( float threshold )
+{
+    lock_guard<recursive_mutex> lock( mData->Sync );
+
+    if ( ( !mData->IsRunning( ) ) && ( threshold >= 0.0f ) )
     {
-        numericValue = mData->MedianDistance;
+        mData->OutlierThreshold = threshold;
     }
-    else
+}
+
+// Set handler to call with median distance after every measurement
+void DistanceController::SetMeasurementHandler( const function<void( float )>& handler )
+{
+    lock_guard<recursive_mutex> lock( mData->Sync );
+
+    if ( !mData->IsRunning( ) )
     {
-        ret = XError::UnknownProperty;
+        mData->MeasurementHandler = handler;
     }
+}
 
-    if ( ret == XError::Success )
-    {
-        char buffer[32];
+// Value of the last measurement
+float DistanceController::Distance( )
+{
+    return mData->LastDistance;
+}
 
-        sprintf( buffer, "%0.2f", numericValue );
-        value = buffer;
-    }
+// Median value of the distance
+float DistanceController::MedianDistance( )
+{
+    return mData->MedianDistance;
+}
+
+// Smoothed median value of the distance
+float DistanceController::SmoothedDistance( )
+{
+    return mData->SmoothedDistance;
+}
 
-    return ret;
+// Get property of the object
+XError DistanceController::GetProperty( const string& propertyName, string& value ) const
+{
+    return PropertyTable.GetProperty( *this, propertyName, value );
 }
 
 // Get all supported properties of the object
 map<string, string> DistanceController::GetAllProperties( ) const
 {
-    map<string, string> properties;
-    string              value;
-
-    for ( auto property : SupportedProperties )
-    {
-        if ( GetProperty( property, value ) )
-        {
-            properties.insert( pair<string, string>( property, value ) );
-        }
-    }
-
-    return properties;
+    return PropertyTable.GetAllProperties( *this );
 }
 
 namespace Private
@@ -177,8 +294,9 @@ bool DistanceControllerData::StartMeasurements( )
 
         LastDistance     = 0.0f;
         MedianDistance   = 0.0f;
-        NextHistoryIndex = 0;
-        MeasurementHistory.clear( );
+        SmoothedDistance = 0.0f;
+        OutliersInRow    = 0;
+        Median.Reset( MedianWindow );
 
         ControlThread = thread( ControlThreadHanlder, this );
     }
@@ -215,71 +333,198 @@ bool DistanceControllerData::IsRunning( )
 // Run the actual measurement loop and checking if it is time to stop
 void DistanceControllerData::RunMeasurementLoop( )
 {
-    uint32_t reftime, start, stop;
-    bool     failed;
+    // prefer timing echo by edge events, which kernel time stamps as they happen; keep
+    // polling echo pin only as a fallback for kernels without GPIO character device
+    int      eventsFd = OpenEchoEvents( );
+    uint32_t echoLength;
 
     while ( !NeedToStop.Wait( 10 ) )
     {
-        failed = false;
-
-        // trigger measurement round
-        digitalWrite( BOT_PIN_ULTRASONIC_TRIGGER, HIGH );
-        delayMicroseconds( 10 );
-        digitalWrite( BOT_PIN_ULTRASONIC_TRIGGER, LOW );
-
-        reftime = micros( );
-        start   = reftime;
+        bool measured = ( eventsFd >= 0 ) ? MeasureByEvents( eventsFd, &echoLength ) : MeasureByPolling( &echoLength );
 
-        // wait for the echo wave start
-        while ( digitalRead( BOT_PIN_ULTRASONIC_ECHO ) == LOW )
+        if ( measured )
         {
-            start = micros( );
-            if ( start - reftime > MEASUREMENT_TIMEOUT_US )
+            AddMeasurement( (float) echoLength / 58.2f );
+
+            if ( MeasurementHandler )
             {
-                failed = true;
-                break;
+                MeasurementHandler( MedianDistance );
             }
         }
+    }
 
-        if ( !failed )
+    if ( eventsFd >= 0 )
+    {
+        close( eventsFd );
+    }
+}
+
+// Request rising/falling edge events of the echo pin (returns -1 if not available)
+int DistanceControllerData::OpenEchoEvents( )
+{
+    int chipFd   = open( ECHO_GPIO_CHIP_DEVICE, O_RDONLY | O_CLOEXEC );
+    int eventsFd = -1;
+
+    if ( chipFd >= 0 )
+    {
+        struct gpioevent_request request;
+
+        memset( &request, 0, sizeof( request ) );
+        request.lineoffset  = physPinToGpio( BOT_PIN_ULTRASONIC_ECHO );
+        request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+        request.eventflags  = GPIOEVENT_REQUEST_BOTH_EDGES;
+        strncpy( request.consumer_label, "pirexbot-echo", sizeof( request.consumer_label ) - 1 );
+
+        if ( ioctl( chipFd, GPIO_GET_LINEEVENT_IOCTL, &request ) == 0 )
         {
-            reftime = micros( );
-            stop    = reftime;
+            eventsFd = request.fd;
+
+            // events are drained before every measurement, so reading must not block
+            fcntl( eventsFd, F_SETFL, fcntl( eventsFd, F_GETFL ) | O_NONBLOCK );
+        }
+
+        close( chipFd );
+    }
+
+    return eventsFd;
+}
 
-            // wait for the echo wave stop
-            while ( digitalRead( BOT_PIN_ULTRASONIC_ECHO ) == HIGH )
+// Trigger measurement round
+void DistanceControllerData::TriggerMeasurement( )
+{
+    digitalWrite( BOT_PIN_ULTRASONIC_TRIGGER, HIGH );
+    delayMicroseconds( 10 );
+    digitalWrite( BOT_PIN_ULTRASONIC_TRIGGER, LOW );
+}
+
+// Measure length of echo (microseconds) from time stamps of its rising and falling edges
+bool DistanceControllerData::MeasureByEvents( int eventsFd, uint32_t* echoLength )
+{
+    struct gpioevent_data event;
+    struct pollfd         pollFd     = { eventsFd, POLLIN, 0 };
+    uint64_t              echoStart  = 0;
+    bool                  gotStart   = false;
+    bool                  gotStop    = false;
+    int                   timeLeftMs = ( 2 * MEASUREMENT_TIMEOUT_US + 999 ) / 1000;
+
+    // drop edges left from a previous round, which timed out half way
+    while ( read( eventsFd, &event, sizeof( event ) ) == sizeof( event ) )
+    {
+    }
+
+    TriggerMeasurement( );
+
+    // sleep till edges arrive - the whole echo must fit into timeout for both of its edges
+    while ( ( !gotStop ) && ( timeLeftMs > 0 ) )
+    {
+        uint32_t waitStart = micros( );
+
+        if ( poll( &pollFd, 1, timeLeftMs ) <= 0 )
+        {
+            timeLeftMs = 0;
+        }
+        else
+        {
+            while ( ( !gotStop ) && ( read( eventsFd, &event, sizeof( event ) ) == sizeof( event ) ) )
             {
-                stop = micros( );
-                if ( stop - reftime > MEASUREMENT_TIMEOUT_US )
+                if ( event.id == GPIOEVENT_EVENT_RISING_EDGE )
                 {
-                    failed = true;
-                    break;
+                    echoStart = event.timestamp;
+                    gotStart  = true;
+                }
+                else if ( ( event.id == GPIOEVENT_EVENT_FALLING_EDGE ) && ( gotStart ) )
+                {
+                    *echoLength = static_cast<uint32_t>( ( event.timestamp - echoStart ) / 1000 );
+                    gotStop     = true;
                 }
             }
+
+            timeLeftMs -= static_cast<int>( ( micros( ) - waitStart ) / 1000 ) + 1;
         }
+    }
+
+    return ( ( gotStop ) && ( *echoLength <= MEASUREMENT_TIMEOUT_US ) );
+}
+
+// Measure length of echo (microseconds) by polling state of the echo pin
+bool DistanceControllerData::MeasureByPolling( uint32_t* echoLength )
+{
+    uint32_t reftime, start, stop = 0;
+    bool     failed = false;
+
+    TriggerMeasurement( );
+
+    reftime = micros( );
+    start   = reftime;
 
-        if ( !failed )
+    // wait for the echo wave start
+    while ( digitalRead( BOT_PIN_ULTRASONIC_ECHO ) == LOW )
+    {
+        start = micros( );
+        if ( start - reftime > MEASUREMENT_TIMEOUT_US )
         {
-            LastDistance = (float) ( stop - start ) / 58.2f;
+            failed = true;
+            break;
+        }
+    }
 
-            if ( MeasurementHistory.size( ) < MEASUREMENT_HISTOTY_LENGTH )
+    if ( !failed )
+    {
+        reftime = micros( );
+        stop    = reftime;
+
+        // wait for the echo wave stop
+        while ( digitalRead( BOT_PIN_ULTRASONIC_ECHO ) == HIGH )
+        {
+            stop = micros( );
+            if ( stop - reftime > MEASUREMENT_TIMEOUT_US )
             {
-                MeasurementHistory.push_back( LastDistance );
+                failed = true;
+                break;
             }
-            else
-            {
-                MeasurementHistory[NextHistoryIndex] = LastDistance;
+        }
+    }
 
-                NextHistoryIndex = ( NextHistoryIndex + 1 ) % MEASUREMENT_HISTOTY_LENGTH;
-            }
+    if ( !failed )
+    {
+        *echoLength = stop - start;
+    }
+
+    return !failed;
+}
+
+// Add new measurement to history and update median/smoothed distance
+void DistanceControllerData::AddMeasurement( float distance )
+{
+    bool outlier = ( ( OutlierThreshold > 0.0f ) && ( Median.IsFull( ) ) &&
+                     ( fabs( distance - Median.Median( ) ) > OutlierThreshold ) );
 
-            // sort the measurements history
-            vector<float> sortedHisotry = MeasurementHistory;
-            std::sort( sortedHisotry.begin(  ), sortedHisotry.end( ) );
+    LastDistance = distance;
 
-            MedianDistance = sortedHisotry[sortedHisotry.size( ) / 2 ];
+    if ( outlier )
+    {
+        // too many outliers in a row mean that something has really changed in front of the sensor,
+        // so the history is started again instead of ignoring all new measurements
+        if ( ++OutliersInRow > MedianWindow / 2 )
+        {
+            Median.Reset( MedianWindow );
+            outlier = false;
         }
     }
+
+    if ( !outlier )
+    {
+        float median;
+
+        OutliersInRow = 0;
+        Median.Add( distance );
+
+        median         = Median.Median( );
+        MedianDistance = median;
+
+        SmoothedDistance = ( Median.Size( ) == 1 ) ? median :
+                           SmoothedDistance + SmoothingFactor * ( median - SmoothedDistance );
+    }
 }
 
 // Measurements thread handler
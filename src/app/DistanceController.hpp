@@ -21,7 +21,9 @@
 #ifndef DISTANCE_CONTROLLER_HPP
 #define DISTANCE_CONTROLLER_HPP
 
+#include <functional>
 #include <IObjectInformation.hpp>
+#include <XPropertyTable.hpp>
 
 namespace Private
 {
@@ -31,10 +33,35 @@ namespace Private
 // Class to take distance measurement using ultrasonic sensor
 class DistanceController : public IObjectInformation
 {
+public:
+    // Maximum number of measurements to take median of
+    static const uint32_t MaxMedianWindow = 31;
+
 public:
     DistanceController( );
     ~DistanceController( );
 
+    // Settings of distance filtering below can be changed only while measurements are not running
+
+    // Get/Set number of the latest measurements to take median of, [1, MaxMedianWindow] (5 by default)
+    uint32_t MedianWindow( ) const;
+    void SetMedianWindow( uint32_t window );
+
+    // Get/Set weight of new median value in the exponential moving average of distance, (0, 1]
+    // (1 by default, i.e. no smoothing)
+    float SmoothingFactor( ) const;
+    void SetSmoothingFactor( float factor );
+
+    // Get/Set difference from median distance (cm), which makes a measurement an outlier to ignore
+    // (0 by default, i.e. outliers are not rejected). More than half window of outliers in a row
+    // restarts the history though, since it's more likely something changed in front of the sensor.
+    float OutlierThreshold( ) const;
+    void SetOutlierThreshold( float threshold );
+
+    // Set handler to call with median distance after every successful measurement. It is called on
+    // the measurements thread, so it must be quick not to delay next measurements.
+    void SetMeasurementHandler( const std::function<void( float )>& handler );
+
     // Start/stop measurements
     bool StartMeasurements( );
     void StopMeasurements( );
@@ -42,8 +69,10 @@ public:
 
     // Value of the last measurement (must be started)
     float Distance( );
-    // Median value of the distance (over last 5 measurements)
+    // Median value of the distance (over the last measurements, see MedianWindow)
     float MedianDistance( );
+    // Median distance smoothed by exponential moving average (see SmoothingFactor)
+    float SmoothedDistance( );
 
     // IObjectConfigurator implementation
     XError GetProperty( const std::string& propertyName, std::string& value ) const;
@@ -51,6 +80,8 @@ public:
 
 private:
     Private::DistanceControllerData* mData;
+
+    static const XPropertyTable<DistanceController> PropertyTable;
 };
 
 #endif // DISTANCE_CONTROLLER_HPP
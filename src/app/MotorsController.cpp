@@ -21,24 +21,59 @@
 #include "MotorsController.hpp"
 #include "BotConfig.h"
 
-#include <list>
+#include <stdlib.h>
 #include <wiringPi.h>
 
+#include "XTrace.hpp"
+
 #ifdef BOT_MOTORS_ENABLE_SOFT_PWM
     #include <softPwm.h>
 #endif
 
 using namespace std;
+using namespace std::chrono;
 
-const static string  PROP_LEFT_POWER  = "leftPower";
-const static string  PROP_RIGHT_POWER = "rightPower";
+// Motors' speed can be controlled with either software or hardware PWM
+#if defined( BOT_MOTORS_ENABLE_SOFT_PWM ) || defined( BOT_MOTORS_ENABLE_HARD_PWM )
+    #define MOTORS_SPEED_CONTROL
+#endif
 
-const static list<string> SupportedProperties = { PROP_LEFT_POWER, PROP_RIGHT_POWER };
+// Ramping power up is done only when speed can be controlled
+#if defined( MOTORS_SPEED_CONTROL ) && ( BOT_MOTORS_RAMP_STEP < 100 )
+    #define MOTORS_RAMP_ENABLED
+#endif
+
+// Properties of motors - power is set by clients, while its forward limit is controlled by the bot itself
+const XPropertyTable<MotorsController> MotorsController::PropertyTable =
+{
+    { { "leftPower", "Left Power", XPropertyType::Integer, -100, 100, 0, nullptr, 0 },
+      []( const MotorsController& motors ) -> double { return motors.leftMotorPower; },
+      []( MotorsController& motors, double value ) { motors.SetLeftPower( static_cast<int8_t>( value ) ); return XError( XError::Success ); } },
+    { { "rightPower", "Right Power", XPropertyType::Integer, -100, 100, 0, nullptr, 0 },
+      []( const MotorsController& motors ) -> double { return motors.rightMotorPower; },
+      []( MotorsController& motors, double value ) { motors.SetRightPower( static_cast<int8_t>( value ) ); return XError( XError::Success ); } },
+    { { "forwardLimit", "Forward Power Limit", XPropertyType::Integer, 0, 100, 100, nullptr, 0 },
+      []( const MotorsController& motors ) -> double { return motors.forwardPowerLimit; },
+      nullptr }
+};
 
 MotorsController::MotorsController( ) :
-    leftMotorPower( 0 ), rightMotorPower( 0 )
+    sync( ), leftMotorPower( 0 ), rightMotorPower( 0 ), appliedLeftPower( 0 ), appliedRightPower( 0 ),
+    forwardPowerLimit( 100 ), stateChangeHandler( ), notifiedLeftPower( 0 ), notifiedRightPower( 0 ), notifiedPowerLimit( 100 ),
+    commandTimeout( BOT_MOTORS_COMMAND_TIMEOUT ), commandDeadline( ),
+    controlThread( ), controlCondition( ), rampPending( false ), nextRampStepTime( ), needToStopControl( false )
 {
-#ifdef BOT_MOTORS_ENABLE_SOFT_PWM
+#if defined( BOT_MOTORS_ENABLE_HARD_PWM )
+    // mark-space mode with range of 100 lets power be written as it is; mode/range/clock are
+    // set after pin mode, which resets them
+    pinMode( BOT_PIN_MOTOR_LEFT_ENABLE, PWM_OUTPUT );
+    pinMode( BOT_PIN_MOTOR_RIGHT_ENABLE, PWM_OUTPUT );
+    pwmSetMode( PWM_MODE_MS );
+    pwmSetRange( 100 );
+    pwmSetClock( BOT_MOTORS_PWM_CLOCK_DIVISOR );
+    pwmWrite( BOT_PIN_MOTOR_LEFT_ENABLE, 0 );
+    pwmWrite( BOT_PIN_MOTOR_RIGHT_ENABLE, 0 );
+#elif defined( BOT_MOTORS_ENABLE_SOFT_PWM )
     softPwmCreate( BOT_PIN_MOTOR_LEFT_ENABLE, 0, 100 );
     softPwmCreate( BOT_PIN_MOTOR_RIGHT_ENABLE, 0, 100 );
 #else
@@ -51,24 +86,39 @@ MotorsController::MotorsController( ) :
  
     pinMode( BOT_PIN_MOTOR_RIGHT_INPUT1, OUTPUT );
     pinMode( BOT_PIN_MOTOR_RIGHT_INPUT2, OUTPUT );
+
+    controlThread = thread( ControlThreadHandler, this );
 }
 
 MotorsController::~MotorsController( )
 {
     Stop( );
+
+    {
+        lock_guard<recursive_mutex> lock( sync );
+        needToStopControl = true;
+    }
+    controlCondition.notify_all( );
+
+    controlThread.join( );
 }
 
 // Run motors at the specified speed [-100, 100]
 void MotorsController::Run( int8_t leftPower, int8_t rightPower )
 {
-    SetLeftPower( leftPower );
-    SetRightPower( rightPower );
+    lock_guard<recursive_mutex> lock( sync );
+
+    leftMotorPower  = ( leftPower  > 100 ) ? 100 : ( ( leftPower  < -100 ) ? -100 : leftPower );
+    rightMotorPower = ( rightPower > 100 ) ? 100 : ( ( rightPower < -100 ) ? -100 : rightPower );
+
+    RearmWatchdog( );
+    ApplyPower( );
 }
 
 // Helper function to set state/direction of motor controlled with L293D chip
 static void SetMotorPower( int8_t power, uint8_t enablePin, uint8_t inputPin1, uint8_t inputPin2 )
 {
-    #ifndef BOT_MOTORS_ENABLE_SOFT_PWM
+    #ifndef MOTORS_SPEED_CONTROL
         if ( power > 0 )
         {
             power = ( power > 50 ) ? 100 : 0;
@@ -81,7 +131,9 @@ static void SetMotorPower( int8_t power, uint8_t enablePin, uint8_t inputPin1, u
     
     if ( power == 0 )
     {
-        #ifdef BOT_MOTORS_ENABLE_SOFT_PWM
+        #if defined( BOT_MOTORS_ENABLE_HARD_PWM )
+            pwmWrite( enablePin, 0 );
+        #elif defined( BOT_MOTORS_ENABLE_SOFT_PWM )
             softPwmWrite( enablePin, 0 );
         #else
             digitalWrite( enablePin, LOW );
@@ -102,7 +154,9 @@ static void SetMotorPower( int8_t power, uint8_t enablePin, uint8_t inputPin1, u
             digitalWrite( inputPin2, HIGH );
         }
         
-        #ifdef BOT_MOTORS_ENABLE_SOFT_PWM
+        #if defined( BOT_MOTORS_ENABLE_HARD_PWM )
+            pwmWrite( enablePin, ( power > 0 ) ? power : -power );
+        #elif defined( BOT_MOTORS_ENABLE_SOFT_PWM )
             softPwmWrite( enablePin, ( power > 0 ) ? power : -power  );
         #else
             digitalWrite( enablePin, HIGH );
@@ -113,106 +167,260 @@ static void SetMotorPower( int8_t power, uint8_t enablePin, uint8_t inputPin1, u
 // Set power of the left motor
 void MotorsController::SetLeftPower( int8_t power )
 {
-    power = ( power > 100 ) ? 100 : ( ( power < -100 ) ? -100 : power );
-        
-    if ( leftMotorPower != power )
-    {
-        leftMotorPower = power;
-        SetMotorPower( power, BOT_PIN_MOTOR_LEFT_ENABLE, BOT_PIN_MOTOR_LEFT_INPUT1, BOT_PIN_MOTOR_LEFT_INPUT2 );
-    }
+    lock_guard<recursive_mutex> lock( sync );
+
+    leftMotorPower = ( power > 100 ) ? 100 : ( ( power < -100 ) ? -100 : power );
+
+    RearmWatchdog( );
+    ApplyPower( );
 }
 
 // Set power of the right motor
 void MotorsController::SetRightPower( int8_t power )
 {
-    power = ( power > 100 ) ? 100 : ( ( power < -100 ) ? -100 : power );
-    
-    if ( rightMotorPower != power )
-    {
-        rightMotorPower = power;
-        SetMotorPower( power, BOT_PIN_MOTOR_RIGHT_ENABLE, BOT_PIN_MOTOR_RIGHT_INPUT1, BOT_PIN_MOTOR_RIGHT_INPUT2 );
-    }    
+    lock_guard<recursive_mutex> lock( sync );
+
+    rightMotorPower = ( power > 100 ) ? 100 : ( ( power < -100 ) ? -100 : power );
+
+    RearmWatchdog( );
+    ApplyPower( );
 }
 
 // Stop both motors
 void MotorsController::MotorsController::Stop( )
 {
-    SetLeftPower( 0 );
-    SetRightPower( 0 );
+    lock_guard<recursive_mutex> lock( sync );
+
+    Run( 0, 0 );
 }
 
-// Set property of the object
-XError MotorsController::SetProperty( const string& propertyName, const string& value )
+// Get/Set limit of power for moving forward
+uint8_t MotorsController::ForwardPowerLimit( ) const
 {
-    XError ret = XError::Success;
-    int    numericValue;
+    lock_guard<recursive_mutex> lock( sync );
+    return forwardPowerLimit;
+}
+void MotorsController::SetForwardPowerLimit( uint8_t limit )
+{
+    lock_guard<recursive_mutex> lock( sync );
 
-    // motors configuration setting are all  numeric, so scan it
-    int scannedCount = sscanf( value.c_str( ), "%d", &numericValue );
-    
-    if ( scannedCount != 1 )
+    limit = ( limit > 100 ) ? 100 : limit;
+
+    if ( forwardPowerLimit != limit )
     {
-        ret = XError::InvalidPropertyValue;
+        forwardPowerLimit = limit;
+        ApplyPower( );
     }
-    else if ( propertyName == PROP_LEFT_POWER )
+}
+
+// Get/Set time (ms) motors keep running without receiving new commands
+uint32_t MotorsController::CommandTimeout( ) const
+{
+    lock_guard<recursive_mutex> lock( sync );
+    return commandTimeout;
+}
+void MotorsController::SetCommandTimeout( uint32_t msec )
+{
+    lock_guard<recursive_mutex> lock( sync );
+
+    commandTimeout = msec;
+    RearmWatchdog( );
+}
+
+// Set handler to call when motors' properties change
+void MotorsController::SetStateChangeHandler( const function<void( )>& handler )
+{
+    lock_guard<recursive_mutex> lock( sync );
+    stateChangeHandler = handler;
+}
+
+// Move deadline of stopping motors, since new command was received
+void MotorsController::RearmWatchdog( )
+{
+    commandDeadline = steady_clock::now( ) + milliseconds( commandTimeout );
+    controlCondition.notify_all( );
+}
+
+// Get next power value on the way from the current one to the target - power goes up by ramp step (if it
+// is time for the next step), while going down (or changing direction) is done at once, since only accelerating
+// causes current spikes. The stepped flag is set if power went up.
+static int RampPower( int current, int target, bool canStep, bool& stepped )
+{
+#ifdef MOTORS_RAMP_ENABLED
+    int step = ( canStep ) ? BOT_MOTORS_RAMP_STEP : 0;
+
+    if ( ( ( current > 0 ) && ( target <= 0 ) ) || ( ( current < 0 ) && ( target >= 0 ) ) )
     {
-        SetLeftPower( static_cast<int8_t>( numericValue ) );
+        current = 0;
     }
-    else if ( propertyName == PROP_RIGHT_POWER )
+
+    if ( ( target > 0 ) ? ( target > current + step ) : ( target < current - step ) )
     {
-        SetRightPower( static_cast<int8_t>( numericValue ) );
+        target = ( target > 0 ) ? current + step : current - step;
     }
-    else
+
+    if ( abs( target ) > abs( current ) )
     {
-        ret = XError::UnknownProperty;
+        stepped = true;
     }
-    
-    return ret;
+#else
+    (void) current;
+    (void) canStep;
+    (void) stepped;
+#endif
+
+    return target;
 }
 
-// Get property of the object
-XError MotorsController::GetProperty( const string& propertyName, string& value ) const
+// Run motors at the requested power, scaling it down if moving forward faster than allowed
+void MotorsController::ApplyPower( )
 {
-    XError ret = XError::Success;
-    int    numericValue;
+    int leftTarget  = leftMotorPower;
+    int rightTarget = rightMotorPower;
+    int maxPower    = ( leftTarget > rightTarget ) ? leftTarget : rightTarget;
+
+    // any motion with forward component is limited (arcs and pivots around one wheel as well), while
+    // turning on the spot and moving backward are not
+    if ( ( leftTarget + rightTarget > 0 ) && ( maxPower > forwardPowerLimit ) )
+    {
+        leftTarget  = leftTarget  * forwardPowerLimit / maxPower;
+        rightTarget = rightTarget * forwardPowerLimit / maxPower;
+    }
 
-    if ( propertyName == PROP_LEFT_POWER )
+    steady_clock::time_point now = steady_clock::now( );
+    bool canStep    = ( now >= nextRampStepTime );
+    bool stepped    = false;
+    int  leftPower  = RampPower( appliedLeftPower, leftTarget, canStep, stepped );
+    int  rightPower = RampPower( appliedRightPower, rightTarget, canStep, stepped );
+
+    if ( stepped )
     {
-        numericValue = leftMotorPower;
+        nextRampStepTime = now + milliseconds( BOT_MOTORS_RAMP_INTERVAL );
     }
-    else if ( propertyName == PROP_RIGHT_POWER )
+
+    // let control thread take next steps
+    rampPending = ( ( leftPower != leftTarget ) || ( rightPower != rightTarget ) );
+    if ( rampPending )
     {
-        numericValue = rightMotorPower;
+        controlCondition.notify_all( );
     }
-    else
+
+    if ( ( notifiedLeftPower != leftMotorPower ) || ( notifiedRightPower != rightMotorPower ) ||
+         ( notifiedPowerLimit != forwardPowerLimit ) )
     {
-        ret = XError::UnknownProperty;
+        notifiedLeftPower  = leftMotorPower;
+        notifiedRightPower = rightMotorPower;
+        notifiedPowerLimit = forwardPowerLimit;
+
+        if ( stateChangeHandler )
+        {
+            stateChangeHandler( );
+        }
     }
-    
-    if ( ret == XError::Success )
+
+    if ( appliedLeftPower != leftPower )
     {
-        char buffer[32];
+        appliedLeftPower = static_cast<int8_t>( leftPower );
+        SetMotorPower( appliedLeftPower, BOT_PIN_MOTOR_LEFT_ENABLE, BOT_PIN_MOTOR_LEFT_INPUT1, BOT_PIN_MOTOR_LEFT_INPUT2 );
+    }
 
-        sprintf( buffer, "%d", numericValue );
-        value = buffer;
+    if ( appliedRightPower != rightPower )
+    {
+        appliedRightPower = static_cast<int8_t>( rightPower );
+        SetMotorPower( appliedRightPower, BOT_PIN_MOTOR_RIGHT_ENABLE, BOT_PIN_MOTOR_RIGHT_INPUT1, BOT_PIN_MOTOR_RIGHT_INPUT2 );
     }
-    
-    return ret;
+}
+
+// Set property of the object
+XError MotorsController::SetProperty( const string& propertyName, const string& value )
+{
+    XTraceScope traceScope( "motors.set_property" );
+
+    return PropertyTable.SetProperty( *this, propertyName, value );
+}
+
+// Get property of the object
+XError MotorsController::GetProperty( const string& propertyName, string& value ) const
+{
+    lock_guard<recursive_mutex> lock( sync );
+
+    return PropertyTable.GetProperty( *this, propertyName, value );
 }
 
 // Get all supported properties of the object
 map<string, string> MotorsController::GetAllProperties( ) const
 {
-    map<string, string> properties;
-    string              value;
+    lock_guard<recursive_mutex> lock( sync );
+
+    return PropertyTable.GetAllProperties( *this );
+}
 
-    for ( auto property : SupportedProperties )
+// Control thread - stops motors if commands stop coming (lost connection with client) and
+// keeps ramping power at fixed rate while motors did not reach the requested one
+void MotorsController::ControlThreadHandler( MotorsController* me )
+{
+    unique_lock<recursive_mutex> lock( me->sync );
+
+    while ( !me->needToStopControl )
     {
-        if ( GetProperty( property, value ) )
+        steady_clock::time_point now = steady_clock::now( );
+        bool watchdogArmed = ( me->commandTimeout != 0 ) && ( ( me->leftMotorPower != 0 ) || ( me->rightMotorPower != 0 ) );
+
+        if ( ( watchdogArmed ) && ( now >= me->commandDeadline ) )
+        {
+            XTraceScope traceScope( "motors.watchdog_stop" );
+
+            me->leftMotorPower  = 0;
+            me->rightMotorPower = 0;
+            me->ApplyPower( );
+        }
+        else if ( ( me->rampPending ) && ( now >= me->nextRampStepTime ) )
+        {
+            me->ApplyPower( );
+        }
+        else if ( ( watchdogArmed ) || ( me->rampPending ) )
         {
-            properties.insert( pair<string, string>( property, value ) );
+            steady_clock::time_point wakeTime = ( watchdogArmed ) ? me->commandDeadline : me->nextRampStepTime;
+
+            if ( ( me->rampPending ) && ( me->nextRampStepTime < wakeTime ) )
+            {
+                wakeTime = me->nextRampStepTime;
+            }
+
+            // any notification makes it re-check the state, so new commands get taken into account
+            me->controlCondition.wait_until( lock, wakeTime );
+        }
+        else
+        {
+            me->controlCondition.wait( lock );
         }
     }
+}
 
-    return properties;
+MotorsWebSocketHandler::MotorsWebSocketHandler( const string& uri, const shared_ptr<MotorsController>& motorsController ) :
+    IWebRequestHandler( uri, false ), motorsController( motorsController )
+{
+}
+
+// Only WebSocket connections are accepted
+void MotorsWebSocketHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+{
+    response.SendError( 400, "WebSocket connection is expected" );
+}
+
+// Set motors' power from the received command
+void MotorsWebSocketHandler::HandleWebSocketMessage( const uint8_t* data, size_t length, bool binary, IWebResponse& /* response */ )
+{
+    XTraceScope traceScope( "motors.ws_message" );
+
+    if ( ( binary ) && ( length == 2 ) )
+    {
+        motorsController->Run( static_cast<int8_t>( data[0] ), static_cast<int8_t>( data[1] ) );
+    }
+}
+
+// Don't leave motors running when controlling client is gone
+void MotorsWebSocketHandler::HandleWebSocketClose( IWebResponse& /* response */ )
+{
+    motorsController->Stop( );
 }
@@ -22,7 +22,15 @@
 #define MOTORS_CONTROLLER_HPP
 
 #include <stdint.h>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
 #include <IObjectConfigurator.hpp>
+#include <XPropertyTable.hpp>
+#include <XWebServer.hpp>
 
 // Class to manage motors speed/direction
 class MotorsController : public IObjectConfigurator
@@ -38,14 +46,72 @@ public:
     // Stop both motors
     void Stop( );
 
+    // Get/Set limit of power [0, 100] for moving forward (sum of motors' power is positive, so
+    // arcs and pivots around one wheel count as well). Both motors are scaled down proportionally,
+    // so the bot keeps its direction, while turning on the spot and moving backward are not limited.
+    uint8_t ForwardPowerLimit( ) const;
+    void SetForwardPowerLimit( uint8_t limit );
+
+    // Get/Set time (ms) motors keep running after the last received command (0 - never stop).
+    // Any call to Run(), SetLeftPower() or SetRightPower() re-arms the timeout.
+    uint32_t CommandTimeout( ) const;
+    void SetCommandTimeout( uint32_t msec );
+
+    // Set handler to call when motors' properties change (called while motors are locked, so it must be quick)
+    void SetStateChangeHandler( const std::function<void( )>& handler );
+
     // IObjectConfigurator implementation
     XError SetProperty( const std::string& propertyName, const std::string& value );
     XError GetProperty( const std::string& propertyName, std::string& value ) const;
     std::map<std::string, std::string> GetAllProperties( ) const;
     
 private:
+    void ApplyPower( );
+    void RearmWatchdog( );
+    static void ControlThreadHandler( MotorsController* me );
+
+private:
+    mutable std::recursive_mutex sync;
+    // requested power of motors and the one they actually run at (after applying limit)
     int8_t leftMotorPower;
     int8_t rightMotorPower;
+    int8_t appliedLeftPower;
+    int8_t appliedRightPower;
+    uint8_t forwardPowerLimit;
+    // properties' values the state change handler was last called for
+    std::function<void( )> stateChangeHandler;
+    int8_t notifiedLeftPower;
+    int8_t notifiedRightPower;
+    uint8_t notifiedPowerLimit;
+    // motors get stopped if no commands come before the deadline
+    uint32_t commandTimeout;
+    std::chrono::steady_clock::time_point commandDeadline;
+    // thread running the watchdog and taking power step by step to the requested one
+    std::thread controlThread;
+    std::condition_variable_any controlCondition;
+    bool rampPending;
+    std::chrono::steady_clock::time_point nextRampStepTime;
+    bool needToStopControl;
+
+    static const XPropertyTable<MotorsController> PropertyTable;
+};
+
+// Web request handler accepting WebSocket connections to control motors. Every binary
+// message is made of 2 signed bytes - power of the left and right motors [-100, 100].
+class MotorsWebSocketHandler : public IWebRequestHandler
+{
+public:
+    MotorsWebSocketHandler( const std::string& uri, const std::shared_ptr<MotorsController>& motorsController );
+
+    // Plain HTTP requests are not supported
+    void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+
+    bool CanHandleWebSocket( ) const { return true; }
+    void HandleWebSocketMessage( const uint8_t* data, size_t length, bool binary, IWebResponse& response );
+    void HandleWebSocketClose( IWebResponse& response );
+
+private:
+    std::shared_ptr<MotorsController> motorsController;
 };
 
 #endif // MOTORS_CONTROLLER_HPP
@@ -24,23 +24,38 @@
 #include <signal.h>
 #include <pwd.h>
 #include <linux/limits.h>
+#include <algorithm>
 #include <map>
 #include <chrono>
+#include <thread>
+#include <atomic>
 #include <wiringPi.h>
 
 #include "XRaspiCamera.hpp"
 #include "XRaspiCameraConfig.hpp"
 #include "XWebServer.hpp"
 #include "XVideoSourceToWeb.hpp"
+#include "XH264StreamToWeb.hpp"
 #include "XObjectConfigurationSerializer.hpp"
+#include "XFrameRecorder.hpp"
+#include "XSharedFrameExporter.hpp"
+#include "XMotionDetector.hpp"
+#include "XAsyncVideoSourceListenerChain.hpp"
 #include "XObjectConfigurationRequestHandler.hpp"
 #include "XManualResetEvent.hpp"
+#include "XTrace.hpp"
+#include "XTraceRequestHandler.hpp"
 
 #include "BotConfig.h"
 #include "MotorsController.hpp"
+#include "BotMetrics.hpp"
+#include "BotStatus.hpp"
 
 #ifdef BOT_DISTANCE_ENABLE_MEASUREMENTS
     #include "DistanceController.hpp"
+    #ifdef BOT_COLLISION_AVOIDANCE_ENABLE
+        #include "CollisionGuard.hpp"
+    #endif
 #endif
 
 // Release build embeds web resources into executable
@@ -80,6 +95,18 @@ using namespace std::chrono;
 #define CAMERA_NAME             "RaspberryPi Camera"
 #define CAMERA_TITLE            "Front Camera"
 
+// Time (ms) without video clients, after which camera capture gets suspended
+#define CAMERA_IDLE_TIMEOUT     (5000)
+
+// Time (ms) camera settings must stay unchanged before they get saved
+#define CONFIG_SAVE_DELAY       (5000)
+
+// Highest supported frame rate of camera
+#define MAX_FRAME_RATE          (30)
+
+// Size of slots to publish raw frames in - fits the biggest YUV420 frame camera can be switched to at run time
+#define SHARED_FRAME_MAX_SIZE   ( 1920 * 1088 * 3 / 2 )
+
 XManualResetEvent ExitEvent;
 
 // Different application settings
@@ -89,10 +116,25 @@ struct
     uint32_t FrameHeight;
     uint32_t FrameRate;
     uint32_t JpegQuality;
+    uint32_t LowFrameWidth;
+    uint32_t LowFrameHeight;
+    uint32_t LowJpegQuality;
+    bool     H264Encoding;
+    uint32_t H264Bitrate;
+    bool     ZeroCopy;
+    uint32_t BuffersCount;
     uint32_t WebPort;
+    uint32_t WebThreads;
+    bool     Trace;
     string   HtRealm;
     string   HtDigestFileName;
     string   CameraConfigFileName;
+    uint32_t RecordingSize;
+    uint32_t RecordingFrameRate;
+    string   RecordingFileName;
+    bool     MotionDetection;
+    bool     RecordOnMotion;
+    string   SharedFrameName;
     string   CustomWebContent;
     string   BotTitle;
 
@@ -133,7 +175,19 @@ void SetDefaultSettings( )
     Settings.FrameHeight = 480;
     Settings.FrameRate   = 30;
     Settings.JpegQuality = 10;
+    Settings.ZeroCopy    = true;
+
+    Settings.BuffersCount = 0;
+
+    Settings.LowFrameWidth  = 0;
+    Settings.LowFrameHeight = 0;
+    Settings.LowJpegQuality = 10;
+
+    Settings.H264Encoding = false;
+    Settings.H264Bitrate  = 2000;
     Settings.WebPort     = 8000;
+    Settings.WebThreads  = 2;
+    Settings.Trace       = false;
 
     Settings.HtRealm = "pirexbot";
     Settings.HtDigestFileName.clear( );
@@ -146,8 +200,19 @@ void SetDefaultSettings( )
     {
         Settings.CameraConfigFileName  = pwd->pw_dir;
         Settings.CameraConfigFileName += "/.cam_config";
+
+        Settings.RecordingFileName  = pwd->pw_dir;
+        Settings.RecordingFileName += "/.pirexbot_recording";
     }
 
+    Settings.RecordingSize      = 0;
+    Settings.RecordingFrameRate = 10;
+
+    Settings.MotionDetection = false;
+    Settings.RecordOnMotion  = false;
+
+    Settings.SharedFrameName.clear( );
+
 #ifdef NDEBUG
     Settings.CustomWebContent.clear( );
 #else
@@ -211,8 +276,8 @@ bool ParseCommandLine( int argc, char* argv[] )
             if ( scanned != 1 )
                 break;
 
-            if ( ( Settings.FrameRate < 1 ) || ( Settings.FrameRate > 30 ) )
-                Settings.FrameRate = 30;
+            if ( ( Settings.FrameRate < 1 ) || ( Settings.FrameRate > MAX_FRAME_RATE ) )
+                Settings.FrameRate = MAX_FRAME_RATE;
         }
         else if ( key == "jpeg" )
         {
@@ -226,6 +291,64 @@ bool ParseCommandLine( int argc, char* argv[] )
             if ( Settings.JpegQuality > 100 )
                 Settings.JpegQuality = 100;
         }
+        else if ( key == "lowsize" )
+        {
+            int v = value[0] - '0';
+
+            if ( ( v < 0 ) || ( v > 4 ) )
+                break;
+
+            Settings.LowFrameWidth  = SupportedWidth[v];
+            Settings.LowFrameHeight = SupportedHeight[v];
+        }
+        else if ( key == "lowjpeg" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.LowJpegQuality) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.LowJpegQuality < 1 )
+                Settings.LowJpegQuality = 1;
+            if ( Settings.LowJpegQuality > 100 )
+                Settings.LowJpegQuality = 100;
+        }
+        else if ( key == "h264" )
+        {
+            if ( ( value != "0" ) && ( value != "1" ) )
+                break;
+
+            Settings.H264Encoding = ( value == "1" );
+        }
+        else if ( key == "h264rate" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.H264Bitrate) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.H264Bitrate < 100 )
+                Settings.H264Bitrate = 100;
+            if ( Settings.H264Bitrate > 25000 )
+                Settings.H264Bitrate = 25000;
+        }
+        else if ( key == "zerocopy" )
+        {
+            if ( ( value != "0" ) && ( value != "1" ) )
+                break;
+
+            Settings.ZeroCopy = ( value == "1" );
+        }
+        else if ( key == "buffers" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.BuffersCount) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.BuffersCount > 16 )
+                Settings.BuffersCount = 16;
+        }
         else if ( key == "port" )
         {
             int scanned = sscanf( value.c_str( ), "%u", &(Settings.WebPort) );
@@ -236,6 +359,23 @@ bool ParseCommandLine( int argc, char* argv[] )
             if ( Settings.WebPort > 65535 )
                 Settings.WebPort = 65535;
         }
+        else if ( key == "webthreads" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.WebThreads) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.WebThreads > 4 )
+                Settings.WebThreads = 4;
+        }
+        else if ( key == "trace" )
+        {
+            if ( ( value != "0" ) && ( value != "1" ) )
+                break;
+
+            Settings.Trace = ( value == "1" );
+        }
         else if ( key == "realm" )
         {
             Settings.HtRealm = value;
@@ -280,6 +420,52 @@ bool ParseCommandLine( int argc, char* argv[] )
         {
             Settings.CameraConfigFileName = value;
         }
+        else if ( key == "rec" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.RecordingSize) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( ( Settings.RecordingSize != 0 ) && ( Settings.RecordingSize < 16 ) )
+                Settings.RecordingSize = 16;
+            if ( Settings.RecordingSize > 16384 )
+                Settings.RecordingSize = 16384;
+        }
+        else if ( key == "recfps" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.RecordingFrameRate) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( ( Settings.RecordingFrameRate < 1 ) || ( Settings.RecordingFrameRate > 30 ) )
+                Settings.RecordingFrameRate = 30;
+        }
+        else if ( key == "recfile" )
+        {
+            Settings.RecordingFileName = value;
+        }
+        else if ( key == "motion" )
+        {
+            if ( ( value != "0" ) && ( value != "1" ) )
+                break;
+
+            Settings.MotionDetection = ( value == "1" );
+        }
+        else if ( key == "recmotion" )
+        {
+            if ( ( value != "0" ) && ( value != "1" ) )
+                break;
+
+            Settings.RecordOnMotion = ( value == "1" );
+            if ( Settings.RecordOnMotion )
+                Settings.MotionDetection = true;
+        }
+        else if ( key == "shm" )
+        {
+            Settings.SharedFrameName = value;
+        }
         else if ( key == "web" )
         {
             Settings.CustomWebContent = value;
@@ -323,12 +509,32 @@ bool ParseCommandLine( int argc, char* argv[] )
         printf( "              2: 640x480 (default) \n" );
         printf( "              3: 800x600 \n" );
         printf( "              4: 1120x840 \n" );
-        printf( "  -fps:<1-30> Sets camera frame rate. Same is used for MJPEG stream. \n" );
+        printf( "  -fps:<1-30> Sets camera frame rate. MJPEG stream follows it. \n" );
         printf( "              Default is 30. \n" );
         printf( "  -jpeg:<num> JPEG quantization factor (quality). \n" );
         printf( "              Default is 10. \n" );
+        printf( "  -lowsize:<0-4> Enables low resolution stream of the specified size (see -size), \n" );
+        printf( "              which is available as ?profile=low of /camera/jpeg and /camera/mjpeg. \n" );
+        printf( "              Default is disabled. \n" );
+        printf( "  -lowjpeg:<num> JPEG quantization factor (quality) of the low resolution stream. \n" );
+        printf( "              Default is 10. \n" );
+        printf( "  -h264:<0|1> Enables H.264 stream available as /camera/h264. \n" );
+        printf( "              Default is 0. \n" );
+        printf( "  -h264rate:<num> Bitrate of H.264 stream, kbit/s. \n" );
+        printf( "              Default is 2000. \n" );
+        printf( "  -zerocopy:<0|1> Provide camera buffers to web streaming without copying. \n" );
+        printf( "              Default is 1. \n" );
+        printf( "  -buffers:<0-16> Number of camera buffers for every video stream. More buffers \n" );
+        printf( "              help slow listeners, fewer save GPU memory (0 - camera's default). \n" );
+        printf( "              Default is 0. \n" );
         printf( "  -port:<num> Port number for web server to listen on. \n" );
         printf( "              Default is 8000. \n" );
+        printf( "  -webthreads:<0-4> Number of web server's threads to handle configuration \n" );
+        printf( "              requests, so those don't delay video streaming (0 - disabled). \n" );
+        printf( "              Default is 2. \n" );
+        printf( "  -trace:<0|1> Record timeline of video frames and motor commands available \n" );
+        printf( "              as /trace (Chrome trace format). \n" );
+        printf( "              Default is 0. \n" );
         printf( "  -realm:<?>  HTTP digest authentication domain. \n" );
         printf( "              Default is 'pirexbot'. \n" );
         printf( "  -htpass:<?> htdigest file containing list of users to access the camera. \n" );
@@ -344,6 +550,23 @@ bool ParseCommandLine( int argc, char* argv[] )
         printf( "              or 'admin' otherwise. \n" );
         printf( "  -fcfg:<?>   Name of the file to store camera settings in. \n" );
         printf( "              Default is '~/.cam_config'. \n" );
+        printf( "  -rec:<num>  Size (MB) of the file to keep recording the latest video in, so it \n" );
+        printf( "              is available as /recording/mjpeg and /recording/jpeg (0 - disabled). \n" );
+        printf( "              Camera keeps running then even if nobody watches it. \n" );
+        printf( "              Default is 0. \n" );
+        printf( "  -recfps:<1-30> Frame rate to record video at. \n" );
+        printf( "              Default is 10. \n" );
+        printf( "  -recfile:<?> Name of the file to record video in. \n" );
+        printf( "              Default is '~/.pirexbot_recording'. \n" );
+        printf( "  -motion:<0|1> Detect motion in front of the bot and report it as /motion \n" );
+        printf( "              and to telemetry clients. Camera keeps running then. \n" );
+        printf( "              Default is 0. \n" );
+        printf( "  -recmotion:<0|1> Record video only when motion is detected (enables \n" );
+        printf( "              motion detection). \n" );
+        printf( "              Default is 0. \n" );
+        printf( "  -shm:<?>    Name of shared memory object to publish raw YUV420 frames in for \n" );
+        printf( "              local processes (see /dev/shm). Camera keeps running then. \n" );
+        printf( "              By default raw frames are not published. \n" );
         printf( "  -web:<?>    Name of the folder to serve custom web content. \n" );
         printf( "              By default embedded web files are used. \n" );
         printf( "  -title:<?>  Name of the bot to be shown in WebUI. \n" );
@@ -445,17 +668,23 @@ int main( int argc, char* argv[] )
     botInfo.insert( PropertyMap::value_type( "providesDistance",  "false" ) );
 #endif
 
-#ifdef BOT_MOTORS_ENABLE_SOFT_PWM
+#if defined( BOT_MOTORS_ENABLE_SOFT_PWM ) || defined( BOT_MOTORS_ENABLE_HARD_PWM )
     botInfo.insert( PropertyMap::value_type( "providesSpeedControl",  "true" ) );
 #else
     botInfo.insert( PropertyMap::value_type( "providesSpeedControl",  "false" ) );
 #endif
 
     // create and configure web server
-    XWebServer          server( "", Settings.WebPort );
-    XVideoSourceToWeb   video2web;
-    UserGroup           viewersGroup = Settings.ViewersGroup;
-    UserGroup           configGroup  = Settings.ConfigGroup;
+    XWebServer           server( "", Settings.WebPort );
+    XVideoSourceToWeb    video2web;
+    XVideoSourceToWeb    video2webLow;
+    XH264StreamToWeb     h264ToWeb;
+    XFrameRecorder       recorder;
+    XSharedFrameExporter frameExporter;
+    UserGroup            viewersGroup = Settings.ViewersGroup;
+    UserGroup            configGroup  = Settings.ConfigGroup;
+
+    server.SetWorkerThreadsCount( Settings.WebThreads );
 
     if ( !Settings.HtRealm.empty( ) )
     {
@@ -466,34 +695,226 @@ int main( int argc, char* argv[] )
         server.LoadUsersFromFile( Settings.HtDigestFileName );
     }
 
+    // restore camera settings - video format given by command line still applies on every start,
+    // while changes of it done at run time are kept till restart
+    serializer.LoadConfiguration( );
+
     // set camera configuration
     xcamera->SetVideoSize( Settings.FrameWidth, Settings.FrameHeight );
     xcamera->SetFrameRate( Settings.FrameRate );
     xcamera->SetJpegQuality( Settings.JpegQuality );
-
-    // restore camera settings
-    serializer.LoadConfiguration( );
+    xcamera->EnableZeroCopy( Settings.ZeroCopy );
+    xcamera->SetBuffersCount( Settings.BuffersCount );
+    xcamera->SetSecondaryVideoSize( Settings.LowFrameWidth, Settings.LowFrameHeight );
+    xcamera->SetSecondaryJpegQuality( Settings.LowJpegQuality );
+    xcamera->EnableH264Encoding( Settings.H264Encoding );
+    xcamera->SetH264Bitrate( Settings.H264Bitrate * 1000 );
+    xcamera->EnableRawStream( !Settings.SharedFrameName.empty( ) );
+
+    if ( Settings.LowFrameWidth != 0 )
+    {
+        // clients may choose low resolution stream
+        video2web.AddProfile( "low", video2webLow );
+    }
 
     // create motors' controller
     shared_ptr<MotorsController> motorsController = make_shared<MotorsController>( );
 
+    shared_ptr<XObjectInformationMap> versionInfoObject = make_shared<XObjectInformationMap>( versionInfo );
+    shared_ptr<XObjectInformationMap> cameraInfoObject  = make_shared<XObjectInformationMap>( cameraInfo );
+    shared_ptr<BotStatus>             botInfoObject     = make_shared<BotStatus>( botInfo );
+
+    // camera initializes on its own thread once started
+    botInfoObject->AddSubsystem( "camera", [xcamera]( )
+    {
+        return ( xcamera->IsInitialized( ) ) ? SubsystemState::Ready :
+               ( xcamera->IsRunning( ) ) ? SubsystemState::Starting : SubsystemState::Failed;
+    } );
+
+    // batches of objects' information to get in one request - configuration is only for those having access to it
+    shared_ptr<XBatchInformationRequestHandler> viewersBatch = make_shared<XBatchInformationRequestHandler>( "/batch" );
+    shared_ptr<XBatchInformationRequestHandler> configBatch  = make_shared<XBatchInformationRequestHandler>( "/config/batch" );
+
+    viewersBatch->AddObject( "version", versionInfoObject ).
+                  AddObject( "info", botInfoObject ).
+                  AddObject( "cameraInfo", cameraInfoObject );
+    configBatch->AddObject( "version", versionInfoObject ).
+                 AddObject( "info", botInfoObject ).
+                 AddObject( "cameraInfo", cameraInfoObject ).
+                 AddObject( "cameraConfig", xcameraConfig ).
+                 AddObject( "motors", motorsController );
+
+    // stream of motors' and distance changes for those having configuration access
+    shared_ptr<XObjectsStreamRequestHandler> telemetryStream = make_shared<XObjectsStreamRequestHandler>( "/telemetry" );
+    // the stream refers to the objects, so they refer back to it weakly
+    weak_ptr<XObjectsStreamRequestHandler>   telemetryStreamWeak = telemetryStream;
+    auto notifyTelemetry = [telemetryStreamWeak]( )
+    {
+        shared_ptr<XObjectsStreamRequestHandler> stream = telemetryStreamWeak.lock( );
+
+        if ( stream )
+        {
+            stream->NotifyChanges( );
+        }
+    };
+
+    telemetryStream->AddObject( "motors", motorsController );
+    motorsController->SetStateChangeHandler( notifyTelemetry );
+
     // add web handlers
-    server.AddHandler( make_shared<XObjectInformationRequestHandler>( "/version", make_shared<XObjectInformationMap>( versionInfo ) ) ).
+    server.AddHandler( make_shared<XObjectInformationRequestHandler>( "/version", versionInfoObject ) ).
            AddHandler( make_shared<XObjectConfigurationRequestHandler>( "/camera/config", xcameraConfig ), configGroup ).
            AddHandler( make_shared<XObjectConfigurationRequestHandler>( "/motors/config", motorsController ), configGroup ).
+           AddHandler( make_shared<MotorsWebSocketHandler>( "/motors/ws", motorsController ), configGroup ).
            AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/properties", make_shared<XRaspiCameraPropsInfo>( ) ), configGroup ).
-           AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/info", make_shared<XObjectInformationMap>( cameraInfo ) ), viewersGroup ).
-           AddHandler( make_shared<XObjectInformationRequestHandler>( "/info", make_shared<XObjectInformationMap>( botInfo ) ), viewersGroup ).
+           AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/info", cameraInfoObject ), viewersGroup ).
+           AddHandler( make_shared<XObjectInformationRequestHandler>( "/info", botInfoObject ), viewersGroup ).
            AddHandler( video2web.CreateJpegHandler( "/camera/jpeg" ), viewersGroup ).
-           AddHandler( video2web.CreateMjpegHandler( "/camera/mjpeg", Settings.FrameRate ), viewersGroup );
+           // camera's frame rate may change at run time, so let MJPEG clients get every new frame
+           AddHandler( video2web.CreateMjpegHandler( "/camera/mjpeg", MAX_FRAME_RATE ), viewersGroup );
+
+    if ( Settings.H264Encoding )
+    {
+        server.AddHandler( h264ToWeb.CreateH264Handler( "/camera/h264" ), viewersGroup );
+
+        // H.264 clients keep camera running and get key frame as soon as possible when joining the stream
+        h264ToWeb.SetStreamRequestHandler( [&video2web, xcamera]( bool needKeyFrame )
+        {
+            video2web.NotifyActivity( );
+
+            if ( needKeyFrame )
+            {
+                xcamera->RequestH264KeyFrame( );
+            }
+        } );
+    }
 
 #ifdef BOT_DISTANCE_ENABLE_MEASUREMENTS
     // create distance controller
     shared_ptr<DistanceController> distanceController = make_shared<DistanceController>( );
 
+    distanceController->SetMedianWindow( BOT_DISTANCE_MEDIAN_WINDOW );
+    distanceController->SetSmoothingFactor( BOT_DISTANCE_SMOOTHING_FACTOR );
+    distanceController->SetOutlierThreshold( BOT_DISTANCE_OUTLIER_THRESHOLD );
+
+    #ifdef BOT_COLLISION_AVOIDANCE_ENABLE
+        // limit forward speed right after every measurement, without waiting for clients to react
+        shared_ptr<CollisionGuard> collisionGuard = make_shared<CollisionGuard>( motorsController,
+            BOT_COLLISION_STOP_DISTANCE, BOT_COLLISION_SLOW_DISTANCE );
+
+        distanceController->SetMeasurementHandler( [collisionGuard, notifyTelemetry]( float distance )
+        {
+            collisionGuard->OnDistanceMeasured( distance );
+            notifyTelemetry( );
+        } );
+    #else
+        distanceController->SetMeasurementHandler( [notifyTelemetry]( float )
+        {
+            notifyTelemetry( );
+        } );
+    #endif
+
+    telemetryStream->AddObject( "distance", distanceController );
+
+    botInfoObject->AddSubsystem( "distance", [distanceController]( )
+    {
+        return ( distanceController->IsRunning( ) ) ? SubsystemState::Ready : SubsystemState::Failed;
+    } );
+
     server.AddHandler( make_shared<XObjectInformationRequestHandler>( "/distance", distanceController ), viewersGroup );
+
+    viewersBatch->AddObject( "distance", distanceController );
+    configBatch->AddObject( "distance", distanceController );
 #endif
 
+    // detection of motion in front of the bot, which is reported to telemetry clients and may trigger recording
+    shared_ptr<XMotionDetector> motionDetector;
+
+    if ( Settings.MotionDetection )
+    {
+        bool recordOnMotion = Settings.RecordOnMotion;
+
+        motionDetector = make_shared<XMotionDetector>( );
+
+        if ( recordOnMotion )
+        {
+            // frames preceding the motion are still kept while paused
+            recorder.Pause( );
+        }
+
+        motionDetector->SetMotionHandler( [&recorder, recordOnMotion, notifyTelemetry]( bool motionDetected )
+        {
+            if ( recordOnMotion )
+            {
+                if ( motionDetected )
+                {
+                    recorder.Resume( );
+                }
+                else
+                {
+                    recorder.Pause( );
+                }
+            }
+            notifyTelemetry( );
+        } );
+
+        telemetryStream->AddObject( "motion", motionDetector );
+
+        server.AddHandler( make_shared<XObjectInformationRequestHandler>( "/motion", motionDetector ), viewersGroup );
+
+        viewersBatch->AddObject( "motion", motionDetector );
+        configBatch->AddObject( "motion", motionDetector );
+    }
+
+    server.AddHandler( viewersBatch, viewersGroup ).
+           AddHandler( configBatch, configGroup ).
+           AddHandler( telemetryStream, configGroup );
+
+    // recording of the latest video for reviewing what has happened around the bot - its file is opened
+    // in background, since preallocating it may take a while
+    atomic<SubsystemState> recorderState( SubsystemState::Starting );
+
+    if ( Settings.RecordingSize != 0 )
+    {
+        recorder.SetMaxFrameRate( Settings.RecordingFrameRate );
+
+        server.AddHandler( recorder.CreateIndexHandler( "/recording/index" ), configGroup ).
+               AddHandler( recorder.CreateJpegHandler( "/recording/jpeg" ), configGroup ).
+               AddHandler( recorder.CreateMjpegHandler( "/recording/mjpeg" ), configGroup );
+
+        botInfoObject->AddSubsystem( "recorder", [&recorderState]( )
+        {
+            return recorderState.load( );
+        } );
+    }
+
+    // performance metrics of camera, encoding and web server
+    shared_ptr<BotMetrics> botMetrics = make_shared<BotMetrics>( xcamera, server );
+
+    botMetrics->AddVideoProfile( "high", video2web );
+    if ( Settings.LowFrameWidth != 0 )
+    {
+        botMetrics->AddVideoProfile( "low", video2webLow );
+    }
+    if ( motionDetector )
+    {
+        botMetrics->SetMotionDetector( *motionDetector );
+    }
+    if ( !Settings.SharedFrameName.empty( ) )
+    {
+        botMetrics->SetSharedFrameExporter( frameExporter );
+    }
+
+    server.AddHandler( make_shared<XMetricsRequestHandler>( "/metrics", botMetrics ), viewersGroup );
+
+    // timeline of frames and motor commands
+    XTrace::Enable( Settings.Trace );
+
+    if ( Settings.Trace )
+    {
+        server.AddHandler( make_shared<XTraceRequestHandler>( "/trace" ), configGroup );
+    }
+
     // use custom or embedded web content
     if ( !Settings.CustomWebContent.empty( ) )
     {
@@ -526,44 +947,89 @@ int main( int argc, char* argv[] )
     #endif
     }
 
-    // set camera listeners
-    XVideoSourceListenerChain   listenerChain;
-    CameraErrorListener         cameraErrorListener;
+    // set camera listeners - streaming only takes reference to the latest frame, while listeners doing
+    // more work with frames get them on their own threads, so camera is not delayed by them
+    XVideoSourceListenerChain       listenerChain;
+    XAsyncVideoSourceListenerChain  asyncListenerChain;
+    CameraErrorListener             cameraErrorListener;
 
     listenerChain.Add( video2web.VideoSourceListener( ) );
     listenerChain.Add( &cameraErrorListener );
+    if ( motionDetector )
+    {
+        asyncListenerChain.Add( motionDetector->VideoSourceListener( ), "motion" );
+    }
+    if ( Settings.RecordingSize != 0 )
+    {
+        // the recorder queues frames itself, but a bigger mailbox still helps when disk is slow
+        asyncListenerChain.Add( recorder.VideoSourceListener( ), "recorder", 4 );
+    }
+    if ( asyncListenerChain.ListenersCount( ) != 0 )
+    {
+        listenerChain.Add( &asyncListenerChain );
+    }
+    botMetrics->SetAsyncListeners( asyncListenerChain );
     xcamera->SetListener( &listenerChain );
+    xcamera->SetSecondaryListener( video2webLow.VideoSourceListener( ) );
+    xcamera->SetH264Listener( h264ToWeb.VideoSourceListener( ) );
 
-    if ( server.Start( ) )
+    // raw frames are copied into shared memory right on camera's thread, which is cheap compared to encoding
+    if ( !Settings.SharedFrameName.empty( ) )
     {
-        int saveCounter = 0;
+        XError error = frameExporter.Open( Settings.SharedFrameName, SHARED_FRAME_MAX_SIZE );
 
-        printf( "Web server started on port %d ...\n", server.Port( ) );
-        printf( "Ctrl+C to stop.\n" );
+        if ( !error )
+        {
+            printf( "Warning: failed opening shared memory '%s' : %s \n\n", Settings.SharedFrameName.c_str( ), error.ToString( ).c_str( ) );
+        }
+        else
+        {
+            xcamera->SetRawListener( frameExporter.VideoSourceListener( ) );
+        }
+    }
 
-        xcamera->Start( );
+    // don't keep capturing video while nobody is watching (unless it is recorded, watched for motion or exported)
+    if ( ( Settings.RecordingSize == 0 ) && ( !motionDetector ) && ( Settings.SharedFrameName.empty( ) ) )
+    {
+        video2web.EnableIdleSuspend( xcamera, CAMERA_IDLE_TIMEOUT );
+    }
 
-        #ifdef BOT_DISTANCE_ENABLE_MEASUREMENTS
-            distanceController->StartMeasurements( );
-        #endif
+    // bring up camera, recorder and sensors in background, so web server and motors don't wait for
+    // them - clients get their state from /info
+    thread recorderOpenThread;
 
-        while ( !ExitEvent.Wait( 1000 ) )
+    xcamera->Start( );
+
+    if ( Settings.RecordingSize != 0 )
+    {
+        recorderOpenThread = thread( [&recorder, &recorderState]( )
         {
-            if ( ++saveCounter == 60 )
+            if ( !recorder.Open( Settings.RecordingFileName, static_cast<uint64_t>( Settings.RecordingSize ) * 1024 * 1024 ) )
             {
-                // save camera settings from time to time
-                serializer.SaveConfiguration( );
-                saveCounter = 0;
+                printf( "Warning: failed opening recording file: %s \n\n", Settings.RecordingFileName.c_str( ) );
+                recorderState = SubsystemState::Failed;
             }
-
-            // stop motors if there was no related activity
-            auto timeSinceMotorAccess = duration_cast<milliseconds>( steady_clock::now( ) - server.LastAccessTime( "/motors/config" ) ).count( );
-
-            if ( timeSinceMotorAccess >= 1000 )
+            else
             {
-                motorsController->Stop( );
+                recorderState = SubsystemState::Ready;
             }
+        } );
+    }
+
+    #ifdef BOT_DISTANCE_ENABLE_MEASUREMENTS
+        distanceController->StartMeasurements( );
+    #endif
+
+    if ( server.Start( ) )
+    {
+        printf( "Web server started on port %d ...\n", server.Port( ) );
+        printf( "Ctrl+C to stop.\n" );
+
+        // save camera settings once they change (on a background thread)
+        serializer.StartAutoSave( CONFIG_SAVE_DELAY );
 
+        while ( !ExitEvent.Wait( 1000 ) )
+        {
         #ifdef BOT_PIN_CONNECTION_ACTIVE_LED
             // update activity LED
             auto timeSinceLastAccess = duration_cast<milliseconds>( steady_clock::now( ) - server.LastAccessTime( ) ).count( );
@@ -572,22 +1038,33 @@ int main( int argc, char* argv[] )
         #endif
         }
 
-        #ifdef BOT_DISTANCE_ENABLE_MEASUREMENTS
-            distanceController->StopMeasurements( );
-        #endif
-
+        // save whatever changed since the last automatic save
+        serializer.StopAutoSave( );
         serializer.SaveConfiguration( );
-        xcamera->SignalToStop( );
-        xcamera->WaitForStop( );
-        server.Stop( );
-
-        printf( "Done \n" );
     }
     else
     {
         printf( "Failed starting web server on port %d\n", server.Port( ) );
     }
 
+    #ifdef BOT_DISTANCE_ENABLE_MEASUREMENTS
+        distanceController->StopMeasurements( );
+    #endif
+
+    if ( recorderOpenThread.joinable( ) )
+    {
+        recorderOpenThread.join( );
+    }
+
+    xcamera->SignalToStop( );
+    xcamera->WaitForStop( );
+    asyncListenerChain.Clear( );
+    recorder.Close( );
+    frameExporter.Close( );
+    server.Stop( );
+
+    printf( "Done \n" );
+
     // do whatever to nicely clean-up the bot
     BotShutDown( );
 
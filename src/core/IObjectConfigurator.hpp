@@ -21,6 +21,7 @@
 #ifndef IOBJECT_CONFIGURATOR_HPP
 #define IOBJECT_CONFIGURATOR_HPP
 
+#include <stdint.h>
 #include <string>
 #include <map>
 
@@ -30,6 +31,10 @@ class IObjectConfigurator : public IObjectInformation
 {
 public:
     virtual XError SetProperty( const std::string& propertyName, const std::string& value ) = 0;
+
+    // Get version of the object's configuration, which changes every time any property is set.
+    // Objects, which don't track their changes, report 0.
+    virtual uint64_t ChangeVersion( ) const { return 0; }
 };
 
 #endif // IOBJECT_CONFIGURATOR_HPP
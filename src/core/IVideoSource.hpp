@@ -42,6 +42,11 @@ public:
     // Get number of frames received since the start of the video source
     virtual uint32_t FramesReceived( ) = 0;
 
+    // Suspend/Resume capture of video frames while video source keeps running (to save power)
+    virtual void SuspendCapture( bool suspend ) = 0;
+    // Check if capture of video frames is suspended
+    virtual bool IsCaptureSuspended( ) = 0;
+
     // Set video source listener returning the old one
     virtual IVideoSourceListener* SetListener( IVideoSourceListener* listener ) = 0;
 };
@@ -0,0 +1,272 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+#include "XAsyncVideoSourceListenerChain.hpp"
+#include "XImagePool.hpp"
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+using namespace std;
+
+namespace Private
+{
+    // Mailbox of a listener and the thread delivering its content
+    class ListenerMailbox : private Uncopyable
+    {
+    public:
+        IVideoSourceListener*            Listener;
+        string                           Name;
+        uint32_t                         Size;
+
+        mutex                            Sync;
+        condition_variable               NewMail;
+        deque<shared_ptr<const XImage>>  Frames;
+        deque<pair<string, bool>>        Errors;
+        bool                             NeedToStop;
+
+        atomic<uint64_t>                 FramesDelivered;
+        atomic<uint64_t>                 FramesDropped;
+
+        thread                           Worker;
+
+    public:
+        ListenerMailbox( IVideoSourceListener* listener, const string& name, uint32_t size ) :
+            Listener( listener ), Name( name ), Size( ( size == 0 ) ? 1 : size ),
+            Sync( ), NewMail( ), Frames( ), Errors( ), NeedToStop( false ),
+            FramesDelivered( 0 ), FramesDropped( 0 ), Worker( )
+        {
+            Worker = thread( WorkerThreadHandler, this );
+        }
+
+        ~ListenerMailbox( )
+        {
+            {
+                lock_guard<mutex> lock( Sync );
+                NeedToStop = true;
+            }
+            NewMail.notify_one( );
+
+            if ( Worker.joinable( ) )
+            {
+                Worker.join( );
+            }
+        }
+
+        void PostFrame( const shared_ptr<const XImage>& image );
+        void PostError( const string& errorMessage, bool fatal );
+
+    private:
+        static void WorkerThreadHandler( ListenerMailbox* me );
+    };
+
+    class XAsyncVideoSourceListenerChainData
+    {
+    public:
+        mutable mutex                       Sync;
+        vector<unique_ptr<ListenerMailbox>> Mailboxes;
+        XImagePool                          CopiedImages;
+
+    public:
+        XAsyncVideoSourceListenerChainData( ) :
+            Sync( ), Mailboxes( ), CopiedImages( )
+        {
+        }
+    };
+}
+
+XAsyncVideoSourceListenerChain::XAsyncVideoSourceListenerChain( ) :
+    mData( new Private::XAsyncVideoSourceListenerChainData( ) )
+{
+}
+
+XAsyncVideoSourceListenerChain::~XAsyncVideoSourceListenerChain( )
+{
+    Clear( );
+    delete mData;
+}
+
+// New video frame notification - post it to all mailboxes
+void XAsyncVideoSourceListenerChain::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    shared_ptr<const XImage> frame = image;
+
+    if ( ( !image->OwnsData( ) ) || ( image->HoldsExternalBuffer( ) ) )
+    {
+        shared_ptr<XImage> copy = mData->CopiedImages.Acquire( image->Width( ), image->Height( ), image->Format( ) );
+
+        if ( ( !copy ) || ( image->CopyData( copy ) != XError::Success ) )
+        {
+            OnError( "Failed copying video frame for listeners", false );
+            return;
+        }
+
+        frame = copy;
+    }
+
+    lock_guard<mutex> lock( mData->Sync );
+
+    for ( auto& mailbox : mData->Mailboxes )
+    {
+        mailbox->PostFrame( frame );
+    }
+}
+
+// Video source error notification - post it to all mailboxes
+void XAsyncVideoSourceListenerChain::OnError( const string& errorMessage, bool fatal )
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    for ( auto& mailbox : mData->Mailboxes )
+    {
+        mailbox->PostError( errorMessage, fatal );
+    }
+}
+
+// Add new listener into the chain
+void XAsyncVideoSourceListenerChain::Add( IVideoSourceListener* listener, const string& name, uint32_t mailboxSize )
+{
+    if ( listener != nullptr )
+    {
+        lock_guard<mutex> lock( mData->Sync );
+
+        mData->Mailboxes.push_back( unique_ptr<Private::ListenerMailbox>( new Private::ListenerMailbox( listener, name, mailboxSize ) ) );
+    }
+}
+
+// Stop all listeners' threads and remove them from the chain
+void XAsyncVideoSourceListenerChain::Clear( )
+{
+    vector<unique_ptr<Private::ListenerMailbox>> mailboxes;
+
+    {
+        lock_guard<mutex> lock( mData->Sync );
+        mailboxes.swap( mData->Mailboxes );
+    }
+
+    // threads are stopped without holding the lock, so new frames are not delayed meanwhile
+    mailboxes.clear( );
+}
+
+// Number of listeners in the chain
+size_t XAsyncVideoSourceListenerChain::ListenersCount( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return mData->Mailboxes.size( );
+}
+
+// Name of the specified listener
+string XAsyncVideoSourceListenerChain::ListenerName( size_t index ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return ( index < mData->Mailboxes.size( ) ) ? mData->Mailboxes[index]->Name : string( );
+}
+
+// Number of frames given to the specified listener
+uint64_t XAsyncVideoSourceListenerChain::FramesDelivered( size_t index ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return ( index < mData->Mailboxes.size( ) ) ? mData->Mailboxes[index]->FramesDelivered.load( ) : 0;
+}
+
+// Number of frames dropped from mailbox of the specified listener
+uint64_t XAsyncVideoSourceListenerChain::FramesDropped( size_t index ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return ( index < mData->Mailboxes.size( ) ) ? mData->Mailboxes[index]->FramesDropped.load( ) : 0;
+}
+
+namespace Private
+{
+
+// Put frame into the mailbox, dropping the oldest one if it is full
+void ListenerMailbox::PostFrame( const shared_ptr<const XImage>& image )
+{
+    {
+        lock_guard<mutex> lock( Sync );
+
+        if ( Frames.size( ) >= Size )
+        {
+            Frames.pop_front( );
+            FramesDropped++;
+        }
+
+        Frames.push_back( image );
+    }
+
+    NewMail.notify_one( );
+}
+
+// Put error into the mailbox
+void ListenerMailbox::PostError( const string& errorMessage, bool fatal )
+{
+    {
+        lock_guard<mutex> lock( Sync );
+        Errors.push_back( pair<string, bool>( errorMessage, fatal ) );
+    }
+
+    NewMail.notify_one( );
+}
+
+// Deliver content of the mailbox to its listener - errors go first
+void ListenerMailbox::WorkerThreadHandler( ListenerMailbox* me )
+{
+    unique_lock<mutex> lock( me->Sync );
+
+    while ( !me->NeedToStop )
+    {
+        if ( !me->Errors.empty( ) )
+        {
+            pair<string, bool> error = me->Errors.front( );
+
+            me->Errors.pop_front( );
+
+            lock.unlock( );
+            me->Listener->OnError( error.first, error.second );
+            lock.lock( );
+        }
+        else if ( !me->Frames.empty( ) )
+        {
+            shared_ptr<const XImage> image = me->Frames.front( );
+
+            me->Frames.pop_front( );
+
+            lock.unlock( );
+            me->Listener->OnNewImage( image );
+            me->FramesDelivered++;
+            // release the frame before waiting for the next one, so it could be reused
+            image.reset( );
+            lock.lock( );
+        }
+        else
+        {
+            me->NewMail.wait( lock );
+        }
+    }
+}
+
+} // namespace Private
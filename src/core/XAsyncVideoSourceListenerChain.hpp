@@ -0,0 +1,72 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+#ifndef XASYNC_VIDEO_SOURCE_LISTENER_CHAIN_HPP
+#define XASYNC_VIDEO_SOURCE_LISTENER_CHAIN_HPP
+
+#include <stdint.h>
+#include <string>
+
+#include "XInterfaces.hpp"
+#include "IVideoSourceListener.hpp"
+
+namespace Private
+{
+    class XAsyncVideoSourceListenerChainData;
+}
+
+// Chain of listeners, which are called on their own threads instead of the video source's one. Every
+// listener gets a mailbox of the latest frames - when it is full, the oldest frame is dropped to make
+// room for the new one. So notification returns right away no matter how slow the listeners are.
+// Frames referring to video source's buffers are copied (once for all listeners), so the buffers
+// are given back to the source without waiting for listeners to release them.
+class XAsyncVideoSourceListenerChain : public IVideoSourceListener, private Uncopyable
+{
+public:
+    XAsyncVideoSourceListenerChain( );
+    ~XAsyncVideoSourceListenerChain( );
+
+    // New video frame notification
+    void OnNewImage( const std::shared_ptr<const XImage>& image );
+
+    // Video source error notification (errors are never dropped)
+    void OnError( const std::string& errorMessage, bool fatal );
+
+    // Add new listener into the chain with the mailbox of the specified size (frames) and start its
+    // thread. The name is only to tell listeners apart in statistics.
+    void Add( IVideoSourceListener* listener, const std::string& name, uint32_t mailboxSize = 1 );
+
+    // Stop threads of all listeners (frames waiting in mailboxes are discarded) and remove them from
+    // the chain. Must be done before listeners are destroyed, unless the chain goes first.
+    void Clear( );
+
+    // Number of listeners in the chain and name of the specified one
+    size_t ListenersCount( ) const;
+    std::string ListenerName( size_t index ) const;
+
+    // Number of frames given to the specified listener and number of frames it missed, since they
+    // were dropped from its mailbox
+    uint64_t FramesDelivered( size_t index ) const;
+    uint64_t FramesDropped( size_t index ) const;
+
+private:
+    Private::XAsyncVideoSourceListenerChainData* mData;
+};
+
+#endif // XASYNC_VIDEO_SOURCE_LISTENER_CHAIN_HPP
@@ -0,0 +1,1231 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+#include "XFrameRecorder.hpp"
+#include "XImagePool.hpp"
+#include "XManualResetEvent.hpp"
+#include "XJsonWriter.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Size of blocks the file is written with (segments and write offsets are aligned to it)
+    #define BLOCK_SIZE          (4096)
+    // Size of the file's header - segments go right after it
+    #define FILE_HEADER_SIZE    (BLOCK_SIZE)
+    // Size of segment's header - frames go right after it
+    #define SEGMENT_HEADER_SIZE (64)
+    // Number of segments to split the file into and the smallest segment
+    #define MAX_SEGMENTS_COUNT  (64)
+    #define MIN_SEGMENTS_COUNT  (4)
+    #define MIN_SEGMENT_SIZE    (1024 * 1024)
+    // Size of the buffer frames are collected in before writing
+    #define WRITE_BUFFER_SIZE   (1024 * 1024)
+    // Max number of frames waiting to be written
+    #define MAX_QUEUED_FRAMES   (16)
+    // Time (ms) of frames to keep while recording is paused, so they get recorded once it is resumed
+    #define PRE_RECORD_TIME     (1000)
+    // Interval (ms) to write collected frames at, even if the buffer is not full
+    #define FLUSH_INTERVAL      (1000)
+    // Time (ms) to wait for the next recorded frame to become available while playing
+    #define PLAYBACK_WAIT_TIME  (500)
+
+    #define FILE_MAGIC          (0x52584F50) // "POXR"
+    #define SEGMENT_MAGIC       (0x53584F50) // "POXS"
+    #define FRAME_MAGIC         (0x46584F50) // "POXF"
+    #define FORMAT_VERSION      (2)
+
+    struct FileHeader
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t SegmentSize;
+        uint32_t SegmentsCount;
+    };
+
+    struct SegmentHeader
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        // sequence number of the segment - tells the order segments were written in (0 - empty)
+        uint64_t Sequence;
+    };
+
+    // Header of every recorded frame - sequence number of the segment tells frames from stale
+    // data, which were left in a reused segment. Recording time orders frames (never goes back),
+    // while wall clock time is kept only to be reported.
+    struct FrameHeader
+    {
+        uint32_t Magic;
+        uint32_t Size;
+        uint64_t Time;
+        uint64_t Sequence;
+        uint64_t WallTime;
+    };
+
+    // Frame in the index of recorded frames - its time and location within segment
+    struct FrameEntry
+    {
+        uint64_t Time;
+        uint64_t WallTime;
+        uint32_t Offset;
+        uint32_t Size;
+    };
+
+    // Frame waiting to be written
+    struct QueuedFrame
+    {
+        shared_ptr<const XImage> Image;
+        uint64_t                 Time;
+        uint64_t                 WallTime;
+    };
+
+    class RecordedSegment
+    {
+    public:
+        uint64_t           Sequence;
+        vector<FrameEntry> Frames;
+
+    public:
+        RecordedSegment( ) : Sequence( 0 ), Frames( ) { }
+    };
+
+    // Frame to read from the file - position of the data and sequence number of its segment
+    // to check that it was not overwritten while reading
+    struct FrameLocation
+    {
+        uint64_t Time;
+        uint64_t WallTime;
+        uint32_t Segment;
+        uint64_t Sequence;
+        uint64_t FileOffset;
+        uint32_t Size;
+    };
+
+    static inline uint32_t AlignUp( uint32_t value, uint32_t alignment )
+    {
+        return ( value + alignment - 1 ) & ~( alignment - 1 );
+    }
+
+    static inline uint64_t WallTimeNow( )
+    {
+        return static_cast<uint64_t>( duration_cast<milliseconds>( system_clock::now( ).time_since_epoch( ) ).count( ) );
+    }
+
+    class XFrameRecorderData;
+
+    // Listener for video source events
+    class RecorderVideoListener : public IVideoSourceListener
+    {
+    private:
+        XFrameRecorderData* Owner;
+
+    public:
+        RecorderVideoListener( XFrameRecorderData* owner ) : Owner( owner ) { }
+
+        void OnNewImage( const shared_ptr<const XImage>& image );
+        void OnError( const string& /* errorMessage */, bool /* fatal */ ) { }
+    };
+
+    // Web request handler providing information about recorded frames
+    class RecordingIndexHandler : public IWebRequestHandler
+    {
+    private:
+        XFrameRecorderData* Owner;
+
+    public:
+        RecordingIndexHandler( const string& uri, XFrameRecorderData* owner ) :
+            IWebRequestHandler( uri, false ), Owner( owner )
+        {
+        }
+
+        void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+        bool CanHandleOnWorkerThread( ) const { return true; }
+    };
+
+    // Web request handler providing single recorded frame
+    class RecordedJpegHandler : public IWebRequestHandler
+    {
+    private:
+        XFrameRecorderData* Owner;
+
+    public:
+        RecordedJpegHandler( const string& uri, XFrameRecorderData* owner ) :
+            IWebRequestHandler( uri, false ), Owner( owner )
+        {
+        }
+
+        void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+        bool CanHandleOnWorkerThread( ) const { return true; }
+    };
+
+    // State of a client playing recording - time of the next frame to send, end of the played range
+    // and play speed
+    class PlaybackClient
+    {
+    public:
+        uint64_t NextTime;
+        uint64_t EndTime;
+        uint32_t Speed;
+
+    public:
+        PlaybackClient( uint64_t startTime, uint64_t endTime, uint32_t speed ) :
+            NextTime( startTime ), EndTime( endTime ), Speed( speed )
+        {
+        }
+    };
+
+    // Web request handler providing recorded frames as MJPEG stream
+    class RecordedMjpegHandler : public IWebRequestHandler
+    {
+    private:
+        XFrameRecorderData* Owner;
+
+    public:
+        RecordedMjpegHandler( const string& uri, XFrameRecorderData* owner ) :
+            IWebRequestHandler( uri, false ), Owner( owner )
+        {
+        }
+
+        void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+        void HandleTimer( IWebResponse& response );
+
+    private:
+        void ProvideFrame( IWebResponse& response, bool firstFrame );
+    };
+
+    // Private implementation details for the XFrameRecorder
+    class XFrameRecorderData
+    {
+    public:
+        RecorderVideoListener       VideoSourceListener;
+
+        // file and its layout - the file can be opened while web handlers and video listener are already
+        // in use, so those check if it is open without waiting for that to complete
+        atomic<bool>                Opened;
+        int                         File;
+        uint32_t                    SegmentSize;
+        uint32_t                    SegmentsCount;
+
+        // index of recorded frames - guarded, since it is used by both writer and readers
+        mutable mutex               IndexGuard;
+        vector<RecordedSegment>     Segments;
+
+        // segment frames are written into and data collected for writing - the buffer
+        // starts at block aligned offset within the segment
+        uint32_t                    CurrentSegment;
+        uint64_t                    NextSequence;
+        uint8_t*                    WriteBuffer;
+        uint32_t                    BufferOffset;
+        uint32_t                    BufferLength;
+        vector<FrameEntry>          PendingFrames;
+        steady_clock::time_point    LastFlushTime;
+
+        // recording time (ms) is wall clock time of opening the file advanced by steady clock, so adjusting
+        // system time does not break order of frames - it also continues after the last recorded frame
+        uint64_t                    TimeOrigin;
+        steady_clock::time_point    SteadyOrigin;
+
+        // frames waiting to be written
+        mutex                       QueueGuard;
+        deque<QueuedFrame>          Queue;
+        deque<QueuedFrame>          PreRecordQueue;
+        bool                        Paused;
+        XImagePool                  CopiedImages;
+        uint32_t                    FrameInterval;
+        steady_clock::time_point    LastFrameTime;
+
+        atomic<uint64_t>            FramesWritten;
+        atomic<uint64_t>            FramesDropped;
+
+        thread                      WriterThread;
+        XManualResetEvent           NewFrameEvent;
+        XManualResetEvent           NeedToStop;
+        mutable recursive_mutex     Sync;
+
+    public:
+        XFrameRecorderData( ) :
+            VideoSourceListener( this ),
+            Opened( false ), File( -1 ), SegmentSize( 0 ), SegmentsCount( 0 ),
+            IndexGuard( ), Segments( ),
+            CurrentSegment( 0 ), NextSequence( 1 ), WriteBuffer( nullptr ), BufferOffset( 0 ), BufferLength( 0 ),
+            PendingFrames( ), LastFlushTime( ), TimeOrigin( 0 ), SteadyOrigin( ),
+            QueueGuard( ), Queue( ), PreRecordQueue( ), Paused( false ), CopiedImages( ), FrameInterval( 0 ), LastFrameTime( ),
+            FramesWritten( 0 ), FramesDropped( 0 ),
+            WriterThread( ), NewFrameEvent( ), NeedToStop( ), Sync( )
+        {
+        }
+
+        XError Open( const string& fileName, uint64_t fileSize );
+        void Close( );
+
+        void QueueFrame( const shared_ptr<const XImage>& image );
+        void SetPaused( bool paused );
+
+        bool RecordedRange( uint64_t& firstTime, uint64_t& lastTime, uint32_t& framesCount ) const;
+        bool FindFrame( uint64_t time, FrameLocation& location, uint64_t* nextTime ) const;
+        bool ReadFrame( const FrameLocation& location, vector<uint8_t>& data ) const;
+        vector<uint32_t> SegmentsInTimeOrder( ) const;
+
+    private:
+        uint64_t SegmentFileOffset( uint32_t segment ) const
+        {
+            return FILE_HEADER_SIZE + static_cast<uint64_t>( segment ) * SegmentSize;
+        }
+
+        bool ReadAt( void* buffer, size_t length, uint64_t offset ) const;
+        bool WriteAt( const void* buffer, size_t length, uint64_t offset ) const;
+
+        bool CreateFile( );
+        void RecoverIndex( );
+
+        uint64_t LastRecordedTime( ) const;
+        uint64_t TimeNow( ) const
+        {
+            return TimeOrigin + static_cast<uint64_t>( duration_cast<milliseconds>( steady_clock::now( ) - SteadyOrigin ).count( ) );
+        }
+
+        void StartSegment( );
+        void WriteFrame( const QueuedFrame& frame );
+        void FlushBuffer( bool writeAll );
+
+        static void WriterThreadHandler( XFrameRecorderData* me );
+    };
+}
+
+// ------------------------------------------------------------------------------------------
+
+XFrameRecorder::XFrameRecorder( ) :
+    mData( new Private::XFrameRecorderData( ) )
+{
+}
+
+XFrameRecorder::~XFrameRecorder( )
+{
+    Close( );
+    delete mData;
+}
+
+// Open ring file and start recording
+XError XFrameRecorder::Open( const string& fileName, uint64_t fileSize )
+{
+    return mData->Open( fileName, fileSize );
+}
+
+// Stop recording and close the file
+void XFrameRecorder::Close( )
+{
+    mData->Close( );
+}
+
+// Check if the ring file is open
+bool XFrameRecorder::IsOpen( ) const
+{
+    return mData->Opened;
+}
+
+// Get/Set the highest rate of frames to record
+uint32_t XFrameRecorder::MaxFrameRate( ) const
+{
+    lock_guard<mutex> lock( mData->QueueGuard );
+
+    return ( mData->FrameInterval == 0 ) ? 0 : 1000 / mData->FrameInterval;
+}
+void XFrameRecorder::SetMaxFrameRate( uint32_t frameRate )
+{
+    lock_guard<mutex> lock( mData->QueueGuard );
+
+    mData->FrameInterval = ( frameRate == 0 ) ? 0 : 1000 / std::min( frameRate, 1000u );
+}
+
+// Pause/Resume recording
+void XFrameRecorder::Pause( )
+{
+    mData->SetPaused( true );
+}
+void XFrameRecorder::Resume( )
+{
+    mData->SetPaused( false );
+}
+bool XFrameRecorder::IsPaused( ) const
+{
+    lock_guard<mutex> lock( mData->QueueGuard );
+
+    return mData->Paused;
+}
+
+// Get video source listener
+IVideoSourceListener* XFrameRecorder::VideoSourceListener( ) const
+{
+    return &mData->VideoSourceListener;
+}
+
+// Get time of the oldest/newest recorded frames
+bool XFrameRecorder::RecordedRange( uint64_t& firstTime, uint64_t& lastTime, uint32_t& framesCount ) const
+{
+    return mData->RecordedRange( firstTime, lastTime, framesCount );
+}
+
+// Number of written/dropped frames since the file was opened
+uint64_t XFrameRecorder::FramesWritten( ) const
+{
+    return mData->FramesWritten;
+}
+uint64_t XFrameRecorder::FramesDropped( ) const
+{
+    return mData->FramesDropped;
+}
+
+// Create web request handlers to provide recorded frames
+shared_ptr<IWebRequestHandler> XFrameRecorder::CreateIndexHandler( const string& uri ) const
+{
+    return make_shared<Private::RecordingIndexHandler>( uri, mData );
+}
+shared_ptr<IWebRequestHandler> XFrameRecorder::CreateJpegHandler( const string& uri ) const
+{
+    return make_shared<Private::RecordedJpegHandler>( uri, mData );
+}
+shared_ptr<IWebRequestHandler> XFrameRecorder::CreateMjpegHandler( const string& uri ) const
+{
+    return make_shared<Private::RecordedMjpegHandler>( uri, mData );
+}
+
+namespace Private
+{
+
+// ------------------------------------------------------------------------------------------
+
+// Open ring file and start writer thread
+XError XFrameRecorderData::Open( const string& fileName, uint64_t fileSize )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+    uint64_t                    segmentsSpace = ( fileSize > FILE_HEADER_SIZE ) ? fileSize - FILE_HEADER_SIZE : 0;
+    uint64_t                    segmentSize;
+    FileHeader                  header;
+
+    Close( );
+
+    // bigger files get bigger segments, so the index stays small
+    SegmentsCount = static_cast<uint32_t>( std::min<uint64_t>( MAX_SEGMENTS_COUNT, segmentsSpace / MIN_SEGMENT_SIZE ) );
+
+    if ( SegmentsCount < MIN_SEGMENTS_COUNT )
+    {
+        return XError::ConfigurationNotSupported;
+    }
+
+    segmentSize = ( segmentsSpace / SegmentsCount ) & ~static_cast<uint64_t>( BLOCK_SIZE - 1 );
+    SegmentSize = static_cast<uint32_t>( std::min<uint64_t>( segmentSize, 0x40000000 ) );
+
+    File = open( fileName.c_str( ), O_RDWR | O_CREAT, 0644 );
+
+    if ( File == -1 )
+    {
+        return XError::IOError;
+    }
+
+    if ( posix_memalign( reinterpret_cast<void**>( &WriteBuffer ), BLOCK_SIZE, WRITE_BUFFER_SIZE ) != 0 )
+    {
+        WriteBuffer = nullptr;
+        Close( );
+        return XError::OutOfMemory;
+    }
+
+    {
+        lock_guard<mutex> indexLock( IndexGuard );
+        Segments.assign( SegmentsCount, RecordedSegment( ) );
+    }
+    CurrentSegment = SegmentsCount - 1;
+    NextSequence   = 1;
+
+    // keep frames recorded before if the file has the expected layout
+    if ( ( ReadAt( &header, sizeof( header ), 0 ) ) && ( header.Magic == FILE_MAGIC ) && ( header.Version == FORMAT_VERSION ) &&
+         ( header.SegmentSize == SegmentSize ) && ( header.SegmentsCount == SegmentsCount ) )
+    {
+        RecoverIndex( );
+    }
+    else if ( !CreateFile( ) )
+    {
+        Close( );
+        return XError::IOError;
+    }
+
+    FramesWritten = 0;
+    FramesDropped = 0;
+
+    // recording time continues from the last recorded frame even if system time went back meanwhile
+    TimeOrigin   = std::max( WallTimeNow( ), LastRecordedTime( ) + 1 );
+    SteadyOrigin = steady_clock::now( );
+
+    // new frames go into the next segment after the last written one
+    StartSegment( );
+
+    NeedToStop.Reset( );
+    NewFrameEvent.Reset( );
+    WriterThread = thread( WriterThreadHandler, this );
+
+    Opened = true;
+
+    return XError::Success;
+}
+
+// Stop writer thread and close the file
+void XFrameRecorderData::Close( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    Opened = false;
+
+    if ( WriterThread.joinable( ) )
+    {
+        NeedToStop.Signal( );
+        NewFrameEvent.Signal( );
+        WriterThread.join( );
+    }
+
+    if ( File != -1 )
+    {
+        close( File );
+        File = -1;
+    }
+
+    if ( WriteBuffer != nullptr )
+    {
+        free( WriteBuffer );
+        WriteBuffer = nullptr;
+    }
+
+    {
+        lock_guard<mutex> indexLock( IndexGuard );
+        Segments.clear( );
+    }
+
+    {
+        lock_guard<mutex> queueLock( QueueGuard );
+        Queue.clear( );
+        PreRecordQueue.clear( );
+    }
+
+    PendingFrames.clear( );
+    BufferOffset = 0;
+    BufferLength = 0;
+}
+
+// Read/Write the specified amount of data at the specified position of the file
+bool XFrameRecorderData::ReadAt( void* buffer, size_t length, uint64_t offset ) const
+{
+    uint8_t* ptr = static_cast<uint8_t*>( buffer );
+
+    while ( length != 0 )
+    {
+        ssize_t count = pread( File, ptr, length, static_cast<off_t>( offset ) );
+
+        if ( count > 0 )
+        {
+            ptr    += count;
+            offset += count;
+            length -= count;
+        }
+        else if ( ( count == 0 ) || ( errno != EINTR ) )
+        {
+            break;
+        }
+    }
+
+    return ( length == 0 );
+}
+bool XFrameRecorderData::WriteAt( const void* buffer, size_t length, uint64_t offset ) const
+{
+    const uint8_t* ptr = static_cast<const uint8_t*>( buffer );
+
+    while ( length != 0 )
+    {
+        ssize_t count = pwrite( File, ptr, length, static_cast<off_t>( offset ) );
+
+        if ( count > 0 )
+        {
+            ptr    += count;
+            offset += count;
+            length -= count;
+        }
+        else if ( ( count == 0 ) || ( errno != EINTR ) )
+        {
+            break;
+        }
+    }
+
+    return ( length == 0 );
+}
+
+// Create empty ring file - all space is allocated right away, so recording never has to grow the file
+bool XFrameRecorderData::CreateFile( )
+{
+    uint64_t   fileSize = SegmentFileOffset( SegmentsCount );
+    FileHeader header   = { FILE_MAGIC, FORMAT_VERSION, SegmentSize, SegmentsCount };
+    bool       ret      = ( ftruncate( File, 0 ) == 0 );
+
+    if ( ret )
+    {
+        // some file systems don't support allocation - the file will be sparse then
+        if ( posix_fallocate( File, 0, static_cast<off_t>( fileSize ) ) != 0 )
+        {
+            ret = ( ftruncate( File, static_cast<off_t>( fileSize ) ) == 0 );
+        }
+    }
+
+    if ( ret )
+    {
+        ret = ( ( WriteAt( &header, sizeof( header ), 0 ) ) && ( fdatasync( File ) == 0 ) );
+    }
+
+    return ret;
+}
+
+// Rebuild index of frames from the file, scanning frame headers of every segment
+void XFrameRecorderData::RecoverIndex( )
+{
+    lock_guard<mutex> lock( IndexGuard );
+    uint64_t          lastSequence = 0;
+
+    for ( uint32_t segment = 0; segment < SegmentsCount; segment++ )
+    {
+        uint64_t      segmentOffset = SegmentFileOffset( segment );
+        uint32_t      offset        = SEGMENT_HEADER_SIZE;
+        SegmentHeader segmentHeader;
+        FrameHeader   frameHeader;
+
+        if ( ( !ReadAt( &segmentHeader, sizeof( segmentHeader ), segmentOffset ) ) ||
+             ( segmentHeader.Magic != SEGMENT_MAGIC ) || ( segmentHeader.Version != FORMAT_VERSION ) ||
+             ( segmentHeader.Sequence == 0 ) )
+        {
+            continue;
+        }
+
+        while ( ( offset + sizeof( frameHeader ) <= SegmentSize ) &&
+                ( ReadAt( &frameHeader, sizeof( frameHeader ), segmentOffset + offset ) ) &&
+                ( frameHeader.Magic == FRAME_MAGIC ) && ( frameHeader.Sequence == segmentHeader.Sequence ) &&
+                ( frameHeader.Size <= SegmentSize - offset - sizeof( frameHeader ) ) )
+        {
+            Segments[segment].Frames.push_back( { frameHeader.Time, frameHeader.WallTime, offset, frameHeader.Size } );
+            offset = AlignUp( offset + sizeof( frameHeader ) + frameHeader.Size, 8 );
+        }
+
+        if ( !Segments[segment].Frames.empty( ) )
+        {
+            Segments[segment].Sequence = segmentHeader.Sequence;
+
+            if ( segmentHeader.Sequence > lastSequence )
+            {
+                lastSequence   = segmentHeader.Sequence;
+                CurrentSegment = segment;
+            }
+        }
+    }
+
+    NextSequence = lastSequence + 1;
+}
+
+// Get recording time of the newest frame in the index (0 if there are none)
+uint64_t XFrameRecorderData::LastRecordedTime( ) const
+{
+    lock_guard<mutex> lock( IndexGuard );
+    vector<uint32_t>  order = SegmentsInTimeOrder( );
+
+    return ( order.empty( ) ) ? 0 : Segments[order.back( )].Frames.back( ).Time;
+}
+
+// Start writing into the next segment - frames it had are removed from the index before anything is written
+void XFrameRecorderData::StartSegment( )
+{
+    SegmentHeader header;
+
+    {
+        lock_guard<mutex> lock( IndexGuard );
+
+        CurrentSegment = ( CurrentSegment + 1 ) % SegmentsCount;
+
+        Segments[CurrentSegment].Sequence = NextSequence;
+        Segments[CurrentSegment].Frames.clear( );
+    }
+
+    memset( &header, 0, sizeof( header ) );
+    header.Magic    = SEGMENT_MAGIC;
+    header.Version  = FORMAT_VERSION;
+    header.Sequence = NextSequence++;
+
+    memset( WriteBuffer, 0, SEGMENT_HEADER_SIZE );
+    memcpy( WriteBuffer, &header, sizeof( header ) );
+
+    BufferOffset = 0;
+    BufferLength = SEGMENT_HEADER_SIZE;
+}
+
+// Put frame into write buffer, writing the buffer when it gets full
+void XFrameRecorderData::WriteFrame( const QueuedFrame& frame )
+{
+    const XImage& image       = *frame.Image;
+    uint32_t      frameSize   = static_cast<uint32_t>( image.Width( ) );
+    uint32_t      recordSize  = AlignUp( sizeof( FrameHeader ) + frameSize, 8 );
+    FrameHeader   frameHeader = { FRAME_MAGIC, frameSize, frame.Time, Segments[CurrentSegment].Sequence, frame.WallTime };
+
+    // the frame must fit into empty buffer (block aligned) and segment
+    if ( ( recordSize > WRITE_BUFFER_SIZE - BLOCK_SIZE ) || ( recordSize > SegmentSize - SEGMENT_HEADER_SIZE ) )
+    {
+        FramesDropped++;
+        return;
+    }
+
+    if ( BufferOffset + BufferLength + recordSize > SegmentSize )
+    {
+        FlushBuffer( true );
+        StartSegment( );
+        frameHeader.Sequence = Segments[CurrentSegment].Sequence;
+    }
+
+    if ( BufferLength + recordSize > WRITE_BUFFER_SIZE )
+    {
+        FlushBuffer( false );
+    }
+
+    uint8_t* ptr = WriteBuffer + BufferLength;
+
+    memcpy( ptr, &frameHeader, sizeof( frameHeader ) );
+    memcpy( ptr + sizeof( frameHeader ), image.Data( ), frameSize );
+    memset( ptr + sizeof( frameHeader ) + frameSize, 0, recordSize - sizeof( frameHeader ) - frameSize );
+
+    PendingFrames.push_back( { frame.Time, frame.WallTime, BufferOffset + BufferLength, frameSize } );
+    BufferLength += recordSize;
+
+    FramesWritten++;
+}
+
+// Write whole blocks collected in the buffer (or everything, padding the last block) and let readers
+// know about frames, which are in the file now
+void XFrameRecorderData::FlushBuffer( bool writeAll )
+{
+    uint32_t fullBlocksLength = BufferLength & ~static_cast<uint32_t>( BLOCK_SIZE - 1 );
+    uint32_t writeLength      = ( writeAll ) ? AlignUp( BufferLength, BLOCK_SIZE ) : fullBlocksLength;
+    uint32_t writtenEnd       = BufferOffset + ( ( writeAll ) ? BufferLength : fullBlocksLength );
+
+    if ( writeLength != 0 )
+    {
+        memset( WriteBuffer + BufferLength, 0, writeLength - BufferLength );
+
+        if ( WriteAt( WriteBuffer, writeLength, SegmentFileOffset( CurrentSegment ) + BufferOffset ) )
+        {
+            lock_guard<mutex> lock( IndexGuard );
+            auto              itFrame = PendingFrames.begin( );
+
+            while ( ( itFrame != PendingFrames.end( ) ) && ( itFrame->Offset + sizeof( FrameHeader ) + itFrame->Size <= writtenEnd ) )
+            {
+                Segments[CurrentSegment].Frames.push_back( *itFrame );
+                ++itFrame;
+            }
+
+            PendingFrames.erase( PendingFrames.begin( ), itFrame );
+        }
+        else
+        {
+            // failed writing, so the frames are lost
+            FramesDropped += PendingFrames.size( );
+            FramesWritten -= PendingFrames.size( );
+            PendingFrames.clear( );
+        }
+    }
+
+    // the partially filled block stays in the buffer and gets written again along with the next frames
+    if ( fullBlocksLength != 0 )
+    {
+        memmove( WriteBuffer, WriteBuffer + fullBlocksLength, BufferLength - fullBlocksLength );
+        BufferOffset += fullBlocksLength;
+        BufferLength -= fullBlocksLength;
+    }
+
+    LastFlushTime = steady_clock::now( );
+}
+
+// Queue frame for writing
+void XFrameRecorderData::QueueFrame( const shared_ptr<const XImage>& image )
+{
+    lock_guard<mutex>        lock( QueueGuard );
+    steady_clock::time_point now = steady_clock::now( );
+
+    if ( !Opened )
+    {
+        return;
+    }
+
+    if ( image->Format( ) != XPixelFormat::JPEG )
+    {
+        FramesDropped++;
+        return;
+    }
+
+    if ( FrameInterval != 0 )
+    {
+        uint32_t sinceLast = static_cast<uint32_t>( duration_cast<milliseconds>( now - LastFrameTime ).count( ) );
+
+        // allow some jitter of frames' arrival, so the rate does not drop below the configured
+        if ( sinceLast + FrameInterval / 8 < FrameInterval )
+        {
+            return;
+        }
+    }
+
+    if ( Paused )
+    {
+        uint64_t time = TimeNow( );
+
+        // keep the latest frames only (leaving room in the queue for the frames coming after resuming) -
+        // copied, so video source's buffers are not held for long
+        while ( ( !PreRecordQueue.empty( ) ) &&
+                ( ( PreRecordQueue.front( ).Time + PRE_RECORD_TIME < time ) || ( PreRecordQueue.size( ) >= MAX_QUEUED_FRAMES / 2 ) ) )
+        {
+            PreRecordQueue.pop_front( );
+        }
+
+        shared_ptr<XImage> copy = CopiedImages.Acquire( image->Width( ), image->Height( ), image->Format( ) );
+
+        if ( ( copy ) && ( image->CopyData( copy ) == XError::Success ) )
+        {
+            PreRecordQueue.push_back( { copy, time, WallTimeNow( ) } );
+            LastFrameTime = now;
+        }
+        return;
+    }
+
+    if ( Queue.size( ) >= MAX_QUEUED_FRAMES )
+    {
+        // writing does not keep up - better lose frames than memory
+        FramesDropped++;
+        return;
+    }
+
+    shared_ptr<const XImage> frame = image;
+
+    if ( !image->OwnsData( ) )
+    {
+        shared_ptr<XImage> copy = CopiedImages.Acquire( image->Width( ), image->Height( ), image->Format( ) );
+
+        if ( ( !copy ) || ( image->CopyData( copy ) != XError::Success ) )
+        {
+            FramesDropped++;
+            return;
+        }
+
+        frame = copy;
+    }
+
+    Queue.push_back( { frame, TimeNow( ), WallTimeNow( ) } );
+    LastFrameTime = now;
+
+    NewFrameEvent.Signal( );
+}
+
+// Pause recording or resume it starting from the frames kept while it was paused
+void XFrameRecorderData::SetPaused( bool paused )
+{
+    lock_guard<mutex> lock( QueueGuard );
+
+    if ( paused != Paused )
+    {
+        Paused = paused;
+
+        if ( !paused )
+        {
+            while ( ( !PreRecordQueue.empty( ) ) && ( Queue.size( ) < MAX_QUEUED_FRAMES ) )
+            {
+                Queue.push_back( PreRecordQueue.front( ) );
+                PreRecordQueue.pop_front( );
+            }
+            PreRecordQueue.clear( );
+
+            if ( !Queue.empty( ) )
+            {
+                NewFrameEvent.Signal( );
+            }
+        }
+    }
+}
+
+// Write queued frames into the file
+void XFrameRecorderData::WriterThreadHandler( XFrameRecorderData* me )
+{
+    bool needToStop = false;
+
+    me->LastFlushTime = steady_clock::now( );
+
+    while ( !needToStop )
+    {
+        deque<QueuedFrame> frames;
+
+        me->NewFrameEvent.Wait( FLUSH_INTERVAL );
+        me->NewFrameEvent.Reset( );
+
+        // check if need to stop before taking frames, so all queued frames are written
+        needToStop = me->NeedToStop.IsSignaled( );
+
+        {
+            lock_guard<mutex> lock( me->QueueGuard );
+            frames.swap( me->Queue );
+        }
+
+        for ( auto& frame : frames )
+        {
+            me->WriteFrame( frame );
+        }
+
+        frames.clear( );
+
+        if ( ( !me->PendingFrames.empty( ) ) &&
+             ( ( needToStop ) || ( duration_cast<milliseconds>( steady_clock::now( ) - me->LastFlushTime ).count( ) >= FLUSH_INTERVAL ) ) )
+        {
+            me->FlushBuffer( true );
+        }
+
+        if ( needToStop )
+        {
+            fdatasync( me->File );
+        }
+        else if ( me->NeedToStop.IsSignaled( ) )
+        {
+            // one more pass to write what was queued before stopping
+            me->NewFrameEvent.Signal( );
+        }
+    }
+}
+
+// Get segments having frames in the order they were written
+vector<uint32_t> XFrameRecorderData::SegmentsInTimeOrder( ) const
+{
+    vector<uint32_t> order;
+
+    for ( uint32_t segment = 0; segment < Segments.size( ); segment++ )
+    {
+        if ( !Segments[segment].Frames.empty( ) )
+        {
+            order.push_back( segment );
+        }
+    }
+
+    sort( order.begin( ), order.end( ), [this]( uint32_t a, uint32_t b )
+    {
+        return Segments[a].Sequence < Segments[b].Sequence;
+    } );
+
+    return order;
+}
+
+// Get time of the oldest/newest recorded frames
+bool XFrameRecorderData::RecordedRange( uint64_t& firstTime, uint64_t& lastTime, uint32_t& framesCount ) const
+{
+    lock_guard<mutex> lock( IndexGuard );
+    vector<uint32_t>  order = SegmentsInTimeOrder( );
+
+    framesCount = 0;
+
+    for ( uint32_t segment : order )
+    {
+        framesCount += static_cast<uint32_t>( Segments[segment].Frames.size( ) );
+    }
+
+    if ( !order.empty( ) )
+    {
+        firstTime = Segments[order.front( )].Frames.front( ).Time;
+        lastTime  = Segments[order.back( )].Frames.back( ).Time;
+    }
+
+    return ( !order.empty( ) );
+}
+
+// Find the first frame recorded at or after the specified time and time of the frame after it (0 if none)
+bool XFrameRecorderData::FindFrame( uint64_t time, FrameLocation& location, uint64_t* nextTime ) const
+{
+    lock_guard<mutex> lock( IndexGuard );
+    vector<uint32_t>  order = SegmentsInTimeOrder( );
+    bool              found = false;
+
+    for ( size_t i = 0; ( i < order.size( ) ) && ( !found ); i++ )
+    {
+        const RecordedSegment& segment = Segments[order[i]];
+
+        if ( segment.Frames.back( ).Time < time )
+        {
+            continue;
+        }
+
+        auto itFrame = lower_bound( segment.Frames.begin( ), segment.Frames.end( ), time,
+                                    []( const FrameEntry& frame, uint64_t t ) { return frame.Time < t; } );
+
+        location.Time       = itFrame->Time;
+        location.WallTime   = itFrame->WallTime;
+        location.Segment    = order[i];
+        location.Sequence   = segment.Sequence;
+        location.FileOffset = SegmentFileOffset( order[i] ) + itFrame->Offset + sizeof( FrameHeader );
+        location.Size       = itFrame->Size;
+        found               = true;
+
+        if ( nextTime != nullptr )
+        {
+            ++itFrame;
+
+            *nextTime = ( itFrame != segment.Frames.end( ) ) ? itFrame->Time :
+                        ( ( i + 1 < order.size( ) ) ? Segments[order[i + 1]].Frames.front( ).Time : 0 );
+        }
+    }
+
+    return found;
+}
+
+// Read frame's data - fails if the segment was reused for new frames meanwhile
+bool XFrameRecorderData::ReadFrame( const FrameLocation& location, vector<uint8_t>& data ) const
+{
+    bool ret;
+
+    data.resize( location.Size );
+
+    ret = ReadAt( data.data( ), location.Size, location.FileOffset );
+
+    if ( ret )
+    {
+        lock_guard<mutex> lock( IndexGuard );
+
+        ret = ( ( location.Segment < Segments.size( ) ) && ( Segments[location.Segment].Sequence == location.Sequence ) );
+    }
+
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------
+
+// New frame from video source
+void RecorderVideoListener::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    Owner->QueueFrame( image );
+}
+
+// Get numeric variable of the request
+static bool GetNumericVariable( const IWebRequest& request, const char* name, uint64_t& value )
+{
+    string str = request.GetVariable( name );
+    char*  end = nullptr;
+
+    if ( !str.empty( ) )
+    {
+        value = strtoull( str.c_str( ), &end, 10 );
+    }
+
+    return ( ( !str.empty( ) ) && ( *end == '\0' ) );
+}
+
+// Provide information about recorded frames
+void RecordingIndexHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+{
+    string      reply;
+    XJsonWriter writer( reply );
+    uint64_t    firstTime   = 0;
+    uint64_t    lastTime    = 0;
+    uint32_t    framesCount = 0;
+
+    Owner->RecordedRange( firstTime, lastTime, framesCount );
+
+    writer.BeginObject( ).Name( "status" ).String( "OK" ).
+           Name( "first" ).Number( firstTime ).Name( "last" ).Number( lastTime ).Name( "frames" ).Number( framesCount ).
+           Name( "written" ).Number( Owner->FramesWritten ).Name( "dropped" ).Number( Owner->FramesDropped ).
+           Name( "segments" ).BeginArray( );
+
+    {
+        lock_guard<mutex> lock( Owner->IndexGuard );
+
+        for ( uint32_t segment : Owner->SegmentsInTimeOrder( ) )
+        {
+            const vector<FrameEntry>& frames = Owner->Segments[segment].Frames;
+
+            writer.BeginObject( ).Name( "first" ).Number( frames.front( ).Time ).Name( "last" ).Number( frames.back( ).Time ).
+                   Name( "frames" ).Number( frames.size( ) ).EndObject( );
+        }
+    }
+
+    writer.EndArray( ).EndObject( );
+
+    response.Printf( "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: application/json\r\n"
+                     "Content-Length: %d\r\n"
+                     "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                     "\r\n", (int) reply.length( ) );
+    response.Send( reinterpret_cast<const uint8_t*>( reply.data( ) ), reply.length( ) );
+}
+
+// Provide recorded frame as JPEG
+void RecordedJpegHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    uint64_t        time        = 0;
+    uint64_t        firstTime   = 0;
+    uint32_t        framesCount = 0;
+    FrameLocation   location;
+    vector<uint8_t> data;
+
+    if ( ( !GetNumericVariable( request, "time", time ) ) &&
+         ( !Owner->RecordedRange( firstTime, time, framesCount ) ) )
+    {
+        response.SendError( 404, "Nothing is recorded" );
+    }
+    else if ( !Owner->FindFrame( time, location, nullptr ) )
+    {
+        response.SendError( 404, "No frame recorded at the time" );
+    }
+    else if ( !Owner->ReadFrame( location, data ) )
+    {
+        response.SendError( 500, "Failed reading frame" );
+    }
+    else
+    {
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: image/jpeg\r\n"
+                         "Content-Length: %u\r\n"
+                         "X-Timestamp: %llu\r\n"
+                         "X-Wall-Time: %llu\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                         "\r\n", location.Size, static_cast<unsigned long long>( location.Time ),
+                         static_cast<unsigned long long>( location.WallTime ) );
+        response.Send( data.data( ), data.size( ) );
+    }
+}
+
+// Start MJPEG stream of recorded frames
+void RecordedMjpegHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    uint64_t      startTime = 0;
+    uint64_t      endTime   = UINT64_MAX;
+    uint64_t      speed     = 1;
+    FrameLocation location;
+
+    GetNumericVariable( request, "from", startTime );
+    GetNumericVariable( request, "to", endTime );
+    GetNumericVariable( request, "speed", speed );
+
+    if ( ( !Owner->FindFrame( startTime, location, nullptr ) ) || ( location.Time > endTime ) )
+    {
+        response.SendError( 404, "No frames recorded at the time" );
+    }
+    else
+    {
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                         "Connection: close\r\n"
+                         "Content-Type: multipart/x-mixed-replace; boundary=--myboundary\r\n"
+                         "\r\n" );
+
+        response.SetUserData( make_shared<PlaybackClient>( startTime, endTime,
+                              static_cast<uint32_t>( std::max<uint64_t>( 1, std::min<uint64_t>( speed, 100 ) ) ) ) );
+
+        ProvideFrame( response, true );
+    }
+}
+
+// Timer event for the connection playing recording - provide next frame
+void RecordedMjpegHandler::HandleTimer( IWebResponse& response )
+{
+    ProvideFrame( response, false );
+}
+
+// Send next recorded frame and set timer for the one after it
+void RecordedMjpegHandler::ProvideFrame( IWebResponse& response, bool firstFrame )
+{
+    shared_ptr<PlaybackClient> client   = static_pointer_cast<PlaybackClient>( response.UserData( ) );
+    uint64_t                   nextTime = 0;
+    FrameLocation              location;
+    vector<uint8_t>            data;
+
+    if ( !client )
+    {
+        response.CloseConnection( );
+        return;
+    }
+
+    // don't queue more while the previous frame is not sent yet, so slow clients just play slower
+    if ( ( !firstFrame ) && ( response.ToSendDataLength( ) != 0 ) )
+    {
+        response.SetTimer( 10 );
+        return;
+    }
+
+    if ( !Owner->FindFrame( client->NextTime, location, &nextTime ) )
+    {
+        // reached the newest frame - wait for more if playing up to now
+        if ( client->EndTime == UINT64_MAX )
+        {
+            response.SetTimer( PLAYBACK_WAIT_TIME );
+        }
+        else
+        {
+            response.CloseConnection( );
+        }
+    }
+    else if ( location.Time > client->EndTime )
+    {
+        response.CloseConnection( );
+    }
+    else
+    {
+        // frames overwritten while playing are skipped
+        if ( Owner->ReadFrame( location, data ) )
+        {
+            response.Printf( "--myboundary\r\n"
+                             "Content-Type: image/jpeg\r\n"
+                             "Content-Length: %u\r\n"
+                             "X-Timestamp: %llu\r\n"
+                             "X-Wall-Time: %llu\r\n"
+                             "\r\n", location.Size, static_cast<unsigned long long>( location.Time ),
+                             static_cast<unsigned long long>( location.WallTime ) );
+            response.Send( data.data( ), data.size( ) );
+        }
+
+        client->NextTime = location.Time + 1;
+
+        if ( nextTime == 0 )
+        {
+            response.SetTimer( PLAYBACK_WAIT_TIME );
+        }
+        else
+        {
+            // keep original pace, but don't wait for long over gaps in recording
+            uint64_t delay = ( nextTime > location.Time ) ? ( nextTime - location.Time ) / client->Speed : 0;
+
+            response.SetTimer( static_cast<uint32_t>( std::min<uint64_t>( delay, PLAYBACK_WAIT_TIME ) ) );
+        }
+    }
+}
+
+} // namespace Private
@@ -0,0 +1,101 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XFRAME_RECORDER_HPP
+#define XFRAME_RECORDER_HPP
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "IVideoSourceListener.hpp"
+#include "XWebServer.hpp"
+
+namespace Private
+{
+    class XFrameRecorderData;
+}
+
+// Records encoded (JPEG) frames coming from a video source into a ring file of fixed size, so the
+// last minutes of video are always available. The file is preallocated once and split into
+// segments, which are overwritten in turn - the oldest segment gets reused when the current one
+// is full. Frames are written on a background thread with large block aligned writes, while
+// index of their time stamps is kept in memory (rebuilt from the file when it is reopened).
+//
+// Frames are ordered and looked up by recording time - milliseconds since epoch at the time the file
+// was opened, advanced by steady clock from there on (and never going back from the last frame in the
+// file), so adjusting system time while recording does not reorder frames. Actual wall clock time
+// of every frame is kept only to be reported along with it.
+class XFrameRecorder : private Uncopyable
+{
+public:
+    XFrameRecorder( );
+    ~XFrameRecorder( );
+
+    // Open ring file of the specified size (bytes). Frames recorded earlier are kept, if the file
+    // has the same size, otherwise it is created from scratch. Recording starts right away,
+    // unless it is paused. Preallocating the file may take a while, so it can be done on a background
+    // thread while the recorder's video listener and web handlers are in use - frames coming
+    // before that are ignored and handlers report nothing recorded.
+    XError Open( const std::string& fileName, uint64_t fileSize );
+    // Stop recording and close the file (frames, which are not written yet, get flushed)
+    void Close( );
+    bool IsOpen( ) const;
+
+    // Get/Set the highest rate of frames to record (0 - record all frames)
+    uint32_t MaxFrameRate( ) const;
+    void SetMaxFrameRate( uint32_t frameRate );
+
+    // Pause/Resume recording. While paused, frames are not written, but the latest of them (up to a second)
+    // are kept, so recording resumed on some event also gets what led to it. Not paused by default.
+    void Pause( );
+    void Resume( );
+    bool IsPaused( ) const;
+
+    // Get video source listener, which could be fed to some video source
+    IVideoSourceListener* VideoSourceListener( ) const;
+
+    // Get time (ms since epoch) of the oldest/newest recorded frames and number of frames in
+    // the file (returns false if nothing was recorded yet)
+    bool RecordedRange( uint64_t& firstTime, uint64_t& lastTime, uint32_t& framesCount ) const;
+
+    // Number of written frames and frames dropped since the file was opened (writing could not
+    // keep up, frame is not JPEG or does not fit into a segment)
+    uint64_t FramesWritten( ) const;
+    uint64_t FramesDropped( ) const;
+
+    // Create web request handler providing information about recorded frames as JSON - time range
+    // and time ranges of individual segments (gaps between segments mean recording was stopped)
+    std::shared_ptr<IWebRequestHandler> CreateIndexHandler( const std::string& uri ) const;
+
+    // Create web request handler providing recorded frame as JPEG - the first one recorded at or
+    // after the time specified by "time" variable (ms since epoch), or the latest frame
+    std::shared_ptr<IWebRequestHandler> CreateJpegHandler( const std::string& uri ) const;
+
+    // Create web request handler providing recorded frames of the specified time range ("from"/"to"
+    // variables, ms since epoch) as MJPEG stream played at original pace ("speed" variable speeds it up)
+    std::shared_ptr<IWebRequestHandler> CreateMjpegHandler( const std::string& uri ) const;
+
+private:
+    Private::XFrameRecorderData* mData;
+};
+
+#endif // XFRAME_RECORDER_HPP
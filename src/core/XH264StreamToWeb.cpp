@@ -0,0 +1,435 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <mutex>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "XH264StreamToWeb.hpp"
+#include "XManualResetEvent.hpp"
+#include "XImage.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Amount of the latest stream data to keep for clients, which did not get it yet
+    #define BUFFERED_DATA_SIZE      (1024 * 1024)
+    // Amount of data waiting to be sent to a client, after which it skips data till the next key frame
+    #define MAX_CLIENT_QUEUED_SIZE  (256 * 1024)
+    // Time (ms) client waits for new data to be pushed, before checking state of the video source
+    #define DATA_WAIT_TIMEOUT       (250)
+    // The shortest interval (ms) between requests for key frames
+    #define KEY_FRAME_REQUEST_INTERVAL (500)
+
+    // Chunk of H.264 byte stream, which is shared (not copied) between all connections it is sent to
+    class H264Chunk : private Uncopyable
+    {
+    public:
+        vector<uint8_t> Data;
+        uint64_t        Sequence;
+        bool            KeyFrameStart;
+
+    public:
+        H264Chunk( const uint8_t* data, size_t size, uint64_t sequence ) :
+            Data( data, data + size ), Sequence( sequence ), KeyFrameStart( IsKeyFrameStart( data, size ) )
+        {
+        }
+
+    private:
+        static bool IsKeyFrameStart( const uint8_t* data, size_t size );
+    };
+
+    // State of a client's connection - sequence number of the chunk it needs next
+    class H264Client
+    {
+    public:
+        uint64_t NextSequence;
+        bool     Started;
+
+    public:
+        H264Client( uint64_t nextSequence ) : NextSequence( nextSequence ), Started( false ) { }
+    };
+
+    // Listener for video source events
+    class H264VideoListener : public IVideoSourceListener
+    {
+    private:
+        XH264StreamToWebData* Owner;
+
+    public:
+        H264VideoListener( XH264StreamToWebData* owner ) : Owner( owner ) { }
+
+        void OnNewImage( const shared_ptr<const XImage>& image );
+        void OnError( const string& errorMessage, bool fatal );
+    };
+
+    // Web request handler providing H.264 stream
+    class H264RequestHandler : public IWebRequestHandler
+    {
+    private:
+        XH264StreamToWebData* Owner;
+
+    public:
+        H264RequestHandler( const string& uri, XH264StreamToWebData* owner ) :
+            IWebRequestHandler( uri, false ), Owner( owner )
+        {
+        }
+
+        void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+        void HandleTimer( IWebResponse& response );
+    };
+
+    // Private implementation details for the XH264StreamToWeb
+    class XH264StreamToWebData
+    {
+    public:
+        H264VideoListener                   VideoSourceListener;
+        mutex                               DataGuard;
+        atomic<bool>                        VideoSourceError;
+        string                              VideoSourceErrorMessage;
+
+        // the latest stream data
+        deque<shared_ptr<const H264Chunk>>  Chunks;
+        size_t                              ChunksSize;
+        uint64_t                            NextSequence;
+
+        function<void( bool )>              StreamRequestHandler;
+        steady_clock::time_point            KeyFrameRequestTime;
+
+        // created web request handlers, which get their clients woken up when new data arrive
+        mutex                               HandlersGuard;
+        list<weak_ptr<IWebRequestHandler>>  Handlers;
+
+        // thread pushing new data to clients, so video source is not blocked by it
+        thread                              PushThread;
+        XManualResetEvent                   NewDataEvent;
+        XManualResetEvent                   NeedToStop;
+
+    public:
+        XH264StreamToWebData( ) :
+            VideoSourceListener( this ), DataGuard( ), VideoSourceError( false ), VideoSourceErrorMessage( ),
+            Chunks( ), ChunksSize( 0 ), NextSequence( 0 ),
+            StreamRequestHandler( ), KeyFrameRequestTime( ),
+            HandlersGuard( ), Handlers( ),
+            PushThread( ), NewDataEvent( ), NeedToStop( )
+        {
+            PushThread = thread( PushThreadHandler, this );
+        }
+
+        ~XH264StreamToWebData( )
+        {
+            NeedToStop.Signal( );
+            NewDataEvent.Signal( );
+            PushThread.join( );
+        }
+
+        void AddChunk( const uint8_t* data, size_t size );
+        bool ReportError( IWebResponse& response );
+        void NotifyStreamRequest( bool needKeyFrame );
+        void ProvideData( IWebResponse& response );
+        shared_ptr<IWebRequestHandler> AddHandler( const shared_ptr<IWebRequestHandler>& handler );
+
+    private:
+        void TriggerHandlers( );
+
+        static void PushThreadHandler( XH264StreamToWebData* me );
+    };
+}
+
+XH264StreamToWeb::XH264StreamToWeb( ) :
+    mData( new Private::XH264StreamToWebData( ) )
+{
+}
+
+XH264StreamToWeb::~XH264StreamToWeb( )
+{
+    delete mData;
+}
+
+// Get video source listener, which could be fed to H.264 video source
+IVideoSourceListener* XH264StreamToWeb::VideoSourceListener( ) const
+{
+    return &mData->VideoSourceListener;
+}
+
+// Create web request handler to provide raw H.264 stream
+shared_ptr<IWebRequestHandler> XH264StreamToWeb::CreateH264Handler( const string& uri ) const
+{
+    return mData->AddHandler( make_shared<Private::H264RequestHandler>( uri, mData ) );
+}
+
+// Set handler, which is called while clients receive the stream
+void XH264StreamToWeb::SetStreamRequestHandler( const function<void( bool needKeyFrame )>& handler )
+{
+    lock_guard<mutex> lock( mData->DataGuard );
+
+    mData->StreamRequestHandler = handler;
+}
+
+namespace Private
+{
+
+// Check if the chunk starts with SPS NAL unit - encoder puts it in front of every key frame
+bool H264Chunk::IsKeyFrameStart( const uint8_t* data, size_t size )
+{
+    size_t startCodeSize = ( ( size > 4 ) && ( data[0] == 0 ) && ( data[1] == 0 ) && ( data[2] == 0 ) && ( data[3] == 1 ) ) ? 4 :
+                           ( ( size > 3 ) && ( data[0] == 0 ) && ( data[1] == 0 ) && ( data[2] == 1 ) ) ? 3 : 0;
+
+    return ( ( startCodeSize != 0 ) && ( ( data[startCodeSize] & 0x1F ) == 7 ) );
+}
+
+// New chunk of H.264 stream is available
+void H264VideoListener::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    if ( Owner->VideoSourceError )
+    {
+        // video source has recovered, so new clients may get the stream again
+        lock_guard<mutex> lock( Owner->DataGuard );
+
+        Owner->VideoSourceErrorMessage.clear( );
+        Owner->VideoSourceError = false;
+    }
+
+    if ( image->Format( ) == XPixelFormat::H264 )
+    {
+        Owner->AddChunk( image->Data( ), static_cast<size_t>( image->Width( ) ) );
+    }
+}
+
+// An error coming from video source
+void H264VideoListener::OnError( const string& errorMessage, bool /* fatal */ )
+{
+    lock_guard<mutex> lock( Owner->DataGuard );
+
+    Owner->VideoSourceErrorMessage = errorMessage;
+    Owner->VideoSourceError        = true;
+}
+
+// Handle H.264 stream request - send headers and start providing stream from the next key frame
+void H264RequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+{
+    if ( !Owner->ReportError( response ) )
+    {
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                         "Connection: close\r\n"
+                         "Content-Type: video/h264\r\n"
+                         "\r\n" );
+
+        {
+            lock_guard<mutex> lock( Owner->DataGuard );
+
+            response.SetUserData( make_shared<H264Client>( Owner->NextSequence ) );
+        }
+
+        Owner->ProvideData( response );
+    }
+}
+
+// Timer event for the connection - send new data pushed by video source
+void H264RequestHandler::HandleTimer( IWebResponse& response )
+{
+    if ( Owner->VideoSourceError )
+    {
+        response.CloseConnection( );
+    }
+    else
+    {
+        Owner->ProvideData( response );
+    }
+}
+
+// Add new chunk of the stream, dropping the oldest ones
+void XH264StreamToWebData::AddChunk( const uint8_t* data, size_t size )
+{
+    {
+        lock_guard<mutex> lock( DataGuard );
+
+        Chunks.push_back( make_shared<H264Chunk>( data, size, NextSequence++ ) );
+        ChunksSize += size;
+
+        while ( ( ChunksSize > BUFFERED_DATA_SIZE ) && ( Chunks.size( ) > 1 ) )
+        {
+            ChunksSize -= Chunks.front( )->Data.size( );
+            Chunks.pop_front( );
+        }
+    }
+
+    NewDataEvent.Signal( );
+}
+
+// Report video source error as HTTP response if there is any
+bool XH264StreamToWebData::ReportError( IWebResponse& response )
+{
+    lock_guard<mutex> lock( DataGuard );
+
+    if ( VideoSourceError )
+    {
+        response.SendError( 500, VideoSourceErrorMessage.c_str( ) );
+    }
+
+    return VideoSourceError;
+}
+
+// Let video source know there are clients and if any of them waits for a key frame
+void XH264StreamToWebData::NotifyStreamRequest( bool needKeyFrame )
+{
+    function<void( bool )> handler;
+
+    {
+        lock_guard<mutex> lock( DataGuard );
+        steady_clock::time_point now = steady_clock::now( );
+
+        if ( needKeyFrame )
+        {
+            // don't flood video source with requests while it encodes one
+            if ( duration_cast<milliseconds>( now - KeyFrameRequestTime ).count( ) < KEY_FRAME_REQUEST_INTERVAL )
+            {
+                needKeyFrame = false;
+            }
+            else
+            {
+                KeyFrameRequestTime = now;
+            }
+        }
+
+        handler = StreamRequestHandler;
+    }
+
+    if ( handler )
+    {
+        handler( needKeyFrame );
+    }
+}
+
+// Send all new chunks of the stream to a client, which are not sent yet
+void XH264StreamToWebData::ProvideData( IWebResponse& response )
+{
+    shared_ptr<H264Client>             client = static_pointer_cast<H264Client>( response.UserData( ) );
+    vector<shared_ptr<const H264Chunk>> chunksToSend;
+
+    {
+        lock_guard<mutex> lock( DataGuard );
+
+        if ( ( !Chunks.empty( ) ) && ( client->NextSequence < Chunks.front( )->Sequence ) )
+        {
+            // client missed some data, so it needs to start from the next key frame
+            client->NextSequence = Chunks.front( )->Sequence;
+            client->Started      = false;
+        }
+
+        if ( response.ToSendDataLength( ) > MAX_CLIENT_QUEUED_SIZE )
+        {
+            // client's connection can not keep up with the stream, skip data till the next key frame
+            client->Started = false;
+        }
+        else
+        {
+            for ( auto& chunk : Chunks )
+            {
+                if ( chunk->Sequence >= client->NextSequence )
+                {
+                    if ( chunk->KeyFrameStart )
+                    {
+                        client->Started = true;
+                    }
+                    if ( client->Started )
+                    {
+                        chunksToSend.push_back( chunk );
+                    }
+                }
+            }
+        }
+
+        client->NextSequence = NextSequence;
+    }
+
+    for ( auto& chunk : chunksToSend )
+    {
+        response.SendShared( chunk, chunk->Data.data( ), chunk->Data.size( ) );
+    }
+
+    NotifyStreamRequest( !client->Started );
+
+    // wait for new data to be pushed
+    response.SetTimer( DATA_WAIT_TIMEOUT );
+}
+
+// Keep track of the created request handler, so its clients could be woken up on new data
+shared_ptr<IWebRequestHandler> XH264StreamToWebData::AddHandler( const shared_ptr<IWebRequestHandler>& handler )
+{
+    lock_guard<mutex> lock( HandlersGuard );
+
+    Handlers.push_back( handler );
+
+    return handler;
+}
+
+// Wake up clients of the created request handlers
+void XH264StreamToWebData::TriggerHandlers( )
+{
+    vector<shared_ptr<IWebRequestHandler>> handlers;
+
+    {
+        lock_guard<mutex> lock( HandlersGuard );
+
+        for ( auto itHandler = Handlers.begin( ); itHandler != Handlers.end( ); )
+        {
+            shared_ptr<IWebRequestHandler> handler = itHandler->lock( );
+
+            if ( handler )
+            {
+                handlers.push_back( handler );
+                itHandler++;
+            }
+            else
+            {
+                itHandler = Handlers.erase( itHandler );
+            }
+        }
+    }
+
+    for ( auto handler : handlers )
+    {
+        handler->TriggerTimers( );
+    }
+}
+
+// Push thread - wake up clients when new data arrive (triggering can not be done from video source's thread,
+// since it would get blocked till web server handles it)
+void XH264StreamToWebData::PushThreadHandler( XH264StreamToWebData* me )
+{
+    while ( !me->NeedToStop.IsSignaled( ) )
+    {
+        if ( me->NewDataEvent.Wait( 1000 ) )
+        {
+            me->NewDataEvent.Reset( );
+            me->TriggerHandlers( );
+        }
+    }
+}
+
+} // namespace Private
@@ -0,0 +1,59 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XH264_STREAM_TO_WEB_HPP
+#define XH264_STREAM_TO_WEB_HPP
+
+#include <string>
+#include <memory>
+#include <functional>
+
+#include "XInterfaces.hpp"
+#include "IVideoSourceListener.hpp"
+#include "XWebServer.hpp"
+
+namespace Private
+{
+    class XH264StreamToWebData;
+}
+
+// Streams H.264 video (chunks of Annex-B byte stream provided as XPixelFormat::H264 images) to web clients
+class XH264StreamToWeb : private Uncopyable
+{
+public:
+    XH264StreamToWeb( );
+    ~XH264StreamToWeb( );
+
+    // Get video source listener, which could be fed to H.264 video source
+    IVideoSourceListener* VideoSourceListener( ) const;
+
+    // Create web request handler to provide raw H.264 stream (Annex-B) - each client
+    // starts receiving it from the next key frame
+    std::shared_ptr<IWebRequestHandler> CreateH264Handler( const std::string& uri ) const;
+
+    // Set handler, which is called while clients receive the stream, so video source could be
+    // kept active. The flag tells if some client waits for a key frame to start its stream.
+    void SetStreamRequestHandler( const std::function<void( bool needKeyFrame )>& handler );
+
+private:
+    Private::XH264StreamToWebData* mData;
+};
+
+#endif // XH264_STREAM_TO_WEB_HPP
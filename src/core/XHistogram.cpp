@@ -0,0 +1,135 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "XHistogram.hpp"
+
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+namespace Private
+{
+    class XHistogramData
+    {
+    public:
+        vector<uint64_t>               Bounds;
+        unique_ptr<atomic<uint64_t>[]> Counts;
+        atomic<uint64_t>               Count;
+        atomic<uint64_t>               Sum;
+
+    public:
+        XHistogramData( const vector<uint64_t>& bounds ) :
+            Bounds( bounds ), Counts( new atomic<uint64_t>[bounds.size( ) + 1] ), Count( 0 ), Sum( 0 )
+        {
+            for ( size_t i = 0; i <= Bounds.size( ); i++ )
+            {
+                Counts[i] = 0;
+            }
+        }
+    };
+}
+
+XHistogram::XHistogram( const vector<uint64_t>& bounds ) :
+    mData( new Private::XHistogramData( bounds ) )
+{
+}
+
+XHistogram::~XHistogram( )
+{
+    delete mData;
+}
+
+// Count the specified value
+void XHistogram::Add( uint64_t value )
+{
+    size_t bucket = 0;
+
+    while ( ( bucket < mData->Bounds.size( ) ) && ( value > mData->Bounds[bucket] ) )
+    {
+        bucket++;
+    }
+
+    mData->Counts[bucket]++;
+    mData->Count++;
+    mData->Sum += value;
+}
+
+// Get upper bounds of the buckets
+vector<uint64_t> XHistogram::Bounds( ) const
+{
+    return mData->Bounds;
+}
+
+// Get number of values in each bucket
+vector<uint64_t> XHistogram::Counts( ) const
+{
+    vector<uint64_t> counts( mData->Bounds.size( ) + 1 );
+
+    for ( size_t i = 0; i < counts.size( ); i++ )
+    {
+        counts[i] = mData->Counts[i];
+    }
+
+    return counts;
+}
+
+// Get number of all counted values and their sum
+uint64_t XHistogram::Count( ) const
+{
+    return mData->Count;
+}
+uint64_t XHistogram::Sum( ) const
+{
+    return mData->Sum;
+}
+
+// Put the histogram into the property map using Prometheus text format
+void XHistogram::ToPrometheus( PropertyMap& properties, const string& name, const string& labels, double scale ) const
+{
+    vector<uint64_t> counts     = Counts( );
+    string           labelsList = ( labels.empty( ) ) ? string( ) : labels + ",";
+    uint64_t         cumulative = 0;
+    char             buffer[64];
+
+    for ( size_t i = 0; i < counts.size( ); i++ )
+    {
+        cumulative += counts[i];
+
+        if ( i < mData->Bounds.size( ) )
+        {
+            sprintf( buffer, "%g", static_cast<double>( mData->Bounds[i] ) / scale );
+        }
+        else
+        {
+            strcpy( buffer, "+Inf" );
+        }
+
+        properties[name + "_bucket{" + labelsList + "le=\"" + buffer + "\"}"] = to_string( cumulative );
+    }
+
+    sprintf( buffer, "%g", static_cast<double>( Sum( ) ) / scale );
+
+    properties[( labels.empty( ) ) ? name + "_sum" : name + "_sum{" + labels + "}"] = buffer;
+    // buckets may be updated while we are reading them, so report count matching the buckets
+    properties[( labels.empty( ) ) ? name + "_count" : name + "_count{" + labels + "}"] = to_string( cumulative );
+}
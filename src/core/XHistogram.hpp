@@ -0,0 +1,65 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XHISTOGRAM_HPP
+#define XHISTOGRAM_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "XInterfaces.hpp"
+#include "IObjectInformation.hpp"
+
+namespace Private
+{
+    class XHistogramData;
+}
+
+// Histogram of values, which can be updated and read from any thread without locking
+class XHistogram : private Uncopyable
+{
+public:
+    // Create histogram with the specified upper bounds (inclusive, ascending) of its buckets;
+    // one more bucket is added for all values above the last bound
+    XHistogram( const std::vector<uint64_t>& bounds );
+    ~XHistogram( );
+
+    // Count the specified value
+    void Add( uint64_t value );
+
+    // Get upper bounds of the buckets
+    std::vector<uint64_t> Bounds( ) const;
+    // Get number of values in each bucket (not cumulative)
+    std::vector<uint64_t> Counts( ) const;
+    // Get number of all counted values and their sum
+    uint64_t Count( ) const;
+    uint64_t Sum( ) const;
+
+    // Put the histogram into the property map using Prometheus text format - cumulative name_bucket{le="..."}
+    // values, name_sum and name_count. Bounds and the sum are divided by the specified scale (to report
+    // microseconds as seconds, for example), while labels are added (if not empty) to every property.
+    void ToPrometheus( PropertyMap& properties, const std::string& name, const std::string& labels, double scale = 1.0 ) const;
+
+private:
+    Private::XHistogramData* mData;
+};
+
+#endif // XHISTOGRAM_HPP
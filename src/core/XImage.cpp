@@ -18,9 +18,14 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <stdlib.h>
 #include <string.h>
 #include <new>
 
+#ifdef WIN32
+    #include <malloc.h>
+#endif
+
 #include "XImage.hpp"
 
 using namespace std;
@@ -28,18 +33,55 @@ using namespace std;
 // Returns number of bits required for pixel in certain format
 uint32_t XImageBitsPerPixel( XPixelFormat format )
 {
-    static int sizes[]     = { 0, 8, 24, 32, 8 };
+    static int sizes[]     = { 0, 8, 24, 32, 8, 8, 8 };
     int        formatIndex = static_cast<int>( format );
 
     return ( formatIndex >= ( sizeof( sizes ) / sizeof( sizes[0] ) ) ) ? 0 : sizes[formatIndex];
 }
 
+// Checks if the format is compressed, so image's width is the size of its data
+static bool XImageIsCompressed( XPixelFormat format )
+{
+    return ( ( format == XPixelFormat::JPEG ) || ( format == XPixelFormat::H264 ) );
+}
+
+// Allocate/free image data aligned to XImageDataAlignment
+static uint8_t* XImageAllocateData( size_t size )
+{
+    void* data = nullptr;
+
+#ifdef WIN32
+    data = _aligned_malloc( size, XImageDataAlignment );
+#else
+    if ( posix_memalign( &data, XImageDataAlignment, size ) != 0 )
+    {
+        data = nullptr;
+    }
+#endif
+
+    return static_cast<uint8_t*>( data );
+}
+static void XImageFreeData( uint8_t* data )
+{
+#ifdef WIN32
+    _aligned_free( data );
+#else
+    free( data );
+#endif
+}
+
 // Returns number of bytes per stride when number of bits per line is known (stride is always 32 bit aligned)
 static uint32_t XImageBytesPerStride( uint32_t bitsPerLine )
 {
     return ( ( bitsPerLine + 31 ) & ~31 ) >> 3;
 }
 
+// Returns number of luma rows allocated for YUV420 image of the specified height (padded to full MCU rows)
+static int32_t XImageYUV420PaddedHeight( int32_t height )
+{
+    return ( height + 15 ) & ~15;
+}
+
 // Returns number of bytes per line when number of bits per line is known (line is always 8 bit aligned)
 static uint32_t XImageBytesPerLine( uint32_t bitsPerLine )
 {
@@ -48,7 +90,8 @@ static uint32_t XImageBytesPerLine( uint32_t bitsPerLine )
 
 // Create empty image
 XImage::XImage( uint8_t* data, int32_t width, int32_t height, int32_t stride, XPixelFormat format, bool ownMemory ) :
-    mData( data ), mWidth( width ), mHeight( height ), mStride( stride ), mFormat( format ), mOwnMemory( ownMemory )
+    mData( data ), mWidth( width ), mHeight( height ), mStride( stride ), mFormat( format ), mOwnMemory( ownMemory ),
+    mReleaseHandler( )
 {
 }
 
@@ -57,7 +100,12 @@ XImage::~XImage( )
 {
     if ( ( mOwnMemory ) && ( mData != nullptr ) )
     {
-        free( mData );
+        XImageFreeData( mData );
+    }
+
+    if ( mReleaseHandler )
+    {
+        mReleaseHandler( );
     }
 }
 
@@ -65,21 +113,32 @@ XImage::~XImage( )
 shared_ptr<XImage> XImage::Allocate( int32_t width, int32_t height, XPixelFormat format, bool zeroInitialize )
 {
     int32_t  stride = (int32_t) XImageBytesPerStride( width * XImageBitsPerPixel( format ) );
+    size_t   size   = height * stride;
     XImage*  image  = nullptr;
     uint8_t* data   = nullptr;
 
-    if ( zeroInitialize )
-    {
-        data = (uint8_t*) calloc( 1, height * stride );
-    }
-    else
+    if ( format == XPixelFormat::YUV420 )
     {
-        data = (uint8_t*) malloc( height * stride );
+        // keep stride of chroma planes 16 bytes aligned, same as camera does
+        stride = ( width + 31 ) & ~31;
+        size   = XImageYUV420PaddedHeight( height ) * stride * 3 / 2;
     }
 
+    data = XImageAllocateData( size );
+
     if ( data != nullptr )
     {
+        if ( zeroInitialize )
+        {
+            memset( data, 0, size );
+        }
+
         image = new (nothrow) XImage( data, width, height, stride, format, true );
+
+        if ( image == nullptr )
+        {
+            XImageFreeData( data );
+        }
     }
 
     return shared_ptr<XImage>( image );
@@ -91,6 +150,20 @@ shared_ptr<XImage> XImage::Create( uint8_t* data, int32_t width, int32_t height,
     return shared_ptr<XImage>( new (nothrow) XImage( data, width, height, stride, format, false ) );
 }
 
+// Create image by wrapping existing memory buffer, which stays valid until the release handler is called on image destruction
+shared_ptr<XImage> XImage::Create( uint8_t* data, int32_t width, int32_t height, int32_t stride, XPixelFormat format,
+                                   const function<void( )>& releaseHandler )
+{
+    XImage* image = new (nothrow) XImage( data, width, height, stride, format, false );
+
+    if ( image != nullptr )
+    {
+        image->mReleaseHandler = releaseHandler;
+    }
+
+    return shared_ptr<XImage>( image );
+}
+
 // Clone image - make a deep copy of it
 shared_ptr<XImage> XImage::Clone( ) const
 {
@@ -121,29 +194,39 @@ XError XImage::CopyData( const shared_ptr<XImage>& copyTo ) const
     {
         ret = XError::NullPointer;
     }
-    // for JPEGs we just make sure there is enough space to copy the image data,
+    // for JPEGs (compressed) we just make sure there is enough space to copy the image data,
     // but for all uncompressed formats we check for exact match of width/height
     else if ( ( mHeight != copyTo->mHeight ) || ( mFormat != copyTo->mFormat ) )
     {
         ret = XError::ImageParametersMismatch;
     }
-    else if  ( ( ( mFormat != XPixelFormat::JPEG ) && ( mWidth != copyTo->mWidth ) ) ||
-               ( ( mFormat == XPixelFormat::JPEG ) && ( mStride > copyTo->mStride ) ) )
+    else if  ( ( ( !XImageIsCompressed( mFormat ) ) && ( mWidth != copyTo->mWidth ) ) ||
+               ( ( XImageIsCompressed( mFormat ) ) && ( mStride > copyTo->mStride ) ) )
     {
         ret = XError::ImageParametersMismatch;
     }
     else
     {
-        uint32_t lineSize  = XImageBytesPerLine( mWidth * XImageBitsPerPixel( mFormat ) );
-        uint8_t* srcPtr    = mData;
-        uint8_t* dstPtr    = copyTo->mData;
-        int32_t  dstStride = copyTo->mStride;
-
-        for ( int y = 0; y < mHeight; y++ )
+        for ( int32_t plane = 0; plane < PlanesCount( ); plane++ )
         {
-            memcpy( dstPtr, srcPtr, lineSize );
-            srcPtr += mStride;
-            dstPtr += dstStride;
+            uint32_t lineSize    = XImageBytesPerLine( mWidth * XImageBitsPerPixel( mFormat ) );
+            uint8_t* srcPtr      = PlaneData( plane );
+            uint8_t* dstPtr      = copyTo->PlaneData( plane );
+            int32_t  srcStride   = PlaneStride( plane );
+            int32_t  dstStride   = copyTo->PlaneStride( plane );
+            int32_t  planeHeight = PlaneHeight( plane );
+
+            if ( plane != 0 )
+            {
+                lineSize = ( mWidth + 1 ) / 2;
+            }
+
+            for ( int y = 0; y < planeHeight; y++ )
+            {
+                memcpy( dstPtr, srcPtr, lineSize );
+                srcPtr += srcStride;
+                dstPtr += dstStride;
+            }
         }
     }
 
@@ -158,8 +241,8 @@ XError XImage::CopyDataOrClone( std::shared_ptr<XImage>& copyTo ) const
     if ( ( !copyTo ) ||
          ( copyTo->Height( ) != mHeight ) ||
          ( copyTo->Format( ) != mFormat ) ||
-         ( ( mFormat != XPixelFormat::JPEG ) && ( copyTo->Width( ) != mWidth ) ) ||
-         ( ( mFormat == XPixelFormat::JPEG ) && ( copyTo->Stride( ) < mStride ) )
+         ( ( !XImageIsCompressed( mFormat ) ) && ( copyTo->Width( ) != mWidth ) ) ||
+         ( ( XImageIsCompressed( mFormat ) ) && ( copyTo->Stride( ) < mStride ) )
        )
     {
         copyTo = Clone( );
@@ -175,3 +258,72 @@ XError XImage::CopyDataOrClone( std::shared_ptr<XImage>& copyTo ) const
 
     return ret;
 }
+
+// Set size of compressed image's data
+XError XImage::SetCompressedSize( int32_t size )
+{
+    XError ret = XError::Success;
+
+    if ( !XImageIsCompressed( mFormat ) )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else if ( ( size < 0 ) || ( size > mStride ) )
+    {
+        ret = XError::ImageParametersMismatch;
+    }
+    else
+    {
+        mWidth = size;
+    }
+
+    return ret;
+}
+
+// Check if the format is compressed
+bool XImage::IsCompressedFormat( XPixelFormat format )
+{
+    return XImageIsCompressed( format );
+}
+
+// Number of planes of the image
+int32_t XImage::PlanesCount( ) const
+{
+    return ( mFormat == XPixelFormat::YUV420 ) ? 3 : 1;
+}
+
+// Data of the specified plane (nullptr if there is no such plane)
+uint8_t* XImage::PlaneData( int32_t plane ) const
+{
+    uint8_t* data = nullptr;
+
+    if ( ( mData != nullptr ) && ( plane >= 0 ) && ( plane < PlanesCount( ) ) )
+    {
+        int32_t lumaSize = mStride * XImageYUV420PaddedHeight( mHeight );
+
+        data = mData;
+
+        if ( plane == 1 )
+        {
+            data += lumaSize;
+        }
+        else if ( plane == 2 )
+        {
+            data += lumaSize + lumaSize / 4;
+        }
+    }
+
+    return data;
+}
+
+// Stride of the specified plane
+int32_t XImage::PlaneStride( int32_t plane ) const
+{
+    return ( plane == 0 ) ? mStride : ( ( mFormat == XPixelFormat::YUV420 ) ? mStride / 2 : 0 );
+}
+
+// Height of the specified plane
+int32_t XImage::PlaneHeight( int32_t plane ) const
+{
+    return ( plane == 0 ) ? mHeight : ( ( mFormat == XPixelFormat::YUV420 ) ? ( mHeight + 1 ) / 2 : 0 );
+}
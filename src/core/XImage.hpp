@@ -22,6 +22,7 @@
 #define XIMAGE_HPP
 
 #include <memory>
+#include <functional>
 
 #include "XInterfaces.hpp"
 #include "XError.hpp"
@@ -32,8 +33,13 @@ enum class XPixelFormat
     Grayscale8,
     RGB24,
     RGBA32,
+    // Planar YUV 4:2:0 (I420) - Y plane followed by U and V planes of half the width/height.
+    // Rows of each plane are padded to the multiple of 16 luma rows, which matches the layout
+    // of camera buffers and lets JPEG encoder take whole MCU rows without copying.
+    YUV420,
 
     JPEG,
+    H264,
     // Enough for this project
 };
 
@@ -44,6 +50,9 @@ enum
     BlueIndex  = 2
 };
 
+// Alignment of allocated image data - enough for cache lines and NEON/SSE loads
+#define XImageDataAlignment (64)
+
 // Class encapsulating image data
 class XImage : private Uncopyable
 {
@@ -53,10 +62,13 @@ private:
 public:
     ~XImage( );
 
-    // Allocate image of the specified size and format
+    // Allocate image of the specified size and format (data are aligned to XImageDataAlignment)
     static std::shared_ptr<XImage> Allocate( int32_t width, int32_t height, XPixelFormat format, bool zeroInitialize = false );
     // Create image by wrapping existing memory buffer
     static std::shared_ptr<XImage> Create( uint8_t* data, int32_t width, int32_t height, int32_t stride, XPixelFormat format );
+    // Create image by wrapping existing memory buffer, which stays valid until the release handler is called on image destruction
+    static std::shared_ptr<XImage> Create( uint8_t* data, int32_t width, int32_t height, int32_t stride, XPixelFormat format,
+                                           const std::function<void( )>& releaseHandler );
 
     // Clone image - make a deep copy of it
     std::shared_ptr<XImage> Clone( ) const;
@@ -73,6 +85,26 @@ public:
     // Raw data of the image
     uint8_t* Data( )       const { return mData;   }
 
+    // Number of planes of the image (3 for YUV420, 1 for all other formats) and their
+    // data/stride/height (0 - Y, 1 - U, 2 - V). Plane height does not include padding rows.
+    int32_t  PlanesCount( ) const;
+    uint8_t* PlaneData( int32_t plane ) const;
+    int32_t  PlaneStride( int32_t plane ) const;
+    int32_t  PlaneHeight( int32_t plane ) const;
+
+    // Set size of compressed image's data, which must fit into its buffer (stride)
+    XError SetCompressedSize( int32_t size );
+
+    // Check if the format is compressed, so image's width is the size of its data
+    static bool IsCompressedFormat( XPixelFormat format );
+
+    // Check if image data stay valid for the life time of the image, i.e. it is not
+    // just a wrapper around somebody's buffer, so a reference to it can be kept
+    bool OwnsData( )       const { return ( ( mOwnMemory ) || ( mReleaseHandler ) ); }
+    // Check if image data is a buffer borrowed from somebody (video source, etc), which gets it back only
+    // when the image is destroyed - references to such images should not be kept for long
+    bool HoldsExternalBuffer( ) const { return static_cast<bool>( mReleaseHandler ); }
+
 private:
     uint8_t*     mData;
     int32_t      mWidth;
@@ -80,6 +112,8 @@ private:
     int32_t      mStride;
     XPixelFormat mFormat;
     bool         mOwnMemory;
+
+    std::function<void( )> mReleaseHandler;
 };
 
 #endif // XIMAGE_HPP
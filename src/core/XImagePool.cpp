@@ -0,0 +1,130 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <mutex>
+#include <list>
+
+#include "XImagePool.hpp"
+
+using namespace std;
+
+namespace Private
+{
+    class XImagePoolData
+    {
+    public:
+        mutable mutex                 Sync;
+        // all allocated images - those referred only from here are free to reuse
+        list<shared_ptr<XImage>>      Images;
+
+    public:
+        XImagePoolData( ) : Sync( ), Images( ) { }
+
+        static bool IsFree( const shared_ptr<XImage>& image )
+        {
+            return ( image.use_count( ) == 1 );
+        }
+    };
+}
+
+XImagePool::XImagePool( ) :
+    mData( new Private::XImagePoolData( ) )
+{
+}
+
+XImagePool::~XImagePool( )
+{
+    // images still in use stay alive until their users release them
+    delete mData;
+}
+
+// Get image of the specified size and format
+shared_ptr<XImage> XImagePool::Acquire( int32_t width, int32_t height, XPixelFormat format )
+{
+    lock_guard<mutex>  lock( mData->Sync );
+    bool               compressed = XImage::IsCompressedFormat( format );
+    shared_ptr<XImage> image;
+
+    for ( const shared_ptr<XImage>& pooledImage : mData->Images )
+    {
+        if ( ( Private::XImagePoolData::IsFree( pooledImage ) ) &&
+             ( pooledImage->Format( ) == format ) && ( pooledImage->Height( ) == height ) &&
+             ( ( ( !compressed ) && ( pooledImage->Width( ) == width ) ) ||
+               ( (  compressed ) && ( pooledImage->Stride( ) >= width ) ) ) )
+        {
+            image = pooledImage;
+            break;
+        }
+    }
+
+    if ( !image )
+    {
+        // free images, which did not fit, are unlikely to be needed again (size/format changed)
+        mData->Images.remove_if( Private::XImagePoolData::IsFree );
+
+        // leave some space for compressed images, which usually vary in size a bit
+        image = XImage::Allocate( ( compressed ) ? width + width / 10 : width, height, format );
+
+        if ( image )
+        {
+            mData->Images.push_back( image );
+        }
+    }
+
+    if ( ( image ) && ( compressed ) )
+    {
+        image->SetCompressedSize( width );
+    }
+
+    return image;
+}
+
+// Number of images allocated by the pool
+uint32_t XImagePool::ImagesCount( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return static_cast<uint32_t>( mData->Images.size( ) );
+}
+
+// Number of images allocated by the pool, which are in use now
+uint32_t XImagePool::ImagesInUse( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    uint32_t          count = 0;
+
+    for ( const shared_ptr<XImage>& image : mData->Images )
+    {
+        if ( !Private::XImagePoolData::IsFree( image ) )
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// Release all images, which are not in use
+void XImagePool::Trim( )
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    mData->Images.remove_if( Private::XImagePoolData::IsFree );
+}
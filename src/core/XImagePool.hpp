@@ -0,0 +1,59 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XIMAGE_POOL_HPP
+#define XIMAGE_POOL_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XImage.hpp"
+
+namespace Private
+{
+    class XImagePoolData;
+}
+
+// Pool of images to reuse instead of allocating new ones for every frame. Images handed out
+// by the pool go back to it once all references to them are released. Free images of
+// different size/format are dropped when a new image has to be allocated, so memory used
+// by the pool stays at the number of images in use at the same time.
+class XImagePool : private Uncopyable
+{
+public:
+    XImagePool( );
+    ~XImagePool( );
+
+    // Get image of the specified size and format - a free one from the pool or a newly allocated.
+    // For compressed formats (width is the size of data) any free image with enough space is taken.
+    std::shared_ptr<XImage> Acquire( int32_t width, int32_t height, XPixelFormat format );
+
+    // Number of images allocated by the pool and how many of them are in use now
+    uint32_t ImagesCount( ) const;
+    uint32_t ImagesInUse( ) const;
+
+    // Release all images, which are not in use
+    void Trim( );
+
+private:
+    Private::XImagePoolData* mData;
+};
+
+#endif // XIMAGE_POOL_HPP
@@ -21,12 +21,26 @@
 #include "XJpegEncoder.hpp"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <jpeglib.h>
 
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 using namespace std;
 
 namespace Private
 {
+    // Maximum number of threads to encode strips of an image
+    #define MAX_ENCODER_THREADS    (16)
+    // Minimum number of MCU rows in a strip - smaller images are not worth splitting
+    #define MIN_STRIP_MCU_ROWS     (4)
+    // Initial size of buffers strips are compressed into
+    #define STRIP_BUFFER_SIZE      (64 * 1024)
+
     class JpegException : public exception
     {
     public:
@@ -46,38 +60,184 @@ namespace Private
         // do nothing - kill the message
     }
 
+    // Destination manager writing compressed image into caller's buffer, which is
+    // re-allocated (grown twice) if it is too small
+    struct MemoryDestination
+    {
+        struct jpeg_destination_mgr pub;
+        uint8_t*                    Buffer;
+        size_t                      BufferSize;
+    };
+
+    static void my_init_destination( j_compress_ptr cinfo )
+    {
+        MemoryDestination* dest = reinterpret_cast<MemoryDestination*>( cinfo->dest );
+
+        dest->pub.next_output_byte = dest->Buffer;
+        dest->pub.free_in_buffer   = dest->BufferSize;
+    }
+
+    static boolean my_empty_output_buffer( j_compress_ptr cinfo )
+    {
+        MemoryDestination* dest      = reinterpret_cast<MemoryDestination*>( cinfo->dest );
+        size_t             newSize   = dest->BufferSize * 2;
+        uint8_t*           newBuffer = static_cast<uint8_t*>( realloc( dest->Buffer, newSize ) );
+
+        if ( newBuffer == nullptr )
+        {
+            throw JpegException( );
+        }
+
+        // the whole buffer is full when libjpeg asks to empty it
+        dest->pub.next_output_byte = newBuffer + dest->BufferSize;
+        dest->pub.free_in_buffer   = newSize - dest->BufferSize;
+        dest->Buffer               = newBuffer;
+        dest->BufferSize           = newSize;
+
+        return TRUE;
+    }
+
+    static void my_term_destination( j_compress_ptr /* cinfo */ )
+    {
+        // nothing to flush - data are already in the buffer
+    }
+
+    // Height/width of MCU for images of the specified format (as set by libjpeg defaults)
+    static int32_t McuSize( XPixelFormat format )
+    {
+        return ( format == XPixelFormat::Grayscale8 ) ? 8 : 16;
+    }
+
+    // Wrapper around libjpeg's compressor, which encodes the whole image or a strip of its rows
+    class JpegCompressor : private Uncopyable
+    {
+    private:
+        struct jpeg_compress_struct cinfo;
+        struct jpeg_error_mgr       jerr;
+        MemoryDestination           dest;
+
+        // parameters compressor is configured for - those are kept between images,
+        // so it is set up again only when any of them changes
+        bool                        Configured;
+        int32_t                     ConfiguredWidth;
+        int32_t                     ConfiguredHeight;
+        XPixelFormat                ConfiguredFormat;
+        uint16_t                    ConfiguredQuality;
+        bool                        ConfiguredFasterCompression;
+
+    public:
+        JpegCompressor( ) :
+            Configured( false ), ConfiguredWidth( 0 ), ConfiguredHeight( 0 ), ConfiguredFormat( XPixelFormat::Unknown ),
+            ConfiguredQuality( 0 ), ConfiguredFasterCompression( false )
+        {
+            // allocate and initialize JPEG compression object
+            cinfo.err           = jpeg_std_error( &jerr );
+            jerr.error_exit     = my_error_exit;
+            jerr.output_message = my_output_message;
+
+            jpeg_create_compress( &cinfo );
+
+            dest.pub.init_destination    = my_init_destination;
+            dest.pub.empty_output_buffer = my_empty_output_buffer;
+            dest.pub.term_destination    = my_term_destination;
+            dest.Buffer                  = nullptr;
+            dest.BufferSize              = 0;
+
+            cinfo.dest = &dest.pub;
+        }
+
+        ~JpegCompressor( )
+        {
+            jpeg_destroy_compress( &cinfo );
+        }
+
+        // Compress the specified number of image's rows starting from the given one as a complete JPEG image
+        XError Compress( const shared_ptr<const XImage>& image, int32_t firstRow, int32_t rowsCount,
+                         uint16_t quality, bool fasterCompression, uint8_t** buffer, uint32_t* bufferSize );
+
+    private:
+        void Configure( XPixelFormat format, int32_t width, int32_t height, uint16_t quality, bool fasterCompression );
+        void WriteScanlines( const shared_ptr<const XImage>& image, int32_t firstRow );
+        void WriteRawData( const shared_ptr<const XImage>& image, int32_t firstRow );
+    };
+
+    // Strip of an image compressed by one of the encoder's threads
+    class JpegStrip : private Uncopyable
+    {
+    public:
+        JpegCompressor Compressor;
+        uint8_t*       Buffer;
+        uint32_t       BufferSize;
+        uint32_t       Size;
+        XError         Error;
+
+    public:
+        JpegStrip( ) :
+            Compressor( ), Buffer( static_cast<uint8_t*>( malloc( STRIP_BUFFER_SIZE ) ) ),
+            BufferSize( ( Buffer != nullptr ) ? STRIP_BUFFER_SIZE : 0 ), Size( 0 ), Error( XError::Success )
+        {
+        }
+
+        ~JpegStrip( )
+        {
+            free( Buffer );
+        }
+    };
+
     class XJpegEncoderData
     {
     public:
         uint16_t                    Quality;
         bool                        FasterCompression;
+        uint32_t                    ThreadsCount;
     private:
-        struct jpeg_compress_struct cinfo;
-        struct jpeg_error_mgr       jerr;
+        // encoding and changing number of threads don't run at the same time
+        mutex                       Sync;
+        // the first strip is compressed by the calling thread (and is the only one if no threads are used)
+        vector<unique_ptr<JpegStrip>> Strips;
+        vector<thread>              Workers;
+
+        // image being encoded by strips, their height and compression settings
+        mutex                       JobSync;
+        condition_variable          JobAvailable;
+        condition_variable          JobDone;
+        shared_ptr<const XImage>    JobImage;
+        int32_t                     JobStripHeight;
+        uint16_t                    JobQuality;
+        bool                        JobFasterCompression;
+        uint32_t                    JobCounter;
+        uint32_t                    PendingStrips;
+        bool                        NeedToStop;
 
     public:
         XJpegEncoderData( uint16_t quality, bool fasterCompression) :
-            Quality( quality ), FasterCompression( fasterCompression  )
+            Quality( quality ), FasterCompression( fasterCompression  ), ThreadsCount( 1 ),
+            Sync( ), Strips( ), Workers( ), JobSync( ), JobAvailable( ), JobDone( ), JobImage( ),
+            JobStripHeight( 0 ), JobQuality( 0 ), JobFasterCompression( false ), JobCounter( 0 ), PendingStrips( 0 ), NeedToStop( false )
         {
             if ( Quality > 100 )
             {
                 Quality = 100;
             }
 
-            // allocate and initialize JPEG compression object
-            cinfo.err           = jpeg_std_error( &jerr );
-            jerr.error_exit     = my_error_exit;
-            jerr.output_message = my_output_message;
-
-            jpeg_create_compress( &cinfo );
+            Strips.push_back( unique_ptr<JpegStrip>( new JpegStrip( ) ) );
         }
 
         ~XJpegEncoderData( )
         {
-            jpeg_destroy_compress( &cinfo );
+            StopWorkers( );
         }
 
+        void SetThreadsCount( uint32_t count );
         XError EncodeToMemory( const shared_ptr<const XImage>& image, uint8_t** buffer, uint32_t* bufferSize );
+
+    private:
+        void StopWorkers( );
+        XError EncodeStrips( const shared_ptr<const XImage>& image, int32_t stripHeight, uint8_t** buffer, uint32_t* bufferSize );
+        void EncodeStrip( uint32_t index );
+        XError JoinStrips( uint32_t stripsCount, uint32_t restartInterval, int32_t imageHeight, uint8_t** buffer, uint32_t* bufferSize );
+
+        static void WorkerThreadHandler( XJpegEncoderData* me, uint32_t index, uint32_t lastJob );
     };
 }
 
@@ -114,6 +274,16 @@ void XJpegEncoder::SetFasterCompression( bool faster )
     mData->FasterCompression = faster;
 }
 
+// Set/get number of threads to encode strips of an image in parallel
+uint32_t XJpegEncoder::ThreadsCount( ) const
+{
+    return mData->ThreadsCount;
+}
+void XJpegEncoder::SetThreadsCount( uint32_t count )
+{
+    mData->SetThreadsCount( count );
+}
+
 // Compress the specified image into provided buffer
 XError XJpegEncoder::EncodeToMemory( const shared_ptr<const XImage>& image, uint8_t** buffer, uint32_t* bufferSize )
 {
@@ -123,73 +293,514 @@ XError XJpegEncoder::EncodeToMemory( const shared_ptr<const XImage>& image, uint
 namespace Private
 {
 
+// Set number of threads to encode images, re-creating worker threads
+void XJpegEncoderData::SetThreadsCount( uint32_t count )
+{
+    lock_guard<mutex> lock( Sync );
+
+    if ( count < 1 )
+    {
+        count = 1;
+    }
+    if ( count > MAX_ENCODER_THREADS )
+    {
+        count = MAX_ENCODER_THREADS;
+    }
+
+    if ( count != ThreadsCount )
+    {
+        StopWorkers( );
+
+        ThreadsCount = count;
+        NeedToStop   = false;
+
+        while ( Strips.size( ) < ThreadsCount )
+        {
+            Strips.push_back( unique_ptr<JpegStrip>( new JpegStrip( ) ) );
+        }
+        Strips.resize( ThreadsCount );
+
+        for ( uint32_t i = 1; i < ThreadsCount; i++ )
+        {
+            Workers.push_back( thread( WorkerThreadHandler, this, i, JobCounter ) );
+        }
+    }
+}
+
+// Stop all worker threads
+void XJpegEncoderData::StopWorkers( )
+{
+    {
+        lock_guard<mutex> lock( JobSync );
+        NeedToStop = true;
+    }
+    JobAvailable.notify_all( );
+
+    for ( auto& worker : Workers )
+    {
+        worker.join( );
+    }
+
+    Workers.clear( );
+}
+
+// Compress the specified image - as a whole or by strips on multiple threads
 XError XJpegEncoderData::EncodeToMemory( const shared_ptr<const XImage>& image, uint8_t** buffer, uint32_t* bufferSize )
 {
-    JSAMPROW    row_pointer[1];
-    XError      ret = XError::Success;
+    lock_guard<mutex> lock( Sync );
+    XError            ret = XError::Success;
 
     if ( ( !image ) || ( image->Data( ) == nullptr ) || ( buffer == nullptr ) || ( *buffer == nullptr ) || ( bufferSize == nullptr ) )
     {
         ret = XError::NullPointer;
     }
-    else if ( ( image->Format( ) != XPixelFormat::RGB24 ) && ( image->Format( ) != XPixelFormat::Grayscale8 ) )
+    else if ( ( image->Format( ) != XPixelFormat::RGB24 ) && ( image->Format( ) != XPixelFormat::Grayscale8 ) &&
+              ( image->Format( ) != XPixelFormat::YUV420 ) )
     {
         ret = XError::UnsupportedPixelFormat;
     }
+    // raw data input takes whole MCUs, so rows of YUV images must be padded to 16 pixels
+    else if ( ( image->Format( ) == XPixelFormat::YUV420 ) && ( image->Stride( ) < ( ( image->Width( ) + 15 ) & ~15 ) ) )
+    {
+        ret = XError::ImageParametersMismatch;
+    }
+    else
+    {
+        // split image into strips of whole MCU rows, one per thread, unless those get too small
+        int32_t  mcuSize     = McuSize( image->Format( ) );
+        uint32_t mcuRows     = ( image->Height( ) + mcuSize - 1 ) / mcuSize;
+        uint32_t stripsCount = ThreadsCount;
+
+        if ( mcuRows / MIN_STRIP_MCU_ROWS < stripsCount )
+        {
+            stripsCount = mcuRows / MIN_STRIP_MCU_ROWS;
+        }
+
+        if ( stripsCount < 2 )
+        {
+            ret = Strips[0]->Compressor.Compress( image, 0, image->Height( ), Quality, FasterCompression, buffer, bufferSize );
+        }
+        else
+        {
+            int32_t stripHeight = static_cast<int32_t>( ( mcuRows + stripsCount - 1 ) / stripsCount ) * mcuSize;
+
+            ret = EncodeStrips( image, stripHeight, buffer, bufferSize );
+        }
+    }
+
+    return ret;
+}
+
+// Compress strips of the image on worker threads (and the calling one) and join them into single JPEG
+XError XJpegEncoderData::EncodeStrips( const shared_ptr<const XImage>& image, int32_t stripHeight, uint8_t** buffer, uint32_t* bufferSize )
+{
+    int32_t  mcuSize         = McuSize( image->Format( ) );
+    uint32_t stripsCount     = static_cast<uint32_t>( ( image->Height( ) + stripHeight - 1 ) / stripHeight );
+    uint32_t restartInterval = static_cast<uint32_t>( ( image->Width( ) + mcuSize - 1 ) / mcuSize ) * ( stripHeight / mcuSize );
+    XError   ret             = XError::Success;
+
+    // restart interval is a 16 bit value in JPEG - fall back to compressing the whole image otherwise
+    if ( restartInterval > 0xFFFF )
+    {
+        ret = Strips[0]->Compressor.Compress( image, 0, image->Height( ), Quality, FasterCompression, buffer, bufferSize );
+    }
     else
     {
-        try
         {
-            // 1 - specify data destination
-            unsigned long mem_buffer_size = *bufferSize;
-            jpeg_mem_dest( &cinfo, buffer, &mem_buffer_size );
+            lock_guard<mutex> lock( JobSync );
+
+            JobImage             = image;
+            JobStripHeight       = stripHeight;
+            JobQuality           = Quality;
+            JobFasterCompression = FasterCompression;
+            PendingStrips        = ThreadsCount - 1;
+            JobCounter++;
+        }
+        JobAvailable.notify_all( );
+
+        EncodeStrip( 0 );
+
+        {
+            unique_lock<mutex> lock( JobSync );
+
+            JobDone.wait( lock, [this] { return ( PendingStrips == 0 ); } );
+            JobImage.reset( );
+        }
+
+        for ( uint32_t i = 0; ( i < stripsCount ) && ( ret == XError::Success ); i++ )
+        {
+            ret = Strips[i]->Error;
+        }
+
+        if ( ret == XError::Success )
+        {
+            ret = JoinStrips( stripsCount, restartInterval, image->Height( ), buffer, bufferSize );
+        }
+    }
+
+    return ret;
+}
+
+// Compress strip of the currently encoded image
+void XJpegEncoderData::EncodeStrip( uint32_t index )
+{
+    JpegStrip* strip    = Strips[index].get( );
+    int32_t    firstRow = JobStripHeight * static_cast<int32_t>( index );
+
+    if ( firstRow < JobImage->Height( ) )
+    {
+        int32_t rowsCount = JobImage->Height( ) - firstRow;
+
+        if ( rowsCount > JobStripHeight )
+        {
+            rowsCount = JobStripHeight;
+        }
+
+        if ( strip->Buffer == nullptr )
+        {
+            strip->Error = XError::OutOfMemory;
+        }
+        else
+        {
+            strip->Size  = strip->BufferSize;
+            strip->Error = strip->Compressor.Compress( JobImage, firstRow, rowsCount, JobQuality, JobFasterCompression,
+                                                       &strip->Buffer, &strip->Size );
 
-            // 2 - set parameters for compression
-            cinfo.image_width  = image->Width( );
-            cinfo.image_height = image->Height( );
+            if ( ( strip->Error == XError::Success ) && ( strip->Size > strip->BufferSize ) )
+            {
+                strip->BufferSize = strip->Size;
+            }
+        }
+    }
+}
 
-            if ( image->Format( ) == XPixelFormat::RGB24 )
+// Find where markers of the frame header and the entropy coded data of the scan start in compressed JPEG
+static bool FindScanData( const uint8_t* data, uint32_t size, uint32_t* sofOffset, uint32_t* sosOffset, uint32_t* scanOffset )
+{
+    uint32_t offset = 2;
+    bool     found  = false;
+    bool     failed = ( ( size < 4 ) || ( data[0] != 0xFF ) || ( data[1] != 0xD8 ) ||
+                        ( data[size - 2] != 0xFF ) || ( data[size - 1] != 0xD9 ) );
+
+    while ( ( !found ) && ( !failed ) )
+    {
+        if ( ( offset + 4 > size ) || ( data[offset] != 0xFF ) )
+        {
+            failed = true;
+        }
+        else
+        {
+            uint8_t  marker = data[offset + 1];
+            uint32_t length = ( static_cast<uint32_t>( data[offset + 2] ) << 8 ) | data[offset + 3];
+
+            if ( ( marker >= 0xC0 ) && ( marker <= 0xC2 ) )
             {
-                cinfo.input_components = 3;
-                cinfo.in_color_space   = JCS_RGB;
+                *sofOffset = offset;
             }
-            else
+            else if ( marker == 0xDA )
             {
-                cinfo.input_components = 1;
-                cinfo.in_color_space   = JCS_GRAYSCALE;
+                *sosOffset  = offset;
+                *scanOffset = offset + 2 + length;
+                found       = ( *scanOffset <= size - 2 );
+                failed      = !found;
             }
 
-            // set default compression parameters
-            jpeg_set_defaults( &cinfo );
-            // set quality
-            jpeg_set_quality( &cinfo, (int) Quality, TRUE /* limit to baseline-JPEG values */ );
+            offset += 2 + length;
+        }
+    }
+
+    return found;
+}
+
+// Join compressed strips into one JPEG - headers of the first strip (with complete image height and restart
+// interval set to strip's size) followed by entropy coded data of all strips separated by restart markers
+XError XJpegEncoderData::JoinStrips( uint32_t stripsCount, uint32_t restartInterval, int32_t imageHeight,
+                                     uint8_t** buffer, uint32_t* bufferSize )
+{
+    vector<uint32_t> scanOffsets( stripsCount );
+    uint32_t         sofOffset = 0;
+    uint32_t         sosOffset = 0;
+    uint32_t         totalSize = 0;
+    XError           ret       = XError::Success;
+
+    for ( uint32_t i = 0; ( i < stripsCount ) && ( ret == XError::Success ); i++ )
+    {
+        uint32_t stripSofOffset = 0;
+        uint32_t stripSosOffset = 0;
+
+        if ( !FindScanData( Strips[i]->Buffer, Strips[i]->Size, &stripSofOffset, &stripSosOffset, &scanOffsets[i] ) )
+        {
+            ret = XError::FailedImageEncoding;
+        }
+        else if ( i == 0 )
+        {
+            sofOffset = stripSofOffset;
+            sosOffset = stripSosOffset;
+            // headers + DRI marker + EOI
+            totalSize = scanOffsets[0] + 6 + 2;
+        }
+
+        // entropy coded data + RSTn marker (if not the last)
+        totalSize += Strips[i]->Size - scanOffsets[i] - 2 + ( ( i + 1 < stripsCount ) ? 2 : 0 );
+    }
+
+    if ( ( ret == XError::Success ) && ( sofOffset == 0 ) )
+    {
+        ret = XError::FailedImageEncoding;
+    }
+
+    if ( ( ret == XError::Success ) && ( totalSize > *bufferSize ) )
+    {
+        uint8_t* newBuffer = static_cast<uint8_t*>( realloc( *buffer, totalSize ) );
+
+        if ( newBuffer == nullptr )
+        {
+            ret = XError::OutOfMemory;
+        }
+        else
+        {
+            *buffer = newBuffer;
+        }
+    }
 
-            // use faster, but less accurate compressions
-            cinfo.dct_method = ( FasterCompression ) ? JDCT_FASTEST : JDCT_DEFAULT;
+    if ( ret == XError::Success )
+    {
+        const uint8_t* header = Strips[0]->Buffer;
+        uint8_t*       ptr    = *buffer;
+
+        // headers up to the start of scan, then DRI and SOS
+        memcpy( ptr, header, sosOffset );
+        ptr[sofOffset + 5] = static_cast<uint8_t>( imageHeight >> 8 );
+        ptr[sofOffset + 6] = static_cast<uint8_t>( imageHeight );
+        ptr += sosOffset;
+
+        ptr[0] = 0xFF;
+        ptr[1] = 0xDD;
+        ptr[2] = 0x00;
+        ptr[3] = 0x04;
+        ptr[4] = static_cast<uint8_t>( restartInterval >> 8 );
+        ptr[5] = static_cast<uint8_t>( restartInterval );
+        ptr += 6;
+
+        memcpy( ptr, header + sosOffset, scanOffsets[0] - sosOffset );
+        ptr += scanOffsets[0] - sosOffset;
+
+        for ( uint32_t i = 0; i < stripsCount; i++ )
+        {
+            uint32_t dataSize = Strips[i]->Size - scanOffsets[i] - 2;
 
-            // 3 - start compressor
-            jpeg_start_compress( &cinfo, TRUE );
+            memcpy( ptr, Strips[i]->Buffer + scanOffsets[i], dataSize );
+            ptr += dataSize;
 
-            // 4 - do compression
-            while ( cinfo.next_scanline < cinfo.image_height )
+            if ( i + 1 < stripsCount )
             {
-                row_pointer[0] = image->Data( ) + image->Stride( ) * cinfo.next_scanline;
+                ptr[0] = 0xFF;
+                ptr[1] = static_cast<uint8_t>( 0xD0 + ( i & 7 ) );
+                ptr += 2;
+            }
+        }
+
+        ptr[0] = 0xFF;
+        ptr[1] = 0xD9;
+
+        *bufferSize = totalSize;
+    }
+
+    return ret;
+}
+
+// Worker thread - compresses strip of the specified index for every new image (the last
+// job it has seen is given by the creator, so it does not miss the one posted before it runs)
+void XJpegEncoderData::WorkerThreadHandler( XJpegEncoderData* me, uint32_t index, uint32_t lastJob )
+{
+    bool run = true;
 
-                jpeg_write_scanlines( &cinfo, row_pointer, 1 );
+    while ( run )
+    {
+        {
+            unique_lock<mutex> lock( me->JobSync );
+
+            me->JobAvailable.wait( lock, [me, lastJob] { return ( me->NeedToStop ) || ( me->JobCounter != lastJob ); } );
+
+            run     = !me->NeedToStop;
+            lastJob = me->JobCounter;
+        }
+
+        if ( run )
+        {
+            me->EncodeStrip( index );
+
+            {
+                lock_guard<mutex> lock( me->JobSync );
+                me->PendingStrips--;
             }
+            me->JobDone.notify_one( );
+        }
+    }
+}
+
+// Compress the specified rows of the image
+XError JpegCompressor::Compress( const shared_ptr<const XImage>& image, int32_t firstRow, int32_t rowsCount,
+                                 uint16_t quality, bool fasterCompression, uint8_t** buffer, uint32_t* bufferSize )
+{
+    XError ret = XError::Success;
+
+    // 1 - specify data destination
+    dest.Buffer     = *buffer;
+    dest.BufferSize = ( *bufferSize != 0 ) ? *bufferSize : 1;
+
+    try
+    {
+        // 2 - set parameters for compression (if image or settings differ from the previous time)
+        Configure( image->Format( ), image->Width( ), rowsCount, quality, fasterCompression );
 
-            // 5 - finish compression
-            jpeg_finish_compress( &cinfo );
+        // 3 - start compressor
+        jpeg_start_compress( &cinfo, TRUE );
 
-            *bufferSize = (uint32_t) mem_buffer_size;
+        // 4 - do compression
+        if ( cinfo.raw_data_in )
+        {
+            WriteRawData( image, firstRow );
         }
-        catch ( const JpegException& )
+        else
         {
-            ret = XError::FailedImageEncoding;
+            WriteScanlines( image, firstRow );
         }
+
+        // 5 - finish compression
+        jpeg_finish_compress( &cinfo );
+
+        *bufferSize = static_cast<uint32_t>( dest.BufferSize - dest.pub.free_in_buffer );
     }
+    catch ( const JpegException& )
+    {
+        // get compressor back to idle state and make sure it is configured again next time
+        jpeg_abort_compress( &cinfo );
+        Configured = false;
+
+        ret = XError::FailedImageEncoding;
+    }
+
+    // buffer may have been re-allocated even if compression failed later
+    *buffer = dest.Buffer;
 
     return ret;
 }
 
+// Set compression parameters for the specified image, unless those are already set
+void JpegCompressor::Configure( XPixelFormat format, int32_t width, int32_t height, uint16_t quality, bool fasterCompression )
+{
+    if ( ( !Configured ) ||
+         ( ConfiguredWidth   != width )   || ( ConfiguredHeight  != height ) ||
+         ( ConfiguredFormat  != format )  || ( ConfiguredQuality != quality ) ||
+         ( ConfiguredFasterCompression != fasterCompression ) )
+    {
+        cinfo.image_width  = width;
+        cinfo.image_height = height;
+
+        if ( format == XPixelFormat::RGB24 )
+        {
+            cinfo.input_components = 3;
+            cinfo.in_color_space   = JCS_RGB;
+        }
+        else if ( format == XPixelFormat::YUV420 )
+        {
+            cinfo.input_components = 3;
+            cinfo.in_color_space   = JCS_YCbCr;
+        }
+        else
+        {
+            cinfo.input_components = 1;
+            cinfo.in_color_space   = JCS_GRAYSCALE;
+        }
+
+        // set default compression parameters
+        jpeg_set_defaults( &cinfo );
+        // set quality
+        jpeg_set_quality( &cinfo, (int) quality, TRUE /* limit to baseline-JPEG values */ );
+
+        // use faster, but less accurate compressions
+        cinfo.dct_method = ( fasterCompression ) ? JDCT_FASTEST : JDCT_DEFAULT;
+
+        if ( format == XPixelFormat::YUV420 )
+        {
+            // provide planes as they are - no color conversion and no down sampling;
+            // defaults already set 2x2 sampling for luma and 1x1 for chroma components
+            cinfo.raw_data_in = TRUE;
+#if JPEG_LIB_VERSION >= 70
+            cinfo.do_fancy_downsampling = FALSE;
+#endif
+        }
+
+        Configured                  = true;
+        ConfiguredWidth             = width;
+        ConfiguredHeight            = height;
+        ConfiguredFormat            = format;
+        ConfiguredQuality           = quality;
+        ConfiguredFasterCompression = fasterCompression;
+    }
+}
+
+// Feed rows of RGB/Grayscale image to compressor by batches of MCU height
+void JpegCompressor::WriteScanlines( const shared_ptr<const XImage>& image, int32_t firstRow )
+{
+    JSAMPROW rows[16];
+    int32_t  stride = image->Stride( );
+    uint8_t* data   = image->Data( ) + stride * firstRow;
+
+    while ( cinfo.next_scanline < cinfo.image_height )
+    {
+        JDIMENSION count = cinfo.image_height - cinfo.next_scanline;
+
+        if ( count > 16 )
+        {
+            count = 16;
+        }
+
+        for ( JDIMENSION i = 0; i < count; i++ )
+        {
+            rows[i] = data + stride * ( cinfo.next_scanline + i );
+        }
+
+        jpeg_write_scanlines( &cinfo, rows, count );
+    }
+}
+
+// Feed planes of YUV420 image to compressor by MCU rows (16 luma and 8 chroma rows)
+void JpegCompressor::WriteRawData( const shared_ptr<const XImage>& image, int32_t firstRow )
+{
+    JSAMPROW   yRows[16];
+    JSAMPROW   uRows[8];
+    JSAMPROW   vRows[8];
+    JSAMPARRAY planes[3] = { yRows, uRows, vRows };
+    uint8_t*   yPlane    = image->PlaneData( 0 );
+    uint8_t*   uPlane    = image->PlaneData( 1 );
+    uint8_t*   vPlane    = image->PlaneData( 2 );
+    int32_t    yStride   = image->PlaneStride( 0 );
+    int32_t    uvStride  = image->PlaneStride( 1 );
+    int32_t    yHeight   = image->PlaneHeight( 0 );
+    int32_t    uvHeight  = image->PlaneHeight( 1 );
+
+    while ( cinfo.next_scanline < cinfo.image_height )
+    {
+        int32_t y  = firstRow + static_cast<int32_t>( cinfo.next_scanline );
+        int32_t uv = y / 2;
+
+        // rows below the image repeat its last row, so padding does not cost extra bits
+        for ( int32_t i = 0; i < 16; i++ )
+        {
+            yRows[i] = yPlane + yStride * ( ( y + i < yHeight ) ? y + i : yHeight - 1 );
+        }
+        for ( int32_t i = 0; i < 8; i++ )
+        {
+            int32_t row = ( uv + i < uvHeight ) ? uv + i : uvHeight - 1;
+
+            uRows[i] = uPlane + uvStride * row;
+            vRows[i] = vPlane + uvStride * row;
+        }
+
+        jpeg_write_raw_data( &cinfo, planes, 16 );
+    }
+}
+
 } // namespace Private
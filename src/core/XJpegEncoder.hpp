@@ -46,11 +46,27 @@ public:
     bool FasterCompression( ) const;
     void SetFasterCompression( bool faster );
 
+    // Set/get number of threads to compress an image with (1 by default). With more threads, images
+    // are split into horizontal strips of whole MCU rows, which are compressed in parallel and joined
+    // into single JPEG using restart markers. Images too small to give each thread at least 4 MCU
+    // rows are split into fewer strips.
+    uint32_t ThreadsCount( ) const;
+    void SetThreadsCount( uint32_t count );
+
     /* Compress the specified image into provided buffer
 
        On input, buffer size must be set to the size of provided buffer.
        On output, it is set to the size of encoded JPEG image. If provided
-       buffer is too small, it will be re-allocated (realloc).
+       buffer is too small, it will be re-allocated (realloc) and the new
+       one is returned (even if encoding fails), so the caller owns it
+       instead of the original one.
+
+       Compression parameters are kept between calls and set again only
+       if size/format of the image or encoder's settings change.
+
+       RGB24 and Grayscale8 images are compressed line by line. YUV420 images
+       are given to compressor as they are (no color conversion, no chroma down
+       sampling), which requires their stride to cover width rounded up to 16 pixels.
     */
     XError EncodeToMemory( const std::shared_ptr<const XImage>& image, uint8_t** buffer, uint32_t* bufferSize );
 
@@ -0,0 +1,190 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include "XJsonWriter.hpp"
+
+using namespace std;
+
+XJsonWriter::XJsonWriter( string& buffer ) :
+    Buffer( buffer ), NeedComma( false )
+{
+}
+
+XJsonWriter& XJsonWriter::BeginObject( )
+{
+    StartValue( );
+    Buffer.push_back( '{' );
+    NeedComma = false;
+    return *this;
+}
+
+XJsonWriter& XJsonWriter::EndObject( )
+{
+    Buffer.push_back( '}' );
+    NeedComma = true;
+    return *this;
+}
+
+XJsonWriter& XJsonWriter::BeginArray( )
+{
+    StartValue( );
+    Buffer.push_back( '[' );
+    NeedComma = false;
+    return *this;
+}
+
+XJsonWriter& XJsonWriter::EndArray( )
+{
+    Buffer.push_back( ']' );
+    NeedComma = true;
+    return *this;
+}
+
+// Write name of the next member of the current object
+XJsonWriter& XJsonWriter::Name( const char* name, size_t length )
+{
+    StartValue( );
+    Buffer.push_back( '"' );
+    AppendEscaped( name, length );
+    Buffer.append( "\":", 2 );
+    // the value goes right after the name
+    NeedComma = false;
+    return *this;
+}
+XJsonWriter& XJsonWriter::Name( const char* name )
+{
+    return Name( name, strlen( name ) );
+}
+
+// Write string value, escaping it as needed
+XJsonWriter& XJsonWriter::String( const char* value, size_t length )
+{
+    StartValue( );
+    Buffer.push_back( '"' );
+    AppendEscaped( value, length );
+    Buffer.push_back( '"' );
+    NeedComma = true;
+    return *this;
+}
+XJsonWriter& XJsonWriter::String( const char* value )
+{
+    return String( value, strlen( value ) );
+}
+
+// Write unsigned integer value
+XJsonWriter& XJsonWriter::Number( uint64_t value )
+{
+    char  digits[20];
+    char* ptr = digits + sizeof( digits );
+
+    do
+    {
+        *--ptr = static_cast<char>( '0' + value % 10 );
+        value /= 10;
+    }
+    while ( value != 0 );
+
+    StartValue( );
+    Buffer.append( ptr, digits + sizeof( digits ) - ptr );
+    NeedComma = true;
+    return *this;
+}
+
+// Write signed integer value
+XJsonWriter& XJsonWriter::Integer( int64_t value )
+{
+    if ( value >= 0 )
+    {
+        return Number( static_cast<uint64_t>( value ) );
+    }
+
+    StartValue( );
+    Buffer.push_back( '-' );
+    // the separator is already written, so the number part must not add another one
+    NeedComma = false;
+    return Number( static_cast<uint64_t>( 0 ) - static_cast<uint64_t>( value ) );
+}
+
+// Write value, which is already serialized JSON
+XJsonWriter& XJsonWriter::Raw( const char* json, size_t length )
+{
+    StartValue( );
+    Buffer.append( json, length );
+    NeedComma = true;
+    return *this;
+}
+
+// Put comma if something was written before in the current object
+void XJsonWriter::StartValue( )
+{
+    if ( NeedComma )
+    {
+        Buffer.push_back( ',' );
+    }
+}
+
+// Append string escaping quotes, back slashes and control characters
+void XJsonWriter::AppendEscaped( const char* str, size_t length )
+{
+    static const char* HexDigits = "0123456789ABCDEF";
+    const char*        end       = str + length;
+    const char*        start     = str;
+
+    for ( ; str != end; str++ )
+    {
+        unsigned char c = static_cast<unsigned char>( *str );
+
+        if ( ( c >= 0x20 ) && ( c != '"' ) && ( c != '\\' ) )
+        {
+            continue;
+        }
+
+        // append everything what does not need escaping in one go
+        Buffer.append( start, str - start );
+        start = str + 1;
+
+        Buffer.push_back( '\\' );
+
+        switch ( c )
+        {
+        case '"':
+        case '\\':
+            Buffer.push_back( static_cast<char>( c ) );
+            break;
+        case '\n':
+            Buffer.push_back( 'n' );
+            break;
+        case '\r':
+            Buffer.push_back( 'r' );
+            break;
+        case '\t':
+            Buffer.push_back( 't' );
+            break;
+        default:
+            Buffer.append( "u00", 3 );
+            Buffer.push_back( HexDigits[c >> 4] );
+            Buffer.push_back( HexDigits[c & 0x0F] );
+            break;
+        }
+    }
+
+    Buffer.append( start, end - start );
+}
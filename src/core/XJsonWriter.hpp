@@ -0,0 +1,73 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XJSON_WRITER_HPP
+#define XJSON_WRITER_HPP
+
+#include <stdint.h>
+#include <string>
+
+/* ================================================================= */
+/* Streaming JSON writer, which appends straight to the given string */
+/* buffer. Reusing the buffer between replies (clearing it keeps its */
+/* capacity) avoids memory allocations once it is large enough.      */
+/* Commas are put by the writer itself - names and values just need  */
+/* to be written in the right order.                                 */
+/* ================================================================= */
+class XJsonWriter
+{
+public:
+    XJsonWriter( std::string& buffer );
+
+    XJsonWriter& BeginObject( );
+    XJsonWriter& EndObject( );
+
+    XJsonWriter& BeginArray( );
+    XJsonWriter& EndArray( );
+
+    // Write name of the next member of the current object
+    XJsonWriter& Name( const char* name, size_t length );
+    XJsonWriter& Name( const std::string& name ) { return Name( name.c_str( ), name.length( ) ); }
+    XJsonWriter& Name( const char* name );
+
+    // Write string value, escaping it as needed
+    XJsonWriter& String( const char* value, size_t length );
+    XJsonWriter& String( const std::string& value ) { return String( value.c_str( ), value.length( ) ); }
+    XJsonWriter& String( const char* value );
+
+    // Write unsigned integer value
+    XJsonWriter& Number( uint64_t value );
+    // Write signed integer value
+    XJsonWriter& Integer( int64_t value );
+
+    // Write value, which is already serialized JSON
+    XJsonWriter& Raw( const char* json, size_t length );
+    XJsonWriter& Raw( const std::string& json ) { return Raw( json.c_str( ), json.length( ) ); }
+
+private:
+    void StartValue( );
+    void AppendEscaped( const char* str, size_t length );
+
+private:
+    std::string& Buffer;
+    bool         NeedComma;
+};
+
+#endif // XJSON_WRITER_HPP
@@ -0,0 +1,563 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+#include "XMotionDetector.hpp"
+
+#include <stdio.h>
+#include <jpeglib.h>
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    #include <arm_neon.h>
+    #define XMOTION_USE_NEON
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Width of thumbnails frames are reduced to before analysis (approximately, as they are
+    // reduced by integer factor)
+    #define THUMBNAIL_WIDTH       (80)
+    // Percentage of changed pixels, which means the whole scene has changed (lights switched
+    // on/off, exposure adjusted, camera moved) - background is reset then instead of reporting motion
+    #define GLOBAL_CHANGE_LEVEL   (50.0f)
+
+    class JpegDecodingException : public exception
+    {
+    public:
+        virtual const char* what( ) const throw( )
+        {
+            return "JPEG decoding failure";
+        }
+    };
+
+    static void my_error_exit( j_common_ptr /* cinfo */ )
+    {
+        throw JpegDecodingException( );
+    }
+
+    static void my_output_message( j_common_ptr /* cinfo */ )
+    {
+        // do nothing - kill the message
+    }
+
+    // Wrapper around libjpeg's decompressor, which decodes JPEG images into reduced size grayscale
+    class JpegThumbnailDecoder : private Uncopyable
+    {
+    private:
+        struct jpeg_decompress_struct cinfo;
+        struct jpeg_error_mgr         jerr;
+
+    public:
+        JpegThumbnailDecoder( )
+        {
+            cinfo.err           = jpeg_std_error( &jerr );
+            jerr.error_exit     = my_error_exit;
+            jerr.output_message = my_output_message;
+
+            jpeg_create_decompress( &cinfo );
+        }
+
+        ~JpegThumbnailDecoder( )
+        {
+            jpeg_destroy_decompress( &cinfo );
+        }
+
+        bool Decode( const uint8_t* data, uint32_t size, vector<uint8_t>& pixels, int32_t& width, int32_t& height );
+    };
+
+    class XMotionDetectorData;
+
+    // Listener for video source events
+    class MotionVideoListener : public IVideoSourceListener
+    {
+    private:
+        XMotionDetectorData* Owner;
+
+    public:
+        MotionVideoListener( XMotionDetectorData* owner ) : Owner( owner ) { }
+
+        void OnNewImage( const shared_ptr<const XImage>& image );
+        void OnError( const string& /* errorMessage */, bool /* fatal */ ) { }
+    };
+
+    class XMotionDetectorData
+    {
+    public:
+        MotionVideoListener         VideoSourceListener;
+
+        // settings and detection state - guarded, since frames are analysed on video source's thread
+        mutable mutex               Sync;
+        uint32_t                    AnalysisInterval;
+        uint8_t                     PixelThreshold;
+        float                       MotionThreshold;
+        uint32_t                    HoldTime;
+        function<void( bool )>      MotionHandler;
+
+        steady_clock::time_point    LastAnalysisTime;
+        steady_clock::time_point    LastMotionTime;
+        bool                        MotionDetected;
+        float                       MotionLevel;
+        uint64_t                    MotionEventsCount;
+        uint64_t                    FramesAnalysed;
+        XHistogram                  AnalysisTime;
+
+        // thumbnail of the current frame and background model of the same size - used only
+        // by the video source's thread
+        JpegThumbnailDecoder        Decoder;
+        vector<uint8_t>             DecodedImage;
+        vector<uint8_t>             Thumbnail;
+        vector<uint8_t>             Background;
+        int32_t                     ThumbnailWidth;
+        int32_t                     ThumbnailHeight;
+        int32_t                     BackgroundWidth;
+        int32_t                     BackgroundHeight;
+
+    public:
+        XMotionDetectorData( ) :
+            VideoSourceListener( this ),
+            Sync( ), AnalysisInterval( 200 ), PixelThreshold( 20 ), MotionThreshold( 1.0f ), HoldTime( 2000 ), MotionHandler( ),
+            LastAnalysisTime( ), LastMotionTime( ), MotionDetected( false ), MotionLevel( 0 ), MotionEventsCount( 0 ), FramesAnalysed( 0 ),
+            AnalysisTime( { 500, 1000, 2000, 3000, 5000, 7500, 10000, 20000, 50000 } ),
+            Decoder( ), DecodedImage( ), Thumbnail( ), Background( ),
+            ThumbnailWidth( 0 ), ThumbnailHeight( 0 ), BackgroundWidth( 0 ), BackgroundHeight( 0 )
+        {
+        }
+
+        void AnalyseFrame( const XImage& image );
+
+    private:
+        bool MakeThumbnail( const XImage& image );
+        void DownscaleLuma( const uint8_t* data, int32_t width, int32_t height, int32_t stride, int32_t pixelSize );
+    };
+}
+
+// Properties of the detector - all are results of detection and so read only
+const XPropertyTable<XMotionDetector> XMotionDetector::PropertyTable =
+{
+    { { "motionDetected", "Motion Detected", XPropertyType::Boolean, 0, 1, 0, nullptr, 0 },
+      []( const XMotionDetector& detector ) -> double { return detector.IsMotionDetected( ); }, nullptr },
+    { { "motionLevel", "Motion Level", XPropertyType::Float, 0, 0, 0, nullptr, 0 },
+      []( const XMotionDetector& detector ) -> double { return detector.MotionLevel( ); }, nullptr },
+    { { "motionEvents", "Motion Events", XPropertyType::Integer, 0, 0, 0, nullptr, 0 },
+      []( const XMotionDetector& detector ) -> double { return static_cast<double>( detector.MotionEventsCount( ) ); }, nullptr }
+};
+
+XMotionDetector::XMotionDetector( ) :
+    mData( new Private::XMotionDetectorData( ) )
+{
+}
+
+XMotionDetector::~XMotionDetector( )
+{
+    delete mData;
+}
+
+// Get/Set interval between analysed frames
+uint32_t XMotionDetector::AnalysisInterval( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->AnalysisInterval;
+}
+void XMotionDetector::SetAnalysisInterval( uint32_t interval )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->AnalysisInterval = interval;
+}
+
+// Get/Set difference of pixel's luma from background to treat the pixel as changed
+uint32_t XMotionDetector::PixelThreshold( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->PixelThreshold;
+}
+void XMotionDetector::SetPixelThreshold( uint32_t threshold )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->PixelThreshold = static_cast<uint8_t>( std::min( std::max( threshold, 1u ), 254u ) );
+}
+
+// Get/Set percentage of changed pixels to treat a frame as having motion
+float XMotionDetector::MotionThreshold( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->MotionThreshold;
+}
+void XMotionDetector::SetMotionThreshold( float threshold )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->MotionThreshold = std::min( std::max( threshold, 0.0f ), 100.0f );
+}
+
+// Get/Set time to keep reporting motion after the last frame having it
+uint32_t XMotionDetector::HoldTime( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->HoldTime;
+}
+void XMotionDetector::SetHoldTime( uint32_t holdTime )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->HoldTime = holdTime;
+}
+
+// Set handler to call when motion starts/stops
+void XMotionDetector::SetMotionHandler( const function<void( bool )>& handler )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->MotionHandler = handler;
+}
+
+// Get video source listener
+IVideoSourceListener* XMotionDetector::VideoSourceListener( ) const
+{
+    return &mData->VideoSourceListener;
+}
+
+// Check if motion is detected now
+bool XMotionDetector::IsMotionDetected( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->MotionDetected;
+}
+
+// Percentage of changed pixels in the last analysed frame
+float XMotionDetector::MotionLevel( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->MotionLevel;
+}
+
+// Number of times motion was detected
+uint64_t XMotionDetector::MotionEventsCount( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->MotionEventsCount;
+}
+
+// Number of analysed frames
+uint64_t XMotionDetector::FramesAnalysed( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->FramesAnalysed;
+}
+
+// Get histogram of time taken to analyse frames
+const XHistogram& XMotionDetector::AnalysisTimeHistogram( ) const
+{
+    return mData->AnalysisTime;
+}
+
+// Get the specified property of the detector
+XError XMotionDetector::GetProperty( const string& propertyName, string& value ) const
+{
+    return PropertyTable.GetProperty( *this, propertyName, value );
+}
+
+// Get all properties of the detector
+map<string, string> XMotionDetector::GetAllProperties( ) const
+{
+    return PropertyTable.GetAllProperties( *this );
+}
+
+namespace Private
+{
+
+// Count pixels of the frame, which differ from background by more than the threshold, and move each
+// background pixel one step towards the frame (approximate median filter, so background follows slow
+// changes, while things moving through the scene hardly affect it)
+static uint32_t DiffAndUpdateBackground( const uint8_t* frame, uint8_t* background, size_t count, uint8_t threshold )
+{
+    uint32_t changed = 0;
+    size_t   i       = 0;
+
+#ifdef XMOTION_USE_NEON
+    uint8x16_t thresholdVector = vdupq_n_u8( threshold );
+
+    while ( i + 16 <= count )
+    {
+        // per lane counters are 8 bit, so they are summed up at least every 255 blocks
+        size_t     blocks  = std::min<size_t>( ( count - i ) / 16, 255 );
+        uint8x16_t counter = vdupq_n_u8( 0 );
+
+        for ( size_t j = 0; j < blocks; j++, i += 16 )
+        {
+            uint8x16_t pixels = vld1q_u8( frame + i );
+            uint8x16_t models = vld1q_u8( background + i );
+
+            // comparisons set lanes to 0xFF (-1), so subtracting them counts/steps up
+            // and adding them steps down
+            counter = vsubq_u8( counter, vcgtq_u8( vabdq_u8( pixels, models ), thresholdVector ) );
+            models  = vaddq_u8( vsubq_u8( models, vcgtq_u8( pixels, models ) ), vcltq_u8( pixels, models ) );
+
+            vst1q_u8( background + i, models );
+        }
+
+        uint64x2_t sum = vpaddlq_u32( vpaddlq_u16( vpaddlq_u8( counter ) ) );
+
+        changed += static_cast<uint32_t>( vgetq_lane_u64( sum, 0 ) + vgetq_lane_u64( sum, 1 ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        uint8_t pixel = frame[i];
+        uint8_t model = background[i];
+        uint8_t diff  = ( pixel > model ) ? pixel - model : model - pixel;
+
+        changed      += ( diff > threshold ) ? 1 : 0;
+        background[i] = model + ( pixel > model ) - ( pixel < model );
+    }
+
+    return changed;
+}
+
+// Decode JPEG image into grayscale at the smallest scale, which still keeps enough pixels for thumbnail
+bool JpegThumbnailDecoder::Decode( const uint8_t* data, uint32_t size, vector<uint8_t>& pixels, int32_t& width, int32_t& height )
+{
+    bool ret = true;
+
+    try
+    {
+        jpeg_mem_src( &cinfo, const_cast<uint8_t*>( data ), size );
+        jpeg_read_header( &cinfo, TRUE );
+
+        cinfo.scale_num   = 1;
+        cinfo.scale_denom = 8;
+
+        while ( ( cinfo.scale_denom > 1 ) && ( cinfo.image_width / cinfo.scale_denom < THUMBNAIL_WIDTH ) )
+        {
+            cinfo.scale_denom /= 2;
+        }
+
+        // quality of the image does not matter much, so take the fastest options
+        cinfo.out_color_space     = JCS_GRAYSCALE;
+        cinfo.dct_method          = JDCT_IFAST;
+        cinfo.do_fancy_upsampling = FALSE;
+        cinfo.do_block_smoothing  = FALSE;
+
+        jpeg_start_decompress( &cinfo );
+
+        width  = static_cast<int32_t>( cinfo.output_width );
+        height = static_cast<int32_t>( cinfo.output_height );
+        pixels.resize( static_cast<size_t>( width ) * height );
+
+        while ( cinfo.output_scanline < cinfo.output_height )
+        {
+            JSAMPROW row = &pixels[static_cast<size_t>( cinfo.output_scanline ) * width];
+
+            jpeg_read_scanlines( &cinfo, &row, 1 );
+        }
+
+        jpeg_finish_decompress( &cinfo );
+    }
+    catch ( const JpegDecodingException& )
+    {
+        jpeg_abort_decompress( &cinfo );
+        ret = false;
+    }
+
+    return ret;
+}
+
+// Reduce image by integer factor to get thumbnail of about THUMBNAIL_WIDTH - pixels of the image are
+// either luma values already (pixel size 1) or RGB(A) values converted to luma
+void XMotionDetectorData::DownscaleLuma( const uint8_t* data, int32_t width, int32_t height, int32_t stride, int32_t pixelSize )
+{
+    int32_t  factor = std::max( 1, width / THUMBNAIL_WIDTH );
+    uint32_t area   = static_cast<uint32_t>( factor * factor );
+
+    ThumbnailWidth  = width / factor;
+    ThumbnailHeight = height / factor;
+    Thumbnail.resize( static_cast<size_t>( ThumbnailWidth ) * ThumbnailHeight );
+
+    for ( int32_t ty = 0; ty < ThumbnailHeight; ty++ )
+    {
+        uint8_t* dst = &Thumbnail[static_cast<size_t>( ty ) * ThumbnailWidth];
+
+        for ( int32_t tx = 0; tx < ThumbnailWidth; tx++ )
+        {
+            const uint8_t* block = data + ty * factor * stride + tx * factor * pixelSize;
+            uint32_t       sum   = 0;
+
+            for ( int32_t y = 0; y < factor; y++ )
+            {
+                const uint8_t* src = block + y * stride;
+
+                if ( pixelSize == 1 )
+                {
+                    for ( int32_t x = 0; x < factor; x++ )
+                    {
+                        sum += src[x];
+                    }
+                }
+                else
+                {
+                    for ( int32_t x = 0; x < factor; x++, src += pixelSize )
+                    {
+                        sum += ( src[0] * 77 + src[1] * 150 + src[2] * 29 ) >> 8;
+                    }
+                }
+            }
+
+            dst[tx] = static_cast<uint8_t>( sum / area );
+        }
+    }
+}
+
+// Make thumbnail of the specified frame
+bool XMotionDetectorData::MakeThumbnail( const XImage& image )
+{
+    bool ret = true;
+
+    switch ( image.Format( ) )
+    {
+    case XPixelFormat::JPEG:
+        {
+            int32_t width, height;
+
+            ret = Decoder.Decode( image.Data( ), static_cast<uint32_t>( image.Width( ) ), DecodedImage, width, height );
+
+            if ( ret )
+            {
+                DownscaleLuma( DecodedImage.data( ), width, height, width, 1 );
+            }
+        }
+        break;
+
+    case XPixelFormat::Grayscale8:
+    case XPixelFormat::YUV420:
+        // luma plane goes first
+        DownscaleLuma( image.PlaneData( 0 ), image.Width( ), image.PlaneHeight( 0 ), image.PlaneStride( 0 ), 1 );
+        break;
+
+    case XPixelFormat::RGB24:
+        DownscaleLuma( image.Data( ), image.Width( ), image.Height( ), image.Stride( ), 3 );
+        break;
+
+    case XPixelFormat::RGBA32:
+        DownscaleLuma( image.Data( ), image.Width( ), image.Height( ), image.Stride( ), 4 );
+        break;
+
+    default:
+        ret = false;
+        break;
+    }
+
+    return ( ( ret ) && ( !Thumbnail.empty( ) ) );
+}
+
+// Analyse the frame, if it is time to do so, and update detection state
+void XMotionDetectorData::AnalyseFrame( const XImage& image )
+{
+    steady_clock::time_point startTime = steady_clock::now( );
+    uint8_t                  pixelThreshold;
+
+    {
+        lock_guard<mutex> lock( Sync );
+
+        if ( ( FramesAnalysed != 0 ) &&
+             ( duration_cast<milliseconds>( startTime - LastAnalysisTime ).count( ) < AnalysisInterval ) )
+        {
+            return;
+        }
+
+        LastAnalysisTime = startTime;
+        pixelThreshold   = PixelThreshold;
+    }
+
+    if ( !MakeThumbnail( image ) )
+    {
+        return;
+    }
+
+    float level        = 0;
+    bool  sceneChanged = true;
+
+    if ( ( ThumbnailWidth == BackgroundWidth ) && ( ThumbnailHeight == BackgroundHeight ) )
+    {
+        uint32_t changed = DiffAndUpdateBackground( Thumbnail.data( ), Background.data( ), Thumbnail.size( ), pixelThreshold );
+
+        level        = 100.0f * changed / Thumbnail.size( );
+        sceneChanged = ( level >= GLOBAL_CHANGE_LEVEL );
+    }
+
+    if ( sceneChanged )
+    {
+        // start over with the current frame as background
+        Background       = Thumbnail;
+        BackgroundWidth  = ThumbnailWidth;
+        BackgroundHeight = ThumbnailHeight;
+    }
+
+    steady_clock::time_point endTime = steady_clock::now( );
+    function<void( bool )>   handler;
+    bool                     motionDetected;
+
+    {
+        lock_guard<mutex> lock( Sync );
+        bool              wasDetected = MotionDetected;
+
+        if ( ( !sceneChanged ) && ( level >= MotionThreshold ) )
+        {
+            LastMotionTime = endTime;
+
+            if ( !MotionDetected )
+            {
+                MotionDetected = true;
+                MotionEventsCount++;
+            }
+        }
+        else if ( ( MotionDetected ) &&
+                  ( duration_cast<milliseconds>( endTime - LastMotionTime ).count( ) >= HoldTime ) )
+        {
+            MotionDetected = false;
+        }
+
+        MotionLevel    = level;
+        motionDetected = MotionDetected;
+        FramesAnalysed++;
+
+        if ( MotionDetected != wasDetected )
+        {
+            handler = MotionHandler;
+        }
+    }
+
+    AnalysisTime.Add( static_cast<uint64_t>( duration_cast<microseconds>( endTime - startTime ).count( ) ) );
+
+    if ( handler )
+    {
+        handler( motionDetected );
+    }
+}
+
+// New frame from video source
+void MotionVideoListener::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    Owner->AnalyseFrame( *image );
+}
+
+} // namespace Private
@@ -0,0 +1,93 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+#ifndef XMOTION_DETECTOR_HPP
+#define XMOTION_DETECTOR_HPP
+
+#include <stdint.h>
+#include <string>
+#include <functional>
+
+#include "XInterfaces.hpp"
+#include "IObjectInformation.hpp"
+#include "IVideoSourceListener.hpp"
+#include "XHistogram.hpp"
+#include "XPropertyTable.hpp"
+
+namespace Private
+{
+    class XMotionDetectorData;
+}
+
+// Detects motion in video frames by comparing their tiny luma thumbnails (about 80 pixels wide)
+// with background model, which follows slow changes of the scene. Frames are analysed on the
+// video source's thread, but only few of them per second - JPEG frames are decoded at 1/8 scale
+// (DC coefficients only), while uncompressed frames are box downscaled. So it takes only a small
+// fraction of CPU time next to streaming the same frames.
+class XMotionDetector : public IObjectInformation, private Uncopyable
+{
+public:
+    XMotionDetector( );
+    ~XMotionDetector( );
+
+    // Get/Set interval (ms) between analysed frames - frames coming in between are skipped (200 by default)
+    uint32_t AnalysisInterval( ) const;
+    void SetAnalysisInterval( uint32_t interval );
+
+    // Get/Set difference of pixel's luma from background to treat the pixel as changed, [1, 254] (20 by default)
+    uint32_t PixelThreshold( ) const;
+    void SetPixelThreshold( uint32_t threshold );
+
+    // Get/Set percentage of changed pixels to treat a frame as having motion (1 by default)
+    float MotionThreshold( ) const;
+    void SetMotionThreshold( float threshold );
+
+    // Get/Set time (ms) to keep reporting motion after the last frame having it (2000 by default)
+    uint32_t HoldTime( ) const;
+    void SetHoldTime( uint32_t holdTime );
+
+    // Set handler to call when motion starts/stops. It is called on the video source's thread,
+    // so must be quick not to delay frames.
+    void SetMotionHandler( const std::function<void( bool )>& handler );
+
+    // Get video source listener, which could be fed to some video source
+    IVideoSourceListener* VideoSourceListener( ) const;
+
+    // Check if motion is detected now and percentage of changed pixels in the last analysed frame
+    bool IsMotionDetected( ) const;
+    float MotionLevel( ) const;
+
+    // Number of times motion was detected and number of analysed frames
+    uint64_t MotionEventsCount( ) const;
+    uint64_t FramesAnalysed( ) const;
+
+    // Get histogram of time (microseconds) taken to analyse frames
+    const XHistogram& AnalysisTimeHistogram( ) const;
+
+    // IObjectInformation implementation
+    XError GetProperty( const std::string& propertyName, std::string& value ) const;
+    std::map<std::string, std::string> GetAllProperties( ) const;
+
+private:
+    Private::XMotionDetectorData* mData;
+
+    static const XPropertyTable<XMotionDetector> PropertyTable;
+};
+
+#endif // XMOTION_DETECTOR_HPP
@@ -19,27 +19,60 @@
 */
 
 #include <string.h>
+#include <stdlib.h>
+#include <algorithm>
 
 #include "XObjectConfigurationRequestHandler.hpp"
-#include "XStringTools.hpp"
 #include "XSimpleJsonParser.hpp"
+#include "XJsonWriter.hpp"
+#include "XTrace.hpp"
 
 using namespace std;
+using namespace std::chrono;
+
+// Default/Min/Max time between updates of objects' stream, ms
+#define STREAM_DEFAULT_INTERVAL (100)
+#define STREAM_MIN_INTERVAL     (10)
+#define STREAM_MAX_INTERVAL     (10000)
+// Interval of checking objects' properties for changes, which were not notified about
+#define STREAM_CHECK_INTERVAL   (1000)
 
 const static char* StatusOK                   = "OK";
 const static char* StatusInvalidJson          = "Invalid JSON object";
 const static char* StatusUnknownProperty      = "Unknown property";
 const static char* StatusInvalidPropertyValue = "Invalid property value";
 const static char* StatusPropertyFailed       = "Failed setting property";
+const static char* StatusUnknownObject        = "Unknown object";
+
+namespace Private
+{
+    // State of a client connected to objects' stream
+    class ObjectsStreamClient
+    {
+    public:
+        ObjectsStreamClient( ) : Indexes( ), PropertiesToGet( ), SentValues( ), Interval( STREAM_DEFAULT_INTERVAL ),
+                                 LastUpdateTime( ), WasUpdated( false )
+        {
+        }
+
+        // indexes of the streamed objects, lists of their properties and values sent last time
+        vector<size_t>      Indexes;
+        vector<string>      PropertiesToGet;
+        vector<PropertyMap> SentValues;
+        uint32_t            Interval;
+        steady_clock::time_point LastUpdateTime;
+        bool                WasUpdated;
+    };
+}
+
+using namespace Private;
 
 // ------------- Helpers to do actual requests handling -------------
 
 // Get all or the list of specified variables
-static void HandleGetRequest( const shared_ptr<const IObjectInformation>& infoObject, const string& varsToGet, IWebResponse& response )
+static PropertyMap GetProperties( const shared_ptr<const IObjectInformation>& infoObject, const string& varsToGet )
 {
-    map<string, string> values;
-    string              reply = "{\"status\":\"OK\",\"config\":{";
-    bool                first = true;
+    PropertyMap values;
 
     if ( varsToGet.empty( ) )
     {
@@ -81,68 +114,172 @@ static void HandleGetRequest( const shared_ptr<const IObjectInformation>& infoOb
         }
     }
 
-    // form a JSON response with values of the properties
-    for ( auto kvp : values )
-    {
-        map<string, string> innerValue;
+    return values;
+}
 
-        if ( !first )
+// Find indexes of the objects listed in the comma separated list of names (all objects if the list is empty);
+// returns name of the first unknown object if there is any
+template <class EntryType>
+static string FindObjects( const vector<EntryType>& objects, const string& objectsToGet, vector<size_t>& indexes )
+{
+    size_t start = 0;
+
+    if ( objectsToGet.empty( ) )
+    {
+        for ( size_t i = 0; i < objects.size( ); i++ )
         {
-            reply += ",";
+            indexes.push_back( i );
         }
+    }
+
+    while ( start < objectsToGet.length( ) )
+    {
+        size_t end = objectsToGet.find( ',', start );
 
-        reply += "\"";
-        reply += kvp.first;
-        reply += "\":";
-        
-        // a dirty hack for providing already serialized JSON
-        if ( ( kvp.second.length( ) >= 2 ) && ( kvp.second.front( ) == '{' ) && ( kvp.second.back( ) == '}' ) &&
-             ( XSimpleJsonParser( kvp.second, innerValue ) ) )
+        if ( end == string::npos )
         {
-            reply += kvp.second;
+            end = objectsToGet.length( );
         }
-        else
+
+        if ( end != start )
         {
-            reply += "\"";
-            reply += StringReplace( kvp.second, "\"", "\\\"" );
-            reply += "\"";
+            string name  = objectsToGet.substr( start, end - start );
+            size_t index = 0;
+
+            while ( ( index < objects.size( ) ) && ( objects[index].Name != name ) )
+            {
+                index++;
+            }
+
+            if ( index == objects.size( ) )
+            {
+                return name;
+            }
+
+            if ( find( indexes.begin( ), indexes.end( ), index ) == indexes.end( ) )
+            {
+                indexes.push_back( index );
+            }
         }
 
-        first = false;
+        start = end + 1;
     }
 
-    reply += "}}";
+    return string( );
+}
+
+// Write name/value pair of a property
+static void WriteJsonProperty( XJsonWriter& writer, const PropertyMap::value_type& kvp )
+{
+    writer.Name( kvp.first );
+
+    // a dirty hack for providing already serialized JSON
+    if ( ( kvp.second.length( ) >= 2 ) && ( kvp.second.front( ) == '{' ) && ( kvp.second.back( ) == '}' ) &&
+         ( XSimpleJsonIsObject( kvp.second.c_str( ), kvp.second.length( ) ) ) )
+    {
+        writer.Raw( kvp.second );
+    }
+    else
+    {
+        writer.String( kvp.second );
+    }
+}
+
+// Write JSON object made of the specified properties
+static void WriteJsonProperties( XJsonWriter& writer, const PropertyMap& values )
+{
+    writer.BeginObject( );
+
+    for ( const auto& kvp : values )
+    {
+        WriteJsonProperty( writer, kvp );
+    }
+
+    writer.EndObject( );
+}
+
+// Write JSON object made of the specified properties (pointing into some property map)
+static void WriteJsonProperties( XJsonWriter& writer, const vector<const PropertyMap::value_type*>& values )
+{
+    writer.BeginObject( );
+
+    for ( const PropertyMap::value_type* kvp : values )
+    {
+        WriteJsonProperty( writer, *kvp );
+    }
+
+    writer.EndObject( );
+}
+
+// Get buffer to build reply in - it is kept for every thread, so its memory gets reused
+static string& ReplyBuffer( )
+{
+    static thread_local string buffer;
+
+    buffer.clear( );
+
+    return buffer;
+}
 
+// Send JSON reply with no caching allowed
+static void SendJsonReply( const string& reply, IWebResponse& response )
+{
     response.Printf( "HTTP/1.1 200 OK\r\n"
                      "Content-Type: application/json\r\n"
                      "Content-Length: %d\r\n"
                      "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
-                     "\r\n"
-                     "%s", (int) reply.length( ), reply.c_str( ) );
+                     "\r\n", (int) reply.length( ) );
+    response.Send( reinterpret_cast<const uint8_t*>( reply.data( ) ), reply.length( ) );
+}
+
+// Provide all or the list of specified variables
+static void HandleGetRequest( const shared_ptr<const IObjectInformation>& infoObject, const string& varsToGet, IWebResponse& response )
+{
+    string&     reply = ReplyBuffer( );
+    XJsonWriter writer( reply );
+
+    writer.BeginObject( ).Name( "status" ).String( StatusOK ).Name( "config" );
+    WriteJsonProperties( writer, GetProperties( infoObject, varsToGet ) );
+    writer.EndObject( );
 
+    SendJsonReply( reply, response );
 }
 
 // Set all variables specified in the posted JSON
 void HandlePostRequest( const shared_ptr<IObjectConfigurator>& objectToConfig, const string& body, IWebResponse& response )
 {
+    XTraceScope         traceScope( "config.post" );
     const char*         status = StatusOK;
-    map<string, string> values;
-    string              reply = "{\"status\":\"";
+    string&             reply  = ReplyBuffer( );
+    XJsonWriter         writer( reply );
     string              failedProperty;
+    string              name, value;
 
-    if ( !XSimpleJsonParser( body, values ) )
+    // nothing is set unless the whole JSON is valid
+    if ( !XSimpleJsonIsObject( body.c_str( ), body.length( ) ) )
     {
         status = StatusInvalidJson;
     }
     else
     {
-        for ( auto kvp : values )
+        XSimpleJsonParser( body.c_str( ), body.length( ), [&]( const XJsonSpan& nameSpan, const XJsonSpan& valueSpan )
         {
-            XError ecode = objectToConfig->SetProperty( kvp.first, kvp.second );
+            XJsonUnescape( nameSpan, name );
+
+            if ( valueSpan.Data[0] == '"' )
+            {
+                XJsonUnescape( valueSpan, value );
+            }
+            else
+            {
+                value.assign( valueSpan.Data, valueSpan.Length );
+            }
+
+            XError ecode = objectToConfig->SetProperty( name, value );
 
             if ( ecode != XError::Success )
             {
-                failedProperty = kvp.first;
+                failedProperty = name;
                 switch ( ecode.Code( ) )
                 {
                 case XError::UnknownProperty:
@@ -156,23 +293,19 @@ void HandlePostRequest( const shared_ptr<IObjectConfigurator>& objectToConfig, c
                     break;
                 }
             }
-        }
+
+            return true;
+        } );
     }
 
-    reply += status;
+    writer.BeginObject( ).Name( "status" ).String( status );
     if ( !failedProperty.empty( ) )
     {
-        reply += "\",\"property\":\"";
-        reply += failedProperty;
+        writer.Name( "property" ).String( failedProperty );
     }
-    reply += "\"}";
+    writer.EndObject( );
 
-    response.Printf( "HTTP/1.1 200 OK\r\n"
-                     "Content-Type: application/json\r\n"
-                     "Content-Length: %d\r\n"
-                     "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
-                     "\r\n"
-                     "%s", (int) reply.length( ), reply.c_str( ) );
+    SendJsonReply( reply, response );
 }
 
 // ------------- Implementation of XObjectConfigurationRequestHandler -------------
@@ -236,3 +369,323 @@ void XObjectInformationRequestHandler::HandleHttpRequest( const IWebRequest& req
                          "Method Not Allowed" );
     }
 }
+
+// ------------- Implementation of XMetricsRequestHandler -------------
+
+XMetricsRequestHandler::XMetricsRequestHandler( const string& uri, const shared_ptr<IObjectInformation>& metricsObject ) :
+    IWebRequestHandler( uri, false ),
+    MetricsObject( metricsObject )
+{
+}
+
+// Handle metrics request by providing all properties of the object as "name value" lines
+void XMetricsRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    if ( request.Method( ) == "GET" )
+    {
+        PropertyMap values = MetricsObject->GetAllProperties( );
+        string&     reply  = ReplyBuffer( );
+
+        for ( const auto& kvp : values )
+        {
+            reply += kvp.first;
+            reply += ' ';
+            reply += kvp.second;
+            reply += '\n';
+        }
+
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: %d\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                         "\r\n", (int) reply.length( ) );
+        response.Send( reinterpret_cast<const uint8_t*>( reply.c_str( ) ), reply.length( ) );
+    }
+    else
+    {
+        response.Printf( "HTTP/1.1 405 Method Not Allowed\r\n"
+                         "Allow: GET\r\n"
+                         "Content-Type: text/plain\r\n"
+                         "Connection: close\r\n"
+                         "\r\n"
+                         "Method Not Allowed" );
+    }
+}
+
+// ------------- Implementation of XBatchInformationRequestHandler -------------
+
+XBatchInformationRequestHandler::XBatchInformationRequestHandler( const string& uri ) :
+    IWebRequestHandler( uri, false ),
+    Sync( ), InfoObjects( ), Version( 0 )
+{
+}
+
+// Add named object to provide information about
+XBatchInformationRequestHandler& XBatchInformationRequestHandler::AddObject( const string& name,
+                                                                             const shared_ptr<const IObjectInformation>& infoObject )
+{
+    lock_guard<mutex> lock( Sync );
+    InfoObjectEntry   entry;
+
+    entry.Name       = name;
+    entry.InfoObject = infoObject;
+
+    InfoObjects.push_back( entry );
+
+    return *this;
+}
+
+// Handle request by providing properties of all the requested objects
+void XBatchInformationRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    if ( request.Method( ) != "GET" )
+    {
+        response.Printf( "HTTP/1.1 405 Method Not Allowed\r\n"
+                         "Allow: GET\r\n"
+                         "Content-Type: text/plain\r\n"
+                         "Connection: close\r\n"
+                         "\r\n"
+                         "Method Not Allowed" );
+        return;
+    }
+
+    string         sinceVersion = request.GetVariable( "since" );
+    uint64_t       since        = ( sinceVersion.empty( ) ) ? 0 : strtoull( sinceVersion.c_str( ), nullptr, 10 );
+    vector<size_t> indexes;
+    string         unknownObject = FindObjects( InfoObjects, request.GetVariable( "objects" ), indexes );
+    string&        reply        = ReplyBuffer( );
+    XJsonWriter    writer( reply );
+
+    if ( !unknownObject.empty( ) )
+    {
+        writer.BeginObject( ).Name( "status" ).String( StatusUnknownObject ).Name( "object" ).String( unknownObject ).EndObject( );
+    }
+    else
+    {
+        lock_guard<mutex>                       lock( Sync );
+        vector<const PropertyMap::value_type*> changedValues;
+
+        writer.BeginObject( ).Name( "status" ).String( StatusOK ).Name( "objects" ).BeginObject( );
+
+        for ( size_t index : indexes )
+        {
+            InfoObjectEntry& entry  = InfoObjects[index];
+            PropertyMap      values = GetProperties( entry.InfoObject, request.GetVariable( entry.Name ) );
+
+            changedValues.clear( );
+
+            // update versions of the properties which changed since they were seen last time
+            for ( const auto& kvp : values )
+            {
+                auto itSeen = entry.SeenProperties.find( kvp.first );
+
+                if ( itSeen == entry.SeenProperties.end( ) )
+                {
+                    itSeen = entry.SeenProperties.insert( make_pair( kvp.first, make_pair( kvp.second, ++Version ) ) ).first;
+                }
+                else if ( itSeen->second.first != kvp.second )
+                {
+                    itSeen->second.first  = kvp.second;
+                    itSeen->second.second = ++Version;
+                }
+
+                if ( itSeen->second.second > since )
+                {
+                    changedValues.push_back( &kvp );
+                }
+            }
+
+            // objects with nothing changed are not included
+            if ( !changedValues.empty( ) )
+            {
+                writer.Name( entry.Name );
+                WriteJsonProperties( writer, changedValues );
+            }
+        }
+
+        // version goes last, once all the changes are counted
+        writer.EndObject( ).Name( "version" ).Number( Version ).EndObject( );
+    }
+
+    SendJsonReply( reply, response );
+}
+
+// ------------- Implementation of XObjectsStreamRequestHandler -------------
+
+XObjectsStreamRequestHandler::XObjectsStreamRequestHandler( const string& uri ) :
+    IWebRequestHandler( uri, false ),
+    InfoObjects( ), NotificationSync( ), NotificationCondition( ), ChangesPending( false ), NeedToStop( false ),
+    NotificationThread( )
+{
+    NotificationThread = thread( NotificationThreadHandler, this );
+}
+
+XObjectsStreamRequestHandler::~XObjectsStreamRequestHandler( )
+{
+    {
+        lock_guard<mutex> lock( NotificationSync );
+        NeedToStop = true;
+    }
+    NotificationCondition.notify_one( );
+
+    NotificationThread.join( );
+}
+
+// Add named object to stream information about
+XObjectsStreamRequestHandler& XObjectsStreamRequestHandler::AddObject( const string& name,
+                                                                       const shared_ptr<const IObjectInformation>& infoObject )
+{
+    InfoObjectEntry entry;
+
+    entry.Name       = name;
+    entry.InfoObject = infoObject;
+
+    InfoObjects.push_back( entry );
+
+    return *this;
+}
+
+// Tell that properties of some objects may have changed
+void XObjectsStreamRequestHandler::NotifyChanges( )
+{
+    {
+        lock_guard<mutex> lock( NotificationSync );
+        ChangesPending = true;
+    }
+    NotificationCondition.notify_one( );
+}
+
+// Thread triggering web server's timers for connected clients, so they get notified changes
+void XObjectsStreamRequestHandler::NotificationThreadHandler( XObjectsStreamRequestHandler* me )
+{
+    unique_lock<mutex> lock( me->NotificationSync );
+
+    while ( !me->NeedToStop )
+    {
+        if ( !me->ChangesPending )
+        {
+            me->NotificationCondition.wait( lock );
+        }
+        else
+        {
+            me->ChangesPending = false;
+
+            lock.unlock( );
+            me->TriggerTimers( );
+            lock.lock( );
+        }
+    }
+}
+
+// Plain HTTP requests are not supported
+void XObjectsStreamRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+{
+    response.SendError( 400, "WebSocket connection is expected" );
+}
+
+// Start streaming the requested objects to new client
+void XObjectsStreamRequestHandler::HandleWebSocketConnect( const IWebRequest& request, IWebResponse& response )
+{
+    shared_ptr<ObjectsStreamClient> client        = make_shared<ObjectsStreamClient>( );
+    string                          unknownObject = FindObjects( InfoObjects, request.GetVariable( "objects" ), client->Indexes );
+    string                          interval      = request.GetVariable( "interval" );
+
+    if ( !unknownObject.empty( ) )
+    {
+        // sending any response rejects the connection
+        response.SendError( 404, "Unknown object" );
+    }
+    else
+    {
+        if ( !interval.empty( ) )
+        {
+            unsigned long value = strtoul( interval.c_str( ), nullptr, 10 );
+
+            client->Interval = static_cast<uint32_t>( ( value < STREAM_MIN_INTERVAL ) ? STREAM_MIN_INTERVAL :
+                                                    ( ( value > STREAM_MAX_INTERVAL ) ? STREAM_MAX_INTERVAL : value ) );
+        }
+
+        for ( size_t index : client->Indexes )
+        {
+            client->PropertiesToGet.push_back( request.GetVariable( InfoObjects[index].Name ) );
+        }
+        client->SentValues.resize( client->Indexes.size( ) );
+
+        // the first update provides all properties (once handshake is done)
+        response.SetUserData( client );
+        response.SetTimer( 0 );
+    }
+}
+
+// Send changed properties to the client, if it is time for update
+void XObjectsStreamRequestHandler::HandleTimer( IWebResponse& response )
+{
+    shared_ptr<ObjectsStreamClient> client = static_pointer_cast<ObjectsStreamClient>( response.UserData( ) );
+
+    if ( client )
+    {
+        steady_clock::time_point now     = steady_clock::now( );
+        uint32_t                 elapsed = static_cast<uint32_t>( duration_cast<milliseconds>( now - client->LastUpdateTime ).count( ) );
+
+        if ( ( client->WasUpdated ) && ( elapsed < client->Interval ) )
+        {
+            // too early for the next update
+            response.SetTimer( client->Interval - elapsed );
+        }
+        else
+        {
+            string&     message = ReplyBuffer( );
+            XJsonWriter writer( message );
+            bool        first   = true;
+
+            vector<const PropertyMap::value_type*> changedValues;
+
+            writer.BeginObject( );
+
+            for ( size_t i = 0; i < client->Indexes.size( ); i++ )
+            {
+                const InfoObjectEntry& entry   = InfoObjects[client->Indexes[i]];
+                PropertyMap            values  = GetProperties( entry.InfoObject, client->PropertiesToGet[i] );
+                PropertyMap&           sent    = client->SentValues[i];
+
+                changedValues.clear( );
+
+                for ( const auto& kvp : values )
+                {
+                    auto itSent = sent.find( kvp.first );
+
+                    if ( itSent == sent.end( ) )
+                    {
+                        sent.insert( itSent, kvp );
+                        changedValues.push_back( &kvp );
+                    }
+                    else if ( itSent->second != kvp.second )
+                    {
+                        itSent->second = kvp.second;
+                        changedValues.push_back( &kvp );
+                    }
+                }
+
+                if ( !changedValues.empty( ) )
+                {
+                    writer.Name( entry.Name );
+                    WriteJsonProperties( writer, changedValues );
+
+                    first = false;
+                }
+            }
+
+            writer.EndObject( );
+
+            if ( !first )
+            {
+                response.SendWebSocketMessage( reinterpret_cast<const uint8_t*>( message.data( ) ), message.length( ), false );
+
+                client->LastUpdateTime = now;
+                client->WasUpdated     = true;
+            }
+
+            response.SetTimer( ( client->Interval > STREAM_CHECK_INTERVAL ) ? client->Interval : STREAM_CHECK_INTERVAL );
+        }
+    }
+}
@@ -21,6 +21,11 @@
 #ifndef XOBJECT_CONFIGURATION_REQUEST_HANDLER_HPP
 #define XOBJECT_CONFIGURATION_REQUEST_HANDLER_HPP
 
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <condition_variable>
+
 #include "IObjectConfigurator.hpp"
 #include "XWebServer.hpp"
 
@@ -32,6 +37,9 @@ public:
 
     void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
 
+    // The configured object must be thread safe
+    bool CanHandleOnWorkerThread( ) const { return true; }
+
 private:
     std::shared_ptr<IObjectConfigurator> ObjectToConfig;
 };
@@ -44,8 +52,106 @@ public:
 
     void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
 
+    // The information object must be thread safe
+    bool CanHandleOnWorkerThread( ) const { return true; }
+
 private:
     std::shared_ptr<IObjectInformation> InfoObject;
 };
 
+// Web request handler to provide object's properties as metrics in Prometheus text format - property
+// names are used as metric names (including labels, if any) and their values must be numbers
+class XMetricsRequestHandler : public IWebRequestHandler
+{
+public:
+    XMetricsRequestHandler( const std::string& uri, const std::shared_ptr<IObjectInformation>& metricsObject );
+
+    void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+
+    // The metrics object must be thread safe
+    bool CanHandleOnWorkerThread( ) const { return true; }
+
+private:
+    std::shared_ptr<IObjectInformation> MetricsObject;
+};
+
+// Web request handler to provide properties of several objects in one reply - read/only. The "objects" variable
+// is a comma separated list of objects' names to provide (all if not set), while a variable named after an object
+// lists its properties to provide (all if not set). If "since" variable is set, then only those properties are
+// provided, which changed after that version - every reply tells current version to use with the next request.
+// Changes are detected by comparing properties' values with those seen by the previous requests.
+class XBatchInformationRequestHandler : public IWebRequestHandler
+{
+public:
+    XBatchInformationRequestHandler( const std::string& uri );
+
+    // Add named object to provide information about (must be done before starting web server)
+    XBatchInformationRequestHandler& AddObject( const std::string& name, const std::shared_ptr<const IObjectInformation>& infoObject );
+
+    void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+
+    // The information objects must be thread safe
+    bool CanHandleOnWorkerThread( ) const { return true; }
+
+private:
+    // property value and version it was last changed at
+    typedef std::map<std::string, std::pair<std::string, uint64_t>> VersionedPropertyMap;
+
+    struct InfoObjectEntry
+    {
+        std::string Name;
+        std::shared_ptr<const IObjectInformation> InfoObject;
+        VersionedPropertyMap SeenProperties;
+    };
+
+    std::mutex                   Sync;
+    std::vector<InfoObjectEntry> InfoObjects;
+    uint64_t                     Version;
+};
+
+// Web request handler streaming properties of objects over WebSocket connections - read/only. Clients select objects
+// and their properties when connecting, same as with batch information requests, while "interval" variable sets the
+// minimum time (ms) between updates. Every update is a JSON text message containing only the properties, which changed
+// since the previous update. Objects' owners call NotifyChanges() to get updates pushed right away - otherwise
+// properties are checked for changes about once a second.
+class XObjectsStreamRequestHandler : public IWebRequestHandler
+{
+public:
+    XObjectsStreamRequestHandler( const std::string& uri );
+    ~XObjectsStreamRequestHandler( );
+
+    // Add named object to stream information about (must be done before starting web server)
+    XObjectsStreamRequestHandler& AddObject( const std::string& name, const std::shared_ptr<const IObjectInformation>& infoObject );
+
+    // Tell that properties of some objects may have changed - can be called from any thread
+    void NotifyChanges( );
+
+    // Plain HTTP requests are not supported
+    void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+
+    void HandleTimer( IWebResponse& response );
+
+    bool CanHandleWebSocket( ) const { return true; }
+    void HandleWebSocketConnect( const IWebRequest& request, IWebResponse& response );
+
+private:
+    static void NotificationThreadHandler( XObjectsStreamRequestHandler* me );
+
+private:
+    struct InfoObjectEntry
+    {
+        std::string Name;
+        std::shared_ptr<const IObjectInformation> InfoObject;
+    };
+
+    std::vector<InfoObjectEntry> InfoObjects;
+
+    // web server's timers can not be triggered from its own thread, so it is done by a helper thread
+    std::mutex                   NotificationSync;
+    std::condition_variable      NotificationCondition;
+    bool                         ChangesPending;
+    bool                         NeedToStop;
+    std::thread                  NotificationThread;
+};
+
 #endif // XOBJECT_CONFIGURATION_REQUEST_HANDLER_HPP
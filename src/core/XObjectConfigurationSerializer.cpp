@@ -18,32 +18,117 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <stdio.h>
+#include <errno.h>
+#include <mutex>
+#include <thread>
+
 #include "XObjectConfigurationSerializer.hpp"
+#include "XManualResetEvent.hpp"
 
 #ifdef WIN32
     #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
 #endif
 
 using namespace std;
 
+namespace Private
+{
+    class XObjectConfigurationSerializerData
+    {
+    public:
+        string                          FileName;
+        shared_ptr<IObjectConfigurator> ObjectToConfigure;
+
+        recursive_mutex                 Sync;
+        // version/content of the object's configuration, which is in the file
+        uint64_t                        SavedVersion;
+        string                          SavedContent;
+        bool                            HaveSavedContent;
+
+        thread                          AutoSaveThread;
+        XManualResetEvent               NeedToStopAutoSave;
+        uint32_t                        SaveDelay;
+
+    public:
+        XObjectConfigurationSerializerData( const string& fileName, const shared_ptr<IObjectConfigurator>& objectToConfigure ) :
+            FileName( fileName ), ObjectToConfigure( objectToConfigure ), Sync( ),
+            SavedVersion( 0 ), SavedContent( ), HaveSavedContent( false ),
+            AutoSaveThread( ), NeedToStopAutoSave( ), SaveDelay( 0 )
+        {
+        }
+
+        XError SaveConfiguration( );
+        XError LoadConfiguration( );
+
+        string Serialize( ) const;
+        XError WriteFile( const string& content ) const;
+
+        static void AutoSaveThreadHandler( XObjectConfigurationSerializerData* me );
+    };
+}
+
 XObjectConfigurationSerializer::XObjectConfigurationSerializer( ) :
-    FileName( ),
-    ObjectToConfigure( )
+    mData( new Private::XObjectConfigurationSerializerData( string( ), shared_ptr<IObjectConfigurator>( ) ) )
 {
 
 }
 
 XObjectConfigurationSerializer::XObjectConfigurationSerializer( const std::string& fileName,
                                                                 const std::shared_ptr<IObjectConfigurator>& objectToConfigure ) :
-    FileName( fileName ),
-    ObjectToConfigure( objectToConfigure )
+    mData( new Private::XObjectConfigurationSerializerData( fileName, objectToConfigure ) )
+{
+}
+
+XObjectConfigurationSerializer::~XObjectConfigurationSerializer( )
+{
+    StopAutoSave( );
+    delete mData;
+}
+
+// Save properties of the specified object into a file (if they changed)
+XError XObjectConfigurationSerializer::SaveConfiguration( )
+{
+    return mData->SaveConfiguration( );
+}
+
+// Load properties of the specified object from a file
+XError XObjectConfigurationSerializer::LoadConfiguration( )
+{
+    return mData->LoadConfiguration( );
+}
+
+// Start saving configuration on background thread
+void XObjectConfigurationSerializer::StartAutoSave( uint32_t saveDelay )
+{
+    StopAutoSave( );
+
+    mData->SaveDelay = ( saveDelay == 0 ) ? 1 : saveDelay;
+    mData->NeedToStopAutoSave.Reset( );
+    mData->AutoSaveThread = thread( Private::XObjectConfigurationSerializerData::AutoSaveThreadHandler, mData );
+}
+
+// Stop saving configuration on background thread (changes done since the last save are not saved)
+void XObjectConfigurationSerializer::StopAutoSave( )
 {
+    if ( mData->AutoSaveThread.joinable( ) )
+    {
+        mData->NeedToStopAutoSave.Signal( );
+        mData->AutoSaveThread.join( );
+    }
 }
 
-// Save properties of the specified object into a file
-XError XObjectConfigurationSerializer::SaveConfiguration( ) const
+namespace Private
+{
+
+// Save properties of the specified object into a file if they changed since the last save/load
+XError XObjectConfigurationSerializerData::SaveConfiguration( )
 {
-    XError ret  = XError::Success;
+    lock_guard<recursive_mutex> lock( Sync );
+    XError                      ret = XError::Success;
 
     if ( ( FileName.empty( ) ) || ( !ObjectToConfigure ) )
     {
@@ -51,61 +136,143 @@ XError XObjectConfigurationSerializer::SaveConfiguration( ) const
     }
     else
     {
-        FILE* file = nullptr;
+        uint64_t version = ObjectToConfigure->ChangeVersion( );
 
-#ifdef WIN32
+        // objects, which don't track changes, always report version 0 - check their content then
+        if ( ( !HaveSavedContent ) || ( version == 0 ) || ( version != SavedVersion ) )
         {
-            int charsRequired = MultiByteToWideChar( CP_UTF8, 0, FileName.c_str( ), -1, NULL, 0 );
+            string content = Serialize( );
 
-            if ( charsRequired > 0 )
+            if ( ( !HaveSavedContent ) || ( content != SavedContent ) )
             {
-                WCHAR* filenameUtf16 = (WCHAR*) malloc( sizeof( WCHAR ) * charsRequired );
+                ret = WriteFile( content );
 
-                if ( MultiByteToWideChar( CP_UTF8, 0, FileName.c_str( ), -1, filenameUtf16, charsRequired ) > 0 )
+                if ( ret )
                 {
-                    file = _wfopen( filenameUtf16, L"w" );
+                    SavedContent     = content;
+                    HaveSavedContent = true;
                 }
+            }
 
-                free( filenameUtf16 );
+            if ( ret )
+            {
+                SavedVersion = version;
             }
         }
-#else
-        file = fopen( FileName.c_str( ), "w" );
-#endif
+    }
 
-        if ( file == nullptr )
+    return ret;
+}
+
+// Get properties of the object in the file's format - property name and value go separate lines,
+// while properties are separated with blank lines
+string XObjectConfigurationSerializerData::Serialize( ) const
+{
+    map<string, string> properties = ObjectToConfigure->GetAllProperties( );
+    string              content;
+
+    for ( auto property : properties )
+    {
+        if ( !content.empty( ) )
         {
-            ret = XError::IOError;
+            content.push_back( '\n' );
         }
-        else
+
+        content.append( property.first );
+        content.push_back( '\n' );
+        content.append( property.second );
+        content.push_back( '\n' );
+    }
+
+    return content;
+}
+
+// Write content into a temporary file and then replace the configuration file with it, so the file
+// has either old or new configuration even if writing gets interrupted
+XError XObjectConfigurationSerializerData::WriteFile( const string& content ) const
+{
+    string tempFileName = FileName + ".tmp";
+    XError ret          = XError::IOError;
+
+#ifdef WIN32
+    int charsRequired = MultiByteToWideChar( CP_UTF8, 0, tempFileName.c_str( ), -1, NULL, 0 );
+
+    if ( charsRequired > 0 )
+    {
+        WCHAR* tempFileNameUtf16 = (WCHAR*) malloc( sizeof( WCHAR ) * charsRequired );
+        WCHAR* fileNameUtf16     = (WCHAR*) malloc( sizeof( WCHAR ) * charsRequired );
+
+        if ( ( MultiByteToWideChar( CP_UTF8, 0, tempFileName.c_str( ), -1, tempFileNameUtf16, charsRequired ) > 0 ) &&
+             ( MultiByteToWideChar( CP_UTF8, 0, FileName.c_str( ), -1, fileNameUtf16, charsRequired ) > 0 ) )
         {
-            map<string, string> properties = ObjectToConfigure->GetAllProperties( );
-            bool                first = true;
+            FILE* file = _wfopen( tempFileNameUtf16, L"wb" );
 
-            // write a simple file, where property name and value go separate lines
-            for ( auto property : properties )
+            if ( file != nullptr )
             {
-                if ( !first )
+                bool written = ( fwrite( content.data( ), 1, content.length( ), file ) == content.length( ) );
+
+                if ( ( fclose( file ) == 0 ) && ( written ) &&
+                     ( MoveFileExW( tempFileNameUtf16, fileNameUtf16, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) ) )
                 {
-                    fprintf( file, "\n" );
+                    ret = XError::Success;
                 }
+            }
+        }
+
+        free( tempFileNameUtf16 );
+        free( fileNameUtf16 );
+    }
+#else
+    int file = open( tempFileName.c_str( ), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+
+    if ( file != -1 )
+    {
+        // the content is small, so single write is expected - making sure it is complete though
+        const char* ptr      = content.data( );
+        size_t      left     = content.length( );
+        bool        written  = true;
 
-                fprintf( file, "%s\n%s\n", property.first.c_str( ), property.second.c_str( ) );
+        while ( ( left != 0 ) && ( written ) )
+        {
+            ssize_t count = write( file, ptr, left );
 
-                first = false;
+            if ( count > 0 )
+            {
+                ptr  += count;
+                left -= count;
+            }
+            else if ( ( count == -1 ) && ( errno == EINTR ) )
+            {
+                continue;
+            }
+            else
+            {
+                written = false;
             }
+        }
 
-            fclose( file );
+        // make sure data are on the disk before the rename makes them the configuration
+        written = ( ( written ) && ( fsync( file ) == 0 ) );
+
+        if ( ( close( file ) == 0 ) && ( written ) && ( rename( tempFileName.c_str( ), FileName.c_str( ) ) == 0 ) )
+        {
+            ret = XError::Success;
+        }
+        else
+        {
+            unlink( tempFileName.c_str( ) );
         }
     }
+#endif
 
     return ret;
 }
 
 // Load properties of the specified object from a file
-XError XObjectConfigurationSerializer::LoadConfiguration( ) const
+XError XObjectConfigurationSerializerData::LoadConfiguration( )
 {
-    XError ret  = XError::Success;
+    lock_guard<recursive_mutex> lock( Sync );
+    XError                      ret = XError::Success;
 
     if ( ( FileName.empty( ) ) || ( !ObjectToConfigure ) )
     {
@@ -172,8 +339,36 @@ XError XObjectConfigurationSerializer::LoadConfiguration( ) const
                     }
                 }
             }
+
+            fclose( file );
+
+            // loaded configuration is what is in the file already
+            SavedVersion     = ObjectToConfigure->ChangeVersion( );
+            SavedContent     = Serialize( );
+            HaveSavedContent = true;
         }
     }
 
     return ret;
 }
+
+// Save configuration once it changes and stays unchanged for the configured delay
+void XObjectConfigurationSerializerData::AutoSaveThreadHandler( XObjectConfigurationSerializerData* me )
+{
+    uint64_t lastVersion = me->ObjectToConfigure->ChangeVersion( );
+
+    while ( !me->NeedToStopAutoSave.Wait( me->SaveDelay ) )
+    {
+        uint64_t version = me->ObjectToConfigure->ChangeVersion( );
+
+        // wait till changes stop coming
+        if ( version == lastVersion )
+        {
+            me->SaveConfiguration( );
+        }
+
+        lastVersion = version;
+    }
+}
+
+} // namespace Private
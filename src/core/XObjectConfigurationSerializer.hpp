@@ -21,23 +21,39 @@
 #ifndef XOBJECT_CONFIGURATION_SERIALIZER_HPP
 #define XOBJECT_CONFIGURATION_SERIALIZER_HPP
 
+#include <stdint.h>
 #include <memory>
 #include "IObjectConfigurator.hpp"
+#include "XInterfaces.hpp"
 
-class XObjectConfigurationSerializer
+namespace Private
+{
+    class XObjectConfigurationSerializerData;
+}
+
+// Saves/loads properties of an object to/from a file. The file is written only when
+// the object's configuration has changed since it was saved/loaded last time.
+class XObjectConfigurationSerializer : private Uncopyable
 {
 public:
     XObjectConfigurationSerializer( );
     XObjectConfigurationSerializer( const std::string& fileName,
                                     const std::shared_ptr<IObjectConfigurator>& objectToConfigure );
+    ~XObjectConfigurationSerializer( );
 
-    XError SaveConfiguration( ) const;
-    XError LoadConfiguration( ) const;
+    // Save configuration if it has changed. The file is replaced atomically - new configuration
+    // is written into a temporary file first, which is then renamed to the configuration file.
+    XError SaveConfiguration( );
+    XError LoadConfiguration( );
+
+    // Start/Stop background thread, which saves configuration once it has changed and then
+    // stayed unchanged for the specified time (ms), so the caller never waits for file I/O
+    // and a series of changes results in a single write.
+    void StartAutoSave( uint32_t saveDelay );
+    void StopAutoSave( );
 
 private:
-    std::string FileName;
-    std::shared_ptr<IObjectConfigurator> ObjectToConfigure;
+    Private::XObjectConfigurationSerializerData* mData;
 };
 
 #endif // XOBJECT_CONFIGURATION_SERIALIZER_HPP
-
@@ -0,0 +1,278 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "XPropertyTable.hpp"
+#include "XJsonWriter.hpp"
+
+using namespace std;
+
+// Hash of a string seeded with the specified value (FNV-1a)
+static uint32_t HashString( const char* str, size_t length, uint32_t seed )
+{
+    uint32_t hash = 2166136261u ^ seed;
+
+    for ( size_t i = 0; i < length; i++ )
+    {
+        hash ^= static_cast<uint8_t>( str[i] );
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// Find seed of the hash function, which puts every property's name into its own slot
+void XPropertyTableBase::BuildIndex( )
+{
+    size_t slotsCount = 4;
+    bool   found      = false;
+
+    while ( slotsCount < Infos.size( ) * 2 )
+    {
+        slotsCount <<= 1;
+    }
+
+    while ( !found )
+    {
+        HashMask = static_cast<uint32_t>( slotsCount - 1 );
+
+        for ( HashSeed = 0; ( HashSeed < 1000 ) && ( !found ); HashSeed++ )
+        {
+            HashSlots.assign( slotsCount, -1 );
+            found = true;
+
+            for ( size_t i = 0; i < Infos.size( ); i++ )
+            {
+                uint32_t slot = HashString( Infos[i].Name, strlen( Infos[i].Name ), HashSeed ) & HashMask;
+
+                if ( HashSlots[slot] != -1 )
+                {
+                    found = false;
+                    break;
+                }
+
+                HashSlots[slot] = static_cast<int16_t>( i );
+            }
+        }
+
+        // the loop increments the seed once more after finding it
+        HashSeed--;
+
+        if ( !found )
+        {
+            // too crowded - try bigger table
+            slotsCount <<= 1;
+        }
+    }
+}
+
+// Find index of the property with the specified name
+int XPropertyTableBase::Find( const char* name, size_t length ) const
+{
+    int index = HashSlots[HashString( name, length, HashSeed ) & HashMask];
+
+    if ( ( index != -1 ) && ( ( strncmp( Infos[index].Name, name, length ) != 0 ) || ( Infos[index].Name[length] != '\0' ) ) )
+    {
+        index = -1;
+    }
+
+    return index;
+}
+
+// Convert property's value to string
+void XPropertyTableBase::ValueToString( const XPropertyInfo& info, double value, string& str )
+{
+    char buffer[32];
+
+    switch ( info.Type )
+    {
+    case XPropertyType::Boolean:
+        str = ( value != 0 ) ? "1" : "0";
+        break;
+
+    case XPropertyType::Choice:
+        str.clear( );
+        for ( size_t i = 0; i < info.ChoicesCount; i++ )
+        {
+            if ( info.Choices[i].Value == static_cast<int32_t>( value ) )
+            {
+                str = info.Choices[i].Name;
+                break;
+            }
+        }
+        break;
+
+    case XPropertyType::Float:
+        sprintf( buffer, "%0.2f", value );
+        str = buffer;
+        break;
+
+    default:
+        sprintf( buffer, "%d", static_cast<int32_t>( value ) );
+        str = buffer;
+        break;
+    }
+}
+
+// Convert property's value from string
+XError XPropertyTableBase::ValueFromString( const XPropertyInfo& info, const string& str, double& value )
+{
+    XError ret = XError::Success;
+    char*  end = nullptr;
+
+    switch ( info.Type )
+    {
+    case XPropertyType::Boolean:
+        value = ( ( str == "1" ) || ( str == "true" ) ) ? 1 : 0;
+        break;
+
+    case XPropertyType::Choice:
+        ret = XError::InvalidPropertyValue;
+        for ( size_t i = 0; i < info.ChoicesCount; i++ )
+        {
+            if ( str == info.Choices[i].Name )
+            {
+                value = info.Choices[i].Value;
+                ret   = XError::Success;
+                break;
+            }
+        }
+        break;
+
+    case XPropertyType::Float:
+        value = strtod( str.c_str( ), &end );
+        if ( ( end == str.c_str( ) ) || ( !isfinite( value ) ) )
+        {
+            ret = XError::InvalidPropertyValue;
+        }
+        break;
+
+    default:
+        value = static_cast<double>( strtol( str.c_str( ), &end, 10 ) );
+        if ( end == str.c_str( ) )
+        {
+            ret = XError::InvalidPropertyValue;
+        }
+        break;
+    }
+
+    return ret;
+}
+
+// Check if the value is valid for the property and bring it to the property's range
+bool XPropertyTableBase::NormalizeValue( const XPropertyInfo& info, double& value )
+{
+    bool ret = false;
+
+    switch ( info.Type )
+    {
+    case XPropertyType::Boolean:
+        value = ( value != 0 ) ? 1 : 0;
+        ret   = true;
+        break;
+
+    case XPropertyType::Choice:
+        for ( size_t i = 0; ( i < info.ChoicesCount ) && ( !ret ); i++ )
+        {
+            ret = ( info.Choices[i].Value == value );
+        }
+        break;
+
+    case XPropertyType::Float:
+        ret = isfinite( value );
+        break;
+
+    default:
+        if ( isfinite( value ) )
+        {
+            // out of range values are clamped, same as the objects themselves did before (strict properties reject them)
+            value = trunc( value );
+            ret   = ( ( !info.Strict ) || ( ( value >= info.Min ) && ( value <= info.Max ) ) );
+            if ( value < info.Min ) { value = info.Min; }
+            if ( value > info.Max ) { value = info.Max; }
+        }
+        break;
+    }
+
+    return ret;
+}
+
+// Get descriptions of all properties as JSON strings
+PropertyMap XPropertyTableBase::GetDescriptions( ) const
+{
+    PropertyMap descriptions;
+    string      description;
+
+    for ( size_t i = 0; i < Infos.size( ); i++ )
+    {
+        const XPropertyInfo& info = Infos[i];
+        XJsonWriter          writer( description );
+
+        description.clear( );
+        writer.BeginObject( );
+
+        switch ( info.Type )
+        {
+        case XPropertyType::Boolean:
+            writer.Name( "def" ).Integer( static_cast<int64_t>( info.Default ) ).Name( "type" ).String( "bool" );
+            break;
+
+        case XPropertyType::Choice:
+            {
+                string defaultValue;
+
+                ValueToString( info, info.Default, defaultValue );
+                writer.Name( "def" ).String( defaultValue ).Name( "type" ).String( "select" );
+            }
+            break;
+
+        case XPropertyType::Float:
+            writer.Name( "type" ).String( "float" );
+            break;
+
+        default:
+            writer.Name( "min" ).Integer( static_cast<int64_t>( info.Min ) ).Name( "max" ).Integer( static_cast<int64_t>( info.Max ) ).
+                   Name( "def" ).Integer( static_cast<int64_t>( info.Default ) ).Name( "type" ).String( "int" );
+            break;
+        }
+
+        writer.Name( "order" ).Integer( static_cast<int64_t>( i ) ).Name( "name" ).String( info.Title );
+
+        if ( info.Type == XPropertyType::Choice )
+        {
+            writer.Name( "choices" ).BeginArray( );
+            for ( size_t j = 0; j < info.ChoicesCount; j++ )
+            {
+                writer.BeginArray( ).String( info.Choices[j].Name ).String( info.Choices[j].Title ).EndArray( );
+            }
+            writer.EndArray( );
+        }
+
+        writer.EndObject( );
+
+        descriptions.insert( PropertyMap::value_type( info.Name, description ) );
+    }
+
+    return descriptions;
+}
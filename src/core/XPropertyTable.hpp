@@ -0,0 +1,229 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XPROPERTY_TABLE_HPP
+#define XPROPERTY_TABLE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <initializer_list>
+
+#include "IObjectInformation.hpp"
+
+enum class XPropertyType
+{
+    Integer,
+    Boolean,
+    Choice,
+    Float
+};
+
+// Named value of a choice property
+struct XPropertyChoice
+{
+    const char* Name;
+    const char* Title;
+    int32_t     Value;
+};
+
+// Description of a property - its name, type, range of integer values or choices, etc. Out of range
+// integers are clamped, unless the property is strict (can be left out when declaring it) - then those
+// are rejected.
+struct XPropertyInfo
+{
+    const char*            Name;
+    const char*            Title;
+    XPropertyType          Type;
+    int32_t                Min;
+    int32_t                Max;
+    int32_t                Default;
+    const XPropertyChoice* Choices;
+    size_t                 ChoicesCount;
+    bool                   Strict;
+};
+
+/* ================================================================= */
+/* Non template part of the property table - finds properties by     */
+/* name using perfect hash (built once for the table), converts      */
+/* values to/from strings and checks them against property's info.   */
+/* ================================================================= */
+class XPropertyTableBase
+{
+protected:
+    XPropertyTableBase( ) : Infos( ), HashSlots( ), HashSeed( 0 ), HashMask( 0 ) { }
+
+    void BuildIndex( );
+
+public:
+    // Number of properties in the table and description of the specified one
+    size_t Count( ) const { return Infos.size( ); }
+    const XPropertyInfo& Info( size_t index ) const { return Infos[index]; }
+
+    // Find index of the property with the specified name (-1 if it is not in the table)
+    int Find( const char* name, size_t length ) const;
+    int Find( const std::string& name ) const { return Find( name.c_str( ), name.length( ) ); }
+
+    // Convert property's value to/from string
+    static void ValueToString( const XPropertyInfo& info, double value, std::string& str );
+    static XError ValueFromString( const XPropertyInfo& info, const std::string& str, double& value );
+
+    // Check if the value is valid for the property (one of choices, finite number, etc.) and
+    // bring it to the property's range (integers are clamped to min/max, unless it is strict)
+    static bool NormalizeValue( const XPropertyInfo& info, double& value );
+
+    // Get descriptions of all properties as JSON strings (property name is the key) - type, title,
+    // default value, range or choices, order. Can be used to build UI for configuring an object.
+    PropertyMap GetDescriptions( ) const;
+
+protected:
+    std::vector<XPropertyInfo> Infos;
+
+private:
+    std::vector<int16_t>       HashSlots;
+    uint32_t                   HashSeed;
+    uint32_t                   HashMask;
+};
+
+/* ================================================================= */
+/* Table of properties provided by objects of the specified class,   */
+/* which is declared once for the class and implements everything    */
+/* what IObjectConfigurator/IObjectInformation needs. Properties are */
+/* accessed either by name as strings or by index as typed values.   */
+/* ================================================================= */
+template <class T> class XPropertyTable : public XPropertyTableBase
+{
+public:
+    struct Property
+    {
+        XPropertyInfo Info;
+        // get/set value of the property - setter is not set for read-only properties
+        double ( *Get )( const T& object );
+        XError ( *Set )( T& object, double value );
+    };
+
+    XPropertyTable( std::initializer_list<Property> properties ) : Accessors( properties )
+    {
+        for ( const Property& property : Accessors )
+        {
+            Infos.push_back( property.Info );
+        }
+        BuildIndex( );
+    }
+
+    // Get/Set property's value by index
+    XError GetValue( const T& object, size_t index, double& value ) const
+    {
+        XError ret = XError::Success;
+
+        if ( index >= Accessors.size( ) )
+        {
+            ret = XError::UnknownProperty;
+        }
+        else
+        {
+            value = Accessors[index].Get( object );
+        }
+
+        return ret;
+    }
+    XError SetValue( T& object, size_t index, double value ) const
+    {
+        XError ret;
+
+        if ( index >= Accessors.size( ) )
+        {
+            ret = XError::UnknownProperty;
+        }
+        else if ( Accessors[index].Set == nullptr )
+        {
+            ret = XError::ReadOnlyProperty;
+        }
+        else if ( !NormalizeValue( Infos[index], value ) )
+        {
+            ret = XError::InvalidPropertyValue;
+        }
+        else
+        {
+            ret = Accessors[index].Set( object, value );
+        }
+
+        return ret;
+    }
+
+    // Get/Set property's value by name
+    XError GetProperty( const T& object, const std::string& name, std::string& value ) const
+    {
+        int    index = Find( name );
+        XError ret   = XError::Success;
+
+        if ( index < 0 )
+        {
+            ret = XError::UnknownProperty;
+        }
+        else
+        {
+            ValueToString( Infos[index], Accessors[index].Get( object ), value );
+        }
+
+        return ret;
+    }
+    XError SetProperty( T& object, const std::string& name, const std::string& value ) const
+    {
+        int    index = Find( name );
+        double numericValue;
+        XError ret;
+
+        if ( index < 0 )
+        {
+            ret = XError::UnknownProperty;
+        }
+        else if ( Accessors[index].Set == nullptr )
+        {
+            ret = XError::ReadOnlyProperty;
+        }
+        else if ( ( ret = ValueFromString( Infos[index], value, numericValue ) ) )
+        {
+            ret = SetValue( object, static_cast<size_t>( index ), numericValue );
+        }
+
+        return ret;
+    }
+
+    // Get all properties of the object as strings
+    PropertyMap GetAllProperties( const T& object ) const
+    {
+        PropertyMap properties;
+        std::string value;
+
+        for ( size_t i = 0; i < Accessors.size( ); i++ )
+        {
+            ValueToString( Infos[i], Accessors[i].Get( object ), value );
+            properties.insert( PropertyMap::value_type( Infos[i].Name, value ) );
+        }
+
+        return properties;
+    }
+
+private:
+    std::vector<Property> Accessors;
+};
+
+#endif // XPROPERTY_TABLE_HPP
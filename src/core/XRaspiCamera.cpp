@@ -20,6 +20,7 @@
 
 #include <mutex>
 #include <thread>
+#include <atomic>
 
 #include <bcm_host.h>
 #include <interface/vcos/vcos.h>
@@ -33,6 +34,7 @@
 
 #include "XRaspiCamera.hpp"
 #include "XManualResetEvent.hpp"
+#include "XTrace.hpp"
 
 using namespace std;
 
@@ -41,6 +43,157 @@ namespace Private
     #define CAMERA_VIDEO_PORT   (1)
     #define BUFFER_COUNT        (2)
 
+    #ifndef MMAL_COMPONENT_DEFAULT_RESIZER
+        #define MMAL_COMPONENT_DEFAULT_RESIZER "vc.ril.resize"
+    #endif
+
+    // Splitter's outputs used for different streams
+    #define SPLITTER_JPEG_OUTPUT      (0)
+    #define SPLITTER_SECONDARY_OUTPUT (1)
+    #define SPLITTER_H264_OUTPUT      (2)
+    #define SPLITTER_RAW_OUTPUT       (3)
+
+    // Number of extra buffers to allocate when listener may keep some of them
+    #define ZERO_COPY_EXTRA_BUFFERS (2)
+
+    // Time (ms) to wait for more configuration changes before reconfiguring running camera
+    #define RECONFIGURATION_DELAY   (200)
+
+    // Supported video format
+    #define MIN_VIDEO_WIDTH         (64)
+    #define MAX_VIDEO_WIDTH         (1920)
+    #define MIN_VIDEO_HEIGHT        (64)
+    #define MAX_VIDEO_HEIGHT        (1080)
+    #define MAX_FRAME_RATE          (90)
+    #define MAX_JPEG_QUALITY        (100)
+
+    // Counters of frames and buffers of a video output - shared with its buffers given to listeners,
+    // since those may be released after camera is stopped
+    class VideoOutputCounters : private Uncopyable
+    {
+    public:
+        atomic<uint32_t> BuffersCount;
+        atomic<uint32_t> BuffersInUse;
+        atomic<uint32_t> MaxBuffersInUse;
+        atomic<uint64_t> BufferStarvations;
+        atomic<uint64_t> FramesCaptured;
+        atomic<uint64_t> FramesDelivered;
+        atomic<uint64_t> FramesDropped;
+
+    public:
+        VideoOutputCounters( ) :
+            BuffersCount( 0 ), BuffersInUse( 0 ), MaxBuffersInUse( 0 ), BufferStarvations( 0 ),
+            FramesCaptured( 0 ), FramesDelivered( 0 ), FramesDropped( 0 )
+        {
+        }
+
+        // Reset counters on camera start (buffers may still be in use since the previous run)
+        void Reset( )
+        {
+            MaxBuffersInUse   = BuffersInUse.load( );
+            BufferStarvations = 0;
+            FramesCaptured    = 0;
+            FramesDelivered   = 0;
+            FramesDropped     = 0;
+        }
+
+        // Account buffer given to listeners
+        void BufferTaken( )
+        {
+            uint32_t inUse    = ++BuffersInUse;
+            uint32_t maxInUse = MaxBuffersInUse;
+
+            while ( ( inUse > maxInUse ) && ( !MaxBuffersInUse.compare_exchange_weak( maxInUse, inUse ) ) )
+            {
+            }
+
+            // port has nothing to fill with the next frames until some buffer is released
+            if ( inUse >= BuffersCount )
+            {
+                BufferStarvations++;
+            }
+        }
+
+        XRaspiCameraStreamStats Stats( ) const
+        {
+            XRaspiCameraStreamStats stats;
+
+            stats.BuffersCount      = BuffersCount;
+            stats.BuffersInUse      = BuffersInUse;
+            stats.MaxBuffersInUse   = MaxBuffersInUse;
+            stats.BufferStarvations = BufferStarvations;
+            stats.FramesCaptured    = FramesCaptured;
+            stats.FramesDelivered   = FramesDelivered;
+            stats.FramesDropped     = FramesDropped;
+
+            return stats;
+        }
+    };
+
+    // Video buffers given to listeners without making a copy of them. The pool is kept alive
+    // until the last buffer is released, even if camera gets stopped in between - it is not
+    // allocated by the port, so it does not need the port (or its component) once deactivated.
+    class SharedVideoBuffers : private Uncopyable
+    {
+    private:
+        mutex           Sync;
+        MMAL_PORT_T*    Port;
+        MMAL_POOL_T*    Pool;
+
+        shared_ptr<VideoOutputCounters> Counters;
+
+    public:
+        SharedVideoBuffers( MMAL_PORT_T* port, MMAL_POOL_T* pool, const shared_ptr<VideoOutputCounters>& counters ) :
+            Sync( ), Port( port ), Pool( pool ), Counters( counters )
+        {
+        }
+
+        ~SharedVideoBuffers( )
+        {
+            mmal_pool_destroy( Pool );
+        }
+
+        // Stop returning released buffers back to the port - must be done before the port is destroyed
+        void Deactivate( )
+        {
+            lock_guard<mutex> lock( Sync );
+            Port = nullptr;
+        }
+
+        // Release the buffer and send a free one to the port, so it could be filled with new frame
+        bool ReturnBuffer( MMAL_BUFFER_HEADER_T* buffer );
+    };
+
+    class XRaspiCameraData;
+
+    // Video streams provided by camera's pipeline
+    enum class VideoStream
+    {
+        Primary = 0,
+        Secondary,
+        H264,
+        Raw
+    };
+
+    // Output port of camera's pipeline, which provides video frames to one of the listeners
+    class VideoOutput : private Uncopyable
+    {
+    public:
+        XRaspiCameraData*              Owner;
+        VideoStream                    Stream;
+        MMAL_PORT_T*                   Port;
+        MMAL_POOL_T*                   Pool;
+        shared_ptr<SharedVideoBuffers> SharedBuffers;
+        shared_ptr<VideoOutputCounters> Counters;
+
+    public:
+        VideoOutput( XRaspiCameraData* owner, VideoStream stream ) :
+            Owner( owner ), Stream( stream ), Port( nullptr ), Pool( nullptr ), SharedBuffers( ),
+            Counters( make_shared<VideoOutputCounters>( ) )
+        {
+        }
+    };
+
     // Private details of the implementation
     class XRaspiCameraData
     {
@@ -50,24 +203,65 @@ namespace Private
         thread                  ControlThread;
         XManualResetEvent       NeedToStop;
         IVideoSourceListener*   Listener;
+        IVideoSourceListener*   SecondaryListener;
+        IVideoSourceListener*   H264Listener;
+        IVideoSourceListener*   RawListener;
         bool                    Running;
 
         MMAL_COMPONENT_T*       Camera;
         MMAL_COMPONENT_T*       JpegEncoder;
         MMAL_CONNECTION_T*      JpegEncoderConnection;
         MMAL_PORT_T*            VideoPort;
-        MMAL_PORT_T*            VideoBufferPort;
-        MMAL_POOL_T*            VideoBufferPool;
-    
+
+        // components of the secondary (resized) stream
+        MMAL_COMPONENT_T*       Splitter;
+        MMAL_COMPONENT_T*       Resizer;
+        MMAL_COMPONENT_T*       SecondaryJpegEncoder;
+        MMAL_CONNECTION_T*      SplitterConnection;
+        MMAL_CONNECTION_T*      ResizerConnection;
+        MMAL_CONNECTION_T*      SecondaryJpegEncoderConnection;
+
+        // components of the H.264 stream
+        MMAL_COMPONENT_T*       H264Encoder;
+        MMAL_CONNECTION_T*      H264EncoderConnection;
+
+        // reconfiguration of the running camera, which is done on its control thread
+        XManualResetEvent       ConfigurationChanged;
+        bool                    PipelineRebuildNeeded;
+        bool                    JpegQualityChangeNeeded;
+        atomic<bool>            Reconfiguring;
+
+        // video format the running pipeline is built with
+        uint32_t                ActiveWidth;
+        uint32_t                ActiveHeight;
+        uint32_t                ActiveFrameRate;
+        uint32_t                ActiveJpegQuality;
+        bool                    ActiveJpegEncoding;
+
         static bool             HostInitDone;
         
     public:
-        uint32_t                FramesReceived;
+        atomic<bool>            Initialized;
+        VideoOutput             PrimaryOutput;
+        VideoOutput             SecondaryOutput;
+        VideoOutput             H264Output;
+        VideoOutput             RawOutput;
+
         uint32_t                FrameWidth;
         uint32_t                FrameHeight;
         uint32_t                FrameRate;
         uint32_t                JpegQuality;
+        uint32_t                SecondaryWidth;
+        uint32_t                SecondaryHeight;
+        uint32_t                SecondaryJpegQuality;
+        uint32_t                H264Bitrate;
         bool                    JpegEncoding;
+        XPixelFormat            UncompressedFormat;
+        bool                    H264Encoding;
+        bool                    RawStream;
+        bool                    ZeroCopy;
+        uint32_t                BuffersCount;
+        bool                    CaptureSuspended;
         bool                    HorizontalFlip;
         bool                    VerticalFlip;
         bool                    VideoStabilisation;
@@ -81,20 +275,30 @@ namespace Private
         ImageEffect             CameraImageEffect;
         string                  TextAnnotation;
         bool                    TextBlackBackground;
+        atomic<uint32_t>        Reconfigurations;
 
     public:
         XRaspiCameraData( ) :
-            Sync( ), ConfigSync( ), ControlThread( ), NeedToStop( ), Listener( nullptr ), Running( false ),
-            Camera( nullptr ), JpegEncoder( nullptr ), JpegEncoderConnection( nullptr ),
-            VideoPort( nullptr ), VideoBufferPort( nullptr ), VideoBufferPool( nullptr ),
-            FramesReceived( 0 ),
-            FrameWidth( 640 ), FrameHeight( 480 ), FrameRate( 30 ), JpegQuality( 10 ), JpegEncoding( true ),
+            Sync( ), ConfigSync( ), ControlThread( ), NeedToStop( ), Listener( nullptr ), SecondaryListener( nullptr ),
+            H264Listener( nullptr ), RawListener( nullptr ), Running( false ),
+            Camera( nullptr ), JpegEncoder( nullptr ), JpegEncoderConnection( nullptr ), VideoPort( nullptr ),
+            Splitter( nullptr ), Resizer( nullptr ), SecondaryJpegEncoder( nullptr ),
+            SplitterConnection( nullptr ), ResizerConnection( nullptr ), SecondaryJpegEncoderConnection( nullptr ),
+            H264Encoder( nullptr ), H264EncoderConnection( nullptr ),
+            ConfigurationChanged( ), PipelineRebuildNeeded( false ), JpegQualityChangeNeeded( false ), Reconfiguring( false ),
+            ActiveWidth( 0 ), ActiveHeight( 0 ), ActiveFrameRate( 0 ), ActiveJpegQuality( 0 ), ActiveJpegEncoding( false ),
+            Initialized( false ), PrimaryOutput( this, VideoStream::Primary ), SecondaryOutput( this, VideoStream::Secondary ),
+            H264Output( this, VideoStream::H264 ), RawOutput( this, VideoStream::Raw ),
+            FrameWidth( 640 ), FrameHeight( 480 ), FrameRate( 30 ), JpegQuality( 10 ),
+            SecondaryWidth( 0 ), SecondaryHeight( 0 ), SecondaryJpegQuality( 10 ), H264Bitrate( 2000000 ),
+            JpegEncoding( true ), UncompressedFormat( XPixelFormat::YUV420 ), H264Encoding( false ), RawStream( false ),
+            ZeroCopy( false ), BuffersCount( 0 ), CaptureSuspended( false ),
             HorizontalFlip( false ), VerticalFlip( false ), VideoStabilisation( false ),
             Sharpness( 0 ), Contrast( 0 ), Brightness( 50 ), Saturation( 0 ),
             WhiteBalanceMode( AwbMode::Auto ), CameraExposureMode( ExposureMode::Auto ),
             CameraExposureMeteringMode( ExposureMeteringMode::Average ),
             CameraImageEffect( ImageEffect::None ),
-            TextAnnotation( ), TextBlackBackground( true )
+            TextAnnotation( ), TextBlackBackground( true ), Reconfigurations( 0 )
         {
         }
                 
@@ -103,17 +307,46 @@ namespace Private
         void WaitForStop( );
         bool IsRunning( );
         IVideoSourceListener* SetListener( IVideoSourceListener* listener );
+        IVideoSourceListener* SetSecondaryListener( IVideoSourceListener* listener );
+        IVideoSourceListener* SetH264Listener( IVideoSourceListener* listener );
+        IVideoSourceListener* SetRawListener( IVideoSourceListener* listener );
         
-        void NotifyNewImage( const std::shared_ptr<const XImage>& image );
+        bool NotifyNewImage( const std::shared_ptr<const XImage>& image, VideoStream stream );
         void NotifyError( const string& errorMessage, bool fatal = false );
         
         bool Init( );
         void Cleanup( );
 
-        void SetVideoSize( uint32_t width, uint32_t height );
-        void SetFrameRate( uint32_t frameRate );
+        bool IsSecondaryStreamEnabled( ) const;
+        bool IsH264StreamEnabled( ) const;
+        bool IsRawStreamEnabled( ) const;
+        MMAL_STATUS_T CreateSplitter( );
+        MMAL_STATUS_T CreateResizer( MMAL_PORT_T* sourcePort );
+        MMAL_STATUS_T CreateJpegEncoder( MMAL_PORT_T* sourcePort, uint32_t jpegQuality, MMAL_COMPONENT_T** encoder );
+        MMAL_STATUS_T CreateH264Encoder( MMAL_PORT_T* sourcePort );
+        MMAL_STATUS_T ConnectPorts( MMAL_PORT_T* outputPort, MMAL_PORT_T* inputPort, MMAL_CONNECTION_T** connection, const char* name );
+        MMAL_STATUS_T InitVideoOutput( VideoOutput& output, MMAL_PORT_T* port );
+        void CleanupVideoOutput( VideoOutput& output );
+
+        void RequestReconfiguration( bool rebuildPipeline );
+        bool ApplyReconfiguration( );
+        bool RebuildPipeline( );
+        MMAL_STATUS_T RestartJpegEncoder( );
+
+        bool SetVideoSize( uint32_t width, uint32_t height );
+        bool SetFrameRate( uint32_t frameRate );
         void EnableJpegEncoding( bool enable );
-        void SetJpegQuality( uint32_t jpegQuality );
+        bool SetJpegQuality( uint32_t jpegQuality );
+        void SetUncompressedFormat( XPixelFormat format );
+        void SetSecondaryVideoSize( uint32_t width, uint32_t height );
+        void SetSecondaryJpegQuality( uint32_t jpegQuality );
+        void EnableH264Encoding( bool enable );
+        void SetH264Bitrate( uint32_t bitrate );
+        void EnableRawStream( bool enable );
+        bool RequestH264KeyFrame( );
+        void EnableZeroCopy( bool enable );
+        void SetBuffersCount( uint32_t count );
+        void SuspendCapture( bool suspend );
 
         bool SetCameraFlip( bool horizontal, bool vertical );
         bool SetVideoStabilisation( bool enabled );
@@ -127,9 +360,15 @@ namespace Private
         bool SetImageEffect( ImageEffect effect );
         bool SetTextTextAnnotation( const string& text, bool blackBackground );
         
+        XPixelFormat OutputImageFormat( const VideoOutput* output ) const;
+        int32_t OutputImageWidth( const VideoOutput* output, const MMAL_BUFFER_HEADER_T* buffer ) const;
+        int32_t OutputImageHeight( const VideoOutput* output ) const;
+        int32_t OutputImageStride( const VideoOutput* output, const MMAL_BUFFER_HEADER_T* buffer ) const;
+
         static void ControlThreadHanlder( XRaspiCameraData* me );
         static void CameraControlCallback( MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer );
         static void VideoBufferCallback( MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer );
+        static void SharedVideoBufferCallback( VideoOutput* output, MMAL_BUFFER_HEADER_T* buffer );
     };
     
     bool XRaspiCameraData::HostInitDone = false;
@@ -174,10 +413,51 @@ bool XRaspiCamera::IsRunning( )
     return mData->IsRunning( );
 }
 
+// Check if camera's pipeline is initialized and provides frames
+bool XRaspiCamera::IsInitialized( ) const
+{
+    return mData->Initialized;
+}
+
 // Get number of frames received since the start of the video source
 uint32_t XRaspiCamera::FramesReceived( )
 {
-    return mData->FramesReceived;
+    return static_cast<uint32_t>( mData->PrimaryOutput.Counters->FramesCaptured );
+}
+
+// Get number of frames lost since the start of the camera, because video buffers could not be returned to it
+uint32_t XRaspiCamera::BuffersDropped( )
+{
+    return static_cast<uint32_t>( mData->PrimaryOutput.Counters->FramesDropped + mData->SecondaryOutput.Counters->FramesDropped +
+                                  mData->H264Output.Counters->FramesDropped + mData->RawOutput.Counters->FramesDropped );
+}
+
+// Get counters of frames and buffers of the primary/secondary/H.264/raw video streams
+XRaspiCameraStreamStats XRaspiCamera::PrimaryStreamStats( ) const
+{
+    return mData->PrimaryOutput.Counters->Stats( );
+}
+XRaspiCameraStreamStats XRaspiCamera::SecondaryStreamStats( ) const
+{
+    return mData->SecondaryOutput.Counters->Stats( );
+}
+XRaspiCameraStreamStats XRaspiCamera::H264StreamStats( ) const
+{
+    return mData->H264Output.Counters->Stats( );
+}
+XRaspiCameraStreamStats XRaspiCamera::RawStreamStats( ) const
+{
+    return mData->RawOutput.Counters->Stats( );
+}
+
+// Suspend/Resume capture of video frames
+void XRaspiCamera::SuspendCapture( bool suspend )
+{
+    mData->SuspendCapture( suspend );
+}
+bool XRaspiCamera::IsCaptureSuspended( )
+{
+    return mData->CaptureSuspended;
 }
 
 // Set video source listener
@@ -186,6 +466,30 @@ IVideoSourceListener* XRaspiCamera::SetListener( IVideoSourceListener* listener
     return mData->SetListener( listener );
 }
 
+// Set listener of the secondary (resized) video stream
+IVideoSourceListener* XRaspiCamera::SetSecondaryListener( IVideoSourceListener* listener )
+{
+    return mData->SetSecondaryListener( listener );
+}
+
+// Set listener of the H.264 video stream
+IVideoSourceListener* XRaspiCamera::SetH264Listener( IVideoSourceListener* listener )
+{
+    return mData->SetH264Listener( listener );
+}
+
+// Set listener of the raw video stream
+IVideoSourceListener* XRaspiCamera::SetRawListener( IVideoSourceListener* listener )
+{
+    return mData->SetRawListener( listener );
+}
+
+// Request H.264 encoder to provide key frame as soon as possible
+bool XRaspiCamera::RequestH264KeyFrame( )
+{
+    return mData->RequestH264KeyFrame( );
+}
+
 // Get/Set video size
 uint32_t XRaspiCamera::Width( ) const
 {
@@ -195,9 +499,9 @@ uint32_t XRaspiCamera::Height( ) const
 {
     return mData->FrameHeight;
 }
-void XRaspiCamera::SetVideoSize( uint32_t width, uint32_t height )
+bool XRaspiCamera::SetVideoSize( uint32_t width, uint32_t height )
 {
-    mData->SetVideoSize( width, height );
+    return mData->SetVideoSize( width, height );
 }
 
 // Get/Set frame rate
@@ -205,9 +509,9 @@ uint32_t XRaspiCamera::FrameRate( ) const
 {
     return mData->FrameRate;
 }
-void XRaspiCamera::SetFrameRate( uint32_t frameRate )
+bool XRaspiCamera::SetFrameRate( uint32_t frameRate )
 {
-    mData->SetFrameRate( frameRate );
+    return mData->SetFrameRate( frameRate );
 }
 
 // Enable/Disable JPEG encoding
@@ -220,14 +524,104 @@ void XRaspiCamera::EnableJpegEncoding( bool enable )
     mData->EnableJpegEncoding( enable );
 }
 
+// Get/Set format of uncompressed images
+XPixelFormat XRaspiCamera::UncompressedFormat( ) const
+{
+    return mData->UncompressedFormat;
+}
+void XRaspiCamera::SetUncompressedFormat( XPixelFormat format )
+{
+    mData->SetUncompressedFormat( format );
+}
+
 // Get/Set JPEG quality
 uint32_t XRaspiCamera::JpegQuality( ) const
 {
     return mData->JpegQuality;
 }
-void XRaspiCamera::SetJpegQuality( uint32_t jpegQuality )
+bool XRaspiCamera::SetJpegQuality( uint32_t jpegQuality )
+{
+    return mData->SetJpegQuality( jpegQuality );
+}
+
+// Get number of times camera's pipeline was reconfigured since it was started
+uint32_t XRaspiCamera::ReconfigurationsCount( ) const
+{
+    return mData->Reconfigurations;
+}
+
+// Get/Set size of the secondary video stream
+uint32_t XRaspiCamera::SecondaryWidth( ) const
+{
+    return mData->SecondaryWidth;
+}
+uint32_t XRaspiCamera::SecondaryHeight( ) const
+{
+    return mData->SecondaryHeight;
+}
+void XRaspiCamera::SetSecondaryVideoSize( uint32_t width, uint32_t height )
+{
+    mData->SetSecondaryVideoSize( width, height );
+}
+
+// Get/Set JPEG quality of the secondary video stream
+uint32_t XRaspiCamera::SecondaryJpegQuality( ) const
+{
+    return mData->SecondaryJpegQuality;
+}
+void XRaspiCamera::SetSecondaryJpegQuality( uint32_t jpegQuality )
+{
+    mData->SetSecondaryJpegQuality( jpegQuality );
+}
+
+// Enable/Disable H.264 encoding
+bool XRaspiCamera::IsH264EncodingEnabled( ) const
+{
+    return mData->H264Encoding;
+}
+void XRaspiCamera::EnableH264Encoding( bool enable )
+{
+    mData->EnableH264Encoding( enable );
+}
+
+// Get/Set bitrate of the H.264 video stream
+uint32_t XRaspiCamera::H264Bitrate( ) const
+{
+    return mData->H264Bitrate;
+}
+void XRaspiCamera::SetH264Bitrate( uint32_t bitrate )
+{
+    mData->SetH264Bitrate( bitrate );
+}
+
+// Enable/Disable raw video stream
+bool XRaspiCamera::IsRawStreamEnabled( ) const
+{
+    return mData->RawStream;
+}
+void XRaspiCamera::EnableRawStream( bool enable )
+{
+    mData->EnableRawStream( enable );
+}
+
+// Enable/Disable providing camera's buffers to listener without copying them
+bool XRaspiCamera::IsZeroCopyEnabled( ) const
+{
+    return mData->ZeroCopy;
+}
+void XRaspiCamera::EnableZeroCopy( bool enable )
+{
+    mData->EnableZeroCopy( enable );
+}
+
+// Get/Set number of buffers in pool of every video stream
+uint32_t XRaspiCamera::BuffersCount( ) const
+{
+    return mData->BuffersCount;
+}
+void XRaspiCamera::SetBuffersCount( uint32_t count )
 {
-    mData->SetJpegQuality( jpegQuality );
+    mData->SetBuffersCount( count );
 }
 
 // Get/Set camera's horizontal/vertical flip
@@ -359,8 +753,15 @@ bool XRaspiCameraData::Start( )
     if ( !IsRunning( ) )
     {
         NeedToStop.Reset( );
+        ConfigurationChanged.Reset( );
+        PipelineRebuildNeeded   = false;
+        JpegQualityChangeNeeded = false;
+        Reconfigurations        = 0;
         Running = true;
-        FramesReceived = 0;
+        PrimaryOutput.Counters->Reset( );
+        SecondaryOutput.Counters->Reset( );
+        H264Output.Counters->Reset( );
+        RawOutput.Counters->Reset( );
         
         ControlThread = thread( ControlThreadHanlder, this );
     }
@@ -376,6 +777,8 @@ void XRaspiCameraData::SignalToStop( )
     if ( IsRunning( ) )
     {
         NeedToStop.Signal( );
+        // wake up control thread
+        ConfigurationChanged.Signal( );
     }
 }
 
@@ -414,35 +817,80 @@ IVideoSourceListener* XRaspiCameraData::SetListener( IVideoSourceListener* liste
     return oldListener;
 }
 
-// Notify listener with a new image
-void XRaspiCameraData::NotifyNewImage( const std::shared_ptr<const XImage>& image )
+// Set listener of the secondary video stream
+IVideoSourceListener* XRaspiCameraData::SetSecondaryListener( IVideoSourceListener* listener )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+    IVideoSourceListener* oldListener = SecondaryListener;
+
+    SecondaryListener = listener;
+
+    return oldListener;
+}
+
+// Set listener of the H.264 video stream
+IVideoSourceListener* XRaspiCameraData::SetH264Listener( IVideoSourceListener* listener )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+    IVideoSourceListener* oldListener = H264Listener;
+
+    H264Listener = listener;
+
+    return oldListener;
+}
+
+// Set listener of the raw video stream
+IVideoSourceListener* XRaspiCameraData::SetRawListener( IVideoSourceListener* listener )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+    IVideoSourceListener* oldListener = RawListener;
+
+    RawListener = listener;
+
+    return oldListener;
+}
+
+// Notify listener of the specified stream with a new image (returns false if there is no listener)
+bool XRaspiCameraData::NotifyNewImage( const std::shared_ptr<const XImage>& image, VideoStream stream )
 {
+    XTraceScope           traceScope( "camera.notify" );
     IVideoSourceListener* myListener;
     
     {
         lock_guard<recursive_mutex> lock( Sync );
-        myListener = Listener;
+        myListener = ( stream == VideoStream::Secondary ) ? SecondaryListener :
+                     ( stream == VideoStream::H264 ) ? H264Listener :
+                     ( stream == VideoStream::Raw ) ? RawListener : Listener;
     }
     
     if ( myListener != nullptr )
     {
         myListener->OnNewImage( image );
     }
+
+    return ( myListener != nullptr );
 }
 
-// Notify listener about error
+// Notify listeners about error
 void XRaspiCameraData::NotifyError( const string& errorMessage, bool fatal )
 {
-    IVideoSourceListener* myListener;
+    IVideoSourceListener* myListeners[4];
     
     {
         lock_guard<recursive_mutex> lock( Sync );
-        myListener = Listener;
+        myListeners[0] = Listener;
+        myListeners[1] = SecondaryListener;
+        myListeners[2] = H264Listener;
+        myListeners[3] = RawListener;
     }
     
-    if ( myListener != nullptr )
+    for ( auto myListener : myListeners )
     {
-        myListener->OnError( errorMessage, fatal );
+        if ( myListener != nullptr )
+        {
+            // failures with new video format are not fatal, since the previous one gets restored
+            myListener->OnError( errorMessage, ( fatal ) && ( !Reconfiguring ) );
+        }
     }
 }
 
@@ -452,6 +900,12 @@ bool XRaspiCameraData::Init( )
     lock_guard<recursive_mutex> lock( ConfigSync );
     MMAL_STATUS_T               status;
 
+    ActiveWidth        = FrameWidth;
+    ActiveHeight       = FrameHeight;
+    ActiveFrameRate    = FrameRate;
+    ActiveJpegQuality  = JpegQuality;
+    ActiveJpegEncoding = JpegEncoding;
+
     if ( !HostInitDone )
     {
         bcm_host_init( );
@@ -504,10 +958,18 @@ bool XRaspiCameraData::Init( )
         // set-up video port format
         MMAL_ES_FORMAT_T* format = VideoPort->format;
         
-        format->encoding                 = ( JpegEncoding ) ? MMAL_ENCODING_I420 : MMAL_ENCODING_RGB24;
+        format->encoding                 = ( ( JpegEncoding ) || ( UncompressedFormat == XPixelFormat::YUV420 ) ) ?
+                                           MMAL_ENCODING_I420 : MMAL_ENCODING_RGB24;
         format->encoding_variant         = format->encoding;
         format->es->video.width          = FrameWidth;
         format->es->video.height         = FrameHeight;
+
+        // planes of YUV images provided to listeners are padded the way XImage expects them
+        if ( ( !JpegEncoding ) && ( UncompressedFormat == XPixelFormat::YUV420 ) )
+        {
+            format->es->video.width      = VCOS_ALIGN_UP( FrameWidth, 32 );
+            format->es->video.height     = VCOS_ALIGN_UP( FrameHeight, 16 );
+        }
         format->es->video.crop.x         = 0;
         format->es->video.crop.y         = 0;
         format->es->video.crop.width     = FrameWidth;
@@ -535,138 +997,91 @@ bool XRaspiCameraData::Init( )
     // configure JPEG encoder in case user prefers getting JPEGs instead of RGB pixel data
     if ( JpegEncoding )
     {
-        if ( status == MMAL_SUCCESS )
+        MMAL_PORT_T* encoderSourcePort = VideoPort;
+
+        // split video frames between the primary JPEG encoder and encoders of other streams
+        if ( ( status == MMAL_SUCCESS ) && ( ( IsSecondaryStreamEnabled( ) ) || ( IsH264StreamEnabled( ) ) ||
+                                              ( IsRawStreamEnabled( ) ) ) )
         {
-            // create JPEG encoder component
-            status = mmal_component_create( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, &JpegEncoder );
-            if ( status != MMAL_SUCCESS )
+            status = CreateSplitter( );
+
+            if ( status == MMAL_SUCCESS )
             {
-                NotifyError( "Failed creating JPEG encoder", true );
+                status = ConnectPorts( VideoPort, Splitter->input[0], &SplitterConnection, "video splitter" );
             }
+
+            encoderSourcePort = ( Splitter != nullptr ) ? Splitter->output[SPLITTER_JPEG_OUTPUT] : nullptr;
         }
+
         if ( status == MMAL_SUCCESS )
         {
-            // set JPEG encoder's input/output ports' format
-            MMAL_PORT_T* inputPort  = JpegEncoder->input[0];
-            MMAL_PORT_T* outputPort = JpegEncoder->output[0];
-    
-            mmal_format_copy( inputPort->format, VideoPort->format );
-    
-            status = mmal_port_format_commit( inputPort );
-            if ( status != MMAL_SUCCESS )
-            {
-                NotifyError( "Failed setting JPEG encoder's input port format", true );
-            }    
-            else
-            {
-                mmal_format_copy( outputPort->format, inputPort->format );
-    
-                outputPort->format->encoding = MMAL_ENCODING_JPEG;
-    
-                status = mmal_port_format_commit( outputPort );
-                if ( status != MMAL_SUCCESS )
-                {
-                    NotifyError( "Failed setting JPEG encoder's output port format", true );
-                }
-                else
-                {
-                    outputPort->buffer_size = outputPort->buffer_size_recommended;
-                    outputPort->buffer_num  = outputPort->buffer_num_recommended;
-    
-                    if ( outputPort->buffer_size < outputPort->buffer_size_min )
-                    {
-                        outputPort->buffer_size = outputPort->buffer_size_min;
-                    }
-                    if ( outputPort->buffer_num < outputPort->buffer_num_min )
-                    {
-                        outputPort->buffer_num = outputPort->buffer_num_min;
-                    }
-
-                    // set JPEG quality
-                    status = mmal_port_parameter_set_uint32( outputPort, MMAL_PARAMETER_JPEG_Q_FACTOR, JpegQuality );
-    
-                    if ( status != MMAL_SUCCESS )
-                    {
-                        NotifyError( "Failed setting JPEG quality" );
-                    }
-                }
-            }
+            status = CreateJpegEncoder( encoderSourcePort, JpegQuality, &JpegEncoder );
         }
-    
         if ( status == MMAL_SUCCESS )
         {
-            // connect video port to JPEG encoder
-            status = mmal_connection_create( &JpegEncoderConnection, VideoPort, JpegEncoder->input[0],
-                                             MMAL_CONNECTION_FLAG_TUNNELLING | MMAL_CONNECTION_FLAG_ALLOCATION_ON_INPUT );
-            if ( status != MMAL_SUCCESS )
-            {
-                NotifyError( "Failed connecting video port to JPEG encoder", true );
-            }
+            status = ConnectPorts( encoderSourcePort, JpegEncoder->input[0], &JpegEncoderConnection, "JPEG encoder" );
         }
-    
-        if ( status == MMAL_SUCCESS )
+
+        // resize video frames of the secondary stream and encode them with own JPEG quality
+        if ( ( status == MMAL_SUCCESS ) && ( IsSecondaryStreamEnabled( ) ) )
         {
-            // enable the JPEG encoder connection
-            status = mmal_connection_enable( JpegEncoderConnection );
-            if ( status != MMAL_SUCCESS )
+            status = CreateResizer( Splitter->output[SPLITTER_SECONDARY_OUTPUT] );
+
+            if ( status == MMAL_SUCCESS )
+            {
+                status = ConnectPorts( Splitter->output[SPLITTER_SECONDARY_OUTPUT], Resizer->input[0], &ResizerConnection, "video resizer" );
+            }
+            if ( status == MMAL_SUCCESS )
+            {
+                status = CreateJpegEncoder( Resizer->output[0], SecondaryJpegQuality, &SecondaryJpegEncoder );
+            }
+            if ( status == MMAL_SUCCESS )
             {
-                NotifyError( "Failed enabling JPEG encoder connection", true );
+                status = ConnectPorts( Resizer->output[0], SecondaryJpegEncoder->input[0],
+                                       &SecondaryJpegEncoderConnection, "secondary JPEG encoder" );
             }
         }
-    }
-
-    if ( status == MMAL_SUCCESS )
-    {
-        // create video buffer pool
-        VideoBufferPort = ( JpegEncoding ) ? JpegEncoder->output[0] : VideoPort;
-        VideoBufferPort->userdata = reinterpret_cast<MMAL_PORT_USERDATA_T*>( this );
 
-        if ( VideoBufferPort->buffer_num < BUFFER_COUNT )
+        // encode full size video frames with H.264 encoder as well
+        if ( ( status == MMAL_SUCCESS ) && ( IsH264StreamEnabled( ) ) )
         {
-            VideoBufferPort->buffer_num  = BUFFER_COUNT;
+            status = CreateH264Encoder( Splitter->output[SPLITTER_H264_OUTPUT] );
+
+            if ( status == MMAL_SUCCESS )
+            {
+                status = ConnectPorts( Splitter->output[SPLITTER_H264_OUTPUT], H264Encoder->input[0],
+                                       &H264EncoderConnection, "H.264 encoder" );
+            }
         }
 
-        VideoBufferPool = mmal_port_pool_create( VideoBufferPort, VideoBufferPort->buffer_num, VideoBufferPort->buffer_size );
-        if ( VideoBufferPool == nullptr )
+        // provide full size video frames as they are (splitter's outputs have the format of camera's video port)
+        if ( ( status == MMAL_SUCCESS ) && ( IsRawStreamEnabled( ) ) )
         {
-            NotifyError( "Failed creating video buffer pool", true );
-            status = MMAL_EFAULT;
+            MMAL_PORT_T* rawPort = Splitter->output[SPLITTER_RAW_OUTPUT];
+
+            rawPort->buffer_size = std::max( rawPort->buffer_size_recommended, rawPort->buffer_size_min );
+            rawPort->buffer_num  = std::max( rawPort->buffer_num_recommended, rawPort->buffer_num_min );
         }
     }
 
     if ( status == MMAL_SUCCESS )
     {
-        // enable the video buffer port
-        status = mmal_port_enable( VideoBufferPort, VideoBufferCallback );
-        if ( status != MMAL_SUCCESS )
-        {
-            NotifyError( "Failed enabling video buffer port", true );
-        }
+        status = InitVideoOutput( PrimaryOutput, ( JpegEncoding ) ? JpegEncoder->output[0] : VideoPort );
     }
-    
-    if ( status == MMAL_SUCCESS )
+
+    if ( ( status == MMAL_SUCCESS ) && ( SecondaryJpegEncoder != nullptr ) )
     {
-        // send all buffers to the video buffer port
-        int queueLength = mmal_queue_length( VideoBufferPool->queue );
+        status = InitVideoOutput( SecondaryOutput, SecondaryJpegEncoder->output[0] );
+    }
 
-        for ( int i = 0; ( i < queueLength ) && ( status == MMAL_SUCCESS ); i++ )
-        {
-            MMAL_BUFFER_HEADER_T* buffer = mmal_queue_get( VideoBufferPool->queue );
+    if ( ( status == MMAL_SUCCESS ) && ( H264Encoder != nullptr ) )
+    {
+        status = InitVideoOutput( H264Output, H264Encoder->output[0] );
+    }
 
-            if ( buffer == nullptr )
-            {
-                status = MMAL_EFAULT;
-            }
-            else
-            {
-                status = mmal_port_send_buffer( VideoBufferPort, buffer ); 
-            }
-        }
-        
-        if ( status != MMAL_SUCCESS )
-        {
-            NotifyError( "Failed configuring video buffer pool", true );
-        }
+    if ( ( status == MMAL_SUCCESS ) && ( IsRawStreamEnabled( ) ) )
+    {
+        status = InitVideoOutput( RawOutput, Splitter->output[SPLITTER_RAW_OUTPUT] );
     }
     
     if ( status == MMAL_SUCCESS )
@@ -688,7 +1103,7 @@ bool XRaspiCameraData::Init( )
         }
     }
 
-    if ( status == MMAL_SUCCESS )
+    if ( ( status == MMAL_SUCCESS ) && ( !CaptureSuspended ) )
     {
         // begin capture
         if ( mmal_port_parameter_set_boolean( VideoPort, MMAL_PARAMETER_CAPTURE, 1 ) != MMAL_SUCCESS )
@@ -696,6 +1111,8 @@ bool XRaspiCameraData::Init( )
             NotifyError( "Failed starting video capture", true );
         }
     }
+
+    Initialized = ( status == MMAL_SUCCESS );
     
     return ( status == MMAL_SUCCESS );
 }
@@ -705,66 +1122,546 @@ void XRaspiCameraData::Cleanup( )
 {
     lock_guard<recursive_mutex> lock( ConfigSync );
 
+    Initialized = false;
+
     if ( VideoPort != nullptr )
     {
         mmal_port_parameter_set_boolean( VideoPort, MMAL_PARAMETER_CAPTURE, 0 );
     }
 
-    if ( VideoBufferPort != nullptr )
+    if ( PrimaryOutput.Port != nullptr )
     {
-        mmal_port_disable( VideoBufferPort );
+        mmal_port_disable( PrimaryOutput.Port );
     }
-    
-    if ( JpegEncoderConnection != nullptr )
+    if ( SecondaryOutput.Port != nullptr )
     {
-        mmal_connection_disable( JpegEncoderConnection );
-        mmal_connection_destroy( JpegEncoderConnection );
-        JpegEncoderConnection = nullptr;
+        mmal_port_disable( SecondaryOutput.Port );
     }
-
-    if ( VideoBufferPool != nullptr )
+    if ( H264Output.Port != nullptr )
     {
-        mmal_port_pool_destroy( VideoPort, VideoBufferPool );
-        VideoBufferPool = nullptr;
+        mmal_port_disable( H264Output.Port );
     }
-        
-    if ( JpegEncoder != nullptr )
+    if ( RawOutput.Port != nullptr )
     {
-        mmal_component_destroy( JpegEncoder );
-        JpegEncoder = nullptr;
+        mmal_port_disable( RawOutput.Port );
     }
 
-    if ( Camera != nullptr )
+    // destroy connections starting from the end of the pipeline
+    for ( MMAL_CONNECTION_T** connection : { &H264EncoderConnection, &SecondaryJpegEncoderConnection, &ResizerConnection,
+                                             &JpegEncoderConnection, &SplitterConnection } )
+    {
+        if ( *connection != nullptr )
+        {
+            mmal_connection_disable( *connection );
+            mmal_connection_destroy( *connection );
+            *connection = nullptr;
+        }
+    }
+
+    CleanupVideoOutput( PrimaryOutput );
+    CleanupVideoOutput( SecondaryOutput );
+    CleanupVideoOutput( H264Output );
+    CleanupVideoOutput( RawOutput );
+
+    for ( MMAL_COMPONENT_T** component : { &H264Encoder, &SecondaryJpegEncoder, &Resizer, &JpegEncoder, &Splitter, &Camera } )
     {
-        mmal_component_destroy( Camera );
-        Camera = nullptr;
+        if ( *component != nullptr )
+        {
+            mmal_component_destroy( *component );
+            *component = nullptr;
+        }
     }
     
     VideoPort = nullptr;
-    VideoBufferPort = nullptr;
 }
 
-// Set size of video frames to be provided
-void XRaspiCameraData::SetVideoSize( uint32_t width, uint32_t height )
+// Check if the secondary (resized) video stream is configured - it is provided only along with JPEG encoding
+bool XRaspiCameraData::IsSecondaryStreamEnabled( ) const
 {
-    lock_guard<recursive_mutex> lock( ConfigSync );
-    
-    if ( !IsRunning( ) )
+    return ( ( JpegEncoding ) && ( SecondaryWidth != 0 ) && ( SecondaryHeight != 0 ) );
+}
+
+// Check if the H.264 video stream is configured - it is provided only along with JPEG encoding
+bool XRaspiCameraData::IsH264StreamEnabled( ) const
+{
+    return ( ( JpegEncoding ) && ( H264Encoding ) );
+}
+
+// Check if the raw video stream is configured - it is provided only along with JPEG encoding
+bool XRaspiCameraData::IsRawStreamEnabled( ) const
+{
+    return ( ( JpegEncoding ) && ( RawStream ) );
+}
+
+// Create video splitter, which provides camera's video frames on all of its outputs
+MMAL_STATUS_T XRaspiCameraData::CreateSplitter( )
+{
+    MMAL_STATUS_T status = mmal_component_create( MMAL_COMPONENT_DEFAULT_VIDEO_SPLITTER, &Splitter );
+
+    if ( status != MMAL_SUCCESS )
+    {
+        NotifyError( "Failed creating video splitter", true );
+    }
+    else
+    {
+        mmal_format_copy( Splitter->input[0]->format, VideoPort->format );
+
+        status = mmal_port_format_commit( Splitter->input[0] );
+
+        for ( uint32_t i = 0; ( i < Splitter->output_num ) && ( status == MMAL_SUCCESS ); i++ )
+        {
+            mmal_format_copy( Splitter->output[i]->format, Splitter->input[0]->format );
+            status = mmal_port_format_commit( Splitter->output[i] );
+        }
+
+        if ( status != MMAL_SUCCESS )
+        {
+            NotifyError( "Failed setting video splitter's ports format", true );
+        }
+    }
+
+    return status;
+}
+
+// Create video resizer, which scales frames down to the size of the secondary stream
+MMAL_STATUS_T XRaspiCameraData::CreateResizer( MMAL_PORT_T* sourcePort )
+{
+    MMAL_STATUS_T status = mmal_component_create( MMAL_COMPONENT_DEFAULT_RESIZER, &Resizer );
+
+    if ( status != MMAL_SUCCESS )
+    {
+        NotifyError( "Failed creating video resizer", true );
+    }
+    else
+    {
+        MMAL_PORT_T* inputPort  = Resizer->input[0];
+        MMAL_PORT_T* outputPort = Resizer->output[0];
+
+        mmal_format_copy( inputPort->format, sourcePort->format );
+
+        status = mmal_port_format_commit( inputPort );
+        if ( status == MMAL_SUCCESS )
+        {
+            MMAL_ES_FORMAT_T* format = outputPort->format;
+
+            mmal_format_copy( format, inputPort->format );
+
+            format->encoding              = MMAL_ENCODING_I420;
+            format->encoding_variant      = MMAL_ENCODING_I420;
+            format->es->video.width       = VCOS_ALIGN_UP( SecondaryWidth, 32 );
+            format->es->video.height      = VCOS_ALIGN_UP( SecondaryHeight, 16 );
+            format->es->video.crop.x      = 0;
+            format->es->video.crop.y      = 0;
+            format->es->video.crop.width  = SecondaryWidth;
+            format->es->video.crop.height = SecondaryHeight;
+
+            status = mmal_port_format_commit( outputPort );
+        }
+
+        if ( status != MMAL_SUCCESS )
+        {
+            NotifyError( "Failed setting video resizer's ports format", true );
+        }
+    }
+
+    return status;
+}
+
+// Create JPEG encoder taking video frames in the format of the specified source port
+MMAL_STATUS_T XRaspiCameraData::CreateJpegEncoder( MMAL_PORT_T* sourcePort, uint32_t jpegQuality, MMAL_COMPONENT_T** encoder )
+{
+    // create JPEG encoder component
+    MMAL_STATUS_T status = mmal_component_create( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, encoder );
+
+    if ( status != MMAL_SUCCESS )
+    {
+        NotifyError( "Failed creating JPEG encoder", true );
+    }
+    else
+    {
+        // set JPEG encoder's input/output ports' format
+        MMAL_PORT_T* inputPort  = (*encoder)->input[0];
+        MMAL_PORT_T* outputPort = (*encoder)->output[0];
+
+        mmal_format_copy( inputPort->format, sourcePort->format );
+
+        status = mmal_port_format_commit( inputPort );
+        if ( status != MMAL_SUCCESS )
+        {
+            NotifyError( "Failed setting JPEG encoder's input port format", true );
+        }
+        else
+        {
+            mmal_format_copy( outputPort->format, inputPort->format );
+
+            outputPort->format->encoding = MMAL_ENCODING_JPEG;
+
+            status = mmal_port_format_commit( outputPort );
+            if ( status != MMAL_SUCCESS )
+            {
+                NotifyError( "Failed setting JPEG encoder's output port format", true );
+            }
+            else
+            {
+                outputPort->buffer_size = outputPort->buffer_size_recommended;
+                outputPort->buffer_num  = outputPort->buffer_num_recommended;
+
+                if ( outputPort->buffer_size < outputPort->buffer_size_min )
+                {
+                    outputPort->buffer_size = outputPort->buffer_size_min;
+                }
+                if ( outputPort->buffer_num < outputPort->buffer_num_min )
+                {
+                    outputPort->buffer_num = outputPort->buffer_num_min;
+                }
+
+                // set JPEG quality
+                status = mmal_port_parameter_set_uint32( outputPort, MMAL_PARAMETER_JPEG_Q_FACTOR, jpegQuality );
+
+                if ( status != MMAL_SUCCESS )
+                {
+                    NotifyError( "Failed setting JPEG quality" );
+                }
+            }
+        }
+    }
+
+    return status;
+}
+
+// Create H.264 encoder taking video frames in the format of the specified source port
+MMAL_STATUS_T XRaspiCameraData::CreateH264Encoder( MMAL_PORT_T* sourcePort )
+{
+    MMAL_STATUS_T status = mmal_component_create( MMAL_COMPONENT_DEFAULT_VIDEO_ENCODER, &H264Encoder );
+
+    if ( status != MMAL_SUCCESS )
+    {
+        NotifyError( "Failed creating H.264 encoder", true );
+    }
+    else
+    {
+        // set H.264 encoder's input/output ports' format
+        MMAL_PORT_T* inputPort  = H264Encoder->input[0];
+        MMAL_PORT_T* outputPort = H264Encoder->output[0];
+
+        mmal_format_copy( inputPort->format, sourcePort->format );
+
+        status = mmal_port_format_commit( inputPort );
+        if ( status != MMAL_SUCCESS )
+        {
+            NotifyError( "Failed setting H.264 encoder's input port format", true );
+        }
+        else
+        {
+            mmal_format_copy( outputPort->format, inputPort->format );
+
+            outputPort->format->encoding                 = MMAL_ENCODING_H264;
+            outputPort->format->bitrate                  = H264Bitrate;
+            outputPort->format->es->video.frame_rate.num = 0;
+            outputPort->format->es->video.frame_rate.den = 1;
+
+            outputPort->buffer_size = outputPort->buffer_size_recommended;
+            outputPort->buffer_num  = outputPort->buffer_num_recommended;
+
+            if ( outputPort->buffer_size < outputPort->buffer_size_min )
+            {
+                outputPort->buffer_size = outputPort->buffer_size_min;
+            }
+            if ( outputPort->buffer_num < outputPort->buffer_num_min )
+            {
+                outputPort->buffer_num = outputPort->buffer_num_min;
+            }
+
+            status = mmal_port_format_commit( outputPort );
+            if ( status != MMAL_SUCCESS )
+            {
+                NotifyError( "Failed setting H.264 encoder's output port format", true );
+            }
+            else
+            {
+                // key frame every second and SPS/PPS before each of them, so clients can join the stream any time
+                if ( ( mmal_port_parameter_set_uint32( outputPort, MMAL_PARAMETER_INTRAPERIOD, FrameRate ) != MMAL_SUCCESS ) ||
+                     ( mmal_port_parameter_set_boolean( outputPort, MMAL_PARAMETER_VIDEO_ENCODE_INLINE_HEADER, 1 ) != MMAL_SUCCESS ) )
+                {
+                    NotifyError( "Failed configuring H.264 encoder" );
+                }
+            }
+        }
+    }
+
+    return status;
+}
+
+// Create and enable tunnelled connection between the two ports
+MMAL_STATUS_T XRaspiCameraData::ConnectPorts( MMAL_PORT_T* outputPort, MMAL_PORT_T* inputPort, MMAL_CONNECTION_T** connection, const char* name )
+{
+    MMAL_STATUS_T status = mmal_connection_create( connection, outputPort, inputPort,
+                                                   MMAL_CONNECTION_FLAG_TUNNELLING | MMAL_CONNECTION_FLAG_ALLOCATION_ON_INPUT );
+    if ( status != MMAL_SUCCESS )
+    {
+        NotifyError( string( "Failed connecting " ) + name, true );
+    }
+    else
+    {
+        status = mmal_connection_enable( *connection );
+        if ( status != MMAL_SUCCESS )
+        {
+            NotifyError( string( "Failed enabling connection to " ) + name, true );
+        }
+    }
+
+    return status;
+}
+
+// Create buffer pool for the output port, enable it and send all buffers to it
+MMAL_STATUS_T XRaspiCameraData::InitVideoOutput( VideoOutput& output, MMAL_PORT_T* port )
+{
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+
+    // create video buffer pool
+    output.Port     = port;
+    port->userdata  = reinterpret_cast<MMAL_PORT_USERDATA_T*>( &output );
+
+    if ( BuffersCount != 0 )
+    {
+        port->buffer_num = std::max( BuffersCount, port->buffer_num_min );
+    }
+    else
+    {
+        if ( port->buffer_num < BUFFER_COUNT )
+        {
+            port->buffer_num  = BUFFER_COUNT;
+        }
+        if ( ZeroCopy )
+        {
+            // listeners may keep some buffers for a while
+            port->buffer_num += ZERO_COPY_EXTRA_BUFFERS;
+        }
+    }
+
+    output.Counters->BuffersCount = port->buffer_num;
+
+    // buffers given to listeners may outlive the port, so those are not allocated by it
+    output.Pool = ( ZeroCopy ) ? mmal_pool_create( port->buffer_num, port->buffer_size ) :
+                                 mmal_port_pool_create( port, port->buffer_num, port->buffer_size );
+    if ( output.Pool == nullptr )
+    {
+        NotifyError( "Failed creating video buffer pool", true );
+        status = MMAL_EFAULT;
+    }
+    else if ( ZeroCopy )
+    {
+        output.SharedBuffers = make_shared<SharedVideoBuffers>( port, output.Pool, output.Counters );
+    }
+
+    if ( status == MMAL_SUCCESS )
+    {
+        // enable the video buffer port
+        status = mmal_port_enable( port, VideoBufferCallback );
+        if ( status != MMAL_SUCCESS )
+        {
+            NotifyError( "Failed enabling video buffer port", true );
+        }
+    }
+    
+    if ( status == MMAL_SUCCESS )
+    {
+        // send all buffers to the video buffer port
+        int queueLength = mmal_queue_length( output.Pool->queue );
+
+        for ( int i = 0; ( i < queueLength ) && ( status == MMAL_SUCCESS ); i++ )
+        {
+            MMAL_BUFFER_HEADER_T* buffer = mmal_queue_get( output.Pool->queue );
+
+            if ( buffer == nullptr )
+            {
+                status = MMAL_EFAULT;
+            }
+            else
+            {
+                status = mmal_port_send_buffer( port, buffer ); 
+            }
+        }
+        
+        if ( status != MMAL_SUCCESS )
+        {
+            NotifyError( "Failed configuring video buffer pool", true );
+        }
+    }
+
+    return status;
+}
+
+// Release buffer pool of the (already disabled) output port
+void XRaspiCameraData::CleanupVideoOutput( VideoOutput& output )
+{
+    if ( output.SharedBuffers )
+    {
+        // the pool is destroyed when the last image referring to its buffers is released
+        output.SharedBuffers->Deactivate( );
+        output.SharedBuffers.reset( );
+    }
+    else if ( output.Pool != nullptr )
+    {
+        mmal_port_pool_destroy( output.Port, output.Pool );
+    }
+
+    output.Pool = nullptr;
+    output.Port = nullptr;
+}
+
+// Request running camera's pipeline to be reconfigured for the changed video format
+void XRaspiCameraData::RequestReconfiguration( bool rebuildPipeline )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+
+    if ( IsRunning( ) )
+    {
+        if ( rebuildPipeline )
+        {
+            PipelineRebuildNeeded = true;
+        }
+        else
+        {
+            JpegQualityChangeNeeded = true;
+        }
+
+        ConfigurationChanged.Signal( );
+    }
+}
+
+// Apply pending changes of video format to the running camera (returns false if camera failed completely)
+bool XRaspiCameraData::ApplyReconfiguration( )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+    bool                        ret = true;
+
+    ConfigurationChanged.Reset( );
+
+    if ( PipelineRebuildNeeded )
+    {
+        ret = RebuildPipeline( );
+        Reconfigurations++;
+    }
+    else if ( JpegQualityChangeNeeded )
+    {
+        Reconfiguring = true;
+        if ( RestartJpegEncoder( ) != MMAL_SUCCESS )
+        {
+            // try the long way if encoder did not take it
+            ret = RebuildPipeline( );
+        }
+        Reconfiguring = false;
+        Reconfigurations++;
+    }
+
+    PipelineRebuildNeeded   = false;
+    JpegQualityChangeNeeded = false;
+
+    return ret;
+}
+
+// Rebuild the whole pipeline for the new video format, restoring the previous one if that fails
+bool XRaspiCameraData::RebuildPipeline( )
+{
+    uint32_t oldWidth        = ActiveWidth;
+    uint32_t oldHeight       = ActiveHeight;
+    bool     oldJpegEncoding = ActiveJpegEncoding;
+    bool     ret;
+
+    Cleanup( );
+
+    Reconfiguring = true;
+    ret = Init( );
+    Reconfiguring = false;
+
+    if ( !ret )
+    {
+        NotifyError( "Failed reconfiguring camera, restoring previous video format" );
+        Cleanup( );
+
+        FrameWidth   = oldWidth;
+        FrameHeight  = oldHeight;
+        JpegEncoding = oldJpegEncoding;
+        FrameRate    = ActiveFrameRate;
+        JpegQuality  = ActiveJpegQuality;
+
+        ret = Init( );
+    }
+
+    return ret;
+}
+
+// Apply new JPEG quality by restarting JPEG encoder only - camera and other streams keep running meanwhile
+MMAL_STATUS_T XRaspiCameraData::RestartJpegEncoder( )
+{
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+
+    if ( ( JpegEncoder != nullptr ) && ( JpegEncoderConnection != nullptr ) )
+    {
+        MMAL_PORT_T* outputPort = JpegEncoder->output[0];
+
+        mmal_port_disable( outputPort );
+        CleanupVideoOutput( PrimaryOutput );
+        mmal_connection_disable( JpegEncoderConnection );
+
+        status = mmal_port_parameter_set_uint32( outputPort, MMAL_PARAMETER_JPEG_Q_FACTOR, JpegQuality );
+        if ( status != MMAL_SUCCESS )
+        {
+            NotifyError( "Failed setting JPEG quality" );
+        }
+        else
+        {
+            status = mmal_connection_enable( JpegEncoderConnection );
+            if ( status != MMAL_SUCCESS )
+            {
+                NotifyError( "Failed enabling connection to JPEG encoder" );
+            }
+            else
+            {
+                status = InitVideoOutput( PrimaryOutput, outputPort );
+            }
+        }
+
+        if ( status == MMAL_SUCCESS )
+        {
+            ActiveJpegQuality = JpegQuality;
+        }
+    }
+
+    return status;
+}
+
+// Set size of video frames to be provided
+bool XRaspiCameraData::SetVideoSize( uint32_t width, uint32_t height )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+    bool                        ret = ( ( width  >= MIN_VIDEO_WIDTH  ) && ( width  <= MAX_VIDEO_WIDTH  ) &&
+                                        ( height >= MIN_VIDEO_HEIGHT ) && ( height <= MAX_VIDEO_HEIGHT ) );
+
+    if ( ( ret ) && ( ( width != FrameWidth ) || ( height != FrameHeight ) ) )
     {
         FrameWidth  = width;
         FrameHeight = height;
+        RequestReconfiguration( true );
     }
+
+    return ret;
 }
 
-// Set frame rate to be set when starting camera
-void XRaspiCameraData::SetFrameRate( uint32_t frameRate )
+// Set frame rate of the video
+bool XRaspiCameraData::SetFrameRate( uint32_t frameRate )
 {
     lock_guard<recursive_mutex> lock( ConfigSync );
-    
-    if ( !IsRunning( ) )
+    bool                        ret = ( ( frameRate >= 1 ) && ( frameRate <= MAX_FRAME_RATE ) );
+
+    if ( ( ret ) && ( frameRate != FrameRate ) )
     {
         FrameRate = frameRate;
+        RequestReconfiguration( true );
     }
+
+    return ret;
 }
 
 // Enable/disable JPEG encoding
@@ -772,20 +1669,145 @@ void XRaspiCameraData::EnableJpegEncoding( bool enable )
 {
     lock_guard<recursive_mutex> lock( ConfigSync );
     
-    if ( !IsRunning( ) )
+    if ( enable != JpegEncoding )
     {
         JpegEncoding = enable;
-    }    
+        RequestReconfiguration( true );
+    }
+}
+
+// Set format of uncompressed images - only the ones camera's video port can provide
+void XRaspiCameraData::SetUncompressedFormat( XPixelFormat format )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+
+    if ( ( !IsRunning( ) ) && ( ( format == XPixelFormat::YUV420 ) || ( format == XPixelFormat::RGB24 ) ) )
+    {
+        UncompressedFormat = format;
+    }
 }
 
 // Set quality of provided JPEG images
-void XRaspiCameraData::SetJpegQuality( uint32_t jpegQuality )
+bool XRaspiCameraData::SetJpegQuality( uint32_t jpegQuality )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+    bool                        ret = ( ( jpegQuality >= 1 ) && ( jpegQuality <= MAX_JPEG_QUALITY ) );
+
+    if ( ( ret ) && ( jpegQuality != JpegQuality ) )
+    {
+        JpegQuality = jpegQuality;
+        RequestReconfiguration( false );
+    }
+
+    return ret;
+}
+
+// Set size of the secondary video stream (0x0 disables it)
+void XRaspiCameraData::SetSecondaryVideoSize( uint32_t width, uint32_t height )
 {
     lock_guard<recursive_mutex> lock( ConfigSync );
     
     if ( !IsRunning( ) )
     {
-        JpegQuality = jpegQuality;
+        SecondaryWidth  = width;
+        SecondaryHeight = height;
+    }
+}
+
+// Set quality of JPEG images provided by the secondary video stream
+void XRaspiCameraData::SetSecondaryJpegQuality( uint32_t jpegQuality )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+    
+    if ( !IsRunning( ) )
+    {
+        SecondaryJpegQuality = jpegQuality;
+    }
+}
+
+// Enable/disable H.264 encoding
+void XRaspiCameraData::EnableH264Encoding( bool enable )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+    
+    if ( !IsRunning( ) )
+    {
+        H264Encoding = enable;
+    }
+}
+
+// Set bitrate of the H.264 video stream
+void XRaspiCameraData::SetH264Bitrate( uint32_t bitrate )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+    
+    if ( !IsRunning( ) )
+    {
+        H264Bitrate = bitrate;
+    }
+}
+
+// Enable/disable raw video stream
+void XRaspiCameraData::EnableRawStream( bool enable )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+    
+    if ( !IsRunning( ) )
+    {
+        RawStream = enable;
+    }
+}
+
+// Request key frame from H.264 encoder, so new clients could start decoding the stream
+bool XRaspiCameraData::RequestH264KeyFrame( )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+    bool                        ret = false;
+
+    if ( H264Output.Port != nullptr )
+    {
+        ret = ( mmal_port_parameter_set_boolean( H264Output.Port, MMAL_PARAMETER_VIDEO_REQUEST_I_FRAME, 1 ) == MMAL_SUCCESS );
+    }
+
+    return ret;
+}
+
+// Enable/disable providing camera's buffers without copying them
+void XRaspiCameraData::EnableZeroCopy( bool enable )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+    
+    if ( !IsRunning( ) )
+    {
+        ZeroCopy = enable;
+    }    
+}
+
+// Set number of buffers in pool of every video stream (0 - default)
+void XRaspiCameraData::SetBuffersCount( uint32_t count )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+
+    if ( !IsRunning( ) )
+    {
+        BuffersCount = count;
+    }
+}
+
+// Suspend/Resume capture of video frames (camera component stays initialized, so resuming is quick)
+void XRaspiCameraData::SuspendCapture( bool suspend )
+{
+    lock_guard<recursive_mutex> lock( ConfigSync );
+
+    if ( suspend != CaptureSuspended )
+    {
+        CaptureSuspended = suspend;
+
+        if ( ( VideoPort != nullptr ) &&
+             ( mmal_port_parameter_set_boolean( VideoPort, MMAL_PARAMETER_CAPTURE, ( suspend ) ? 0 : 1 ) != MMAL_SUCCESS ) )
+        {
+            NotifyError( ( suspend ) ? "Failed suspending video capture" : "Failed resuming video capture" );
+        }
     }
 }
 
@@ -1104,13 +2126,20 @@ bool XRaspiCameraData::SetTextTextAnnotation( const string& text, bool blackBack
     return ret;
 }
 
-// Background control thread - does not do much other than init, clean-up and wait in between
+// Background control thread - does not do much other than init, clean-up and reconfiguring camera in between
 void XRaspiCameraData::ControlThreadHanlder( XRaspiCameraData* me )
-{    
-    if ( me->Init( ) )
+{
+    bool initialized = me->Init( );
+
+    while ( ( initialized ) && ( !me->NeedToStop.IsSignaled( ) ) )
     {
-        while ( !me->NeedToStop.Wait( 1000 ) )
+        if ( me->ConfigurationChanged.Wait( 1000 ) )
         {
+            // give a bit of time for other changes to come, so those are applied at once
+            if ( !me->NeedToStop.Wait( RECONFIGURATION_DELAY ) )
+            {
+                initialized = me->ApplyReconfiguration( );
+            }
         }
     }
     
@@ -1127,25 +2156,66 @@ void XRaspiCameraData::CameraControlCallback( MMAL_PORT_T* port, MMAL_BUFFER_HEA
 {
 }
 
+// Format of images provided by the output - uncompressed YUV/RGB for the raw stream and for the primary
+// stream when encoding is disabled
+XPixelFormat XRaspiCameraData::OutputImageFormat( const VideoOutput* output ) const
+{
+    return ( output->Stream == VideoStream::H264 ) ? XPixelFormat::H264 :
+           ( output->Stream == VideoStream::Raw )  ? XPixelFormat::YUV420 :
+           ( ( output->Stream == VideoStream::Primary ) && ( !ActiveJpegEncoding ) ) ? UncompressedFormat : XPixelFormat::JPEG;
+}
+
+// Size of images provided by the output - for compressed images width/stride is the size of data
+int32_t XRaspiCameraData::OutputImageWidth( const VideoOutput* output, const MMAL_BUFFER_HEADER_T* buffer ) const
+{
+    XPixelFormat format = OutputImageFormat( output );
+
+    return ( ( format == XPixelFormat::RGB24 ) || ( format == XPixelFormat::YUV420 ) ) ? ActiveWidth : buffer->length;
+}
+int32_t XRaspiCameraData::OutputImageHeight( const VideoOutput* output ) const
+{
+    XPixelFormat format = OutputImageFormat( output );
+
+    return ( ( format == XPixelFormat::RGB24 ) || ( format == XPixelFormat::YUV420 ) ) ? ActiveHeight : 1;
+}
+int32_t XRaspiCameraData::OutputImageStride( const VideoOutput* output, const MMAL_BUFFER_HEADER_T* buffer ) const
+{
+    XPixelFormat format = OutputImageFormat( output );
+
+    return ( format == XPixelFormat::RGB24 )  ? ActiveWidth * 3 :
+           ( format == XPixelFormat::YUV420 ) ? VCOS_ALIGN_UP( ActiveWidth, 32 ) : buffer->length;
+}
+
 // Callback signalling availability of a new video frame
 void XRaspiCameraData::VideoBufferCallback( MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer )
 {
-    XRaspiCameraData* me = reinterpret_cast<XRaspiCameraData*>( port->userdata );
+    XTraceScope       traceScope( "camera.buffer" );
+    VideoOutput*      output = reinterpret_cast<VideoOutput*>( port->userdata );
+    XRaspiCameraData* me     = output->Owner;
+
+    if ( output->SharedBuffers )
+    {
+        SharedVideoBufferCallback( output, buffer );
+        return;
+    }
     
     if ( buffer->length != 0 )
     {
         mmal_buffer_header_mem_lock( buffer );
 
         {
-            shared_ptr<XImage> image = ( !me->JpegEncoding ) ?
-                XImage::Create( buffer->data + buffer->offset, me->FrameWidth, me->FrameHeight, me->FrameWidth * 3, XPixelFormat::RGB24 ) :
-                XImage::Create( buffer->data + buffer->offset, buffer->length, 1, buffer->length, XPixelFormat::JPEG );
+            shared_ptr<XImage> image = XImage::Create( buffer->data + buffer->offset, me->OutputImageWidth( output, buffer ),
+                                                       me->OutputImageHeight( output ), me->OutputImageStride( output, buffer ),
+                                                       me->OutputImageFormat( output ) );
                 
-            me->FramesReceived++;
+            output->Counters->FramesCaptured++;
 
             if ( image )
             {
-                me->NotifyNewImage( image );
+                if ( me->NotifyNewImage( image, output->Stream ) )
+                {
+                    output->Counters->FramesDelivered++;
+                }
             }
             else
             {
@@ -1163,18 +2233,97 @@ void XRaspiCameraData::VideoBufferCallback( MMAL_PORT_T* port, MMAL_BUFFER_HEADE
         MMAL_BUFFER_HEADER_T* newBuffer;
         MMAL_STATUS_T         status;
         
-        newBuffer = mmal_queue_get( me->VideoBufferPool->queue );
+        newBuffer = mmal_queue_get( output->Pool->queue );
 		if ( newBuffer )
         {
             status = mmal_port_send_buffer( port, newBuffer );
         }
         
-        if ( ( !newBuffer ) || ( status != MMAL_SUCCESS ) )
+        // port has one buffer less to fill with frames - counted, so pool depth could be tuned
+        if ( !newBuffer )
         {
+            output->Counters->FramesDropped++;
+        }
+        else if ( status != MMAL_SUCCESS )
+        {
+            output->Counters->FramesDropped++;
             me->NotifyError( "Unable to return buffer to video port" );
         }
     }
 }
 
+// Handle new video frame, which is given to listener without copying it - the buffer is returned
+// to the video port only when the last reference to the image is released
+void XRaspiCameraData::SharedVideoBufferCallback( VideoOutput* output, MMAL_BUFFER_HEADER_T* buffer )
+{
+    XRaspiCameraData*              me            = output->Owner;
+    shared_ptr<SharedVideoBuffers> sharedBuffers = output->SharedBuffers;
+    shared_ptr<XImage>             image;
+
+    if ( buffer->length != 0 )
+    {
+        mmal_buffer_header_mem_lock( buffer );
+
+        // the image keeps the pool alive as long as it refers to a buffer from it
+        shared_ptr<VideoOutputCounters> counters = output->Counters;
+        auto releaseHandler = [sharedBuffers, counters, buffer]( )
+        {
+            mmal_buffer_header_mem_unlock( buffer );
+            counters->BuffersInUse--;
+            sharedBuffers->ReturnBuffer( buffer );
+        };
+
+        image = XImage::Create( buffer->data + buffer->offset, me->OutputImageWidth( output, buffer ),
+                                me->OutputImageHeight( output ), me->OutputImageStride( output, buffer ),
+                                me->OutputImageFormat( output ), releaseHandler );
+
+        output->Counters->FramesCaptured++;
+
+        if ( image )
+        {
+            output->Counters->BufferTaken( );
+
+            if ( me->NotifyNewImage( image, output->Stream ) )
+            {
+                output->Counters->FramesDelivered++;
+            }
+        }
+        else
+        {
+            mmal_buffer_header_mem_unlock( buffer );
+            me->NotifyError( "Failed allocating an image" );
+        }
+    }
+
+    // otherwise buffer goes back to the port when listeners release the image (may be right now)
+    if ( ( !image ) && ( !sharedBuffers->ReturnBuffer( buffer ) ) )
+    {
+        me->NotifyError( "Unable to return buffer to video port" );
+    }
+}
+
+// Release the buffer and send a free one to the port, so it could be filled with new frame
+bool SharedVideoBuffers::ReturnBuffer( MMAL_BUFFER_HEADER_T* buffer )
+{
+    lock_guard<mutex> lock( Sync );
+    bool              ret = true;
+
+    mmal_buffer_header_release( buffer );
+
+    if ( ( Port != nullptr ) && ( Port->is_enabled ) )
+    {
+        MMAL_BUFFER_HEADER_T* newBuffer = mmal_queue_get( Pool->queue );
+
+        ret = ( ( newBuffer != nullptr ) && ( mmal_port_send_buffer( Port, newBuffer ) == MMAL_SUCCESS ) );
+
+        if ( !ret )
+        {
+            Counters->FramesDropped++;
+        }
+    }
+
+    return ret;
+}
+
 } // namespace Private
 
@@ -21,6 +21,7 @@
 #ifndef XRASPI_CAMERA_HPP
 #define XRASPI_CAMERA_HPP
 
+#include <stdint.h>
 #include <memory>
 
 #include "IVideoSource.hpp"
@@ -96,7 +97,25 @@ enum class ImageEffect
     ColorBalance,
     Cartoon
 };
-    
+
+// Counters of frames and buffers of one of camera's video streams (since camera start)
+struct XRaspiCameraStreamStats
+{
+    // number of buffers in the stream's pool
+    uint32_t BuffersCount;
+    // number of buffers held by listeners now and the highest number of them (zero copy only)
+    uint32_t BuffersInUse;
+    uint32_t MaxBuffersInUse;
+    // number of times listeners took the last free buffer, so camera had none to fill with the
+    // next frames until some got released (zero copy only)
+    uint64_t BufferStarvations;
+    // number of frames received from camera, frames given to listener and frames lost, since
+    // no free buffer could be given back to camera
+    uint64_t FramesCaptured;
+    uint64_t FramesDelivered;
+    uint64_t FramesDropped;
+};
+
 class XRaspiCamera : public IVideoSource, private Uncopyable
 {
 protected:
@@ -115,31 +134,106 @@ public:
     void WaitForStop( );
     // Check if video source is still running
     bool IsRunning( );
+    // Check if camera's pipeline is initialized and provides frames (initialization is done on background
+    // thread after start; the check fails meanwhile and while the pipeline is rebuilt for new video format)
+    bool IsInitialized( ) const;
 
     // Get number of frames received since the start of the video source
     uint32_t FramesReceived( );
+    // Get number of frames lost since the start of the camera, because video buffers could not be returned to it
+    uint32_t BuffersDropped( );
+
+    // Get counters of frames and buffers of the primary/secondary/H.264/raw video streams
+    XRaspiCameraStreamStats PrimaryStreamStats( ) const;
+    XRaspiCameraStreamStats SecondaryStreamStats( ) const;
+    XRaspiCameraStreamStats H264StreamStats( ) const;
+    XRaspiCameraStreamStats RawStreamStats( ) const;
+
+    // Suspend/Resume capture of video frames while camera keeps running
+    void SuspendCapture( bool suspend );
+    bool IsCaptureSuspended( );
 
     // Set video source listener returning the old one
     IVideoSourceListener* SetListener( IVideoSourceListener* listener );
+    // Set listener of the secondary (resized) video stream returning the old one
+    IVideoSourceListener* SetSecondaryListener( IVideoSourceListener* listener );
+    // Set listener of the H.264 video stream returning the old one (images are chunks of Annex-B byte stream)
+    IVideoSourceListener* SetH264Listener( IVideoSourceListener* listener );
+    // Set listener of the raw video stream returning the old one (images are uncompressed YUV420)
+    IVideoSourceListener* SetRawListener( IVideoSourceListener* listener );
+
+    // Request H.264 encoder to provide key frame as soon as possible
+    bool RequestH264KeyFrame( );
+
+public: // Video format of the primary stream (can be changed at run time)
+
+    // Changing video format of a running camera reconfigures its pipeline in the background. New JPEG quality
+    // restarts JPEG encoder only, while other settings rebuild the whole pipeline, so video stalls for a moment.
+    // Changes done within a short time of each other are applied at once. If camera fails with the new
+    // format, the previous one is restored. Setters fail (keeping current format) if a value is out of range -
+    // width 64-1920, height 64-1080, frame rate 1-90 and JPEG quality 1-100.
 
-public: // Camera configuration to be done before starting it
-    
     // Get/Set video size
     uint32_t Width( ) const;
     uint32_t Height( ) const;
-    void SetVideoSize( uint32_t width, uint32_t height );
-    
+    bool SetVideoSize( uint32_t width, uint32_t height );
+
     // Get/Set frame rate
     uint32_t FrameRate( ) const;
-    void SetFrameRate( uint32_t frameRate );
-    
+    bool SetFrameRate( uint32_t frameRate );
+
     // Enable/Disable JPEG encoding
     bool IsJpegEncodingEnabled( ) const;
     void EnableJpegEncoding( bool enable );
-    
+
     // Get/Set JPEG quality
     uint32_t JpegQuality( ) const;
-    void SetJpegQuality( uint32_t jpegQuality );
+    bool SetJpegQuality( uint32_t jpegQuality );
+
+    // Get number of times camera's pipeline was reconfigured since it was started
+    uint32_t ReconfigurationsCount( ) const;
+
+public: // Camera configuration to be done before starting it
+
+    // Get/Set format of images provided when JPEG encoding is disabled - YUV420 (default),
+    // which is camera's native format, or RGB24 converted from it by camera's ISP
+    XPixelFormat UncompressedFormat( ) const;
+    void SetUncompressedFormat( XPixelFormat format );
+
+    // Get/Set size of the secondary video stream, which is resized from the primary one and provided
+    // to its own listener at the same time. Available only with JPEG encoding; 0x0 size disables it.
+    uint32_t SecondaryWidth( ) const;
+    uint32_t SecondaryHeight( ) const;
+    void SetSecondaryVideoSize( uint32_t width, uint32_t height );
+
+    // Get/Set JPEG quality of the secondary video stream
+    uint32_t SecondaryJpegQuality( ) const;
+    void SetSecondaryJpegQuality( uint32_t jpegQuality );
+
+    // Enable/Disable H.264 encoding of the video stream, which is provided to its own listener
+    // at the same time as JPEGs. Available only with JPEG encoding.
+    bool IsH264EncodingEnabled( ) const;
+    void EnableH264Encoding( bool enable );
+
+    // Get/Set bitrate (bits/second) of the H.264 video stream
+    uint32_t H264Bitrate( ) const;
+    void SetH264Bitrate( uint32_t bitrate );
+
+    // Enable/Disable raw video stream, which provides full size YUV420 frames as they come from camera
+    // to its own listener at the same time as JPEGs. Available only with JPEG encoding.
+    bool IsRawStreamEnabled( ) const;
+    void EnableRawStream( bool enable );
+
+    // Enable/Disable providing camera's buffers to listener without copying them. When enabled,
+    // listeners may keep provided images, which return their buffers to camera on destruction.
+    bool IsZeroCopyEnabled( ) const;
+    void EnableZeroCopy( bool enable );
+
+    // Get/Set number of buffers in pool of every video stream - more buffers let listeners keep frames
+    // longer without starving camera, fewer save GPU memory. 0 (default) takes camera's recommended
+    // number (at least 2), plus 2 more when zero copy is enabled.
+    uint32_t BuffersCount( ) const;
+    void SetBuffersCount( uint32_t count );
 
 public: // Different settings of the video source (can be changed at run time)
 
@@ -18,126 +18,143 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
-#include <map>
-#include <algorithm>
 #include "XRaspiCameraConfig.hpp"
 
 using namespace std;
 
-const static string  PROP_BRIGHTNESS          = "brightness";
-const static string  PROP_CONTRAST            = "contrast";
-const static string  PROP_SATURATION          = "saturation";
-const static string  PROP_SHARPNESS           = "sharpness";
-const static string  PROP_HFLIP               = "hflip";
-const static string  PROP_VFLIP               = "vflip";
-const static string  PROP_VIDEO_STABILISATION = "videostabilisation";
+#define CHOICES_COUNT( choices ) ( sizeof( choices ) / sizeof( choices[0] ) )
 
-const static string  PROP_AWBMODE             = "awb";
-const static string  PROP_EXPMODE             = "expmode";
-const static string  PROP_EXPMETERINGMODE     = "expmeteringmode";
-const static string  PROP_EFFECT              = "effect";
-
-const static map<string, string> SupportedProperties =
+const static XPropertyChoice AwbModeChoices[] =
 {
-    { PROP_BRIGHTNESS, "{\"min\":0,\"max\":100,\"def\":50,\"type\":\"int\",\"order\":0,\"name\":\"Brightness\"}"    },
-    { PROP_CONTRAST,   "{\"min\":-100,\"max\":100,\"def\":0,\"type\":\"int\",\"order\":1,\"name\":\"Contrast\"}"    },
-    { PROP_SATURATION, "{\"min\":-100,\"max\":100,\"def\":0,\"type\":\"int\",\"order\":2,\"name\":\"Saturation\"}"  },
-    { PROP_SHARPNESS,  "{\"min\":-100,\"max\":100,\"def\":0,\"type\":\"int\",\"order\":3,\"name\":\"Sharpness\"}"   },
-    
-    { PROP_AWBMODE, "{\"def\":\"Auto\",\"type\":\"select\",\"order\":4,\"name\":\"White Balance\","
-                    "\"choices\":[[\"Off\",\"Off\"],[\"Auto\",\"Auto\"],[\"Sunlight\",\"Sunlight\"],"
-                    "[\"Cloudy\",\"Cloudy\"],[\"Shade\",\"Shade\"],[\"Tungsten\",\"Tungsten\"],"
-                    "[\"Fluorescent\",\"Fluorescent\"],[\"Incandescent\",\"Incandescent\"],[\"Flash\",\"Flash\"],"
-                    "[\"Horizon\",\"Horizon\"]]}" },
-    { PROP_EXPMODE, "{\"def\":\"Auto\",\"type\":\"select\",\"order\":5,\"name\":\"Exposure Mode\","
-                    "\"choices\":[[\"Off\",\"Off\"],[\"Auto\",\"Auto\"],[\"Night\",\"Night\"],"
-                    "[\"NightPreview\",\"Night Preview\"],[\"Backlight\",\"Backlight\"],[\"Spotlight\",\"Spotlight\"],"
-                    "[\"Sports\",\"Sports\"],[\"Snow\",\"Snow\"],[\"Beach\",\"Beach\"],[\"VeryLong\",\"Very Long\"],"
-                    "[\"FixedFps\",\"Fixed Fps\"],[\"AntiShake\",\"Anti Shake\"],[\"Fireworks\",\"Fireworks\"]]}" },
-    { PROP_EXPMETERINGMODE, "{\"def\":\"Average\",\"type\":\"select\",\"order\":6,\"name\":\"Exposure Metering Mode\","
-                    "\"choices\":[[\"Average\",\"Average\"],[\"Spot\",\"Spot\"],[\"Backlit\",\"Backlit\"],"
-                    "[\"Matrix\",\"Matrix\"]]}" },
-    { PROP_EFFECT,  "{\"def\":\"None\",\"type\":\"select\",\"order\":7,\"name\":\"Image Effect\","
-                    "\"choices\":[[\"None\",\"None\"],[\"Negative\",\"Negative\"],[\"Solarize\",\"Solarize\"],"
-                    "[\"Sketch\",\"Sketch\"],[\"Denoise\",\"Denoise\"],[\"Emboss\",\"Emboss\"],"
-                    "[\"OilPaint\",\"Oil Paint\"],[\"Hatch\",\"Hatch\"],[\"Gpen\",\"G-Pen\"],"
-                    "[\"Pastel\",\"Pastel\"],[\"WaterColor\",\"Water Color\"],[\"Film\",\"Film\"],"
-                    "[\"Blur\",\"Blur\"],[\"Saturation\",\"Saturation\"],[\"ColorSwap\",\"Color Swap\"],"
-                    "[\"WashedOut\",\"Washed Out\"],[\"Posterise\",\"Posterise\"],[\"ColorPoint\",\"Color Point\"],"
-                    "[\"ColorBalance\",\"Color Balance\"],[\"Cartoon\",\"Cartoon\"]]}" },
-                    
-    { PROP_HFLIP, "{\"def\":0,\"type\":\"bool\",\"order\":8,\"name\":\"Horizontal Flip\"}"   },
-    { PROP_VFLIP, "{\"def\":0,\"type\":\"bool\",\"order\":9,\"name\":\"Vertical Flip\"}"   },
-    { PROP_VIDEO_STABILISATION, "{\"def\":0,\"type\":\"bool\",\"order\":10,\"name\":\"Video Stabilisation\"}"   },
+    { "Off",          "Off",           static_cast<int32_t>( AwbMode::Off )          },
+    { "Auto",         "Auto",          static_cast<int32_t>( AwbMode::Auto )         },
+    { "Sunlight",     "Sunlight",      static_cast<int32_t>( AwbMode::Sunlight )     },
+    { "Cloudy",       "Cloudy",        static_cast<int32_t>( AwbMode::Cloudy )       },
+    { "Shade",        "Shade",         static_cast<int32_t>( AwbMode::Shade )        },
+    { "Tungsten",     "Tungsten",      static_cast<int32_t>( AwbMode::Tungsten )     },
+    { "Fluorescent",  "Fluorescent",   static_cast<int32_t>( AwbMode::Fluorescent )  },
+    { "Incandescent", "Incandescent",  static_cast<int32_t>( AwbMode::Incandescent ) },
+    { "Flash",        "Flash",         static_cast<int32_t>( AwbMode::Flash )        },
+    { "Horizon",      "Horizon",       static_cast<int32_t>( AwbMode::Horizon )      }
 };
 
-const static map<string, AwbMode> SupportedAwbModes =
+const static XPropertyChoice ExposureModeChoices[] =
 {
-    { "Off",          AwbMode::Off          },
-    { "Auto",         AwbMode::Auto         },
-    { "Sunlight",     AwbMode::Sunlight     },
-    { "Cloudy",       AwbMode::Cloudy       },
-    { "Shade",        AwbMode::Shade        },
-    { "Tungsten",     AwbMode::Tungsten     },
-    { "Fluorescent",  AwbMode::Fluorescent  },
-    { "Incandescent", AwbMode::Incandescent },
-    { "Flash",        AwbMode::Flash        },
-    { "Horizon",      AwbMode::Horizon      }
+    { "Off",          "Off",           static_cast<int32_t>( ExposureMode::Off )          },
+    { "Auto",         "Auto",          static_cast<int32_t>( ExposureMode::Auto )         },
+    { "Night",        "Night",         static_cast<int32_t>( ExposureMode::Night )        },
+    { "NightPreview", "Night Preview", static_cast<int32_t>( ExposureMode::NightPreview ) },
+    { "Backlight",    "Backlight",     static_cast<int32_t>( ExposureMode::Backlight )    },
+    { "Spotlight",    "Spotlight",     static_cast<int32_t>( ExposureMode::Spotlight )    },
+    { "Sports",       "Sports",        static_cast<int32_t>( ExposureMode::Sports )       },
+    { "Snow",         "Snow",          static_cast<int32_t>( ExposureMode::Snow )         },
+    { "Beach",        "Beach",         static_cast<int32_t>( ExposureMode::Beach )        },
+    { "VeryLong",     "Very Long",     static_cast<int32_t>( ExposureMode::VeryLong )     },
+    { "FixedFps",     "Fixed Fps",     static_cast<int32_t>( ExposureMode::FixedFps )     },
+    { "AntiShake",    "Anti Shake",    static_cast<int32_t>( ExposureMode::AntiShake )    },
+    { "Fireworks",    "Fireworks",     static_cast<int32_t>( ExposureMode::Fireworks )    }
 };
 
-const static map<string, ExposureMode> SupportedExposureModes =
+const static XPropertyChoice ExposureMeteringModeChoices[] =
 {
-    { "Off",          ExposureMode::Off          },
-    { "Auto",         ExposureMode::Auto         },
-    { "Night",        ExposureMode::Night        },
-    { "NightPreview", ExposureMode::NightPreview },
-    { "Backlight",    ExposureMode::Backlight    },
-    { "Spotlight",    ExposureMode::Spotlight    },
-    { "Sports",       ExposureMode::Sports       },
-    { "Snow",         ExposureMode::Snow         },
-    { "Beach",        ExposureMode::Beach        },
-    { "VeryLong",     ExposureMode::VeryLong     },
-    { "FixedFps",     ExposureMode::FixedFps     },
-    { "AntiShake",    ExposureMode::AntiShake    },
-    { "Fireworks",    ExposureMode::Fireworks    }
+    { "Average",      "Average",       static_cast<int32_t>( ExposureMeteringMode::Average ) },
+    { "Spot",         "Spot",          static_cast<int32_t>( ExposureMeteringMode::Spot )    },
+    { "Backlit",      "Backlit",       static_cast<int32_t>( ExposureMeteringMode::Backlit ) },
+    { "Matrix",       "Matrix",        static_cast<int32_t>( ExposureMeteringMode::Matrix )  }
 };
 
-const static map<string, ExposureMeteringMode> SupportedExposureMeteringModes =
+const static XPropertyChoice ImageEffectChoices[] =
 {
-    { "Average", ExposureMeteringMode::Average },
-    { "Spot",    ExposureMeteringMode::Spot    },
-    { "Backlit", ExposureMeteringMode::Backlit },
-    { "Matrix",  ExposureMeteringMode::Matrix  }
+    { "None",         "None",          static_cast<int32_t>( ImageEffect::None )         },
+    { "Negative",     "Negative",      static_cast<int32_t>( ImageEffect::Negative )     },
+    { "Solarize",     "Solarize",      static_cast<int32_t>( ImageEffect::Solarize )     },
+    { "Sketch",       "Sketch",        static_cast<int32_t>( ImageEffect::Sketch )       },
+    { "Denoise",      "Denoise",       static_cast<int32_t>( ImageEffect::Denoise )      },
+    { "Emboss",       "Emboss",        static_cast<int32_t>( ImageEffect::Emboss )       },
+    { "OilPaint",     "Oil Paint",     static_cast<int32_t>( ImageEffect::OilPaint )     },
+    { "Hatch",        "Hatch",         static_cast<int32_t>( ImageEffect::Hatch )        },
+    { "Gpen",         "G-Pen",         static_cast<int32_t>( ImageEffect::Gpen )         },
+    { "Pastel",       "Pastel",        static_cast<int32_t>( ImageEffect::Pastel )       },
+    { "WaterColor",   "Water Color",   static_cast<int32_t>( ImageEffect::WaterColor )   },
+    { "Film",         "Film",          static_cast<int32_t>( ImageEffect::Film )         },
+    { "Blur",         "Blur",          static_cast<int32_t>( ImageEffect::Blur )         },
+    { "Saturation",   "Saturation",    static_cast<int32_t>( ImageEffect::Saturation )   },
+    { "ColorSwap",    "Color Swap",    static_cast<int32_t>( ImageEffect::ColorSwap )    },
+    { "WashedOut",    "Washed Out",    static_cast<int32_t>( ImageEffect::WashedOut )    },
+    { "Posterise",    "Posterise",     static_cast<int32_t>( ImageEffect::Posterise )    },
+    { "ColorPoint",   "Color Point",   static_cast<int32_t>( ImageEffect::ColorPoint )   },
+    { "ColorBalance", "Color Balance", static_cast<int32_t>( ImageEffect::ColorBalance ) },
+    { "Cartoon",      "Cartoon",       static_cast<int32_t>( ImageEffect::Cartoon )      }
 };
 
-const static map<string, ImageEffect> SupportedImageEffects =
+static inline XError StatusToError( bool status )
+{
+    return ( status ) ? XError::Success : XError::Failed;
+}
+
+// All properties of a PI camera - declared once and used both to get/set them and to describe them
+const XPropertyTable<XRaspiCameraConfig> XRaspiCameraConfig::PropertyTable =
 {
-    { "None",         ImageEffect::None         },
-    { "Negative",     ImageEffect::Negative     },
-    { "Solarize",     ImageEffect::Solarize     },
-    { "Sketch",       ImageEffect::Sketch       },
-    { "Denoise",      ImageEffect::Denoise      },
-    { "Emboss",       ImageEffect::Emboss       },
-    { "OilPaint",     ImageEffect::OilPaint     },
-    { "Hatch",        ImageEffect::Hatch        },
-    { "Gpen",         ImageEffect::Gpen         },
-    { "Pastel",       ImageEffect::Pastel       },
-    { "WaterColor",   ImageEffect::WaterColor   },
-    { "Film",         ImageEffect::Film         },
-    { "Blur",         ImageEffect::Blur         },
-    { "Saturation",   ImageEffect::Saturation   },
-    { "ColorSwap",    ImageEffect::ColorSwap    },
-    { "WashedOut",    ImageEffect::WashedOut    },
-    { "Posterise",    ImageEffect::Posterise    },
-    { "ColorPoint",   ImageEffect::ColorPoint   },
-    { "ColorBalance", ImageEffect::ColorBalance },
-    { "Cartoon",      ImageEffect::Cartoon      }
+    { { "brightness", "Brightness", XPropertyType::Integer, 0, 100, 50, nullptr, 0 },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->GetBrightness( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetBrightness( static_cast<int32_t>( value ) ) ); } },
+    { { "contrast", "Contrast", XPropertyType::Integer, -100, 100, 0, nullptr, 0 },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->GetContrast( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetContrast( static_cast<int32_t>( value ) ) ); } },
+    { { "saturation", "Saturation", XPropertyType::Integer, -100, 100, 0, nullptr, 0 },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->GetSaturation( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetSaturation( static_cast<int32_t>( value ) ) ); } },
+    { { "sharpness", "Sharpness", XPropertyType::Integer, -100, 100, 0, nullptr, 0 },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->GetSharpness( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetSharpness( static_cast<int32_t>( value ) ) ); } },
+
+    { { "awb", "White Balance", XPropertyType::Choice, 0, 0, static_cast<int32_t>( AwbMode::Auto ),
+        AwbModeChoices, CHOICES_COUNT( AwbModeChoices ) },
+      []( const XRaspiCameraConfig& config ) -> double { return static_cast<int32_t>( config.mCamera->GetWhiteBalanceMode( ) ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetWhiteBalanceMode( static_cast<AwbMode>( value ) ) ); } },
+    { { "expmode", "Exposure Mode", XPropertyType::Choice, 0, 0, static_cast<int32_t>( ExposureMode::Auto ),
+        ExposureModeChoices, CHOICES_COUNT( ExposureModeChoices ) },
+      []( const XRaspiCameraConfig& config ) -> double { return static_cast<int32_t>( config.mCamera->GetExposureMode( ) ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetExposureMode( static_cast<ExposureMode>( value ) ) ); } },
+    { { "expmeteringmode", "Exposure Metering Mode", XPropertyType::Choice, 0, 0, static_cast<int32_t>( ExposureMeteringMode::Average ),
+        ExposureMeteringModeChoices, CHOICES_COUNT( ExposureMeteringModeChoices ) },
+      []( const XRaspiCameraConfig& config ) -> double { return static_cast<int32_t>( config.mCamera->GetExposureMeteringMode( ) ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetExposureMeteringMode( static_cast<ExposureMeteringMode>( value ) ) ); } },
+    { { "effect", "Image Effect", XPropertyType::Choice, 0, 0, static_cast<int32_t>( ImageEffect::None ),
+        ImageEffectChoices, CHOICES_COUNT( ImageEffectChoices ) },
+      []( const XRaspiCameraConfig& config ) -> double { return static_cast<int32_t>( config.mCamera->GetImageEffect( ) ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetImageEffect( static_cast<ImageEffect>( value ) ) ); } },
+
+    { { "hflip", "Horizontal Flip", XPropertyType::Boolean, 0, 1, 0, nullptr, 0 },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->GetHorizontalFlip( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetCameraFlip( value != 0, config.mCamera->GetVerticalFlip( ) ) ); } },
+    { { "vflip", "Vertical Flip", XPropertyType::Boolean, 0, 1, 0, nullptr, 0 },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->GetVerticalFlip( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetCameraFlip( config.mCamera->GetHorizontalFlip( ), value != 0 ) ); } },
+    { { "videostabilisation", "Video Stabilisation", XPropertyType::Boolean, 0, 1, 0, nullptr, 0 },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->GetVideoStabilisation( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetVideoStabilisation( value != 0 ) ); } },
+
+    // video format - changing it reconfigures running camera's pipeline, so out of range values are rejected
+    // rather than clamped (each dimension is checked on its own)
+    { { "width", "Video Width", XPropertyType::Integer, 64, 1920, 640, nullptr, 0, true },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->Width( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetVideoSize( static_cast<uint32_t>( value ), config.mCamera->Height( ) ) ); } },
+    { { "height", "Video Height", XPropertyType::Integer, 64, 1080, 480, nullptr, 0, true },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->Height( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetVideoSize( config.mCamera->Width( ), static_cast<uint32_t>( value ) ) ); } },
+    { { "framerate", "Frame Rate", XPropertyType::Integer, 1, 30, 30, nullptr, 0, true },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->FrameRate( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetFrameRate( static_cast<uint32_t>( value ) ) ); } },
+    { { "jpegquality", "JPEG Quality", XPropertyType::Integer, 1, 100, 10, nullptr, 0, true },
+      []( const XRaspiCameraConfig& config ) -> double { return config.mCamera->JpegQuality( ); },
+      []( XRaspiCameraConfig& config, double value ) { return StatusToError( config.mCamera->SetJpegQuality( static_cast<uint32_t>( value ) ) ); } }
 };
 
 // ------------------------------------------------------------------------------------------
 
 XRaspiCameraConfig::XRaspiCameraConfig( const shared_ptr<XRaspiCamera>& camera ) :
-    mCamera( camera )
+    mCamera( camera ), mChangeVersion( 1 )
 {
 
 }
@@ -145,135 +162,11 @@ XRaspiCameraConfig::XRaspiCameraConfig( const shared_ptr<XRaspiCamera>& camera )
 // Set the specified property of a PI camera
 XError XRaspiCameraConfig::SetProperty( const string& propertyName, const string& value )
 {
-    XError ret = XError::Success;
-    int    numericValue;
-    bool   propStatus = true;
-
-    // many configuration setting are actually numeric, so scan it once
-    int scannedCount = sscanf( value.c_str( ), "%d", &numericValue );
-
-    if ( propertyName == PROP_HFLIP )
-    {
-        bool hflip = ( ( value == "1" ) || ( value == "true" ) );
-        bool vflip = mCamera->GetVerticalFlip( );
-
-        propStatus = mCamera->SetCameraFlip( hflip, vflip );
-    }
-    else if ( propertyName == PROP_VFLIP )
-    {
-        bool vflip = ( ( value == "1" ) || ( value == "true" ) );
-        bool hflip = mCamera->GetHorizontalFlip( );
-
-        propStatus = mCamera->SetCameraFlip( hflip, vflip );
-    }
-    else if ( propertyName == PROP_VIDEO_STABILISATION )
-    {
-        propStatus = mCamera->SetVideoStabilisation( ( value == "1" ) || ( value == "true" ) );
-    }
-    else if ( propertyName == PROP_SHARPNESS )
-    {
-        if ( scannedCount == 1 )
-        {
-            propStatus = mCamera->SetSharpness( numericValue );
-        }
-        else
-        {
-            ret = XError::InvalidPropertyValue;
-        }
-    }
-    else if ( propertyName == PROP_CONTRAST )
-    {
-        if ( scannedCount == 1 )
-        {
-            propStatus = mCamera->SetContrast( numericValue );
-        }
-        else
-        {
-            ret = XError::InvalidPropertyValue;
-        }
-    }
-    else if ( propertyName == PROP_BRIGHTNESS )
-    {
-        if ( scannedCount == 1 )
-        {
-            propStatus = mCamera->SetBrightness( numericValue );
-        }
-        else
-        {
-            ret = XError::InvalidPropertyValue;
-        }    
-    }
-    else if ( propertyName == PROP_SATURATION )
-    {
-        if ( scannedCount == 1 )
-        {
-            propStatus = mCamera->SetSaturation( numericValue );
-        }
-        else
-        {
-            ret = XError::InvalidPropertyValue;
-        }
-    }
-    else if ( propertyName == PROP_AWBMODE )
-    {
-        map<string, AwbMode>::const_iterator itMode = SupportedAwbModes.find( value );
-        
-        if ( itMode == SupportedAwbModes.end( ) )
-        {
-            ret = XError::InvalidPropertyValue;
-        }
-        else
-        {
-            propStatus = mCamera->SetWhiteBalanceMode( itMode->second );
-        }
-    }
-    else if ( propertyName == PROP_EXPMODE )
-    {
-        map<string, ExposureMode>::const_iterator itMode = SupportedExposureModes.find( value );
-        
-        if ( itMode == SupportedExposureModes.end( ) )
-        {
-            ret = XError::InvalidPropertyValue;
-        }
-        else
-        {
-            propStatus = mCamera->SetExposureMode( itMode->second );
-        }
-    }
-    else if ( propertyName == PROP_EXPMETERINGMODE )
-    {
-        map<string, ExposureMeteringMode>::const_iterator itMode = SupportedExposureMeteringModes.find( value );
-        
-        if ( itMode == SupportedExposureMeteringModes.end( ) )
-        {
-            ret = XError::InvalidPropertyValue;
-        }
-        else
-        {
-            propStatus = mCamera->SetExposureMeteringMode( itMode->second );
-        }            
-    }
-    else if ( propertyName == PROP_EFFECT )
-    {
-        map<string, ImageEffect>::const_iterator itMode = SupportedImageEffects.find( value );
-        
-        if ( itMode == SupportedImageEffects.end( ) )
-        {
-            ret = XError::InvalidPropertyValue;
-        }
-        else
-        {
-            propStatus = mCamera->SetImageEffect( itMode->second );
-        }            
-    }
-    else
-    {
-        ret = XError::UnknownProperty;
-    }
+    XError ret = PropertyTable.SetProperty( *this, propertyName, value );
 
-    if ( ( ret == XError::Success ) && ( !propStatus ) )
+    if ( ret )
     {
-        ret = XError::Failed;
+        mChangeVersion++;
     }
 
     return ret;
@@ -282,138 +175,43 @@ XError XRaspiCameraConfig::SetProperty( const string& propertyName, const string
 // Get the specified property of a PI camera
 XError XRaspiCameraConfig::GetProperty( const string& propertyName, string& value ) const
 {
-    XError ret = XError::Success;
-    bool   valueIsANumber = false;
-    int    numericValue;
-
-    if ( propertyName == PROP_HFLIP )
-    {
-        value = ( mCamera->GetHorizontalFlip( ) ) ? "1" : "0";
-    }
-    else if ( propertyName == PROP_VFLIP )
-    {
-        value = ( mCamera->GetVerticalFlip( ) ) ? "1" : "0";
-    }
-    else if ( propertyName == PROP_VIDEO_STABILISATION )
-    {
-        value = ( mCamera->GetVideoStabilisation( ) ) ? "1" : "0";
-    }
-    else if ( propertyName == PROP_SHARPNESS )
-    {
-        numericValue   = mCamera->GetSharpness( );
-        valueIsANumber = true;
-    }
-    else if ( propertyName == PROP_CONTRAST )
-    {
-        numericValue   = mCamera->GetContrast( );
-        valueIsANumber = true;
-    }
-    else if ( propertyName == PROP_BRIGHTNESS )
-    {
-        numericValue   = mCamera->GetBrightness( );
-        valueIsANumber = true;
-    }
-    else if ( propertyName == PROP_SATURATION )
-    {
-        numericValue   = mCamera->GetSaturation( );
-        valueIsANumber = true;
-    }
-    else if ( propertyName == PROP_AWBMODE )
-    {
-        AwbMode awbMode = mCamera->GetWhiteBalanceMode( );
-
-        for ( auto supportedMode : SupportedAwbModes )
-        {
-            if ( supportedMode.second == awbMode )
-            {
-                value = supportedMode.first;
-                break;
-            }
-        }
-    }
-    else if ( propertyName == PROP_EXPMODE )
-    {
-        ExposureMode expMode = mCamera->GetExposureMode( );
-
-        for ( auto supportedMode : SupportedExposureModes )
-        {
-            if ( supportedMode.second == expMode )
-            {
-                value = supportedMode.first;
-                break;
-            }
-        }
-    }
-    else if ( propertyName == PROP_EXPMETERINGMODE )
-    {
-        ExposureMeteringMode expMeteringMode = mCamera->GetExposureMeteringMode( );
-
-        for ( auto supportedMode : SupportedExposureMeteringModes )
-        {
-            if ( supportedMode.second == expMeteringMode )
-            {
-                value = supportedMode.first;
-                break;
-            }
-        }
-    }
-    else if ( propertyName == PROP_EFFECT )
-    {
-        ImageEffect imageEffect = mCamera->GetImageEffect( );
-
-        for ( auto supportedEffect : SupportedImageEffects )
-        {
-            if ( supportedEffect.second == imageEffect )
-            {
-                value = supportedEffect.first;
-                break;
-            }
-        }
-    }
-    else
-    {
-        ret = XError::UnknownProperty;
-    }
-
-    if ( valueIsANumber )
-    {
-        char buffer[32];
-
-        sprintf( buffer, "%d", numericValue );
-        value = buffer;
-    }
-
-    return ret;
+    return PropertyTable.GetProperty( *this, propertyName, value );
 }
 
 // Get all supported properties of a PI camera
 map<string, string> XRaspiCameraConfig::GetAllProperties( ) const
 {
-    map<string, string> properties;
-    string              value;
+    return PropertyTable.GetAllProperties( *this );
+}
 
-    for ( auto property : SupportedProperties )
-    {
-        if ( GetProperty( property.first, value ) )
-        {
-            properties.insert( pair<string, string>( property.first, value ) );
-        }
-    }
+// Get version of camera's configuration, which changes every time a property is set
+uint64_t XRaspiCameraConfig::ChangeVersion( ) const
+{
+    return mChangeVersion;
+}
 
-    return properties;
+// Get the table of camera's properties
+const XPropertyTableBase& XRaspiCameraConfig::Properties( )
+{
+    return PropertyTable;
 }
 
 // ------------------------------------------------------------------------------------------
 
+XRaspiCameraPropsInfo::XRaspiCameraPropsInfo( ) :
+    mDescriptions( XRaspiCameraConfig::Properties( ).GetDescriptions( ) )
+{
+
+}
+
 XError XRaspiCameraPropsInfo::GetProperty( const std::string& propertyName, std::string& value ) const
 {
-    XError  ret = XError::Success;
-    char    buffer[128];
+    XError ret = XError::Success;
 
     // find the property in the list of supported
-    map<string, string>::const_iterator itSupportedProperty = SupportedProperties.find( propertyName );
+    map<string, string>::const_iterator itSupportedProperty = mDescriptions.find( propertyName );
 
-    if ( itSupportedProperty == SupportedProperties.end( ) )
+    if ( itSupportedProperty == mDescriptions.end( ) )
     {
         ret = XError::UnknownProperty;
     }
@@ -425,19 +223,8 @@ XError XRaspiCameraPropsInfo::GetProperty( const std::string& propertyName, std:
     return ret;
 }
 
-// Get information for all supported properties of a DirectShow video device
+// Get information for all supported properties of a PI camera
 map<string, string> XRaspiCameraPropsInfo::GetAllProperties( ) const
 {
-    map<string, string> properties;
-    string              value;
-
-    for ( auto property : SupportedProperties )
-    {
-        if ( GetProperty( property.first, value ) )
-        {
-            properties.insert( pair<string, string>( property.first, value ) );
-        }
-    }
-
-    return properties;
+    return mDescriptions;
 }
@@ -21,8 +21,10 @@
 #ifndef XRASPI_CAMERA_CONFIG_HPP
 #define XRASPI_CAMERA_CONFIG_HPP
 
+#include <atomic>
 #include "IObjectConfigurator.hpp"
 #include "XRaspiCamera.hpp"
+#include "XPropertyTable.hpp"
 
 // The class is to get/set camera properties
 class XRaspiCameraConfig : public IObjectConfigurator
@@ -35,17 +37,30 @@ public:
 
     std::map<std::string, std::string> GetAllProperties( ) const;
 
+    uint64_t ChangeVersion( ) const;
+
+    // Get the table of supported properties (names, types, ranges, etc.)
+    static const XPropertyTableBase& Properties( );
+
 private:
     std::shared_ptr<XRaspiCamera> mCamera;
+    std::atomic<uint64_t>         mChangeVersion;
+
+    static const XPropertyTable<XRaspiCameraConfig> PropertyTable;
 };
 
 // The class is to get/set camera properties information - min, max, default, etc.
 class XRaspiCameraPropsInfo : public IObjectInformation
 {
 public:
+    XRaspiCameraPropsInfo( );
+
     XError GetProperty( const std::string& propertyName, std::string& value ) const;
 
     std::map<std::string, std::string> GetAllProperties( ) const;
+
+private:
+    std::map<std::string, std::string> mDescriptions;
 };
 
 #endif // XRASPI_CAMERA_CONFIG_HPP
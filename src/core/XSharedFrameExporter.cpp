@@ -0,0 +1,380 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include <string.h>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "XSharedFrameExporter.hpp"
+#include "XImage.hpp"
+#include "XTrace.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Slots are aligned to cache lines, so are their headers and data
+    #define SLOT_ALIGNMENT (64)
+
+    class XSharedFrameExporterData;
+
+    class SharedFrameVideoListener : public IVideoSourceListener
+    {
+    private:
+        XSharedFrameExporterData* Owner;
+
+    public:
+        SharedFrameVideoListener( XSharedFrameExporterData* owner ) : Owner( owner ) { }
+
+        void OnNewImage( const shared_ptr<const XImage>& image );
+        void OnError( const string& /* errorMessage */, bool /* fatal */ ) { }
+    };
+
+    class XSharedFrameExporterData
+    {
+    public:
+        SharedFrameVideoListener    VideoSourceListener;
+
+        // the mapped object - publishing is guarded, so it is not unmapped while a frame is written
+        mutable mutex               Sync;
+        uint8_t*                    Memory;
+        size_t                      MemorySize;
+        XSharedFrameHeader*         Header;
+
+        atomic<uint64_t>            FramesPublished;
+        atomic<uint64_t>            FramesSkipped;
+        XHistogram                  PublishTime;
+
+    public:
+        XSharedFrameExporterData( ) :
+            VideoSourceListener( this ), Sync( ), Memory( nullptr ), MemorySize( 0 ), Header( nullptr ),
+            FramesPublished( 0 ), FramesSkipped( 0 ),
+            PublishTime( { 100, 250, 500, 1000, 2000, 3000, 5000, 10000 } )
+        {
+        }
+
+        XError Open( const string& name, uint32_t maxFrameSize, uint32_t slotsCount );
+        void Close( );
+
+        void Publish( const XImage& image );
+
+    private:
+        void Unmap( );
+        bool IsSameLayout( uint32_t slotsCount, uint32_t slotSize ) const;
+        void InitLayout( uint32_t slotsCount, uint32_t slotSize );
+
+        XSharedFrameSlot* Slot( uint32_t index ) const
+        {
+            return reinterpret_cast<XSharedFrameSlot*>( Memory + Header->HeaderSize + static_cast<size_t>( index ) * Header->SlotSize );
+        }
+    };
+}
+
+// Size of image's data in the layout of XImage
+static size_t ImageDataSize( const XImage& image )
+{
+    size_t size = static_cast<size_t>( image.Stride( ) ) * image.Height( );
+
+    if ( image.Format( ) == XPixelFormat::YUV420 )
+    {
+        size = static_cast<size_t>( image.Stride( ) ) * ( ( image.Height( ) + 15 ) & ~15 ) * 3 / 2;
+    }
+
+    return size;
+}
+
+// Current time of monotonic clock in microseconds
+static uint64_t MonotonicTimeNow( )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return static_cast<uint64_t>( now.tv_sec ) * 1000000 + now.tv_nsec / 1000;
+}
+
+// ------------------------------------------------------------------------------------------
+
+XSharedFrameExporter::XSharedFrameExporter( ) :
+    mData( new Private::XSharedFrameExporterData( ) )
+{
+}
+
+XSharedFrameExporter::~XSharedFrameExporter( )
+{
+    Close( );
+    delete mData;
+}
+
+// Create/Open shared memory object and start publishing frames into it
+XError XSharedFrameExporter::Open( const string& name, uint32_t maxFrameSize, uint32_t slotsCount )
+{
+    return mData->Open( name, maxFrameSize, slotsCount );
+}
+
+// Stop publishing frames
+void XSharedFrameExporter::Close( )
+{
+    mData->Close( );
+}
+
+// Check if shared memory object is open
+bool XSharedFrameExporter::IsOpen( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return ( mData->Header != nullptr );
+}
+
+// Get video source listener, which could be fed to some video source
+IVideoSourceListener* XSharedFrameExporter::VideoSourceListener( ) const
+{
+    return &mData->VideoSourceListener;
+}
+
+// Number of published/skipped frames
+uint64_t XSharedFrameExporter::FramesPublished( ) const
+{
+    return mData->FramesPublished;
+}
+uint64_t XSharedFrameExporter::FramesSkipped( ) const
+{
+    return mData->FramesSkipped;
+}
+
+// Get histogram of time taken to publish frames
+const XHistogram& XSharedFrameExporter::PublishTimeHistogram( ) const
+{
+    return mData->PublishTime;
+}
+
+namespace Private
+{
+
+// ------------------------------------------------------------------------------------------
+
+// Map shared memory object, initializing its layout unless it already has the same one
+XError XSharedFrameExporterData::Open( const string& name, uint32_t maxFrameSize, uint32_t slotsCount )
+{
+    lock_guard<mutex> lock( Sync );
+    string            shmName  = ( ( !name.empty( ) ) && ( name[0] == '/' ) ) ? name : "/" + name;
+    uint32_t          slotSize = ( sizeof( XSharedFrameSlot ) + maxFrameSize + SLOT_ALIGNMENT - 1 ) & ~( SLOT_ALIGNMENT - 1 );
+    size_t            size     = sizeof( XSharedFrameHeader ) + static_cast<size_t>( slotSize ) * slotsCount;
+    struct stat       fileStat;
+    int               fd       = -1;
+    XError            ret      = XError::Success;
+
+    Unmap( );
+
+    if ( ( maxFrameSize == 0 ) || ( slotsCount < 2 ) )
+    {
+        ret = XError::ConfigurationNotSupported;
+    }
+    else if ( ( fd = shm_open( shmName.c_str( ), O_RDWR | O_CREAT, 0644 ) ) == -1 )
+    {
+        ret = XError::IOError;
+    }
+    // keep the size of existing object if it is the same, so consumers having it mapped are fine
+    else if ( ( fstat( fd, &fileStat ) != 0 ) ||
+              ( ( static_cast<size_t>( fileStat.st_size ) != size ) && ( ftruncate( fd, static_cast<off_t>( size ) ) != 0 ) ) )
+    {
+        ret = XError::IOError;
+    }
+    else
+    {
+        void* memory = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+
+        if ( memory == MAP_FAILED )
+        {
+            ret = XError::OutOfMemory;
+        }
+        else
+        {
+            Memory     = static_cast<uint8_t*>( memory );
+            MemorySize = size;
+            Header     = reinterpret_cast<XSharedFrameHeader*>( Memory );
+
+            if ( IsSameLayout( slotsCount, slotSize ) )
+            {
+                // frame could be left half written if the previous producer stopped badly
+                for ( uint32_t i = 0; i < slotsCount; i++ )
+                {
+                    XSharedFrameSlot* slot    = Slot( i );
+                    uint32_t          seqLock = __atomic_load_n( &slot->Lock, __ATOMIC_RELAXED );
+
+                    if ( ( seqLock & 1 ) != 0 )
+                    {
+                        __atomic_store_n( &slot->FrameSequence, 0, __ATOMIC_RELAXED );
+                        __atomic_store_n( &slot->Lock, seqLock + 1, __ATOMIC_RELEASE );
+                    }
+                }
+            }
+            else
+            {
+                InitLayout( slotsCount, slotSize );
+            }
+
+            FramesPublished = 0;
+            FramesSkipped   = 0;
+        }
+    }
+
+    // the mapping stays valid without the descriptor
+    if ( fd != -1 )
+    {
+        close( fd );
+    }
+
+    return ret;
+}
+
+// Stop publishing frames and unmap shared memory
+void XSharedFrameExporterData::Close( )
+{
+    lock_guard<mutex> lock( Sync );
+
+    Unmap( );
+}
+
+void XSharedFrameExporterData::Unmap( )
+{
+    if ( Memory != nullptr )
+    {
+        munmap( Memory, MemorySize );
+    }
+
+    Memory     = nullptr;
+    MemorySize = 0;
+    Header     = nullptr;
+}
+
+// Check if the mapped object was initialized for the same layout earlier
+bool XSharedFrameExporterData::IsSameLayout( uint32_t slotsCount, uint32_t slotSize ) const
+{
+    return ( ( __atomic_load_n( &Header->Magic, __ATOMIC_ACQUIRE ) == XSharedFrameMagic ) &&
+             ( Header->Version == XSharedFrameVersion ) && ( Header->HeaderSize == sizeof( XSharedFrameHeader ) ) &&
+             ( Header->SlotsCount == slotsCount ) && ( Header->SlotSize == slotSize ) );
+}
+
+// Initialize header and slots of the mapped object - magic number is set last, so consumers know it is ready
+void XSharedFrameExporterData::InitLayout( uint32_t slotsCount, uint32_t slotSize )
+{
+    __atomic_store_n( &Header->Magic, 0, __ATOMIC_RELEASE );
+
+    Header->Version    = XSharedFrameVersion;
+    Header->HeaderSize = sizeof( XSharedFrameHeader );
+    Header->SlotsCount = slotsCount;
+    Header->SlotSize   = slotSize;
+    memset( Header->Reserved, 0, sizeof( Header->Reserved ) );
+
+    __atomic_store_n( &Header->FrameSequence, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &Header->Waiters, 0, __ATOMIC_RELAXED );
+
+    for ( uint32_t i = 0; i < slotsCount; i++ )
+    {
+        memset( Slot( i ), 0, sizeof( XSharedFrameSlot ) );
+    }
+
+    __atomic_store_n( &Header->Magic, XSharedFrameMagic, __ATOMIC_RELEASE );
+}
+
+// Copy frame into the next slot and make it the latest one
+void XSharedFrameExporterData::Publish( const XImage& image )
+{
+    XTraceScope              traceScope( "shm.publish" );
+    steady_clock::time_point startTime = steady_clock::now( );
+    lock_guard<mutex>        lock( Sync );
+
+    if ( Header != nullptr )
+    {
+        size_t dataSize = ImageDataSize( image );
+
+        if ( ( XImage::IsCompressedFormat( image.Format( ) ) ) || ( image.Format( ) == XPixelFormat::Unknown ) ||
+             ( dataSize > Header->SlotSize - sizeof( XSharedFrameSlot ) ) )
+        {
+            FramesSkipped++;
+        }
+        else
+        {
+            // this is the only writer, so its own stores can be read relaxed
+            uint32_t          sequence = __atomic_load_n( &Header->FrameSequence, __ATOMIC_RELAXED ) + 1;
+            XSharedFrameSlot* slot     = Slot( ( sequence - 1 ) % Header->SlotsCount );
+            uint8_t*          data     = reinterpret_cast<uint8_t*>( slot ) + sizeof( XSharedFrameSlot );
+            uint32_t          seqLock  = __atomic_load_n( &slot->Lock, __ATOMIC_RELAXED );
+
+            // odd lock tells consumers the slot is being written - ordered before any of the writes below
+            __atomic_store_n( &slot->Lock, seqLock + 1, __ATOMIC_RELAXED );
+            __atomic_thread_fence( __ATOMIC_RELEASE );
+
+            __atomic_store_n( &slot->FrameSequence, sequence, __ATOMIC_RELAXED );
+            __atomic_store_n( &slot->Timestamp, MonotonicTimeNow( ), __ATOMIC_RELAXED );
+            __atomic_store_n( &slot->Format, static_cast<uint32_t>( image.Format( ) ), __ATOMIC_RELAXED );
+            __atomic_store_n( &slot->Width, image.Width( ), __ATOMIC_RELAXED );
+            __atomic_store_n( &slot->Height, image.Height( ), __ATOMIC_RELAXED );
+            __atomic_store_n( &slot->Stride, image.Stride( ), __ATOMIC_RELAXED );
+            __atomic_store_n( &slot->DataSize, static_cast<uint32_t>( dataSize ), __ATOMIC_RELAXED );
+
+            if ( !image.CopyData( XImage::Create( data, image.Width( ), image.Height( ), image.Stride( ), image.Format( ) ) ) )
+            {
+                // leave the slot empty and don't advance the sequence - consumers keep the previous frame
+                __atomic_store_n( &slot->FrameSequence, 0, __ATOMIC_RELAXED );
+                __atomic_store_n( &slot->Lock, seqLock + 2, __ATOMIC_RELEASE );
+
+                FramesSkipped++;
+            }
+            else
+            {
+                __atomic_store_n( &slot->Lock, seqLock + 2, __ATOMIC_RELEASE );
+
+                // publish the frame and wake up consumers waiting for it - seq_cst pairs with consumers
+                // incrementing waiters before checking the sequence, so none of them misses the wake up
+                __atomic_store_n( &Header->FrameSequence, sequence, __ATOMIC_SEQ_CST );
+
+                if ( __atomic_load_n( &Header->Waiters, __ATOMIC_SEQ_CST ) != 0 )
+                {
+                    syscall( SYS_futex, &Header->FrameSequence, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0 );
+                }
+
+                FramesPublished++;
+                PublishTime.Add( static_cast<uint64_t>( duration_cast<microseconds>( steady_clock::now( ) - startTime ).count( ) ) );
+            }
+        }
+    }
+}
+
+// ------------------------------------------------------------------------------------------
+
+// New frame from video source
+void SharedFrameVideoListener::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    Owner->Publish( *image );
+}
+
+} // namespace Private
@@ -0,0 +1,126 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XSHARED_FRAME_EXPORTER_HPP
+#define XSHARED_FRAME_EXPORTER_HPP
+
+#include <stdint.h>
+#include <string>
+
+#include "XInterfaces.hpp"
+#include "IVideoSourceListener.hpp"
+#include "XHistogram.hpp"
+
+namespace Private
+{
+    class XSharedFrameExporterData;
+}
+
+/* ================================================================= */
+/* Layout of the shared memory object                                */
+/* ================================================================= */
+
+// The object starts with XSharedFrameHeader, which is followed by SlotsCount slots of SlotSize bytes. Every slot
+// starts with XSharedFrameSlot followed by image data in the layout of XImage (YUV420 planes are padded to
+// the multiple of 16 luma rows). All fields, which change, must be accessed atomically (__atomic builtins).
+//
+// Consumer gets the newest frame without copying it:
+//   1) seq = __atomic_load_n( &header->FrameSequence, __ATOMIC_ACQUIRE ); nothing is published yet if it is 0;
+//   2) slot is at HeaderSize + ( ( seq - 1 ) % SlotsCount ) * SlotSize;
+//   3) lock = __atomic_load_n( &slot->Lock, __ATOMIC_ACQUIRE ); go back to 1) if it is odd (slot is written);
+//   4) use slot's fields and data in place;
+//   5) __atomic_thread_fence( __ATOMIC_ACQUIRE ), then the frame was consistent if slot->Lock still equals
+//      to lock (relaxed load) and slot->FrameSequence equals seq - otherwise results of 4) must be discarded.
+// Frames are written into slots in turn, so the newest frame is not touched for ( SlotsCount - 1 ) frames.
+//
+// To wait for a new frame, consumer increments Waiters, waits on FrameSequence futex while it equals to the
+// last seen value (FUTEX_WAIT, not private) and decrements Waiters - producer wakes waiters only if there are any.
+// The object is not removed when producer stops, so consumers may keep it mapped while producer restarts -
+// FrameSequence keeps growing then, unless the layout changes (Magic is rewritten last on initialization).
+
+#define XSharedFrameMagic   (0x52465358) // "XSFR"
+#define XSharedFrameVersion (1)
+
+struct XSharedFrameHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t HeaderSize;
+    uint32_t SlotsCount;
+    uint32_t SlotSize;
+    // sequence number of the latest published frame (starts from 1) - futex word
+    uint32_t FrameSequence;
+    // number of consumers waiting on the futex
+    uint32_t Waiters;
+    uint32_t Reserved[9];
+};
+
+struct XSharedFrameSlot
+{
+    // seqlock of the slot - odd while frame is written into it
+    uint32_t Lock;
+    uint32_t FrameSequence;
+    // time (microseconds, CLOCK_MONOTONIC) of publishing the frame
+    uint64_t Timestamp;
+    // XPixelFormat value, size of the image and its data
+    uint32_t Format;
+    int32_t  Width;
+    int32_t  Height;
+    int32_t  Stride;
+    uint32_t DataSize;
+    uint32_t Reserved[7];
+};
+
+/* ================================================================= */
+/* Publisher of uncompressed video frames into shared memory         */
+/* ================================================================= */
+
+// Publishes uncompressed frames (YUV420, RGB, grayscale) coming from a video source into POSIX shared
+// memory, so local processes can analyse them without decoding JPEGs or pulling them over HTTP. Every
+// frame is copied once into the next slot on the video source's thread, which takes much less than
+// encoding it; compressed frames and frames not fitting into a slot are skipped.
+class XSharedFrameExporter : private Uncopyable
+{
+public:
+    XSharedFrameExporter( );
+    ~XSharedFrameExporter( );
+
+    // Create/Open shared memory object with the specified name (as for shm_open) having the specified number
+    // of slots, which fit frames of up to the specified data size
+    XError Open( const std::string& name, uint32_t maxFrameSize, uint32_t slotsCount = 3 );
+    // Stop publishing frames and unmap the object (it stays available for consumers)
+    void Close( );
+    bool IsOpen( ) const;
+
+    // Get video source listener, which could be fed to some video source
+    IVideoSourceListener* VideoSourceListener( ) const;
+
+    // Number of published frames and frames skipped since the object was opened
+    uint64_t FramesPublished( ) const;
+    uint64_t FramesSkipped( ) const;
+
+    // Get histogram of time (microseconds) taken to publish frames
+    const XHistogram& PublishTimeHistogram( ) const;
+
+private:
+    Private::XSharedFrameExporterData* mData;
+};
+
+#endif // XSHARED_FRAME_EXPORTER_HPP
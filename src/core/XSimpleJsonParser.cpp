@@ -22,348 +22,372 @@
 
 using namespace std;
 
-static bool ExtractString( const char** ptr, string& str );
-static bool ExtractValue( const char** ptr, string& str, bool addQuotesToStrings );
-static bool ExtractArrayAsString( const char** ptr, string& str );
-static bool ExtractObjectAsString( const char** ptr, string& str );
+// Maximum depth of nested objects/arrays
+#define MAX_NESTING_DEPTH (32)
 
-// Skip spaces in a string pointed by the pointer
-#define SKIP_SPACES(strptr) while ( ( *strptr != '\0' ) && ( *strptr == ' ' ) ) { strptr++; }
+static bool ScanString( const char** ptr, const char* end );
+static bool ScanValue( const char** ptr, const char* end, int depth );
+static bool ScanObject( const char** ptr, const char* end, int depth,
+                        const function<bool( const XJsonSpan&, const XJsonSpan& )>* handler );
+static bool ScanArray( const char** ptr, const char* end, int depth );
+
+// Skip white spaces in a string pointed by the pointer
+#define SKIP_SPACES(strptr, end) while ( ( strptr != end ) && ( ( *strptr == ' ' ) || ( *strptr == '\t' ) || \
+                                                                ( *strptr == '\r' ) || ( *strptr == '\n' ) ) ) { strptr++; }
 
 // Parse JSON string and provide it as name-value map. Nested objects/arrays
 // are not supported - provided as they are in string format.
 bool XSimpleJsonParser( const string& jsonStr, map<string, string>& values )
 {
-    const char* ptr = jsonStr.c_str( );
-    string      strName, strValue;
+    string strName, strValue;
 
     values.clear( );
 
-    SKIP_SPACES( ptr );
-
-    if ( *ptr != '{' )
-    {
-        return false;
-    }
-
-    for ( ; ; )
+    return XSimpleJsonParser( jsonStr.c_str( ), jsonStr.length( ), [&]( const XJsonSpan& name, const XJsonSpan& value )
     {
-        ptr++;
+        XJsonUnescape( name, strName );
 
-        if ( !ExtractString( &ptr, strName ) )
+        if ( value.Data[0] == '"' )
         {
-            break;
+            XJsonUnescape( value, strValue );
         }
-
-        if ( *ptr != ':' )
+        else
         {
-            return false;
+            strValue.assign( value.Data, value.Length );
         }
 
-        ptr++;
+        values.insert( pair<string, string>( strName, strValue ) );
+        return true;
+    } );
+}
 
-        if ( !ExtractValue( &ptr, strValue, false ) )
-        {
-            return false;
-        }
+// Parse JSON string calling handler for every name/value pair of the object
+bool XSimpleJsonParser( const char* jsonStr, size_t length,
+                        const function<bool( const XJsonSpan& name, const XJsonSpan& value )>& handler )
+{
+    const char* ptr = jsonStr;
 
-        values.insert( pair<string, string>( strName, strValue ) );
+    return ScanObject( &ptr, jsonStr + length, 0, &handler );
+}
 
-        if ( *ptr == '}' )
-        {
-            // all done
-            break;
-        }
+// Check if the string is a valid JSON object
+bool XSimpleJsonIsObject( const char* jsonStr, size_t length )
+{
+    const char* ptr = jsonStr;
+    const char* end = jsonStr + length;
+    bool        ret = ScanObject( &ptr, end, 0, nullptr );
 
-        if ( *ptr != ',' )
-        {
-            // broken JSON
-            return false;
-        }
-    }
+    return ( ( ret ) && ( ptr == end ) );
+}
 
-    if ( *ptr != '}' )
+// Get unescaped string from the span
+void XJsonUnescape( const XJsonSpan& span, string& s )
+{
+    const char* p   = span.Data;
+    const char* end = span.Data + span.Length;
+
+    s.clear( );
+
+    if ( ( span.Length >= 2 ) && ( *p == '"' ) )
     {
-        return false;
+        p++;
+        end--;
     }
 
-    return true;
+    s.reserve( end - p );
+
+    while ( p != end )
+    {
+        if ( *p != '\\' )
+        {
+            s.push_back( *p );
+            p++;
+        }
+        else
+        {
+            char esc;
+
+            if ( ++p == end )
+            {
+                break;
+            }
+
+            esc = *p;
+            p++;
+
+            switch ( esc )
+            {
+            case 'b':
+                s.push_back( '\b' );
+                break;
+            case 'f':
+                s.push_back( '\f' );
+                break;
+            case 'n':
+                s.push_back( '\n' );
+                break;
+            case 'r':
+                s.push_back( '\r' );
+                break;
+            case 't':
+                s.push_back( '\t' );
+                break;
+            case 'u':
+                // unicode is not supported - just skip 4 hex digits
+                p = ( end - p > 4 ) ? p + 4 : end;
+                break;
+            default:
+                // quote, back slash and slash
+                s.push_back( esc );
+                break;
+            }
+        }
+    }
 }
 
-// Extract a string from JSON
-bool ExtractString( const char** ptr, string& str )
+// Move over a string in JSON, checking its escape sequences
+static bool ScanString( const char** ptr, const char* end )
 {
     const char* p = *ptr;
 
-    SKIP_SPACES( p );
-
-    if ( *p != '"' )
+    if ( ( p == end ) || ( *p != '"' ) )
     {
         return false;
     }
-    else
-    {
-        string s;
 
-        p++;
+    p++;
 
-        while ( ( *p != '\0' ) && ( *p != '"' ) )
+    while ( ( p != end ) && ( *p != '"' ) )
+    {
+        if ( *p != '\\' )
         {
-            if ( *p != '\\' )
+            p++;
+        }
+        else
+        {
+            if ( ++p == end )
             {
-                s.push_back( *p );
-                p++;
+                return false;
             }
-            else
+
+            switch ( *p )
             {
+            case '"':
+            case '\\':
+            case '/':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
                 p++;
-                if ( *p == '\0' )
+                break;
+            case 'u':
+                if ( end - p < 5 )
                 {
                     return false;
                 }
-                else
-                {
-                    char esc = *p;
-
-                    p++;
-
-                    switch ( esc )
-                    {
-                    case '"':
-                        s.push_back( '"' );
-                        break;
-                    case '\\':
-                        s.push_back( '\\' );
-                        break;
-                    case '/':
-                        s.push_back( '/' );
-                        break;
-                    case 'b':
-                        s.push_back( '\b' );
-                        break;
-                    case 'f':
-                        s.push_back( '\f' );
-                        break;
-                    case 'n':
-                        s.push_back( '\n' );
-                        break;
-                    case 'r':
-                        s.push_back( '\r' );
-                        break;
-                    case 't':
-                        s.push_back( '\t' );
-                        break;
-                    case 'u':
-                        // unicode is not supported - just skip 4 hex digits
-                        for ( int i = 0; i < 4; i++ )
-                        {
-                            if ( *p == '\0' )
-                            {
-                                return false;
-                            }
-                            p++;
-                        }
-                        break;
-                    default:
-                        return false;
-                    }
-                }
+                p += 5;
+                break;
+            default:
+                return false;
             }
         }
+    }
 
-        if ( *p != '"' )
-        {
-            return false;
-        }
-
-        // move to the next character after the string and spaces
-        p++;
-        SKIP_SPACES( p );
-
-        *ptr = p;
-        str  = s;
+    if ( p == end )
+    {
+        return false;
     }
 
+    // move to the next character after the string
+    *ptr = p + 1;
+
     return true;
 }
 
-// Extract a value from JSON
-bool ExtractValue( const char** ptr, string& str, bool addQuotesToStrings )
+// Move over a value in JSON, checking it is valid
+static bool ScanValue( const char** ptr, const char* end, int depth )
 {
     const char* p = *ptr;
-    string      s;
 
-    SKIP_SPACES( p );
+    if ( p == end )
+    {
+        return false;
+    }
 
     switch ( *p )
     {
     case '"':   // string value
-        if ( !ExtractString( &p, s ) )
-        {
-            return false;
-        }
-        if ( addQuotesToStrings )
-        {
-            s.insert( 0, 1, '"' );
-            s.push_back( '"' );
-        }
-        break;
+        return ScanString( ptr, end );
 
     case '{':   // object value
-        if ( !ExtractObjectAsString( &p, s ) )
-        {
-            return false;
-        }
-        break;
+        return ScanObject( ptr, end, depth + 1, nullptr );
 
     case '[':   // array value
-        if ( !ExtractArrayAsString( &p, s ) )
-        {
-            return false;
-        }
-        break;
+        return ScanArray( ptr, end, depth + 1 );
 
     default:
         if ( ( *p == 't' ) || ( *p == 'f' ) || ( *p == 'n' ) || ( *p == '-' ) || ( ( *p >= '0' ) && ( *p <= '9' ) ) )
         {
-            // number or true/false/null  - extract everything up to the next space or ,}] - no checking for valid numbers
-            while ( ( *p != '\0' ) )
+            // number or true/false/null  - everything up to the next space or ,}] - no checking for valid numbers
+            const char* start = p;
+
+            while ( ( p != end ) && ( *p != ' ' ) && ( *p != '\t' ) && ( *p != '\r' ) && ( *p != '\n' ) &&
+                    ( *p != ',' ) && ( *p != '}' ) && ( *p != ']' ) )
             {
-                if ( ( *p == ' ' ) || ( *p == ',' ) || ( *p == '}' ) || ( *p == ']' ) )
-                {
-                    break;
-                }
-                s.push_back( *p );
                 p++;
             }
 
-            if ( ( ( s[0] == 't' ) && ( s != "true"  ) ) ||
-                 ( ( s[0] == 'f' ) && ( s != "false" ) ) ||
-                 ( ( s[0] == 'n' ) && ( s != "null"  ) ) )
+            size_t length = p - start;
+
+            if ( ( ( *start == 't' ) && ( ( length != 4 ) || ( start[1] != 'r' ) || ( start[2] != 'u' ) || ( start[3] != 'e' ) ) ) ||
+                 ( ( *start == 'f' ) && ( ( length != 5 ) || ( start[1] != 'a' ) || ( start[2] != 'l' ) || ( start[3] != 's' ) || ( start[4] != 'e' ) ) ) ||
+                 ( ( *start == 'n' ) && ( ( length != 4 ) || ( start[1] != 'u' ) || ( start[2] != 'l' ) || ( start[3] != 'l' ) ) ) )
             {
                 return false;
             }
 
-            SKIP_SPACES( p );
-        }
-        else
-        {
-            // broken value
-            return false;
+            *ptr = p;
+            return true;
         }
     }
 
-    *ptr = p;
-    str  = s;
-
-    return true;
+    // broken value
+    return false;
 }
 
-// Extract JSPN array as string
-static bool ExtractArrayAsString( const char** ptr, string& str )
+// Move over JSON object, calling handler (if any) for its members
+static bool ScanObject( const char** ptr, const char* end, int depth,
+                        const function<bool( const XJsonSpan&, const XJsonSpan& )>* handler )
 {
     const char* p = *ptr;
 
-    SKIP_SPACES( p );
+    SKIP_SPACES( p, end );
 
-    if ( *p != '[' )
+    if ( ( depth > MAX_NESTING_DEPTH ) || ( p == end ) || ( *p != '{' ) )
     {
         return false;
     }
+
+    p++;
+    SKIP_SPACES( p, end );
+
+    if ( ( p != end ) && ( *p == '}' ) )
+    {
+        // empty object
+        p++;
+    }
     else
     {
-        string s, strValue;
-
         for ( ; ; )
         {
+            XJsonSpan name, value;
+
+            name.Data = p + 1;
+            if ( !ScanString( &p, end ) )
+            {
+                return false;
+            }
+            name.Length = p - name.Data - 1;
+
+            SKIP_SPACES( p, end );
+
+            if ( ( p == end ) || ( *p != ':' ) )
+            {
+                return false;
+            }
+
             p++;
+            SKIP_SPACES( p, end );
 
-            if ( !ExtractValue( &p, strValue, true ) )
+            value.Data = p;
+            if ( !ScanValue( &p, end, depth ) )
             {
-                break;
+                return false;
             }
+            value.Length = p - value.Data;
 
-            if ( !s.empty( ) )
+            if ( ( handler != nullptr ) && ( !(*handler)( name, value ) ) )
             {
-                s.append( "," );
+                return false;
             }
-            s.append( strValue );
 
-            if ( *p == ']' )
+            SKIP_SPACES( p, end );
+
+            if ( p == end )
             {
+                return false;
+            }
+
+            if ( *p == '}' )
+            {
+                // all done
+                p++;
                 break;
             }
 
             if ( *p != ',' )
             {
+                // broken JSON
                 return false;
             }
-        }
-
-        if ( *p != ']' )
-        {
-            return false;
-        }
-
-        s.insert( 0, 1, '[' );
-        s.push_back( ']' );
 
-        p++; // move to the next character after the array and spaces
-        SKIP_SPACES( p );
+            p++;
+            SKIP_SPACES( p, end );
 
-        *ptr = p;
-        str  = s;
+            // trailing comma is tolerated, as it always was
+            if ( ( p != end ) && ( *p == '}' ) )
+            {
+                p++;
+                break;
+            }
+        }
     }
 
+    SKIP_SPACES( p, end );
+    *ptr = p;
+
     return true;
 }
 
-// Extract JSON object as string
-static bool ExtractObjectAsString( const char** ptr, string& str )
+// Move over JSON array checking its values
+static bool ScanArray( const char** ptr, const char* end, int depth )
 {
     const char* p = *ptr;
 
-    SKIP_SPACES( p );
-
-    if ( *p != '{' )
+    if ( ( depth > MAX_NESTING_DEPTH ) || ( p == end ) || ( *p != '[' ) )
     {
         return false;
     }
+
+    p++;
+    SKIP_SPACES( p, end );
+
+    if ( ( p != end ) && ( *p == ']' ) )
+    {
+        // empty array
+        p++;
+    }
     else
     {
-        string s, strName, strValue;
-
-        for (  ;; )
+        for ( ; ; )
         {
-            p++;
-
-            if ( !ExtractString( &p, strName ) )
-            {
-                break;
-            }
-
-            if ( *p != ':' )
+            if ( !ScanValue( &p, end, depth ) )
             {
                 return false;
             }
 
-            p++;
+            SKIP_SPACES( p, end );
 
-            if ( !ExtractValue( &p, strValue, true ) )
+            if ( p == end )
             {
                 return false;
             }
 
-            if ( !s.empty( ) )
-            {
-                s.append( "," );
-            }
-            s.append( strName );
-            s.push_back( ':' );
-            s.append( strValue );
-
-            if ( *p == '}' )
+            if ( *p == ']' )
             {
+                p++;
                 break;
             }
 
@@ -371,23 +395,19 @@ static bool ExtractObjectAsString( const char** ptr, string& str )
             {
                 return false;
             }
-        }
-
-        if ( *p != '}' )
-        {
-            return false;
-        }
 
-        s.insert( 0, 1, '{' );
-        s.push_back( '}' );
-
-        // move to the next character after the object and spaces
-        p++;
-        SKIP_SPACES( p );
+            p++;
+            SKIP_SPACES( p, end );
 
-        *ptr = p;
-        str  = s;
+            if ( ( p != end ) && ( *p == ']' ) )
+            {
+                p++;
+                break;
+            }
+        }
     }
 
+    *ptr = p;
+
     return true;
 }
@@ -23,6 +23,7 @@
 
 #include <string>
 #include <map>
+#include <functional>
 
 /* ================================================================= */
 /* The function implements a *VERY* simple JSON parser. It does NOT  */
@@ -30,8 +31,33 @@
 /* In fact all values are returned as strings in a map. It is up to  */
 /* caller to know type of a particular value and perform further     */
 /* checking/parsing.                                                 */
+/*                                                                   */
+/* Nested objects/arrays are returned exactly as they are in the     */
+/* source text (spaces and escapes kept), so they are valid JSON and */
+/* can be parsed again. A trailing comma before closing bracket of   */
+/* object or array is tolerated.                                     */
 /* ================================================================= */
 
 bool XSimpleJsonParser( const std::string& jsonStr, std::map<std::string, std::string>& values );
 
+// Part of a parsed JSON string (not null terminated)
+struct XJsonSpan
+{
+    const char* Data;
+    size_t      Length;
+};
+
+// Non allocating variant of the parser, which calls the handler for every name/value pair of the object
+// with spans pointing into the source string. Names are given without quotes, while values are given
+// exactly as they are in the source (strings with quotes, nested objects/arrays as they are) - strings
+// are still escaped. Parsing stops if the handler returns false.
+bool XSimpleJsonParser( const char* jsonStr, size_t length,
+                        const std::function<bool( const XJsonSpan& name, const XJsonSpan& value )>& handler );
+
+// Check if the string is a valid JSON object (without allocating any memory)
+bool XSimpleJsonIsObject( const char* jsonStr, size_t length );
+
+// Get unescaped string from the span - quotes around are removed if there are any
+void XJsonUnescape( const XJsonSpan& span, std::string& str );
+
 #endif // XSIMPLE_JSON_PARSER_HPP
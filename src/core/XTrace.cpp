@@ -0,0 +1,260 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "XTrace.hpp"
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <list>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Number of events kept for every thread
+    #define TRACE_EVENTS_PER_THREAD (4096)
+
+    // Event recorded by a trace point
+    struct TraceEventData
+    {
+        const char* Name;
+        uint32_t    ThreadId;
+        uint32_t    Duration;
+        int64_t     StartTime;
+    };
+
+    // Slot of thread's ring buffer keeping an event
+    class TraceEvent
+    {
+    public:
+        // odd while the event is being written, 0 if it was never written
+        atomic<uint32_t> Sequence;
+        TraceEventData   Data;
+
+    public:
+        TraceEvent( ) :
+            Sequence( 0 ), Data( { nullptr, 0, 0, 0 } )
+        {
+        }
+    };
+
+    // Ring buffer of events written by a single thread - buffers are never freed, but
+    // are given to new threads once their original threads are gone
+    class TraceThreadBuffer : private Uncopyable
+    {
+    public:
+        TraceEvent       Events[TRACE_EVENTS_PER_THREAD];
+        atomic<uint32_t> NextEvent;
+        uint32_t         ThreadId;
+        bool             InUse;
+
+    public:
+        TraceThreadBuffer( ) :
+            NextEvent( 0 ), ThreadId( 0 ), InUse( false )
+        {
+        }
+    };
+
+    // Releases thread's buffer when the thread exits
+    class TraceThreadBufferHolder
+    {
+    public:
+        TraceThreadBuffer* Buffer;
+        // name of the thread, which is registered once it gets a buffer
+        string             ThreadName;
+
+    public:
+        TraceThreadBufferHolder( ) : Buffer( nullptr ), ThreadName( ) { }
+        ~TraceThreadBufferHolder( );
+    };
+
+    static atomic<bool>              TraceEnabled( false );
+    static mutex                     TraceSync;
+    static list<TraceThreadBuffer*>  TraceBuffers;
+    static map<uint32_t, string>     TraceThreadNames;
+    static uint32_t                  TraceNextThreadId = 1;
+
+    static thread_local TraceThreadBufferHolder ThreadBufferHolder;
+
+    // Get buffer of the calling thread, taking a free one or allocating new one if the thread does not have it yet
+    static TraceThreadBuffer* GetThreadBuffer( )
+    {
+        if ( ThreadBufferHolder.Buffer == nullptr )
+        {
+            lock_guard<mutex>  lock( TraceSync );
+            TraceThreadBuffer* buffer = nullptr;
+
+            for ( auto existingBuffer : TraceBuffers )
+            {
+                if ( !existingBuffer->InUse )
+                {
+                    buffer = existingBuffer;
+                    break;
+                }
+            }
+
+            if ( buffer == nullptr )
+            {
+                buffer = new TraceThreadBuffer( );
+                TraceBuffers.push_back( buffer );
+            }
+
+            buffer->InUse    = true;
+            buffer->ThreadId = TraceNextThreadId++;
+
+            if ( !ThreadBufferHolder.ThreadName.empty( ) )
+            {
+                TraceThreadNames[buffer->ThreadId] = ThreadBufferHolder.ThreadName;
+            }
+
+            ThreadBufferHolder.Buffer = buffer;
+        }
+
+        return ThreadBufferHolder.Buffer;
+    }
+
+    TraceThreadBufferHolder::~TraceThreadBufferHolder( )
+    {
+        if ( Buffer != nullptr )
+        {
+            lock_guard<mutex> lock( TraceSync );
+            Buffer->InUse = false;
+        }
+    }
+
+    // Take a consistent copy of the event - returns false if it is not written or being written
+    static bool CopyEvent( const TraceEvent& event, TraceEventData& copy )
+    {
+        uint32_t sequence = event.Sequence.load( memory_order_acquire );
+
+        copy = event.Data;
+
+        atomic_thread_fence( memory_order_acquire );
+
+        return ( ( sequence != 0 ) && ( ( sequence & 1 ) == 0 ) && ( event.Sequence.load( memory_order_relaxed ) == sequence ) );
+    }
+}
+
+using namespace Private;
+
+// Enable/disable recording of trace events
+void XTrace::Enable( bool enable )
+{
+    TraceEnabled = enable;
+}
+bool XTrace::IsEnabled( )
+{
+    return TraceEnabled.load( memory_order_relaxed );
+}
+
+// Set name of the calling thread to show in trace dumps
+void XTrace::SetThreadName( const string& name )
+{
+    lock_guard<mutex> lock( TraceSync );
+
+    ThreadBufferHolder.ThreadName = name;
+
+    // buffer is allocated only when the thread records its first event
+    if ( ThreadBufferHolder.Buffer != nullptr )
+    {
+        TraceThreadNames[ThreadBufferHolder.Buffer->ThreadId] = name;
+    }
+}
+
+// Record a complete event, which started at the specified time and is done now
+void XTrace::AddEvent( const char* name, steady_clock::time_point startTime )
+{
+    steady_clock::time_point now    = steady_clock::now( );
+    TraceThreadBuffer*       buffer = GetThreadBuffer( );
+    uint32_t                 index  = buffer->NextEvent.load( memory_order_relaxed );
+    TraceEvent&              event  = buffer->Events[index];
+    uint32_t                 seq    = event.Sequence.load( memory_order_relaxed );
+
+    // mark the event as being written, so readers skip it
+    event.Sequence.store( seq + 1, memory_order_relaxed );
+    atomic_thread_fence( memory_order_release );
+
+    event.Data.Name      = name;
+    event.Data.ThreadId  = buffer->ThreadId;
+    event.Data.StartTime = duration_cast<microseconds>( startTime.time_since_epoch( ) ).count( );
+    event.Data.Duration  = static_cast<uint32_t>( duration_cast<microseconds>( now - startTime ).count( ) );
+
+    event.Sequence.store( seq + 2, memory_order_release );
+    buffer->NextEvent.store( ( index + 1 ) % TRACE_EVENTS_PER_THREAD, memory_order_relaxed );
+}
+
+// Get the recorded events in Chrome trace format
+string XTrace::ToChromeTrace( )
+{
+    vector<TraceEventData> events;
+    map<uint32_t, string>  threadNames;
+    string                 trace = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    char                   buffer[256];
+    bool                   first = true;
+
+    {
+        lock_guard<mutex> lock( TraceSync );
+
+        threadNames = TraceThreadNames;
+
+        for ( auto threadBuffer : TraceBuffers )
+        {
+            for ( uint32_t i = 0; i < TRACE_EVENTS_PER_THREAD; i++ )
+            {
+                TraceEventData copy;
+
+                if ( CopyEvent( threadBuffer->Events[i], copy ) )
+                {
+                    events.push_back( copy );
+                }
+            }
+        }
+    }
+
+    sort( events.begin( ), events.end( ), []( const TraceEventData& e1, const TraceEventData& e2 )
+    {
+        return e1.StartTime < e2.StartTime;
+    } );
+
+    for ( auto threadName : threadNames )
+    {
+        snprintf( buffer, sizeof( buffer ), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                  ( first ) ? "" : ",", threadName.first, threadName.second.c_str( ) );
+        trace += buffer;
+        first  = false;
+    }
+
+    for ( const auto& event : events )
+    {
+        snprintf( buffer, sizeof( buffer ), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%u}",
+                  ( first ) ? "" : ",", event.Name, event.ThreadId, static_cast<long long>( event.StartTime ), event.Duration );
+        trace += buffer;
+        first  = false;
+    }
+
+    trace += "]}";
+
+    return trace;
+}
@@ -0,0 +1,77 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XTRACE_HPP
+#define XTRACE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <chrono>
+
+#include "XInterfaces.hpp"
+
+// Tracing of hot code paths. Every thread records its trace events into its own ring buffer,
+// so recording takes no locks. Nothing is recorded until tracing is enabled.
+class XTrace
+{
+public:
+    // Enable/disable recording of trace events
+    static void Enable( bool enable );
+    static bool IsEnabled( );
+
+    // Set name of the calling thread to show in trace dumps
+    static void SetThreadName( const std::string& name );
+
+    // Record a complete event, which started at the specified time and is done now (the name
+    // must be a string literal or some other string, which exists for the lifetime of the application)
+    static void AddEvent( const char* name, std::chrono::steady_clock::time_point startTime );
+
+    // Get the recorded events in Chrome trace format (JSON), which can be loaded into chrome://tracing
+    static std::string ToChromeTrace( );
+};
+
+// Scoped trace point - records an event taking time from its construction till destruction
+// (nothing is recorded if the name is nullptr)
+class XTraceScope : private Uncopyable
+{
+public:
+    XTraceScope( const char* name ) :
+        mName( ( XTrace::IsEnabled( ) ) ? name : nullptr ), mStartTime( )
+    {
+        if ( mName != nullptr )
+        {
+            mStartTime = std::chrono::steady_clock::now( );
+        }
+    }
+
+    ~XTraceScope( )
+    {
+        if ( mName != nullptr )
+        {
+            XTrace::AddEvent( mName, mStartTime );
+        }
+    }
+
+private:
+    const char*                           mName;
+    std::chrono::steady_clock::time_point mStartTime;
+};
+
+#endif // XTRACE_HPP
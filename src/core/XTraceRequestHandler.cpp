@@ -0,0 +1,55 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "XTraceRequestHandler.hpp"
+#include "XTrace.hpp"
+
+using namespace std;
+
+XTraceRequestHandler::XTraceRequestHandler( const string& uri ) :
+    IWebRequestHandler( uri, false )
+{
+}
+
+// Handle request by providing all recorded trace events
+void XTraceRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    if ( request.Method( ) == "GET" )
+    {
+        string trace = XTrace::ToChromeTrace( );
+
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: application/json\r\n"
+                         "Content-Length: %d\r\n"
+                         "Content-Disposition: inline; filename=\"trace.json\"\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                         "\r\n", (int) trace.length( ) );
+        response.Send( reinterpret_cast<const uint8_t*>( trace.c_str( ) ), trace.length( ) );
+    }
+    else
+    {
+        response.Printf( "HTTP/1.1 405 Method Not Allowed\r\n"
+                         "Allow: GET\r\n"
+                         "Content-Type: text/plain\r\n"
+                         "Connection: close\r\n"
+                         "\r\n"
+                         "Method Not Allowed" );
+    }
+}
@@ -0,0 +1,38 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XTRACE_REQUEST_HANDLER_HPP
+#define XTRACE_REQUEST_HANDLER_HPP
+
+#include "XWebServer.hpp"
+
+// Web request handler to provide recorded trace events in Chrome trace format
+class XTraceRequestHandler : public IWebRequestHandler
+{
+public:
+    XTraceRequestHandler( const std::string& uri );
+
+    void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+
+    // Trace events are collected without blocking anyone, but dumping them takes a while
+    bool CanHandleOnWorkerThread( ) const { return true; }
+};
+
+#endif // XTRACE_REQUEST_HANDLER_HPP
@@ -21,6 +21,10 @@
 #include <string.h>
 #include <mutex>
 #include <chrono>
+#include <list>
+#include <map>
+#include <vector>
+#include <thread>
 
 // If we have C++14, then shared_timed_mutex is a better option for BufferGuard,
 // so it could allow one writer and multiple readers. However mongoose web server
@@ -31,6 +35,9 @@
 
 #include "XVideoSourceToWeb.hpp"
 #include "XJpegEncoder.hpp"
+#include "XImagePool.hpp"
+#include "XManualResetEvent.hpp"
+#include "XTrace.hpp"
 
 using namespace std;
 using namespace std::chrono;
@@ -39,6 +46,75 @@ namespace Private
 {
     #define JPEG_BUFFER_SIZE (1024 * 1024)
 
+    // Number of unused JPEG frames to keep for reuse
+    #define JPEG_FRAMES_TO_KEEP (4)
+
+    // Time (ms) since the last client's request, while new images are still encoded
+    #define DEMAND_TIMEOUT      (1000)
+    // Age (ms) of an image when demand for images resumes, so it is still fine to provide it
+    #define FRESH_IMAGE_AGE     (100)
+    // Time (ms) to wait for the video source to provide a new image
+    #define IMAGE_WAIT_TIMEOUT  (1000)
+    // Interval (ms) to check if new JPEG image is ready for a waiting client (if it was not pushed yet)
+    #define JPEG_WAIT_INTERVAL  (50)
+    // Time (ms) MJPEG client waits for a new image to be pushed, before checking state of the video source
+    #define FRAME_WAIT_TIMEOUT  (250)
+    // The longest interval (ms) between MJPEG frames for clients on slow connections
+    #define MAX_FRAME_INTERVAL  (1000)
+
+    // Encoded JPEG image, which is shared (not copied) between all connections it is sent to.
+    // Its content must not be changed while anyone else refers to it.
+    class JpegFrame : private Uncopyable
+    {
+    public:
+        uint8_t*  Data;
+        uint32_t  BufferSize;
+        uint32_t  Size;
+
+        // time the source image was received from video source
+        steady_clock::time_point ImageTime;
+
+    public:
+        JpegFrame( uint32_t bufferSize ) :
+            Data( (uint8_t*) malloc( bufferSize ) ), BufferSize( 0 ), Size( 0 ), ImageTime( )
+        {
+            if ( Data != nullptr )
+            {
+                BufferSize = bufferSize;
+            }
+        }
+
+        ~JpegFrame( )
+        {
+            if ( Data != nullptr )
+            {
+                free( Data );
+            }
+        }
+    };
+
+    // State of a client's connection - video source (profile) it receives images from and
+    // the frame interval adapted to the rate its connection manages to send data at
+    class StreamClient
+    {
+    public:
+        XVideoSourceToWebData*   Source;
+        uint32_t                 FrameInterval;
+        size_t                   QueuedLength;
+        steady_clock::time_point QueuedTime;
+        steady_clock::time_point SentTime;
+        steady_clock::time_point SentImageTime;
+
+    public:
+        StreamClient( XVideoSourceToWebData* source, uint32_t frameInterval = 0 ) :
+            Source( source ), FrameInterval( frameInterval ), QueuedLength( 0 ), QueuedTime( ),
+            SentTime( ), SentImageTime( )
+        {
+        }
+
+        void AdaptFrameInterval( size_t queuedLength, size_t frameSize, uint32_t minFrameInterval );
+    };
+
     // Listener for video source events
     class VideoListener : public IVideoSourceListener
     {
@@ -65,6 +141,10 @@ namespace Private
         }
 
         void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+        void HandleTimer( IWebResponse& response );
+
+    private:
+        void ProvideImage( XVideoSourceToWebData* source, IWebResponse& response );
     };
 
     // Web request handler providing camera images as MJPEG stream
@@ -82,6 +162,9 @@ namespace Private
 
         void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
         void HandleTimer( IWebResponse& response );
+
+    private:
+        void ProvideImage( XVideoSourceToWebData* source, IWebResponse& response, bool firstImage );
     };
 
     // Private implementation details for the XVideoSourceToWeb
@@ -91,42 +174,99 @@ namespace Private
         volatile bool      NewImageAvailable;
         volatile bool      VideoSourceError;
         XError             InternalError;
-        uint8_t*           JpegBuffer;
-        uint32_t           JpegBufferSize;
-        uint32_t           JpegSize;
         VideoListener      VideoSourceListener;
-        shared_ptr<XImage> CameraImage;
         string             VideoSourceErrorMessage;
         mutex              ImageGuard;
         mutex              BufferGuard;
         XJpegEncoder       JpegEncoder;
 
+        // distribution of encoding time (us) and size (bytes) of JPEG frames
+        XHistogram         EncodeTime;
+        XHistogram         FrameSize;
+
+        // the latest image to encode - either the image kept from video source or a copy of it
+        shared_ptr<const XImage>  CameraImage;
+        steady_clock::time_point  CameraImageTime;
+        // buffers to copy images into, when video source does not allow keeping them
+        XImagePool                CopiedImages;
+
+        // time of the last image and images' demand from clients
+        steady_clock::time_point  LastImageTime;
+        steady_clock::time_point  LastDemandTime;
+        steady_clock::time_point  DemandStartTime;
+
+        // video source to suspend when there are no clients
+        shared_ptr<IVideoSource>  VideoSource;
+        uint32_t                  IdleTimeout;
+        bool                      CaptureSuspended;
+        steady_clock::time_point  CaptureResumeTime;
+        steady_clock::time_point  LastActivityTime;
+
+        // other video sources (different resolution/quality), which clients may choose;
+        // activity of their clients keeps parent's video source running
+        map<string, XVideoSourceToWebData*> Profiles;
+        XVideoSourceToWebData*              Parent;
+
+        // created web request handlers, which get their clients woken up when new image is encoded
+        mutex                               HandlersGuard;
+        list<weak_ptr<IWebRequestHandler>>  Handlers;
+
+        // the latest encoded image provided to clients
+        shared_ptr<const JpegFrame>  LatestFrame;
+        // all allocated frames - those referred only from here can be reused
+        list<shared_ptr<JpegFrame>>  Frames;
+
+        // encoder thread compressing images as soon as they come from video source
+        thread             EncoderThread;
+        XManualResetEvent  NewImageEvent;
+        XManualResetEvent  NeedToStop;
+
     public:
         XVideoSourceToWebData( uint16_t jpegQuality ) :
             NewImageAvailable( false ), VideoSourceError( false ), InternalError( XError::Success ),
-            JpegBuffer( nullptr ), JpegBufferSize( 0 ), JpegSize( 0 ), VideoSourceListener( this ),
-            CameraImage( ), VideoSourceErrorMessage( ), ImageGuard( ), BufferGuard( ),
-            JpegEncoder( jpegQuality, true )
+            VideoSourceListener( this ),
+            VideoSourceErrorMessage( ), ImageGuard( ), BufferGuard( ),
+            JpegEncoder( jpegQuality, true ),
+            EncodeTime( { 1000, 2000, 5000, 10000, 20000, 35000, 50000, 75000, 100000, 200000 } ),
+            FrameSize( { 8192, 16384, 32768, 65536, 131072, 262144, 524288, 1048576 } ),
+            CameraImage( ), CameraImageTime( ), CopiedImages( ),
+            LastImageTime( ), LastDemandTime( ), DemandStartTime( ),
+            VideoSource( ), IdleTimeout( 0 ), CaptureSuspended( false ), CaptureResumeTime( ), LastActivityTime( ),
+            Profiles( ), Parent( nullptr ), HandlersGuard( ), Handlers( ),
+            LatestFrame( ), Frames( ),
+            EncoderThread( ), NewImageEvent( ), NeedToStop( )
         {
-            // allocate initial buffer for JPEG images
-            JpegBuffer = (uint8_t*) malloc( JPEG_BUFFER_SIZE );
-            if ( JpegBuffer != nullptr )
-            {
-                JpegBufferSize = JPEG_BUFFER_SIZE;
-            }
+            EncoderThread = thread( EncoderThreadHandler, this );
         }
 
         ~XVideoSourceToWebData( )
         {
-            if ( JpegBuffer != nullptr )
-            {
-                free( JpegBuffer );
-            }
+            NeedToStop.Signal( );
+            NewImageEvent.Signal( );
+            EncoderThread.join( );
         }
 
         bool IsError( );
         void ReportError( IWebResponse& response );
         void EncodeCameraImage( );
+        shared_ptr<const JpegFrame> GetLatestFrame( );
+
+        void NotifyDemand( );
+        void NotifyActivity( );
+        XVideoSourceToWebData* SelectProfile( const IWebRequest& request );
+        bool IsFrameUpToDate( const shared_ptr<const JpegFrame>& frame );
+        bool IsNewImageExpected( );
+        bool HasDemand( const steady_clock::time_point& now ) const;
+
+        void SetIdleVideoSource( const shared_ptr<IVideoSource>& videoSource, uint32_t idleTimeout );
+        shared_ptr<IWebRequestHandler> AddHandler( const shared_ptr<IWebRequestHandler>& handler );
+
+    private:
+        void TriggerHandlers( );
+        shared_ptr<JpegFrame> GetFreeFrame( );
+        void UpdateCaptureState( );
+
+        static void EncoderThreadHandler( XVideoSourceToWebData* me );
     };
 }
 
@@ -149,13 +289,13 @@ IVideoSourceListener* XVideoSourceToWeb::VideoSourceListener( ) const
 // Create web request handler to provide camera images as JPEGs
 shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateJpegHandler( const string& uri ) const
 {
-    return make_shared<Private::JpegRequestHandler>( uri, mData );
+    return mData->AddHandler( make_shared<Private::JpegRequestHandler>( uri, mData ) );
 }
 
 // Create web request handler to provide camera images as MJPEG stream
 shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateMjpegHandler( const string& uri, uint32_t frameRate ) const
 {
-    return make_shared<Private::MjpegRequestHandler>( uri, frameRate, mData );
+    return mData->AddHandler( make_shared<Private::MjpegRequestHandler>( uri, frameRate, mData ) );
 }
 
 // Get/Set JPEG quality (valid only if camera provides uncompressed images)
@@ -168,19 +308,84 @@ void XVideoSourceToWeb::SetJpegQuality( uint16_t quality )
     mData->JpegEncoder.SetQuality( quality );
 }
 
+// Get/Set number of threads to encode a JPEG with
+uint32_t XVideoSourceToWeb::JpegEncoderThreadsCount( ) const
+{
+    return mData->JpegEncoder.ThreadsCount( );
+}
+void XVideoSourceToWeb::SetJpegEncoderThreadsCount( uint32_t count )
+{
+    mData->JpegEncoder.SetThreadsCount( count );
+}
+
+// Add another video source clients can choose by specifying its name as "profile" variable
+void XVideoSourceToWeb::AddProfile( const string& name, XVideoSourceToWeb& profileSource )
+{
+    mData->Profiles[name]        = profileSource.mData;
+    profileSource.mData->Parent  = mData;
+}
+
+// Notify about clients receiving video from the same video source in some other way
+void XVideoSourceToWeb::NotifyActivity( )
+{
+    mData->NotifyActivity( );
+}
+
+// Suspend capture of the video source when there are no clients for the specified time
+void XVideoSourceToWeb::EnableIdleSuspend( const shared_ptr<IVideoSource>& videoSource, uint32_t idleTimeout )
+{
+    mData->SetIdleVideoSource( videoSource, idleTimeout );
+}
+
+// Get histograms of time taken to encode images and size of JPEG frames
+const XHistogram& XVideoSourceToWeb::EncodeTimeHistogram( ) const
+{
+    return mData->EncodeTime;
+}
+const XHistogram& XVideoSourceToWeb::FrameSizeHistogram( ) const
+{
+    return mData->FrameSize;
+}
+
 namespace Private
 {
 
-// On new image from video source - make a copy of it
+// On new image from video source - keep reference to it or make a copy if it is needed by clients
 void VideoListener::OnNewImage( const shared_ptr<const XImage>& image )
 {
-    lock_guard<mutex> lock( Owner->ImageGuard );
+    XTraceScope              traceScope( "video.new_image" );
+    lock_guard<mutex>        lock( Owner->ImageGuard );
+    steady_clock::time_point now       = steady_clock::now( );
+    bool                     hasDemand = Owner->HasDemand( now );
 
-    Owner->InternalError = image->CopyDataOrClone( Owner->CameraImage );
-    
-    if ( Owner->InternalError == XError::Success )
+    Owner->LastImageTime = now;
+
+    if ( image->OwnsData( ) )
     {
+        // image data stay valid while we keep the image, so no need to copy it
+        Owner->CameraImage       = image;
+        Owner->CameraImageTime   = now;
         Owner->NewImageAvailable = true;
+        Owner->InternalError     = XError::Success;
+    }
+    else if ( hasDemand )
+    {
+        // the image being encoded (if any) is not free, so the copy never goes into it
+        shared_ptr<XImage> copiedImage = Owner->CopiedImages.Acquire( image->Width( ), image->Height( ), image->Format( ) );
+
+        Owner->InternalError = ( copiedImage ) ? image->CopyData( copiedImage ) : XError( XError::OutOfMemory );
+
+        if ( Owner->InternalError == XError::Success )
+        {
+            Owner->CameraImage       = copiedImage;
+            Owner->CameraImageTime   = now;
+            Owner->NewImageAvailable = true;
+        }
+    }
+
+    if ( ( Owner->NewImageAvailable ) && ( hasDemand ) )
+    {
+        Owner->NewImageEvent.Signal( );
     }
 
     // since we got an image from video source, clear any error reported by it
@@ -198,22 +403,45 @@ void VideoListener::OnError( const string& errorMessage, bool /* fatal */ )
 }
 
 // Handle JPEG request - provide current camera image
-void JpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+void JpegRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
 {
-    if ( !Owner->IsError( ) )
-    {
-        Owner->EncodeCameraImage( );
-    }
+    ProvideImage( Owner->SelectProfile( request ), response );
+}
+
+// Timer event for the connection waiting for new JPEG image
+void JpegRequestHandler::HandleTimer( IWebResponse& response )
+{
+    shared_ptr<StreamClient> client = static_pointer_cast<StreamClient>( response.UserData( ) );
+
+    ProvideImage( ( client ) ? client->Source : Owner, response );
+}
+
+// Provide current camera image or wait till the one coming from video source gets encoded
+void JpegRequestHandler::ProvideImage( XVideoSourceToWebData* source, IWebResponse& response )
+{
+    XTraceScope traceScope( "video.send_jpeg" );
 
-    if ( Owner->IsError( ) )
+    if ( source->IsError( ) )
     {
-        Owner->ReportError( response );
+        source->ReportError( response );
     }
     else
     {
-        lock_guard<mutex> lock( Owner->BufferGuard );
+        shared_ptr<const JpegFrame> frame;
 
-        if ( Owner->JpegSize == 0 )
+        source->NotifyDemand( );
+        frame = source->GetLatestFrame( );
+
+        if ( ( !source->IsFrameUpToDate( frame ) ) && ( source->IsNewImageExpected( ) ) )
+        {
+            // wait for encoder to provide new image
+            if ( !response.UserData( ) )
+            {
+                response.SetUserData( make_shared<StreamClient>( source ) );
+            }
+            response.SetTimer( JPEG_WAIT_INTERVAL );
+        }
+        else if ( !frame )
         {
             response.SendError( 500, "No image from video source" );
         }
@@ -223,61 +451,42 @@ void JpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IW
                              "Content-Type: image/jpeg\r\n"
                              "Content-Length: %u\r\n"
                              "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
-                             "\r\n",  Owner->JpegSize );
+                             "\r\n",  frame->Size );
     
-            response.Send( Owner->JpegBuffer, Owner->JpegSize );
+            response.SendShared( frame, frame->Data, frame->Size );
         }
     }
 }
 
 // Handle MJPEG request - continuously provide camera images as MJPEG stream
-void MjpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+void MjpegRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
 {
-    uint32_t handlingTime = 0;
+    XVideoSourceToWebData* source = Owner->SelectProfile( request );
 
-    if ( !Owner->IsError( ) )
+    if ( source->IsError( ) )
     {
-        steady_clock::time_point startTime = steady_clock::now( );
-
-        Owner->EncodeCameraImage( );
-
-        handlingTime = static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
-    }
-
-    if ( Owner->IsError( ) )
-    {
-        Owner->ReportError( response );
+        source->ReportError( response );
     }
     else
     {
-        steady_clock::time_point startTime = steady_clock::now( );
-        lock_guard<mutex>        lock( Owner->BufferGuard );
+        source->NotifyDemand( );
 
-        if ( Owner->JpegSize == 0 )
+        if ( ( !source->GetLatestFrame( ) ) && ( !source->IsNewImageExpected( ) ) )
         {
             response.SendError( 500, "No image from video source" );
         }
         else
         {
-            // provide first image of the MJPEG stream
             response.Printf( "HTTP/1.1 200 OK\r\n"
                              "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
                              "Connection: close\r\n"
                              "Content-Type: multipart/x-mixed-replace; boundary=--myboundary\r\n"
                              "\r\n" );
-    
-            response.Printf( "--myboundary\r\n"
-                             "Content-Type: image/jpeg\r\n"
-                             "Content-Length: %u\r\n"
-                             "\r\n",  Owner->JpegSize );
-    
-            response.Send( Owner->JpegBuffer, Owner->JpegSize );
-    
-            // get final request handling time
-            handlingTime += static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
-    
-            // set time to provide next images
-            response.SetTimer( FrameInterval );
+
+            response.SetUserData( make_shared<StreamClient>( source, FrameInterval ) );
+
+            // provide first image of the MJPEG stream
+            ProvideImage( source, response, true );
         }
     }
 }
@@ -285,42 +494,110 @@ void MjpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, I
 // Timer event for then connection handling MJPEG request - provide new image
 void MjpegRequestHandler::HandleTimer( IWebResponse& response )
 {
-    uint32_t handlingTime = 0;
+    shared_ptr<StreamClient> client = static_pointer_cast<StreamClient>( response.UserData( ) );
+    XVideoSourceToWebData*   source = ( client ) ? client->Source : Owner;
+
+    source->NotifyDemand( );
 
-    if ( !Owner->IsError( ) )
+    if ( ( source->IsError( ) ) || ( ( !source->GetLatestFrame( ) ) && ( !source->IsNewImageExpected( ) ) ) )
     {
-        steady_clock::time_point startTime = steady_clock::now( );
+        response.CloseConnection( );
+    }
+    else
+    {
+        ProvideImage( source, response, false );
+    }
+}
+
+// Provide next image of MJPEG stream if it is time for it and set timer for the one after
+void MjpegRequestHandler::ProvideImage( XVideoSourceToWebData* source, IWebResponse& response, bool firstImage )
+{
+    XTraceScope                 traceScope( "video.send_mjpeg" );
+    steady_clock::time_point    now     = steady_clock::now( );
+    shared_ptr<const JpegFrame> frame   = source->GetLatestFrame( );
+    shared_ptr<StreamClient>    client  = static_pointer_cast<StreamClient>( response.UserData( ) );
+    uint32_t                    timeout = FRAME_WAIT_TIMEOUT;
+
+    // don't provide images, which are too old - encoder may not be producing new images while nobody was watching;
+    // also don't send same image twice - next one gets pushed as soon as it is encoded
+    if ( ( source->IsFrameUpToDate( frame ) ) && ( frame->ImageTime > client->SentImageTime ) )
+    {
+        int64_t sinceSent = duration_cast<milliseconds>( now - client->SentTime ).count( );
+
+        if ( ( !firstImage ) && ( sinceSent < static_cast<int64_t>( client->FrameInterval ) ) )
+        {
+            // too early for this client - it will get the latest image at its own frame rate
+            timeout = client->FrameInterval - static_cast<uint32_t>( sinceSent );
+        }
+        else
+        {
+            size_t queuedLength = response.ToSendDataLength( );
 
-        Owner->EncodeCameraImage( );
+            if ( !firstImage )
+            {
+                client->AdaptFrameInterval( queuedLength, frame->Size, FrameInterval );
+            }
+
+            // don't try sending too much on slow connections - it will only create video lag
+            if ( ( firstImage ) || ( queuedLength < frame->Size ) )
+            {
+                response.Printf( "--myboundary\r\n"
+                                 "Content-Type: image/jpeg\r\n"
+                                 "Content-Length: %u\r\n"
+                                 "\r\n",  frame->Size );
+                response.SendShared( frame, frame->Data, frame->Size );
+
+                client->SentTime      = now;
+                client->SentImageTime = frame->ImageTime;
+            }
+            else
+            {
+                timeout = client->FrameInterval;
+            }
 
-        handlingTime = static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+            client->QueuedLength = response.ToSendDataLength( );
+            client->QueuedTime   = now;
+        }
     }
 
-    if ( ( Owner->IsError( ) ) || ( Owner->JpegSize == 0 ) )
+    // wait for new image or the time to send the latest one
+    response.SetTimer( timeout );
+}
+
+// Adapt frame interval to the rate the connection sends data at - the amount of data
+// sent since the previous check tells how long it takes to send a single frame
+void StreamClient::AdaptFrameInterval( size_t queuedLength, size_t frameSize, uint32_t minFrameInterval )
+{
+    uint32_t elapsed = static_cast<uint32_t>( duration_cast<milliseconds>( steady_clock::now( ) - QueuedTime ).count( ) );
+    uint32_t estimatedInterval;
+
+    if ( queuedLength == 0 )
     {
-        response.CloseConnection( );
+        // everything was sent, so the connection may keep up with higher frame rate
+        estimatedInterval = minFrameInterval;
+    }
+    else if ( queuedLength >= QueuedLength )
+    {
+        // nothing was sent at all
+        estimatedInterval = MAX_FRAME_INTERVAL;
     }
     else
     {
-        steady_clock::time_point startTime = steady_clock::now( );
-        lock_guard<mutex>        lock( Owner->BufferGuard );
+        size_t sentLength = QueuedLength - queuedLength;
 
-        // don't try sending too much on slow connections - it will only create video lag
-        if ( response.ToSendDataLength( ) < 2 * Owner->JpegSize )
-        {
-            // provide subsequent images of the MJPEG stream
-            response.Printf( "--myboundary\r\n"
-                             "Content-Type: image/jpeg\r\n"
-                             "Content-Length: %u\r\n"
-                             "\r\n",  Owner->JpegSize );
-            response.Send( Owner->JpegBuffer, Owner->JpegSize );
-        }
+        estimatedInterval = static_cast<uint32_t>( ( static_cast<uint64_t>( frameSize ) * elapsed + sentLength - 1 ) / sentLength );
+    }
 
-        // get final request handling time
-        handlingTime += static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+    // smooth changes of the interval, so a single stall does not drop frame rate to the minimum
+    FrameInterval = ( FrameInterval * 3 + estimatedInterval ) / 4;
 
-        // set new timer for further images
-        response.SetTimer( ( handlingTime >= FrameInterval ) ? 1 : FrameInterval - handlingTime );
+    if ( FrameInterval < minFrameInterval )
+    {
+        FrameInterval = minFrameInterval;
+    }
+    else if ( FrameInterval > MAX_FRAME_INTERVAL )
+    {
+        FrameInterval = MAX_FRAME_INTERVAL;
     }
 }
 
@@ -345,55 +622,352 @@ void XVideoSourceToWebData::ReportError( IWebResponse& response )
     }
 }
 
+// Get the latest encoded image
+shared_ptr<const JpegFrame> XVideoSourceToWebData::GetLatestFrame( )
+{
+    lock_guard<mutex> lock( BufferGuard );
+
+    return LatestFrame;
+}
+
+// Clients want to get images - keep encoding them
+void XVideoSourceToWebData::NotifyDemand( )
+{
+    NotifyActivity( );
+
+    lock_guard<mutex>        lock( ImageGuard );
+    steady_clock::time_point now = steady_clock::now( );
+
+    if ( !HasDemand( now ) )
+    {
+        DemandStartTime = now;
+    }
+
+    LastDemandTime = now;
+
+    if ( ( NewImageAvailable ) || ( CaptureSuspended ) )
+    {
+        NewImageEvent.Signal( );
+    }
+}
+
+// Clients are active - keep video source running or resume it
+void XVideoSourceToWebData::NotifyActivity( )
+{
+    {
+        lock_guard<mutex>        lock( ImageGuard );
+        steady_clock::time_point now = steady_clock::now( );
+
+        LastActivityTime = now;
+
+        if ( CaptureSuspended )
+        {
+            // resuming video source takes a bit, so clients should wait for it
+            CaptureResumeTime = now;
+            NewImageEvent.Signal( );
+        }
+    }
+
+    if ( Parent != nullptr )
+    {
+        Parent->NotifyActivity( );
+    }
+}
+
+// Select video source (profile) requested by client
+XVideoSourceToWebData* XVideoSourceToWebData::SelectProfile( const IWebRequest& request )
+{
+    XVideoSourceToWebData* source = this;
+
+    if ( !Profiles.empty( ) )
+    {
+        auto itProfile = Profiles.find( request.GetVariable( "profile" ) );
+
+        if ( itProfile != Profiles.end( ) )
+        {
+            source = itProfile->second;
+        }
+    }
+
+    return source;
+}
+
+// Check if any clients were asking for images recently (must be called from under ImageGuard)
+bool XVideoSourceToWebData::HasDemand( const steady_clock::time_point& now ) const
+{
+    return ( duration_cast<milliseconds>( now - LastDemandTime ).count( ) < DEMAND_TIMEOUT );
+}
+
+// Check if the frame was encoded from an image received (nearly) since clients started asking for images
+bool XVideoSourceToWebData::IsFrameUpToDate( const shared_ptr<const JpegFrame>& frame )
+{
+    lock_guard<mutex> lock( ImageGuard );
+
+    return ( ( frame ) && ( frame->ImageTime + milliseconds( FRESH_IMAGE_AGE ) >= DemandStartTime ) );
+}
+
+// Check if video source keeps providing images, so it is worth waiting for a new one
+bool XVideoSourceToWebData::IsNewImageExpected( )
+{
+    bool expected;
+
+    {
+        lock_guard<mutex>        lock( ImageGuard );
+        steady_clock::time_point expectedSince = ( LastImageTime > CaptureResumeTime ) ? LastImageTime : CaptureResumeTime;
+
+        expected = ( ( expectedSince != steady_clock::time_point( ) ) &&
+                     ( duration_cast<milliseconds>( steady_clock::now( ) - expectedSince ).count( ) < IMAGE_WAIT_TIMEOUT ) );
+    }
+
+    // images of a profile come from the same video source as parent's images
+    if ( ( !expected ) && ( Parent != nullptr ) )
+    {
+        expected = Parent->IsNewImageExpected( );
+    }
+
+    return expected;
+}
+
+// Set video source to suspend when there are no clients for the specified time
+void XVideoSourceToWebData::SetIdleVideoSource( const shared_ptr<IVideoSource>& videoSource, uint32_t idleTimeout )
+{
+    lock_guard<mutex> lock( ImageGuard );
+
+    VideoSource      = videoSource;
+    IdleTimeout      = idleTimeout;
+    CaptureSuspended = false;
+
+    NewImageEvent.Signal( );
+}
+
+// Suspend or resume video source depending on clients' demand for images
+void XVideoSourceToWebData::UpdateCaptureState( )
+{
+    shared_ptr<IVideoSource> videoSource;
+    bool                     suspend;
+
+    {
+        lock_guard<mutex> lock( ImageGuard );
+
+        if ( !VideoSource )
+        {
+            return;
+        }
+
+        suspend = ( duration_cast<milliseconds>( steady_clock::now( ) - LastActivityTime ).count( ) >= IdleTimeout );
+
+        if ( suspend == CaptureSuspended )
+        {
+            return;
+        }
+
+        CaptureSuspended = suspend;
+        videoSource      = VideoSource;
+    }
+
+    videoSource->SuspendCapture( suspend );
+}
+
+// Get a frame nobody refers to, so it could be overwritten with a new image
+shared_ptr<JpegFrame> XVideoSourceToWebData::GetFreeFrame( )
+{
+    shared_ptr<JpegFrame> freeFrame;
+    uint32_t              freeCount = 0;
+
+    for ( auto it = Frames.begin( ); it != Frames.end( ); )
+    {
+        if ( it->use_count( ) == 1 )
+        {
+            if ( !freeFrame )
+            {
+                freeFrame = *it;
+            }
+            else if ( ++freeCount >= JPEG_FRAMES_TO_KEEP )
+            {
+                // too many unused frames left after slow clients
+                it = Frames.erase( it );
+                continue;
+            }
+        }
+        ++it;
+    }
+
+    if ( !freeFrame )
+    {
+        freeFrame = make_shared<JpegFrame>( JPEG_BUFFER_SIZE );
+
+        if ( freeFrame->Data != nullptr )
+        {
+            Frames.push_back( freeFrame );
+        }
+    }
+
+    return freeFrame;
+}
+
 // Encode current camera image as JPEG
 void XVideoSourceToWebData::EncodeCameraImage( )
 {
-    if ( NewImageAvailable )
+    shared_ptr<const XImage> image;
+    steady_clock::time_point imageTime;
+
     {
         lock_guard<mutex> imageLock( ImageGuard );
-        lock_guard<mutex> bufferLock( BufferGuard );
 
-        if ( JpegBuffer == nullptr )
+        // don't waste time encoding images nobody wants
+        if ( ( !NewImageAvailable ) || ( !HasDemand( steady_clock::now( ) ) ) )
         {
-            InternalError = XError::OutOfMemory;
+            return;
         }
-        else
+
+        // take the latest image for encoding, while video source keeps providing new images
+        image.swap( CameraImage );
+        imageTime         = CameraImageTime;
+        NewImageAvailable = false;
+    }
+
+    XTraceScope              traceScope( "video.encode" );
+    shared_ptr<JpegFrame>    frame       = GetFreeFrame( );
+    XError                   error       = XError::Success;
+    steady_clock::time_point encodeStart = steady_clock::now( );
+
+    if ( frame->Data == nullptr )
+    {
+        error = XError::OutOfMemory;
+    }
+    else
+    {
+        if ( image->Format( ) == XPixelFormat::JPEG )
         {
-            if ( CameraImage->Format( ) == XPixelFormat::JPEG )
+            // check allocated buffer size
+            if ( frame->BufferSize < static_cast<uint32_t>( image->Width( ) ) )
             {
-                // check allocated buffer size
-                if ( JpegBufferSize < static_cast<uint32_t>( CameraImage->Width( ) ) )
+                // make new size 10% bigger than needed
+                uint32_t newSize   = image->Width( ) + image->Width( ) / 10;
+                uint8_t* newBuffer = (uint8_t*) realloc( frame->Data, newSize );
+
+                if ( newBuffer != nullptr )
                 {
-                    // make new size 10% bigger than needed
-                    uint32_t newSize = CameraImage->Width( ) + CameraImage->Width( ) / 10;
-
-                    JpegBuffer = (uint8_t*) realloc( JpegBuffer, newSize );
-                    if ( JpegBuffer != nullptr )
-                    {
-                        JpegBufferSize = newSize;
-                    }
-                    else
-                    {
-                        InternalError = XError::OutOfMemory;
-                    }
+                    frame->Data       = newBuffer;
+                    frame->BufferSize = newSize;
                 }
-
-                if ( JpegBuffer != nullptr )
+                else
                 {
-                    // just copy JPEG data if we got already encoded image
-                    memcpy( JpegBuffer, CameraImage->Data( ), CameraImage->Width( ) );
-                    JpegSize = CameraImage->Width( );
+                    error = XError::OutOfMemory;
                 }
             }
+
+            if ( error == XError::Success )
+            {
+                // just copy JPEG data if we got already encoded image
+                memcpy( frame->Data, image->Data( ), image->Width( ) );
+                frame->Size = image->Width( );
+            }
+        }
+        else
+        {
+            // encode image as JPEG (buffer is re-allocated if too small by encoder, so
+            // frames grow to the size of the biggest image and stay of that size)
+            uint32_t size = frame->BufferSize;
+
+            error = JpegEncoder.EncodeToMemory( image, &frame->Data, &size );
+
+            if ( ( error == XError::Success ) && ( size > frame->BufferSize ) )
+            {
+                frame->BufferSize = size;
+            }
+
+            frame->Size = size;
+        }
+    }
+
+    if ( error == XError::Success )
+    {
+        EncodeTime.Add( static_cast<uint64_t>( duration_cast<microseconds>( steady_clock::now( ) - encodeStart ).count( ) ) );
+        FrameSize.Add( frame->Size );
+    }
+
+    if ( error == XError::Success )
+    {
+        lock_guard<mutex> bufferLock( BufferGuard );
+
+        // publish the new image - clients still sending previous one keep it alive
+        frame->ImageTime = imageTime;
+        LatestFrame      = frame;
+    }
+
+    if ( error == XError::Success )
+    {
+        // push the new image to clients instead of waiting for their timers
+        TriggerHandlers( );
+    }
+    else
+    {
+        InternalError = error;
+    }
+}
+
+// Keep track of the created request handler, so its clients could be woken up on new image
+shared_ptr<IWebRequestHandler> XVideoSourceToWebData::AddHandler( const shared_ptr<IWebRequestHandler>& handler )
+{
+    lock_guard<mutex> lock( HandlersGuard );
+
+    Handlers.push_back( handler );
+
+    return handler;
+}
+
+// Wake up clients of the created request handlers - clients of profiles are served by parent's handlers
+void XVideoSourceToWebData::TriggerHandlers( )
+{
+    XVideoSourceToWebData*                root = this;
+    vector<shared_ptr<IWebRequestHandler>> handlers;
+
+    while ( root->Parent != nullptr )
+    {
+        root = root->Parent;
+    }
+
+    {
+        lock_guard<mutex> lock( root->HandlersGuard );
+
+        for ( auto itHandler = root->Handlers.begin( ); itHandler != root->Handlers.end( ); )
+        {
+            shared_ptr<IWebRequestHandler> handler = itHandler->lock( );
+
+            if ( handler )
+            {
+                handlers.push_back( handler );
+                itHandler++;
+            }
             else
             {
-                // encode image as JPEG (buffer is re-allocated if too small by encoder)
-                JpegSize      = JpegBufferSize;
-                InternalError = JpegEncoder.EncodeToMemory( CameraImage, &JpegBuffer, &JpegSize );
+                itHandler = root->Handlers.erase( itHandler );
             }
         }
+    }
 
-        NewImageAvailable = false;
+    for ( auto handler : handlers )
+    {
+        handler->TriggerTimers( );
+    }
+}
+
+// Encoder thread - compress images as they arrive, so web handlers only pick up the latest ready JPEG;
+// also suspend/resume video source depending on clients' activity
+void XVideoSourceToWebData::EncoderThreadHandler( XVideoSourceToWebData* me )
+{
+    XTrace::SetThreadName( "jpeg encoder" );
+
+    while ( !me->NeedToStop.IsSignaled( ) )
+    {
+        if ( me->NewImageEvent.Wait( 1000 ) )
+        {
+            me->NewImageEvent.Reset( );
+        }
+
+        me->UpdateCaptureState( );
+        me->EncodeCameraImage( );
     }
 }
 
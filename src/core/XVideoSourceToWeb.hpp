@@ -25,8 +25,10 @@
 #include <memory>
 
 #include "XInterfaces.hpp"
+#include "IVideoSource.hpp"
 #include "IVideoSourceListener.hpp"
 #include "XWebServer.hpp"
+#include "XHistogram.hpp"
 
 namespace Private
 {
@@ -52,6 +54,27 @@ public:
     uint16_t JpegQuality( ) const;
     void SetJpegQuality( uint16_t quality );
 
+    // Get/Set number of threads to encode a JPEG with (valid only if camera provides uncompressed images)
+    uint32_t JpegEncoderThreadsCount( ) const;
+    void SetJpegEncoderThreadsCount( uint32_t count );
+
+    // Add another instance (different resolution/quality) as a profile, which clients may choose by
+    // specifying "profile" variable in the URI of JPEG/MJPEG handlers (e.g. /camera/mjpeg?profile=low)
+    void AddProfile( const std::string& name, XVideoSourceToWeb& profileSource );
+
+    // Notify about clients receiving video from the same video source in some other way (e.g. different
+    // streaming format), so its capture is not suspended while they are active
+    void NotifyActivity( );
+
+    // Suspend capture of the specified video source when clients don't request images for the
+    // specified amount of time (ms). Capture is resumed on the next request for camera images.
+    void EnableIdleSuspend( const std::shared_ptr<IVideoSource>& videoSource, uint32_t idleTimeout = 5000 );
+
+    // Get histogram of time (microseconds) taken to encode (or copy already encoded) images
+    const XHistogram& EncodeTimeHistogram( ) const;
+    // Get histogram of JPEG frames' size (bytes)
+    const XHistogram& FrameSizeHistogram( ) const;
+
 private:
     Private::XVideoSourceToWebData* mData;
 };
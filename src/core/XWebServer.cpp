@@ -20,10 +20,18 @@
 
 #include "XWebServer.hpp"
 #include "XManualResetEvent.hpp"
+#include "XTrace.hpp"
 
 #include <map>
 #include <list>
+#include <deque>
+#include <vector>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
 
 #include <mongoose.h>
 
@@ -31,6 +39,10 @@
     #include <windows.h>
 #endif
 
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL (0)
+#endif
+
 using namespace std;
 using namespace std::chrono;
 
@@ -38,6 +50,172 @@ namespace Private
 {
     #define DEFAULT_AUTH_DOMAIN "cam2web"
 
+    // Maximum number of authenticated digest sessions to remember
+    #define MAX_AUTH_SESSIONS (64)
+
+    // Amount of shared data to copy into connection's buffer when socket is not
+    // ready for writing, so mongoose waits for it to become writable again
+    #define SHARED_DATA_PRIME_SIZE (1460)
+
+    // Interval (ms) of updating statistics of connections' send queues
+    #define QUEUE_STATS_INTERVAL (500)
+
+    /* ================================================================= */
+    /* Buffer enqueued for sending without copying it                    */
+    /* ================================================================= */
+    class SharedBuffer
+    {
+    public:
+        shared_ptr<const void> Owner;
+        const uint8_t*         Data;
+        size_t                 Length;
+
+    public:
+        SharedBuffer( const shared_ptr<const void>& owner, const uint8_t* data, size_t length ) :
+            Owner( owner ), Data( data ), Length( length )
+        { }
+    };
+
+    class RequestHandlerData;
+    class WorkerJob;
+
+    /* ================================================================= */
+    /* Statistics of request handler, which are updated by polling       */
+    /* thread and can be read by anyone without locking                 */
+    /* ================================================================= */
+    class HandlerMetrics
+    {
+    public:
+        atomic<steady_clock::rep> LastAccessTime;
+        atomic<bool>              WasAccessed;
+        atomic<uint64_t>          RequestsCount;
+        atomic<uint64_t>          BytesSent;
+        atomic<uint32_t>          ActiveConnections;
+        atomic<uint64_t>          QueuedBytes;
+        atomic<uint64_t>          MaxQueuedBytes;
+        atomic<uint64_t>          LatencyHistogram[XWebHandlerStats::LatencyBucketsCount];
+        atomic<uint64_t>          LatencySum;
+
+    public:
+        HandlerMetrics( ) :
+            LastAccessTime( 0 ), WasAccessed( false ), RequestsCount( 0 ), BytesSent( 0 ), ActiveConnections( 0 ),
+            QueuedBytes( 0 ), MaxQueuedBytes( 0 ), LatencySum( 0 )
+        {
+            for ( auto& bucket : LatencyHistogram )
+            {
+                bucket = 0;
+            }
+        }
+
+        // Mark the handler as accessed right now
+        void MarkAccess( )
+        {
+            LastAccessTime = steady_clock::now( ).time_since_epoch( ).count( );
+            WasAccessed    = true;
+        }
+
+        // Count request, which started handling at the specified time and is done now
+        void AddRequest( steady_clock::time_point startTime )
+        {
+            uint64_t latency = static_cast<uint64_t>( duration_cast<microseconds>( steady_clock::now( ) - startTime ).count( ) );
+
+            LatencyHistogram[XWebHandlerStats::LatencyBucket( latency )]++;
+            LatencySum += latency;
+            RequestsCount++;
+        }
+
+        // Get snapshot of the statistics
+        void Get( XWebHandlerStats& stats ) const
+        {
+            stats.LastAccessTime    = steady_clock::time_point( steady_clock::duration( LastAccessTime.load( ) ) );
+            stats.WasAccessed       = WasAccessed;
+            stats.RequestsCount     = RequestsCount;
+            stats.BytesSent         = BytesSent;
+            stats.ActiveConnections = ActiveConnections;
+            stats.QueuedBytes       = QueuedBytes;
+            stats.MaxQueuedBytes    = MaxQueuedBytes;
+
+            for ( uint32_t i = 0; i < XWebHandlerStats::LatencyBucketsCount; i++ )
+            {
+                stats.LatencyHistogram[i] = LatencyHistogram[i];
+            }
+            stats.LatencySum = LatencySum;
+        }
+    };
+
+    /* ================================================================= */
+    /* Data associated with mongoose connection (its user_data)          */
+    /* ================================================================= */
+    class ConnectionData
+    {
+    public:
+        IWebRequestHandler*  TimerHandler;
+        RequestHandlerData*  WebSocketHandler;
+        shared_ptr<void>     UserData;
+        deque<SharedBuffer>  SendQueue;
+        size_t               QueuedLength;
+        bool                 CloseWhenSent;
+        // requests of the connection, which are not yet responded - handled one by one in the order they came
+        deque<shared_ptr<WorkerJob>> Jobs;
+        // statistics of the handler serving the connection
+        shared_ptr<HandlerMetrics>   Metrics;
+
+    public:
+        ConnectionData( ) :
+            TimerHandler( nullptr ), WebSocketHandler( nullptr ), UserData( ), SendQueue( ), QueuedLength( 0 ), CloseWhenSent( false ),
+            Jobs( ), Metrics( )
+        { }
+
+        ~ConnectionData( )
+        {
+            SetMetrics( nullptr );
+        }
+
+        // Set statistics of the handler, which now serves the connection
+        void SetMetrics( const shared_ptr<HandlerMetrics>& metrics )
+        {
+            if ( Metrics != metrics )
+            {
+                if ( Metrics )
+                {
+                    Metrics->ActiveConnections--;
+                }
+                if ( metrics )
+                {
+                    metrics->ActiveConnections++;
+                }
+                Metrics = metrics;
+            }
+        }
+
+        // Get data of the specified connection, creating it if needed
+        static ConnectionData* Get( struct mg_connection* connection )
+        {
+            if ( connection->user_data == nullptr )
+            {
+                connection->user_data = new ConnectionData( );
+            }
+            return static_cast<ConnectionData*>( connection->user_data );
+        }
+
+        // Check if the connection has any shared data waiting to be sent
+        static bool HasQueuedData( const struct mg_connection* connection )
+        {
+            return ( ( connection->user_data != nullptr ) &&
+                     ( !static_cast<const ConnectionData*>( connection->user_data )->SendQueue.empty( ) ) );
+        }
+
+        // Write as much of the enqueued shared data directly into connection's socket as it accepts
+        static void FlushSendQueue( struct mg_connection* connection );
+
+        // Release data associated with the connection
+        static void Release( struct mg_connection* connection )
+        {
+            delete static_cast<ConnectionData*>( connection->user_data );
+            connection->user_data = nullptr;
+        }
+    };
+
     /* ================================================================= */
     /* Web request implementation using Mangoose APIs                    */
     /* ================================================================= */
@@ -89,13 +267,19 @@ namespace Private
             else
             {
                 char* temp = new char[body->len + 1];
-                mg_get_http_var( body, name.c_str( ), temp, sizeof( body->len ) );
+                mg_get_http_var( body, name.c_str( ), temp, body->len + 1 );
                 ret = temp;
                 delete [] temp;
             }
 
             return ret;
         }
+        string GetHeader( const string& name ) const
+        {
+            struct mg_str* value = mg_get_http_header( mMessage, name.c_str( ) );
+
+            return ( value == nullptr ) ? string( ) : string( value->p, value->p + value->len );
+        }
         map<string, string> Headers( ) const
         {
             map<string, string> headers;
@@ -139,29 +323,73 @@ namespace Private
         // Length of data, which is still enqueued for sending
         size_t ToSendDataLength( ) const
         {
-            return mConnection->send_mbuf.len;
+            size_t length = mConnection->send_mbuf.len;
+
+            if ( mConnection->user_data != nullptr )
+            {
+                length += static_cast<const ConnectionData*>( mConnection->user_data )->QueuedLength;
+            }
+
+            return length;
         }
 
         // Send the specified buffer into response
         void Send( const uint8_t* buffer, size_t length )
         {
-            mg_send( mConnection, buffer, static_cast<int>( length ) );
+            if ( ConnectionData::HasQueuedData( mConnection ) )
+            {
+                // keep ordering of the data - put a copy of it after already enqueued shared buffers
+                shared_ptr<vector<uint8_t>> copy = make_shared<vector<uint8_t>>( buffer, buffer + length );
+
+                SendShared( copy, copy->data( ), length );
+            }
+            else
+            {
+                mg_send( mConnection, buffer, static_cast<int>( length ) );
+            }
         }
 
         // Print formatted response
         void Printf( const char *fmt, ... )
         {
+            char    mem[MG_VPRINTF_BUFFER_SIZE];
+            char*   buf = mem;
+            int     len;
             va_list list;
 
             va_start( list, fmt );
-            mg_vprintf( mConnection, fmt, list );
+            len = mg_avprintf( &buf, sizeof( mem ), fmt, list );
             va_end( list );
+
+            if ( len >= 0 )
+            {
+                Send( reinterpret_cast<const uint8_t*>( buf ), static_cast<size_t>( len ) );
+            }
+
+            if ( ( buf != mem ) && ( buf != nullptr ) )
+            {
+                free( buf );
+            }
+        }
+
+        // Enqueue the specified buffer for sending without copying it
+        void SendShared( const shared_ptr<const void>& owner, const uint8_t* buffer, size_t length )
+        {
+            if ( length != 0 )
+            {
+                ConnectionData* data = ConnectionData::Get( mConnection );
+
+                data->SendQueue.push_back( SharedBuffer( owner, buffer, length ) );
+                data->QueuedLength += length;
+            }
         }
 
         // Send the specified buffer as a chunk into response
         void SendChunk( const uint8_t* buffer, size_t length )
         {
-            mg_send_http_chunk( mConnection, (const char*) buffer , length );
+            Printf( "%X\r\n", static_cast<unsigned int>( length ) );
+            Send( buffer, length );
+            Send( reinterpret_cast<const uint8_t*>( "\r\n" ), 2 );
         }
 
         // Print formatted chunk into response
@@ -178,7 +406,7 @@ namespace Private
 
             if ( len >= 0 )
             {
-                mg_send_http_chunk( mConnection, buf, len );
+                SendChunk( reinterpret_cast<const uint8_t*>( buf ), static_cast<size_t>( len ) );
             }
 
             if ( ( buf != mem ) && ( buf != nullptr ) )
@@ -193,6 +421,12 @@ namespace Private
             mg_http_send_error( mConnection, errorCode, reason );
         }
 
+        // Send message over WebSocket connection
+        void SendWebSocketMessage( const uint8_t* buffer, size_t length, bool binary )
+        {
+            mg_send_websocket_frame( mConnection, ( binary ) ? WEBSOCKET_OP_BINARY : WEBSOCKET_OP_TEXT, buffer, length );
+        }
+
         // Close connection associated with the response
         void CloseConnection( )
         {
@@ -204,9 +438,275 @@ namespace Private
         // after the specified number of milliseconds
         void SetTimer( uint32_t msec )
         {
-            mConnection->user_data = mHandler;
+            ConnectionData::Get( mConnection )->TimerHandler = mHandler;
             mg_set_timer( mConnection, mg_time( ) + (double) msec / 1000 );
         }
+
+        // Get/Set handler's data associated with the connection
+        shared_ptr<void> UserData( ) const
+        {
+            return ( mConnection->user_data == nullptr ) ? shared_ptr<void>( ) :
+                     static_cast<const ConnectionData*>( mConnection->user_data )->UserData;
+        }
+        void SetUserData( const shared_ptr<void>& userData )
+        {
+            ConnectionData::Get( mConnection )->UserData = userData;
+        }
+    };
+
+    /* ================================================================= */
+    /* Copy of HTTP message, which outlives connection's receive buffer  */
+    /* ================================================================= */
+    class CopiedHttpMessage
+    {
+    public:
+        struct http_message Message;
+
+    private:
+        vector<char>        Buffer;
+
+    public:
+        CopiedHttpMessage( const struct http_message* message ) :
+            Message( *message ), Buffer( message->message.p, message->message.p + message->message.len )
+        {
+            // point all parts of the message into its copy
+            Rebase( Message.message, message->message.p );
+            Rebase( Message.method, message->message.p );
+            Rebase( Message.uri, message->message.p );
+            Rebase( Message.proto, message->message.p );
+            Rebase( Message.resp_status_msg, message->message.p );
+            Rebase( Message.query_string, message->message.p );
+            Rebase( Message.body, message->message.p );
+
+            for ( int i = 0; i < MG_MAX_HTTP_HEADERS; i++ )
+            {
+                Rebase( Message.header_names[i], message->message.p );
+                Rebase( Message.header_values[i], message->message.p );
+            }
+        }
+
+    private:
+        void Rebase( struct mg_str& str, const char* originalStart )
+        {
+            if ( ( str.p >= originalStart ) && ( str.p + str.len <= originalStart + Buffer.size( ) ) && ( !Buffer.empty( ) ) )
+            {
+                str.p = Buffer.data( ) + ( str.p - originalStart );
+            }
+            else
+            {
+                str.p   = nullptr;
+                str.len = 0;
+            }
+        }
+    };
+
+    /* ================================================================= */
+    /* Web response buffered on a worker thread, which is sent later by  */
+    /* the polling thread                                                */
+    /* ================================================================= */
+    class BufferedWebResponse : public IWebResponse
+    {
+    private:
+        vector<uint8_t>  Data;
+        int              ErrorCode;
+        string           ErrorReason;
+        bool             HasErrorReason;
+        bool             CloseRequested;
+        bool             TimerRequested;
+        uint32_t         TimerMsec;
+        shared_ptr<void> ConnectionUserData;
+        bool             UserDataChanged;
+
+    public:
+        BufferedWebResponse( ) :
+            Data( ), ErrorCode( 0 ), ErrorReason( ), HasErrorReason( false ), CloseRequested( false ),
+            TimerRequested( false ), TimerMsec( 0 ), ConnectionUserData( ), UserDataChanged( false )
+        { }
+
+        // Provide user data of the connection as it is before handling the request
+        void SetInitialUserData( const shared_ptr<void>& userData )
+        {
+            ConnectionUserData = userData;
+        }
+
+        // Send everything buffered into the actual response (must be done on polling thread)
+        void Apply( IWebResponse& response )
+        {
+            if ( !Data.empty( ) )
+            {
+                response.Send( Data.data( ), Data.size( ) );
+            }
+            if ( ErrorCode != 0 )
+            {
+                response.SendError( ErrorCode, ( HasErrorReason ) ? ErrorReason.c_str( ) : nullptr );
+            }
+            if ( UserDataChanged )
+            {
+                response.SetUserData( ConnectionUserData );
+            }
+            if ( TimerRequested )
+            {
+                response.SetTimer( TimerMsec );
+            }
+            if ( CloseRequested )
+            {
+                response.CloseConnection( );
+            }
+        }
+
+    public:
+        // Length of data, which is still enqueued for sending
+        size_t ToSendDataLength( ) const
+        {
+            return Data.size( );
+        }
+
+        // Send the specified buffer into response
+        void Send( const uint8_t* buffer, size_t length )
+        {
+            Data.insert( Data.end( ), buffer, buffer + length );
+        }
+
+        // Print formatted response
+        void Printf( const char *fmt, ... )
+        {
+            char    mem[MG_VPRINTF_BUFFER_SIZE];
+            char*   buf = mem;
+            int     len;
+            va_list list;
+
+            va_start( list, fmt );
+            len = mg_avprintf( &buf, sizeof( mem ), fmt, list );
+            va_end( list );
+
+            if ( len >= 0 )
+            {
+                Send( reinterpret_cast<const uint8_t*>( buf ), static_cast<size_t>( len ) );
+            }
+
+            if ( ( buf != mem ) && ( buf != nullptr ) )
+            {
+                free( buf );
+            }
+        }
+
+        // Shared buffers are copied, since the response is sent later anyway
+        void SendShared( const shared_ptr<const void>& /* owner */, const uint8_t* buffer, size_t length )
+        {
+            Send( buffer, length );
+        }
+
+        // Send the specified buffer as a chunk into response
+        void SendChunk( const uint8_t* buffer, size_t length )
+        {
+            Printf( "%X\r\n", static_cast<unsigned int>( length ) );
+            Send( buffer, length );
+            Send( reinterpret_cast<const uint8_t*>( "\r\n" ), 2 );
+        }
+
+        // Print formatted chunk into response
+        void PrintfChunk( const char* fmt, ... )
+        {
+            char    mem[MG_VPRINTF_BUFFER_SIZE];
+            char*   buf = mem;
+            int     len;
+            va_list list;
+
+            va_start( list, fmt );
+            len = mg_avprintf( &buf, sizeof( mem ), fmt, list );
+            va_end( list );
+
+            if ( len >= 0 )
+            {
+                SendChunk( reinterpret_cast<const uint8_t*>( buf ), static_cast<size_t>( len ) );
+            }
+
+            if ( ( buf != mem ) && ( buf != nullptr ) )
+            {
+                free( buf );
+            }
+        }
+
+        // Send the specified error code as response
+        void SendError( int errorCode, const char* reason = nullptr )
+        {
+            ErrorCode      = errorCode;
+            HasErrorReason = ( reason != nullptr );
+            ErrorReason    = ( reason != nullptr ) ? reason : "";
+        }
+
+        // No WebSocket messages for HTTP requests
+        void SendWebSocketMessage( const uint8_t* /* buffer */, size_t /* length */, bool /* binary */ )
+        {
+        }
+
+        // Close connection once buffered response is sent
+        void CloseConnection( )
+        {
+            CloseRequested = true;
+        }
+
+        // Timer is set when the buffered response is sent
+        void SetTimer( uint32_t msec )
+        {
+            TimerRequested = true;
+            TimerMsec      = msec;
+        }
+
+        // Get/Set handler's data associated with the connection
+        shared_ptr<void> UserData( ) const
+        {
+            return ConnectionUserData;
+        }
+        void SetUserData( const shared_ptr<void>& userData )
+        {
+            ConnectionUserData = userData;
+            UserDataChanged    = true;
+        }
+    };
+
+    /* ================================================================= */
+    /* Request waiting for its handling                                  */
+    /* ================================================================= */
+    class WorkerJob
+    {
+    public:
+        shared_ptr<IWebRequestHandler> Handler;
+        shared_ptr<HandlerMetrics>     Metrics;
+        CopiedHttpMessage              Message;
+        BufferedWebResponse            Response;
+        steady_clock::time_point       StartTime;
+        bool                           UseWorkerThread;
+        bool                           IsQueued;
+        bool                           IsCompleted; // guarded by XWebServerData::JobsSync
+
+    public:
+        WorkerJob( const shared_ptr<IWebRequestHandler>& handler, const shared_ptr<HandlerMetrics>& metrics,
+                   const struct http_message* message, bool useWorkerThread ) :
+            Handler( handler ), Metrics( metrics ), Message( message ), Response( ), StartTime( steady_clock::now( ) ),
+            UseWorkerThread( useWorkerThread ), IsQueued( false ), IsCompleted( false )
+        { }
+    };
+
+    /* ================================================================= */
+    /* Digest authentication session (user/nonce), which was already     */
+    /* verified - keeps user's details found for it                      */
+    /* ================================================================= */
+    class AuthSession
+    {
+    public:
+        char                     Ha1[33];
+        UserGroup                Group;
+        unsigned long            LastNonceCount;
+        uint32_t                 UsersVersion;
+        steady_clock::time_point LastUseTime;
+
+    public:
+        AuthSession( const char* ha1, UserGroup group, unsigned long nonceCount, uint32_t usersVersion ) :
+            Group( group ), LastNonceCount( nonceCount ), UsersVersion( usersVersion ), LastUseTime( steady_clock::now( ) )
+        {
+            memcpy( Ha1, ha1, sizeof( Ha1 ) );
+        }
     };
 
     /* ================================================================= */
@@ -217,19 +717,54 @@ namespace Private
     public:
         shared_ptr<IWebRequestHandler>  Handler;
         UserGroup                       AllowedUserGroup;
-        steady_clock::time_point        LastAccessTime;
-        bool                            WasAccessed;
+        // created for handlers of running web server only
+        shared_ptr<HandlerMetrics>      Metrics;
     public:
         RequestHandlerData( ) :
-            Handler( ), AllowedUserGroup( UserGroup::Anyone ),
-            LastAccessTime( ), WasAccessed( false )
+            Handler( ), AllowedUserGroup( UserGroup::Anyone ), Metrics( )
         { }
 
         RequestHandlerData( const shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup ) :
-            Handler( handler), AllowedUserGroup( allowedUserGroup )
+            Handler( handler), AllowedUserGroup( allowedUserGroup ), Metrics( )
         { }
     };
 
+    typedef map<string, RequestHandlerData> HandlersMap;
+    typedef list<RequestHandlerData>        HandlersList;
+
+    /* ================================================================= */
+    /* Prefix tree of request handlers, which is built once the web      */
+    /* server starts and is not changed while it is running              */
+    /* ================================================================= */
+    class HandlersTree
+    {
+    private:
+        class Node
+        {
+        public:
+            RequestHandlerData* FileHandler;
+            RequestHandlerData* FolderHandler;
+            uint32_t            FolderHandlerOrder;
+            // children of a node are stored one after another, sorted by their characters
+            uint32_t            FirstChild;
+            uint32_t            ChildrenCount;
+
+        public:
+            Node( ) :
+                FileHandler( nullptr ), FolderHandler( nullptr ), FolderHandlerOrder( 0 ), FirstChild( 0 ), ChildrenCount( 0 )
+            { }
+        };
+
+        vector<Node> Nodes;
+        vector<char> NodeChars;
+
+    public:
+        HandlersTree( ) : Nodes( 1 ), NodeChars( 1, '\0' ) { }
+
+        void Build( HandlersMap& fileHandlers, HandlersList& folderHandlers );
+        RequestHandlerData* Find( const char* uri, size_t length ) const;
+    };
+
     /* ================================================================= */
     /* Private data/implementation of the web server                     */
     /* ================================================================= */
@@ -240,9 +775,13 @@ namespace Private
         string                    DocumentRoot;
         string                    AuthDomain;
         uint16_t                  Port;
+        uint32_t                  WorkerThreadsCount;
+
+        atomic<steady_clock::rep> LastAccessTime;
+        atomic<bool>              WasAccessed;
 
-        steady_clock::time_point  LastAccessTime;
-        bool                      WasAccessed;
+        // time taken to handle events of connections
+        XHistogram                EventHandlingTime;
 
     private:
         struct mg_mgr             EventManager;
@@ -256,26 +795,42 @@ namespace Private
         recursive_mutex           StartSync;
         bool                      IsRunning;
 
-        typedef map<string, RequestHandlerData> HandlersMap;
-        typedef list<RequestHandlerData>        HandlersList;
-
         HandlersMap  FileHandlers;
         HandlersList FolderHandlers;
 
         HandlersMap  ActiveFileHandlers;
         HandlersList ActiveFolderHandlers;
+        HandlersTree ActiveHandlersTree;
 
         typedef map<string, pair<string, UserGroup>> UsersMap;
 
         UsersMap Users;
 
+        // incremented on any change of users, so authenticated sessions get re-checked
+        atomic<uint32_t> UsersVersion;
+
+        // authenticated sessions - accessed by polling thread only
+        typedef map<string, AuthSession> AuthSessionsMap;
+
+        AuthSessionsMap AuthSessions;
+
+        // requests to handle on worker threads
+        vector<thread>                WorkerThreads;
+        mutex                         JobsSync;
+        condition_variable            JobsAvailable;
+        deque<shared_ptr<WorkerJob>>  JobsQueue;
+        bool                          NeedToStopWorkers;
+
     public:
         XWebServerData( const string& documentRoot, uint16_t port ) :
-            DataSync( ), DocumentRoot( documentRoot ), AuthDomain( DEFAULT_AUTH_DOMAIN ), Port( port ),
-            LastAccessTime( ), WasAccessed( false ),
+            DataSync( ), DocumentRoot( documentRoot ), AuthDomain( DEFAULT_AUTH_DOMAIN ), Port( port ), WorkerThreadsCount( 0 ),
+            LastAccessTime( 0 ), WasAccessed( false ),
+            EventHandlingTime( { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 } ),
             EventManager( { 0 } ), ServerOptions( { 0 } ),
             ActiveDocumentRoot( nullptr ), ActiveAuthDomain( ),
-            NeedToStop( ), IsStopped( ), StartSync( ), IsRunning( false )
+            NeedToStop( ), IsStopped( ), StartSync( ), IsRunning( false ),
+            UsersVersion( 0 ), AuthSessions( ),
+            WorkerThreads( ), JobsSync( ), JobsAvailable( ), JobsQueue( ), NeedToStopWorkers( false )
         {
             ServerOptions.enable_directory_listing = "no";
         }
@@ -291,8 +846,11 @@ namespace Private
         void AddHandler( const shared_ptr<IWebRequestHandler>& handler, UserGroup userGroup );
         void RemoveHandler( const shared_ptr<IWebRequestHandler>& handler );
         void ClearHandlers( );
+        RequestHandlerData* FindHandler( const struct mg_str& uri );
         RequestHandlerData* FindHandler( const string& uri );
         steady_clock::time_point HandlerLastAccessTime( const string& handlerUri, bool* pWasAccessed = nullptr );
+        bool HandlerStats( const string& handlerUri, XWebHandlerStats& stats );
+        map<string, XWebHandlerStats> HandlersStats( );
 
         void AddUser( const string& name, const string& digestHa1, UserGroup group );
         void RemoveUser( const string& name );
@@ -301,9 +859,25 @@ namespace Private
 
         UserGroup CheckDigestAuth( struct http_message* msg );
 
+        void StartWorkers( uint32_t count );
+        void StopWorkers( );
+        void ProcessJobs( struct mg_connection* connection );
+        void UpdateQueueStats( );
+
+        static void TriggerTimers( IWebRequestHandler* handler );
+
         static void* pollHandler( void* param );
         static void eventHandler( struct mg_connection* connection, int event, void* param );
+        static void timerHandler( struct mg_connection* connection );
+        static void triggerTimerHandler( struct mg_connection* connection, int event, void* param );
+        static void workerHandler( XWebServerData* self );
+        static void completedJobsHandler( struct mg_connection* connection, int event, void* param );
     };
+
+    // Running web servers, which may get connections' timers triggered by request handlers
+    // or get notified about requests completed by worker threads
+    static mutex                 RunningServersSync;
+    static list<XWebServerData*> RunningServers;
 }
 
 /* ================================================================= */
@@ -326,6 +900,41 @@ IWebRequestHandler::IWebRequestHandler( const string& uri, bool canHandleSubCont
     }
 }
 
+// Generate timer events for all connections waiting for timer event of this handler
+void IWebRequestHandler::TriggerTimers( )
+{
+    Private::XWebServerData::TriggerTimers( this );
+}
+
+/* ================================================================= */
+/* Implementation of the XWebHandlerStats                            */
+/* ================================================================= */
+
+const uint32_t XWebHandlerStats::LatencyBucketBounds[] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000 };
+
+// Get index of the latency histogram bucket - bounds are inclusive
+uint32_t XWebHandlerStats::LatencyBucket( uint64_t latency )
+{
+    uint32_t bucket = 0;
+
+    while ( ( bucket < LatencyBucketsCount - 1 ) && ( latency > LatencyBucketBounds[bucket] ) )
+    {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+XWebHandlerStats::XWebHandlerStats( ) :
+    LastAccessTime( ), WasAccessed( false ), RequestsCount( 0 ), BytesSent( 0 ), ActiveConnections( 0 ),
+    QueuedBytes( 0 ), MaxQueuedBytes( 0 ), LatencySum( 0 )
+{
+    for ( auto& bucket : LatencyHistogram )
+    {
+        bucket = 0;
+    }
+}
+
 /* ================================================================= */
 /* Implementation of the XEmbeddedContentHandler                     */
 /* ================================================================= */
@@ -335,14 +944,71 @@ XEmbeddedContentHandler::XEmbeddedContentHandler( const string& uri, const XEmbe
 {
 }
 
+// Check if client accepts gzip content encoding (and did not disable it with zero quality value)
+static bool IsGzipAccepted( const string& acceptEncoding )
+{
+    size_t gzipPos = acceptEncoding.find( "gzip" );
+    bool   ret     = false;
+
+    if ( gzipPos != string::npos )
+    {
+        size_t qualityPos = acceptEncoding.find_first_not_of( ' ', gzipPos + 4 );
+
+        ret = true;
+
+        if ( ( qualityPos != string::npos ) && ( acceptEncoding.compare( qualityPos, 3, ";q=" ) == 0 ) )
+        {
+            ret = ( atof( acceptEncoding.c_str( ) + qualityPos + 3 ) > 0 );
+        }
+    }
+
+    return ret;
+}
+
 // Handle request providing given embedded content
-void XEmbeddedContentHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+void XEmbeddedContentHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
 {
-    response.Printf( "HTTP/1.1 200 OK\r\n"
-                     "Content-Type: %s\r\n"
-                     "Content-Length: %u\r\n"
-                     "\r\n", mContent->Type, mContent->Length );
-    response.Send( mContent->Body, mContent->Length );
+    bool   hasGzip = ( mContent->GzipBody != nullptr );
+    bool   useGzip = ( ( hasGzip ) && ( IsGzipAccepted( request.GetHeader( "Accept-Encoding" ) ) ) );
+    string eTag;
+
+    if ( mContent->ETag != nullptr )
+    {
+        // different representations must have different entity tags
+        eTag = string( "\"" ) + mContent->ETag + ( ( useGzip ) ? "-gzip\"" : "\"" );
+    }
+
+    if ( ( !eTag.empty( ) ) && ( request.GetHeader( "If-None-Match" ).find( eTag ) != string::npos ) )
+    {
+        // client has up to date content already
+        response.Printf( "HTTP/1.1 304 Not Modified\r\n"
+                         "ETag: %s\r\n"
+                         "Cache-Control: no-cache\r\n"
+                         "%s"
+                         "\r\n", eTag.c_str( ), ( hasGzip ) ? "Vary: Accept-Encoding\r\n" : "" );
+    }
+    else
+    {
+        string cacheHeaders = ( eTag.empty( ) ) ? string( ) : "ETag: " + eTag + "\r\nCache-Control: no-cache\r\n";
+
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: %s\r\n"
+                         "Content-Length: %u\r\n"
+                         "%s%s%s"
+                         "\r\n", mContent->Type, ( useGzip ) ? mContent->GzipLength : mContent->Length,
+                         ( useGzip ) ? "Content-Encoding: gzip\r\n" : "",
+                         ( hasGzip ) ? "Vary: Accept-Encoding\r\n" : "",
+                         cacheHeaders.c_str( ) );
+
+        if ( useGzip )
+        {
+            response.Send( mContent->GzipBody, mContent->GzipLength );
+        }
+        else
+        {
+            response.Send( mContent->Body, mContent->Length );
+        }
+    }
 }
 
 /* ================================================================= */
@@ -402,6 +1068,18 @@ XWebServer& XWebServer::SetPort( uint16_t port )
 
 #pragma pop_macro( "SetPort" )
 
+// Get/Set number of worker threads
+uint32_t XWebServer::WorkerThreadsCount( ) const
+{
+    return mData->WorkerThreadsCount;
+}
+XWebServer& XWebServer::SetWorkerThreadsCount( uint32_t count )
+{
+    lock_guard<recursive_mutex> lock( mData->DataSync );
+    mData->WorkerThreadsCount = count;
+    return *this;
+}
+
 // Start/Stop the Web server
 bool XWebServer::Start( )
 {
@@ -419,7 +1097,7 @@ steady_clock::time_point XWebServer::LastAccessTime( bool* pWasAccessed )
     {
         *pWasAccessed = mData->WasAccessed;
     }
-    return mData->LastAccessTime;
+    return steady_clock::time_point( steady_clock::duration( mData->LastAccessTime.load( ) ) );
 }
 
 // Get time of the last access/request to the specified handler
@@ -428,6 +1106,24 @@ steady_clock::time_point XWebServer::LastAccessTime( const string& handlerUri, b
     return mData->HandlerLastAccessTime( handlerUri, pWasAccessed );
 }
 
+// Get statistics of the specified handler
+bool XWebServer::HandlerStats( const string& handlerUri, XWebHandlerStats& stats )
+{
+    return mData->HandlerStats( handlerUri, stats );
+}
+
+// Get statistics of all handlers
+map<string, XWebHandlerStats> XWebServer::HandlersStats( )
+{
+    return mData->HandlersStats( );
+}
+
+// Get histogram of time taken to handle network events, requests and timers
+const XHistogram& XWebServer::EventHandlingTimeHistogram( ) const
+{
+    return mData->EventHandlingTime;
+}
+
 // Add new web request handler
 XWebServer& XWebServer::AddHandler( const shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup )
 {
@@ -493,7 +1189,8 @@ namespace Private
 bool XWebServerData::Start( )
 {
     lock_guard<recursive_mutex> lock( StartSync );
-    char strPort[16];
+    char     strPort[16];
+    uint32_t workersCount;
 
     {
         lock_guard<recursive_mutex> lock( DataSync );
@@ -512,16 +1209,31 @@ bool XWebServerData::Start( )
         // get a copy of handlers, so we don't need to guard it while server is running
         ActiveFileHandlers   = FileHandlers;
         ActiveFolderHandlers = FolderHandlers;
+
+        // new statistics for every run
+        for ( auto& fileHandler : ActiveFileHandlers )
+        {
+            fileHandler.second.Metrics = make_shared<HandlerMetrics>( );
+        }
+        for ( auto& folderHandler : ActiveFolderHandlers )
+        {
+            folderHandler.Metrics = make_shared<HandlerMetrics>( );
+        }
+
+        ActiveHandlersTree.Build( ActiveFileHandlers, ActiveFolderHandlers );
         ActiveAuthDomain     = AuthDomain;
+        workersCount         = WorkerThreadsCount;
     }
 
+    AuthSessions.clear( );
+
     mg_mgr_init( &EventManager, this );
 
     NeedToStop.Reset( );
     IsStopped.Reset( );
 
     WasAccessed    = false;
-    LastAccessTime = steady_clock::time_point( );
+    LastAccessTime = 0;
 
     struct mg_connection* connection = mg_bind( &EventManager, strPort, eventHandler );
 
@@ -529,14 +1241,20 @@ bool XWebServerData::Start( )
     {
         mg_set_protocol_http_websocket( connection );
 
+        StartWorkers( workersCount );
+
         if ( mg_start_thread( pollHandler, this ) != nullptr )
         {
+            lock_guard<mutex> serversLock( RunningServersSync );
+
+            RunningServers.push_back( this );
             IsRunning = true;
         }
     }
 
     if ( !IsRunning )
     {
+        StopWorkers( );
         Cleanup( );
     }
 
@@ -550,9 +1268,16 @@ void XWebServerData::Stop( )
 
     if ( IsRunning )
     {
+        {
+            // make sure nobody triggers timers of connections when polling thread is gone
+            lock_guard<mutex> serversLock( RunningServersSync );
+            RunningServers.remove( this );
+        }
+
         NeedToStop.Signal( );
         IsStopped.Wait( );
 
+        StopWorkers( );
         Cleanup( );
 
         IsRunning = false;
@@ -612,28 +1337,137 @@ void XWebServerData::ClearHandlers( )
 }
 
 // Find request handler for the specified URI
+RequestHandlerData* XWebServerData::FindHandler( const struct mg_str& uri )
+{
+    size_t length = uri.len;
+
+    // make sure nothing finishes with / except the root
+    while ( ( length > 1 ) && ( uri.p[length - 1] == '/' ) )
+    {
+        length--;
+    }
+
+    return ActiveHandlersTree.Find( uri.p, length );
+}
 RequestHandlerData* XWebServerData::FindHandler( const string& uri )
 {
-    RequestHandlerData*   handler = nullptr;
-    HandlersMap::iterator fileIt  = ActiveFileHandlers.find( uri );
+    return ActiveHandlersTree.Find( uri.c_str( ), uri.length( ) );
+}
+
+// Build prefix tree for the specified handlers
+void HandlersTree::Build( HandlersMap& fileHandlers, HandlersList& folderHandlers )
+{
+    // temporary tree, which then gets packed, so that children of every node are next to each other
+    class BuildNode
+    {
+    public:
+        RequestHandlerData*              FileHandler;
+        RequestHandlerData*              FolderHandler;
+        uint32_t                         FolderHandlerOrder;
+        map<char, shared_ptr<BuildNode>> Children;
+
+    public:
+        BuildNode( ) : FileHandler( nullptr ), FolderHandler( nullptr ), FolderHandlerOrder( 0 ), Children( ) { }
+
+        BuildNode* Add( const string& uri )
+        {
+            BuildNode* node = this;
+
+            for ( char c : uri )
+            {
+                shared_ptr<BuildNode>& child = node->Children[c];
+
+                if ( !child )
+                {
+                    child = make_shared<BuildNode>( );
+                }
+                node = child.get( );
+            }
 
-    if ( fileIt != ActiveFileHandlers.end( ) )
+            return node;
+        }
+    };
+
+    BuildNode root;
+    uint32_t  folderHandlerOrder = 0;
+
+    for ( auto& fileHandler : fileHandlers )
     {
-        handler = &fileIt->second;
+        root.Add( fileHandler.first )->FileHandler = &fileHandler.second;
     }
-    else
+
+    for ( auto& folderHandler : folderHandlers )
+    {
+        BuildNode* node = root.Add( folderHandler.Handler->Uri( ) );
+
+        // the first added handler is used if there are few for the same folder
+        if ( node->FolderHandler == nullptr )
+        {
+            node->FolderHandler      = &folderHandler;
+            node->FolderHandlerOrder = folderHandlerOrder;
+        }
+        folderHandlerOrder++;
+    }
+
+    // pack the tree breadth first
+    deque<pair<const BuildNode*, uint32_t>> toPack;
+
+    Nodes.assign( 1, Node( ) );
+    NodeChars.assign( 1, '\0' );
+    toPack.push_back( pair<const BuildNode*, uint32_t>( &root, 0 ) );
+
+    while ( !toPack.empty( ) )
+    {
+        const BuildNode* buildNode = toPack.front( ).first;
+        uint32_t         index     = toPack.front( ).second;
+
+        toPack.pop_front( );
+
+        Nodes[index].FileHandler        = buildNode->FileHandler;
+        Nodes[index].FolderHandler      = buildNode->FolderHandler;
+        Nodes[index].FolderHandlerOrder = buildNode->FolderHandlerOrder;
+        Nodes[index].FirstChild         = static_cast<uint32_t>( Nodes.size( ) );
+        Nodes[index].ChildrenCount      = static_cast<uint32_t>( buildNode->Children.size( ) );
+
+        for ( auto& child : buildNode->Children )
+        {
+            toPack.push_back( pair<const BuildNode*, uint32_t>( child.second.get( ), static_cast<uint32_t>( Nodes.size( ) ) ) );
+            Nodes.push_back( Node( ) );
+            NodeChars.push_back( child.first );
+        }
+    }
+}
+
+// Find handler for the specified URI - exactly matching file handler or folder handler for any of its parents
+RequestHandlerData* HandlersTree::Find( const char* uri, size_t length ) const
+{
+    RequestHandlerData* folderHandler      = Nodes[0].FolderHandler;
+    uint32_t            folderHandlerOrder = Nodes[0].FolderHandlerOrder;
+    const Node*         node               = &Nodes[0];
+    size_t              i;
+
+    for ( i = 0; i < length; i++ )
     {
-        for ( auto& folderHandlerData : ActiveFolderHandlers )
+        const char* childrenChars = &NodeChars[node->FirstChild];
+        const char* childrenEnd   = childrenChars + node->ChildrenCount;
+        const char* childChar     = lower_bound( childrenChars, childrenEnd, uri[i] );
+
+        if ( ( childChar == childrenEnd ) || ( *childChar != uri[i] ) )
         {
-            if ( uri.compare( 0, folderHandlerData.Handler->Uri( ).length( ), folderHandlerData.Handler->Uri( ) ) == 0 )
-            {
-                handler = &folderHandlerData;
-                break;
-            }
+            break;
+        }
+
+        node = &Nodes[node->FirstChild + ( childChar - childrenChars )];
+
+        if ( ( node->FolderHandler != nullptr ) &&
+             ( ( folderHandler == nullptr ) || ( node->FolderHandlerOrder < folderHandlerOrder ) ) )
+        {
+            folderHandler      = node->FolderHandler;
+            folderHandlerOrder = node->FolderHandlerOrder;
         }
     }
 
-    return handler;
+    return ( ( i == length ) && ( node->FileHandler != nullptr ) ) ? node->FileHandler : folderHandler;
 }
 
 // Get time of the last access/request to the specified handler
@@ -645,8 +1479,8 @@ steady_clock::time_point XWebServerData::HandlerLastAccessTime( const string& ha
 
     if ( handlerData != nullptr )
     {
-        lastAccess  = handlerData->LastAccessTime;
-        wasAccessed = handlerData->WasAccessed;
+        lastAccess  = steady_clock::time_point( steady_clock::duration( handlerData->Metrics->LastAccessTime.load( ) ) );
+        wasAccessed = handlerData->Metrics->WasAccessed;
     }
 
     if ( pWasAccessed != nullptr )
@@ -657,18 +1491,54 @@ steady_clock::time_point XWebServerData::HandlerLastAccessTime( const string& ha
     return lastAccess;
 }
 
+// Get statistics of the specified handler
+bool XWebServerData::HandlerStats( const string& handlerUri, XWebHandlerStats& stats )
+{
+    RequestHandlerData* handlerData = FindHandler( handlerUri );
+    bool                ret         = ( ( handlerData != nullptr ) && ( handlerData->Metrics ) );
+
+    if ( ret )
+    {
+        handlerData->Metrics->Get( stats );
+    }
+
+    return ret;
+}
+
+// Get statistics of all active handlers
+map<string, XWebHandlerStats> XWebServerData::HandlersStats( )
+{
+    map<string, XWebHandlerStats> allStats;
+    XWebHandlerStats              stats;
+
+    for ( auto& fileHandler : ActiveFileHandlers )
+    {
+        fileHandler.second.Metrics->Get( stats );
+        allStats.insert( map<string, XWebHandlerStats>::value_type( fileHandler.first, stats ) );
+    }
+    for ( auto& folderHandler : ActiveFolderHandlers )
+    {
+        folderHandler.Metrics->Get( stats );
+        allStats.insert( map<string, XWebHandlerStats>::value_type( folderHandler.Handler->Uri( ), stats ) );
+    }
+
+    return allStats;
+}
+
 // Add/Remove user to/from the list of user who can access protected request handlers
 void XWebServerData::AddUser( const string& name, const string& digestHa1, UserGroup group )
 {
     lock_guard<recursive_mutex> lock( DataSync );
 
     Users[name] = pair<string, UserGroup>( digestHa1, group );
+    UsersVersion++;
 }
 void XWebServerData::RemoveUser( const string& name )
 {
     lock_guard<recursive_mutex> lock( DataSync );
 
     Users.erase( name );
+    UsersVersion++;
 }
 
 // Load users from file having "htdigest" format
@@ -778,16 +1648,26 @@ void XWebServerData::ClearUsers( )
     lock_guard<recursive_mutex> lock( DataSync );
 
     Users.clear( );
+    UsersVersion++;
 }
 
 // Thread to poll web events
 void* XWebServerData::pollHandler( void* param )
 {
-    XWebServerData* self = (XWebServerData*) param;
+    XWebServerData*          self            = (XWebServerData*) param;
+    steady_clock::time_point lastStatsUpdate = steady_clock::now( );
+
+    XTrace::SetThreadName( "web poll" );
 
     while ( !self->NeedToStop.Wait( 0 ) )
     {
         mg_mgr_poll( &self->EventManager, 1000 );
+
+        if ( duration_cast<milliseconds>( steady_clock::now( ) - lastStatsUpdate ).count( ) >= QUEUE_STATS_INTERVAL )
+        {
+            self->UpdateQueueStats( );
+            lastStatsUpdate = steady_clock::now( );
+        }
     }
 
     self->IsStopped.Signal( );
@@ -830,29 +1710,78 @@ UserGroup XWebServerData::CheckDigestAuth( struct http_message* msg )
          ( mg_http_parse_header( hdr, "uri", uri, sizeof( uri ) ) != 0 ) &&
          ( mg_http_parse_header( hdr, "qop", qop, sizeof( qop ) ) != 0 ) &&
          ( mg_http_parse_header( hdr, "nc", nc, sizeof( nc ) ) != 0 ) &&
-         ( mg_http_parse_header( hdr, "nonce", nonce, sizeof( nonce ) ) != 0 ) )
+         ( mg_http_parse_header( hdr, "nonce", nonce, sizeof( nonce ) ) != 0 ) &&
+         ( check_nonce( nonce ) ) )
     {
-        // got some authentication data to check
-        if ( check_nonce( nonce ) )
+        // clients generate new cnonce for every request, but keep using nonce given by the server
+        string                    sessionKey = string( user ) + ':' + nonce;
+        unsigned long             nonceCount = strtoul( nc, nullptr, 16 );
+        AuthSessionsMap::iterator itSession  = AuthSessions.find( sessionKey );
+        bool                      userFound  = false;
+        char                      ha1[33]    = { 0 };
+        UserGroup                 group      = UserGroup::Anyone;
+
+        // nonce count must grow with every request of the session, so a captured request can not be replayed
+        if ( ( itSession == AuthSessions.end( ) ) || ( nonceCount > itSession->second.LastNonceCount ) )
         {
-            lock_guard<recursive_mutex> lock( DataSync );
+            if ( ( itSession != AuthSessions.end( ) ) && ( itSession->second.UsersVersion == UsersVersion ) )
+            {
+                // the user was looked up already for the session, so only the digest needs to be checked
+                memcpy( ha1, itSession->second.Ha1, sizeof( ha1 ) );
+                group     = itSession->second.Group;
+                userFound = true;
+            }
+            else
+            {
+                lock_guard<recursive_mutex> lock( DataSync );
+                UsersMap::const_iterator    itUser = Users.find( user );
 
-            // first find the user
-            UsersMap::const_iterator itUser = Users.find( user );
+                if ( ( itUser != Users.end( ) ) && ( itUser->second.first.length( ) == 32 ) )
+                {
+                    memcpy( ha1, itUser->second.first.c_str( ), sizeof( ha1 ) );
+                    group     = itUser->second.second;
+                    userFound = true;
+                }
+            }
+        }
 
-            if ( itUser != Users.end( ) )
+        if ( userFound )
+        {
+            char ha2[33];
+
+            // HA2 = MD5( method:digestURI )
+            cs_md5( ha2, msg->method.p, static_cast<size_t>( msg->method.len ),
+                         ":", static_cast<size_t>( 1 ),
+                         msg->uri.p, static_cast<size_t>( msg->uri.len + ( msg->query_string.len ? msg->query_string.len + 1 : 0 ) ),
+                         nullptr );
+
+            // response = MD5( HA1:nonce:nonceCount:cnonce:qop:HA2 )
+            cs_md5( expectedResponse1, 
+                    ha1, static_cast<size_t>( 32 ), // HA1 of the user
+                    ":", static_cast<size_t>( 1 ),
+                    nonce, strlen( nonce ),
+                    ":", static_cast<size_t>( 1 ),
+                    nc, strlen( nc ),
+                    ":", static_cast<size_t>( 1 ),
+                    cnonce, strlen( cnonce ),
+                    ":", static_cast<size_t>( 1 ),
+                    qop, strlen( qop ),
+                    ":", static_cast<size_t>( 1 ),
+                    ha2, static_cast<size_t>( 32 ),
+                    nullptr );
+
+            if ( msg->query_string.len != 0 )
             {
-                char ha2[33];
+                // Found some clients (like .NET's HttpWebRequest), which calculate HA2 using URI without query part.
+                // So need to calculate both variant, to make all clients happy.
 
-                // HA2 = MD5( method:digestURI )
                 cs_md5( ha2, msg->method.p, static_cast<size_t>( msg->method.len ),
-                             ":", static_cast<size_t>( 1 ),
-                             msg->uri.p, static_cast<size_t>( msg->uri.len + ( msg->query_string.len ? msg->query_string.len + 1 : 0 ) ),
-                             nullptr );
+                        ":", static_cast<size_t>( 1 ),
+                        msg->uri.p, static_cast<size_t>( msg->uri.len ),
+                        nullptr );
 
-                // response = MD5( HA1:nonce:nonceCount:cnonce:qop:HA2 )
-                cs_md5( expectedResponse1, 
-                        itUser->second.first.c_str( ), itUser->second.first.length( ), // HA1 of the user
+                cs_md5( expectedResponse2,
+                        ha1, static_cast<size_t>( 32 ), // HA1 of the user
                         ":", static_cast<size_t>( 1 ),
                         nonce, strlen( nonce ),
                         ":", static_cast<size_t>( 1 ),
@@ -864,36 +1793,43 @@ UserGroup XWebServerData::CheckDigestAuth( struct http_message* msg )
                         ":", static_cast<size_t>( 1 ),
                         ha2, static_cast<size_t>( 32 ),
                         nullptr );
+            }
+
+            if ( ( strcmp( response, expectedResponse1 ) == 0 ) ||
+                 ( ( msg->query_string.len != 0 ) && ( strcmp( response, expectedResponse2 ) == 0 ) ) )
+            {
+                userGroup = group;
 
-                if ( msg->query_string.len != 0 )
+                if ( itSession != AuthSessions.end( ) )
                 {
-                    // Found some clients (like .NET's HttpWebRequest), which calculate HA2 using URI without query part.
-                    // So need to calculate both variant, to make all clients happy.
-
-                    cs_md5( ha2, msg->method.p, static_cast<size_t>( msg->method.len ),
-                            ":", static_cast<size_t>( 1 ),
-                            msg->uri.p, static_cast<size_t>( msg->uri.len ),
-                            nullptr );
-
-                    cs_md5( expectedResponse2,
-                            itUser->second.first.c_str( ), itUser->second.first.length( ), // HA1 of the user
-                            ":", static_cast<size_t>( 1 ),
-                            nonce, strlen( nonce ),
-                            ":", static_cast<size_t>( 1 ),
-                            nc, strlen( nc ),
-                            ":", static_cast<size_t>( 1 ),
-                            cnonce, strlen( cnonce ),
-                            ":", static_cast<size_t>( 1 ),
-                            qop, strlen( qop ),
-                            ":", static_cast<size_t>( 1 ),
-                            ha2, static_cast<size_t>( 32 ),
-                            nullptr );
+                    AuthSession& session = itSession->second;
+
+                    // update the session in place, it may be outdated by changes of users
+                    memcpy( session.Ha1, ha1, sizeof( ha1 ) );
+                    session.Group          = group;
+                    session.LastNonceCount = nonceCount;
+                    session.UsersVersion   = UsersVersion;
+                    session.LastUseTime    = steady_clock::now( );
                 }
-
-                if ( ( strcmp( response, expectedResponse1 ) == 0 ) ||
-                     ( ( msg->query_string.len != 0 ) && ( strcmp( response, expectedResponse2 ) == 0 ) ) )
+                else
                 {
-                    userGroup = itUser->second.second;
+                    // remember the session, evicting the one not used for the longest time if there are too many
+                    if ( AuthSessions.size( ) >= MAX_AUTH_SESSIONS )
+                    {
+                        AuthSessionsMap::iterator itOldest = AuthSessions.begin( );
+
+                        for ( AuthSessionsMap::iterator it = AuthSessions.begin( ); it != AuthSessions.end( ); it++ )
+                        {
+                            if ( it->second.LastUseTime < itOldest->second.LastUseTime )
+                            {
+                                itOldest = it;
+                            }
+                        }
+
+                        AuthSessions.erase( itOldest );
+                    }
+
+                    AuthSessions.insert( AuthSessionsMap::value_type( sessionKey, AuthSession( ha1, group, nonceCount, UsersVersion ) ) );
                 }
             }
         }
@@ -905,7 +1841,9 @@ UserGroup XWebServerData::CheckDigestAuth( struct http_message* msg )
 // Mangoose web server event handler
 void XWebServerData::eventHandler( struct mg_connection* connection, int event, void* param )
 {
-    XWebServerData* self = (XWebServerData*) connection->mgr->user_data;
+    XWebServerData*          self       = (XWebServerData*) connection->mgr->user_data;
+    steady_clock::time_point eventStart = steady_clock::now( );
+    XTraceScope              traceScope( ( event != MG_EV_POLL ) ? "web.event" : nullptr );
 
     static bool isAuth = false;
 
@@ -914,36 +1852,50 @@ void XWebServerData::eventHandler( struct mg_connection* connection, int event,
         struct http_message* message = static_cast<struct http_message*>( param );
         MangooseWebRequest   request( message );
         MangooseWebResponse  response( connection );
-        string               uri = request.Uri( );
         UserGroup            authUserGroup = self->CheckDigestAuth( message );
 
-        // make sure nothing finishes with / except the root
-        while ( ( uri.back( ) == '/' ) && ( uri.length( ) != 1 ) )
-        {
-            uri.pop_back( );
-        }
-
         // try finding handler for the URI
-        RequestHandlerData* handlerData = self->FindHandler( uri );
+        RequestHandlerData* handlerData = self->FindHandler( message->uri );
 
         if ( handlerData != nullptr )
         {
+            bool                     useWorkerThread = ( ( !self->WorkerThreads.empty( ) ) && ( handlerData->Handler->CanHandleOnWorkerThread( ) ) );
+            steady_clock::time_point startTime       = steady_clock::now( );
+
+            ConnectionData::Get( connection )->SetMetrics( handlerData->Metrics );
+
             if ( static_cast<int>( authUserGroup ) < static_cast<int>( handlerData->AllowedUserGroup ) )
             {
                 http_send_digest_auth_request( connection, self->ActiveAuthDomain.c_str( ) );
             }
+            else if ( ( useWorkerThread ) ||
+                      ( ( connection->user_data != nullptr ) && ( !static_cast<ConnectionData*>( connection->user_data )->Jobs.empty( ) ) ) )
+            {
+                // get the request handled on a worker thread or wait for the previous request of the connection
+                // to complete, so responses don't get mixed
+                ConnectionData::Get( connection )->Jobs.push_back( make_shared<WorkerJob>( handlerData->Handler, handlerData->Metrics,
+                                                                                           message, useWorkerThread ) );
+                self->ProcessJobs( connection );
+
+                handlerData->Metrics->MarkAccess( );
+            }
             else
             {
                 response.SetHandler( handlerData->Handler.get( ) );
                 // handle request with the found handler
                 handlerData->Handler->HandleHttpRequest( request, response );
 
-                handlerData->WasAccessed    = true;
-                handlerData->LastAccessTime = steady_clock::now( );
+                handlerData->Metrics->MarkAccess( );
+                handlerData->Metrics->AddRequest( startTime );
             }
         }
         else if ( self->ActiveDocumentRoot )
         {
+            if ( connection->user_data != nullptr )
+            {
+                static_cast<ConnectionData*>( connection->user_data )->SetMetrics( nullptr );
+            }
+
             // use static content
             mg_serve_http( connection, message, self->ServerOptions );
         }
@@ -953,23 +1905,396 @@ void XWebServerData::eventHandler( struct mg_connection* connection, int event,
             response.SendError( 404 );
         }
     }
-    else if ( event == MG_EV_TIMER )
+    else if ( event == MG_EV_WEBSOCKET_HANDSHAKE_REQUEST )
     {
-        if ( connection->user_data != nullptr )
+        struct http_message* message = static_cast<struct http_message*>( param );
+        MangooseWebRequest   request( message );
+        MangooseWebResponse  response( connection );
+        RequestHandlerData*  handlerData = self->FindHandler( message->uri );
+
+        // sending any response rejects WebSocket handshake
+        if ( ( handlerData == nullptr ) || ( !handlerData->Handler->CanHandleWebSocket( ) ) )
+        {
+            response.SendError( 404 );
+        }
+        else if ( static_cast<int>( self->CheckDigestAuth( message ) ) < static_cast<int>( handlerData->AllowedUserGroup ) )
         {
-            IWebRequestHandler* handler = static_cast<IWebRequestHandler*>( connection->user_data );
-            MangooseWebResponse response( connection, handler );
+            http_send_digest_auth_request( connection, self->ActiveAuthDomain.c_str( ) );
+            connection->flags |= MG_F_SEND_AND_CLOSE;
+        }
+        else
+        {
+            ConnectionData* data = ConnectionData::Get( connection );
 
-            connection->user_data = nullptr;
+            response.SetHandler( handlerData->Handler.get( ) );
+            handlerData->Handler->HandleWebSocketConnect( request, response );
+
+            data->WebSocketHandler = handlerData;
+            data->SetMetrics( handlerData->Metrics );
+
+            handlerData->Metrics->MarkAccess( );
+        }
+    }
+    else if ( event == MG_EV_WEBSOCKET_FRAME )
+    {
+        RequestHandlerData* handlerData = ( connection->user_data == nullptr ) ? nullptr :
+                                            static_cast<ConnectionData*>( connection->user_data )->WebSocketHandler;
+
+        if ( handlerData != nullptr )
+        {
+            struct websocket_message* message   = static_cast<struct websocket_message*>( param );
+            MangooseWebResponse       response( connection, handlerData->Handler.get( ) );
+            steady_clock::time_point  startTime = steady_clock::now( );
+
+            handlerData->Handler->HandleWebSocketMessage( message->data, message->size,
+                                                          ( ( message->flags & 0x0F ) == WEBSOCKET_OP_BINARY ), response );
+
+            handlerData->Metrics->MarkAccess( );
+            handlerData->Metrics->AddRequest( startTime );
+        }
+    }
+    else if ( event == MG_EV_TIMER )
+    {
+        timerHandler( connection );
+    }
+    else if ( event == MG_EV_SEND )
+    {
+        int sent = *static_cast<int*>( param );
+
+        if ( ( sent > 0 ) && ( connection->user_data != nullptr ) &&
+             ( static_cast<ConnectionData*>( connection->user_data )->Metrics ) )
+        {
+            static_cast<ConnectionData*>( connection->user_data )->Metrics->BytesSent += sent;
+        }
+    }
+    else if ( event == MG_EV_CLOSE )
+    {
+        if ( ( connection->user_data != nullptr ) &&
+             ( static_cast<ConnectionData*>( connection->user_data )->WebSocketHandler != nullptr ) )
+        {
+            RequestHandlerData* handlerData = static_cast<ConnectionData*>( connection->user_data )->WebSocketHandler;
+            MangooseWebResponse response( connection, handlerData->Handler.get( ) );
 
-            handler->HandleTimer( response );
+            handlerData->Handler->HandleWebSocketClose( response );
         }
+
+        ConnectionData::Release( connection );
+    }
+
+    if ( ( event != MG_EV_CLOSE ) && ( connection->user_data != nullptr ) )
+    {
+        ConnectionData::FlushSendQueue( connection );
     }
 
     if ( ( event != MG_EV_POLL ) && ( event != MG_EV_CLOSE ) )
     {
         self->WasAccessed    = true;
-        self->LastAccessTime = steady_clock::now( );
+        self->LastAccessTime = steady_clock::now( ).time_since_epoch( ).count( );
+    }
+
+    if ( event != MG_EV_POLL )
+    {
+        self->EventHandlingTime.Add( static_cast<uint64_t>( duration_cast<microseconds>( steady_clock::now( ) - eventStart ).count( ) ) );
+    }
+}
+
+// Let handler, which set the timer for the connection, handle its event
+void XWebServerData::timerHandler( struct mg_connection* connection )
+{
+    if ( ( connection->user_data != nullptr ) &&
+         ( static_cast<ConnectionData*>( connection->user_data )->TimerHandler != nullptr ) )
+    {
+        ConnectionData*     data    = static_cast<ConnectionData*>( connection->user_data );
+        IWebRequestHandler* handler = data->TimerHandler;
+        MangooseWebResponse response( connection, handler );
+
+        data->TimerHandler = nullptr;
+
+        handler->HandleTimer( response );
+    }
+}
+
+// Ask all running web servers to generate timer events for connections waiting for the handler's timer
+void XWebServerData::TriggerTimers( IWebRequestHandler* handler )
+{
+    lock_guard<mutex> serversLock( RunningServersSync );
+
+    for ( auto server : RunningServers )
+    {
+        // the message is handled by polling thread for every connection (returns once done)
+        mg_broadcast( &server->EventManager, triggerTimerHandler, &handler, sizeof( handler ) );
+    }
+}
+
+// Generate timer event for the connection if it waits for timer of the specified handler
+void XWebServerData::triggerTimerHandler( struct mg_connection* connection, int /* event */, void* param )
+{
+    IWebRequestHandler* handler = *static_cast<IWebRequestHandler**>( param );
+
+    if ( ( connection->user_data != nullptr ) &&
+         ( static_cast<ConnectionData*>( connection->user_data )->TimerHandler == handler ) )
+    {
+        steady_clock::time_point eventStart = steady_clock::now( );
+
+        // cancel the timer, which is handled now
+        mg_set_timer( connection, 0 );
+
+        timerHandler( connection );
+        ConnectionData::FlushSendQueue( connection );
+
+        static_cast<XWebServerData*>( connection->mgr->user_data )->EventHandlingTime.Add(
+            static_cast<uint64_t>( duration_cast<microseconds>( steady_clock::now( ) - eventStart ).count( ) ) );
+    }
+}
+
+// Start threads to handle requests, which don't need to be handled on polling thread
+void XWebServerData::StartWorkers( uint32_t count )
+{
+    NeedToStopWorkers = false;
+
+    for ( uint32_t i = 0; i < count; i++ )
+    {
+        WorkerThreads.push_back( thread( workerHandler, this ) );
+    }
+}
+
+// Stop worker threads, discarding requests they did not get to (must be done when polling thread is gone)
+void XWebServerData::StopWorkers( )
+{
+    {
+        lock_guard<mutex> lock( JobsSync );
+        NeedToStopWorkers = true;
+    }
+    JobsAvailable.notify_all( );
+
+    for ( auto& worker : WorkerThreads )
+    {
+        worker.join( );
+    }
+
+    WorkerThreads.clear( );
+    JobsQueue.clear( );
+}
+
+// Handle pending requests of the connection in the order they came, till the one which is still on a worker thread
+void XWebServerData::ProcessJobs( struct mg_connection* connection )
+{
+    ConnectionData* data = ConnectionData::Get( connection );
+
+    while ( !data->Jobs.empty( ) )
+    {
+        shared_ptr<WorkerJob> job = data->Jobs.front( );
+        MangooseWebResponse   response( connection, job->Handler.get( ) );
+
+        if ( !job->UseWorkerThread )
+        {
+            MangooseWebRequest request( &job->Message.Message );
+
+            job->Handler->HandleHttpRequest( request, response );
+        }
+        else if ( !job->IsQueued )
+        {
+            job->IsQueued = true;
+            job->Response.SetInitialUserData( data->UserData );
+
+            {
+                lock_guard<mutex> lock( JobsSync );
+                JobsQueue.push_back( job );
+            }
+            JobsAvailable.notify_one( );
+            break;
+        }
+        else
+        {
+            {
+                lock_guard<mutex> lock( JobsSync );
+
+                if ( !job->IsCompleted )
+                {
+                    break;
+                }
+            }
+
+            job->Response.Apply( response );
+        }
+
+        job->Metrics->AddRequest( job->StartTime );
+        data->Jobs.pop_front( );
+    }
+}
+
+// Handle requests queued for worker threads
+void XWebServerData::workerHandler( XWebServerData* self )
+{
+    XTrace::SetThreadName( "web worker" );
+
+    for ( ; ; )
+    {
+        shared_ptr<WorkerJob> job;
+
+        {
+            unique_lock<mutex> lock( self->JobsSync );
+
+            self->JobsAvailable.wait( lock, [self] { return ( self->NeedToStopWorkers ) || ( !self->JobsQueue.empty( ) ); } );
+
+            if ( self->NeedToStopWorkers )
+            {
+                break;
+            }
+
+            job = self->JobsQueue.front( );
+            self->JobsQueue.pop_front( );
+        }
+
+        {
+            XTraceScope        traceScope( "web.worker_request" );
+            MangooseWebRequest request( &job->Message.Message );
+
+            job->Handler->HandleHttpRequest( request, job->Response );
+        }
+
+        {
+            lock_guard<mutex> lock( self->JobsSync );
+            job->IsCompleted = true;
+        }
+
+        {
+            lock_guard<mutex> serversLock( RunningServersSync );
+
+            // let polling thread send the response (unless it is already gone)
+            if ( find( RunningServers.begin( ), RunningServers.end( ), self ) != RunningServers.end( ) )
+            {
+                mg_broadcast( &self->EventManager, completedJobsHandler, &self, sizeof( self ) );
+            }
+        }
+    }
+}
+
+// Send responses of the connection's requests completed by worker threads
+void XWebServerData::completedJobsHandler( struct mg_connection* connection, int /* event */, void* /* param */ )
+{
+    if ( ( connection->user_data != nullptr ) &&
+         ( !static_cast<ConnectionData*>( connection->user_data )->Jobs.empty( ) ) )
+    {
+        XWebServerData*          self       = static_cast<XWebServerData*>( connection->mgr->user_data );
+        steady_clock::time_point eventStart = steady_clock::now( );
+
+        self->ProcessJobs( connection );
+        ConnectionData::FlushSendQueue( connection );
+
+        self->EventHandlingTime.Add( static_cast<uint64_t>( duration_cast<microseconds>( steady_clock::now( ) - eventStart ).count( ) ) );
+    }
+}
+
+// Update statistics of handlers' send queues from the data waiting to be sent over their connections
+void XWebServerData::UpdateQueueStats( )
+{
+    map<HandlerMetrics*, pair<uint64_t, uint64_t>> queues;
+
+    for ( struct mg_connection* connection = mg_next( &EventManager, nullptr ); connection != nullptr;
+          connection = mg_next( &EventManager, connection ) )
+    {
+        if ( ( connection->user_data != nullptr ) &&
+             ( static_cast<ConnectionData*>( connection->user_data )->Metrics ) )
+        {
+            ConnectionData*           data   = static_cast<ConnectionData*>( connection->user_data );
+            uint64_t                  queued = connection->send_mbuf.len + data->QueuedLength;
+            pair<uint64_t, uint64_t>& stats  = queues[data->Metrics.get( )];
+
+            stats.first  += queued;
+            stats.second  = std::max( stats.second, queued );
+        }
+    }
+
+    for ( auto& fileHandler : ActiveFileHandlers )
+    {
+        fileHandler.second.Metrics->QueuedBytes    = queues[fileHandler.second.Metrics.get( )].first;
+        fileHandler.second.Metrics->MaxQueuedBytes = queues[fileHandler.second.Metrics.get( )].second;
+    }
+    for ( auto& folderHandler : ActiveFolderHandlers )
+    {
+        folderHandler.Metrics->QueuedBytes    = queues[folderHandler.Metrics.get( )].first;
+        folderHandler.Metrics->MaxQueuedBytes = queues[folderHandler.Metrics.get( )].second;
+    }
+}
+
+// Check if the last socket error is only about socket not being ready for writing
+static bool IsSocketBusy( )
+{
+#ifdef WIN32
+    int err = WSAGetLastError( );
+    return ( ( err == WSAEWOULDBLOCK ) || ( err == WSAEINTR ) );
+#else
+    return ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) || ( errno == EINTR ) );
+#endif
+}
+
+// Write as much of the enqueued shared data directly into connection's socket as it accepts
+void ConnectionData::FlushSendQueue( struct mg_connection* connection )
+{
+    ConnectionData* data = static_cast<ConnectionData*>( connection->user_data );
+    XTraceScope     traceScope( ( !data->SendQueue.empty( ) ) ? "web.send" : nullptr );
+
+    // shared buffers go after anything mongoose still has in its own buffer
+    while ( ( connection->send_mbuf.len == 0 ) && ( !data->SendQueue.empty( ) ) &&
+            ( ( connection->flags & MG_F_CLOSE_IMMEDIATELY ) == 0 ) )
+    {
+        SharedBuffer& buffer = data->SendQueue.front( );
+        int           sent   = static_cast<int>( send( connection->sock, reinterpret_cast<const char*>( buffer.Data ),
+                                                       buffer.Length, MSG_NOSIGNAL ) );
+
+        if ( sent < 0 )
+        {
+            if ( !IsSocketBusy( ) )
+            {
+                connection->flags |= MG_F_CLOSE_IMMEDIATELY;
+                break;
+            }
+
+            // socket is not ready, so put a bit of the data into connection's buffer
+            // to make mongoose wait till it becomes writable
+            sent = static_cast<int>( ( buffer.Length < SHARED_DATA_PRIME_SIZE ) ? buffer.Length : SHARED_DATA_PRIME_SIZE );
+            mg_send( connection, buffer.Data, sent );
+        }
+        else
+        {
+            connection->last_io_time = (time_t) mg_time( );
+
+            if ( data->Metrics )
+            {
+                data->Metrics->BytesSent += sent;
+            }
+        }
+
+        buffer.Data        += sent;
+        buffer.Length      -= sent;
+        data->QueuedLength -= sent;
+
+        if ( buffer.Length == 0 )
+        {
+            data->SendQueue.pop_front( );
+        }
+    }
+
+    if ( connection->flags & MG_F_CLOSE_IMMEDIATELY )
+    {
+        data->SendQueue.clear( );
+        data->QueuedLength = 0;
+    }
+
+    // don't let mongoose close the connection while shared data is still waiting to be sent
+    if ( !data->SendQueue.empty( ) )
+    {
+        if ( connection->flags & MG_F_SEND_AND_CLOSE )
+        {
+            connection->flags  &= ~MG_F_SEND_AND_CLOSE;
+            data->CloseWhenSent = true;
+        }
+    }
+    else if ( data->CloseWhenSent )
+    {
+        connection->flags  |= MG_F_SEND_AND_CLOSE;
+        data->CloseWhenSent = false;
     }
 }
 
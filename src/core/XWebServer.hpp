@@ -28,6 +28,7 @@
 #include <chrono>
 
 #include "XInterfaces.hpp"
+#include "XHistogram.hpp"
 
 namespace Private
 {
@@ -58,6 +59,9 @@ public:
 
     virtual std::string GetVariable( const std::string& name ) const = 0;
 
+    // Get value of the specified header (case insensitive name), empty string if it is not present
+    virtual std::string GetHeader( const std::string& name ) const = 0;
+
     virtual std::map<std::string, std::string> Headers( ) const = 0;
 };
 
@@ -75,16 +79,29 @@ public:
     virtual void Send( const uint8_t* buffer, size_t length ) = 0;
     virtual void Printf( const char* fmt, ... ) = 0;
 
+    // Enqueue the specified buffer for sending without copying it. The owner object
+    // is referenced until the buffer is completely written into the connection's socket,
+    // so it must keep the buffer unchanged for all that time.
+    virtual void SendShared( const std::shared_ptr<const void>& owner, const uint8_t* buffer, size_t length ) = 0;
+
     virtual void SendChunk( const uint8_t* buffer, size_t length ) = 0;
     virtual void PrintfChunk( const char* fmt, ... ) = 0;
 
     virtual void SendError( int errorCode, const char* reason = nullptr ) = 0;
 
+    // Send message over WebSocket connection (must not be mixed with SendShared)
+    virtual void SendWebSocketMessage( const uint8_t* buffer, size_t length, bool binary = true ) = 0;
+
     virtual void CloseConnection( ) = 0;
 
     // Generate timer event for the connection associated with the response
     // after the specified number of milliseconds
     virtual void SetTimer( uint32_t msec ) = 0;
+
+    // Get/Set handler's data associated with the connection of the response,
+    // which are kept until the connection is closed
+    virtual std::shared_ptr<void> UserData( ) const = 0;
+    virtual void SetUserData( const std::shared_ptr<void>& userData ) = 0;
 };
 
 /* ================================================================= */
@@ -107,11 +124,65 @@ public:
     // Handle timer event
     virtual void HandleTimer( IWebResponse& ) { };
 
+    // Check if requests can be handled on one of the web server's worker threads (if it has any) instead of
+    // its polling thread. Such handlers must be thread safe. Their response is buffered and sent only once
+    // HandleHttpRequest() is done, while timer events are still handled on the polling thread.
+    virtual bool CanHandleOnWorkerThread( ) const { return false; }
+
+    // Check if the handler accepts WebSocket connections, which get handled by the methods below
+    virtual bool CanHandleWebSocket( ) const { return false; }
+
+    // Handle request to establish WebSocket connection - the handler may reject it by sending an error
+    virtual void HandleWebSocketConnect( const IWebRequest&, IWebResponse& ) { };
+    // Handle message received over WebSocket connection
+    virtual void HandleWebSocketMessage( const uint8_t* /* data */, size_t /* length */, bool /* binary */, IWebResponse& ) { };
+    // Handle closing of WebSocket connection
+    virtual void HandleWebSocketClose( IWebResponse& ) { };
+
+    // Generate timer events right away for all connections waiting for timer event of this handler,
+    // so new data could be pushed to clients without waiting for timers to expire. Can be called from
+    // any thread other than web server's one (i.e. not from handling requests/timers).
+    void TriggerTimers( );
+
 private:
     std::string mUri;
     bool        mCanHandleSubContent;
 };
 
+/* ================================================================= */
+/* Statistics of a web request handler                               */
+/* ================================================================= */
+class XWebHandlerStats
+{
+public:
+    // Upper bounds (inclusive, microseconds) of the latency histogram buckets - the last bucket takes the rest
+    static const uint32_t LatencyBucketsCount = 10;
+    static const uint32_t LatencyBucketBounds[LatencyBucketsCount - 1];
+
+    // Get index of the latency histogram bucket for the specified latency (microseconds)
+    static uint32_t LatencyBucket( uint64_t latency );
+
+    // Time of the last access to the handler and if it was accessed at all
+    std::chrono::steady_clock::time_point LastAccessTime;
+    bool     WasAccessed;
+    // Number of handled requests (WebSocket messages count as requests as well)
+    uint64_t RequestsCount;
+    // Number of bytes sent over connections of the handler
+    uint64_t BytesSent;
+    // Number of open connections, which are served by the handler
+    uint32_t ActiveConnections;
+    // Number of bytes waiting to be sent over all connections of the handler and the biggest of
+    // those queues (updated periodically)
+    uint64_t QueuedBytes;
+    uint64_t MaxQueuedBytes;
+    // Number of requests by time taken to handle them and total time (microseconds) of handling all of them
+    uint64_t LatencyHistogram[LatencyBucketsCount];
+    uint64_t LatencySum;
+
+public:
+    XWebHandlerStats( );
+};
+
 /* ================================================================= */
 /* Definition of embedded content                                    */
 /* ================================================================= */
@@ -120,6 +191,11 @@ typedef struct
     uint32_t       Length;
     const char*    Type;
     const uint8_t* Body;
+    // optional gzip compressed variant of the body
+    uint32_t       GzipLength;
+    const uint8_t* GzipBody;
+    // optional entity tag (without quotes) to let clients cache the content
+    const char*    ETag;
 }
 XEmbeddedContent;
 
@@ -131,7 +207,7 @@ class XEmbeddedContentHandler : public IWebRequestHandler
 public:
     XEmbeddedContentHandler( const std::string& uri, const XEmbeddedContent* content );
 
-    // Handle request providing given embedded content
+    // Handle request providing given embedded content (compressed if client accepts it)
     void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
 
 private:
@@ -165,6 +241,11 @@ public:
     uint16_t Port( ) const;
     XWebServer& SetPort( uint16_t port );
 
+    // Get/Set number of worker threads to handle requests of those handlers, which allow it
+    // (0 - all requests are handled on the polling thread)
+    uint32_t WorkerThreadsCount( ) const;
+    XWebServer& SetWorkerThreadsCount( uint32_t count );
+
     // Add/Remove web handler
     XWebServer& AddHandler( const std::shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup = UserGroup::Anyone );
     void RemoveHandler( const std::shared_ptr<IWebRequestHandler>& handler );
@@ -183,6 +264,14 @@ public:
     // Get time of the last access/request to the specified handler
     std::chrono::steady_clock::time_point LastAccessTime( const std::string& handlerUri, bool* pWasAccessed = nullptr );
 
+    // Get statistics of the specified handler (returns false if there is no such handler)
+    bool HandlerStats( const std::string& handlerUri, XWebHandlerStats& stats );
+    // Get statistics of all handlers of the running (or the last run) web server
+    std::map<std::string, XWebHandlerStats> HandlersStats( );
+
+    // Get histogram of time (microseconds) taken by polling thread to handle network events, requests and timers
+    const XHistogram& EventHandlingTimeHistogram( ) const;
+
     // Add/Remove user to access protected request handlers
     XWebServer& AddUser( const std::string& name, const std::string& digestHa1, UserGroup group );
     void RemoveUser( const std::string& name );
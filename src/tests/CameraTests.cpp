@@ -0,0 +1,237 @@
+/*
+    tests - unit tests of PiRexBot core classes
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include "Tests.hpp"
+#include "FakeMmal.hpp"
+#include "XRaspiCamera.hpp"
+#include "XRaspiCameraConfig.hpp"
+#include "XImage.hpp"
+
+using namespace std;
+
+namespace
+{
+    // Listener keeping the first image it gets, while releasing all others right away
+    class ImageKeeper : public IVideoSourceListener
+    {
+    public:
+        mutex                    Sync;
+        shared_ptr<const XImage> Image;
+        uint32_t                 ImagesCount;
+        string                   Errors;
+
+        ImageKeeper( ) : Sync( ), Image( ), ImagesCount( 0 ), Errors( ) { }
+
+        void OnNewImage( const shared_ptr<const XImage>& image )
+        {
+            lock_guard<mutex> lock( Sync );
+
+            if ( ImagesCount++ == 0 )
+            {
+                Image = image;
+            }
+        }
+
+        void OnError( const string& errorMessage, bool )
+        {
+            lock_guard<mutex> lock( Sync );
+            Errors += errorMessage + "\n";
+        }
+
+        shared_ptr<const XImage> TakeImage( )
+        {
+            lock_guard<mutex>        lock( Sync );
+            shared_ptr<const XImage> image = Image;
+
+            Image.reset( );
+            return image;
+        }
+    };
+
+    // Wait till running camera applies the specified number of reconfigurations
+    bool WaitForReconfigurations( const shared_ptr<XRaspiCamera>& camera, uint32_t count )
+    {
+        for ( int i = 0; ( i < 300 ) && ( camera->ReconfigurationsCount( ) < count ); i++ )
+        {
+            this_thread::sleep_for( chrono::milliseconds( 10 ) );
+        }
+
+        return ( camera->ReconfigurationsCount( ) == count );
+    }
+}
+
+TEST( CameraImageReleasedAfterCleanup )
+{
+    shared_ptr<XRaspiCamera> camera = XRaspiCamera::Create( );
+    ImageKeeper              listener;
+    shared_ptr<const XImage> image;
+    FakeMmal::Stats          stats;
+
+    FakeMmal::Reset( );
+
+    camera->EnableZeroCopy( true );
+    camera->SetListener( &listener );
+    CHECK( camera->Start( ) );
+
+    CHECK( FakeMmal::WaitForOutput( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, 0, 2000 ) );
+    CHECK( FakeMmal::DeliverFrame( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, 0, 1000, 0x5A ) );
+
+    image = listener.TakeImage( );
+    CHECK( image );
+    CHECK( ( image ) && ( image->Width( ) == 1000 ) && ( image->Data( )[0] == 0x5A ) );
+
+    // image outlives camera's pipeline, so keeps the pool of its buffer alive
+    camera->SignalToStop( );
+    camera->WaitForStop( );
+
+    stats = FakeMmal::GetStats( );
+    CHECK( stats.LiveComponents == 0 );
+    CHECK( stats.LivePools == 1 );
+
+    image.reset( );
+
+    stats = FakeMmal::GetStats( );
+    CHECK( stats.LivePools == 0 );
+    CHECK( stats.DeadPortUses == 0 );
+    CHECK( stats.DeadPoolUses == 0 );
+    CHECK( listener.Errors.empty( ) );
+
+    camera->SetListener( nullptr );
+}
+
+TEST( CameraImageReleasedAfterReconfiguration )
+{
+    shared_ptr<XRaspiCamera> camera = XRaspiCamera::Create( );
+    ImageKeeper              listener;
+    shared_ptr<const XImage> image;
+    FakeMmal::Stats          stats;
+    MMAL_VIDEO_FORMAT_T      format = { };
+
+    FakeMmal::Reset( );
+
+    camera->EnableZeroCopy( true );
+    camera->SetListener( &listener );
+    CHECK( camera->Start( ) );
+
+    CHECK( FakeMmal::WaitForOutput( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, 0, 2000 ) );
+    CHECK( FakeMmal::DeliverFrame( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, 0, 1000, 1 ) );
+    image = listener.TakeImage( );
+    CHECK( image );
+
+    // new video size rebuilds the whole pipeline, while the image is still held
+    CHECK( camera->SetVideoSize( 800, 600 ) );
+    CHECK( WaitForReconfigurations( camera, 1 ) );
+    CHECK( FakeMmal::GetOutputFormat( MMAL_COMPONENT_DEFAULT_CAMERA, 1, format ) );
+    CHECK( ( format.crop.width == 800 ) && ( format.crop.height == 600 ) );
+
+    stats = FakeMmal::GetStats( );
+    CHECK( stats.LivePools == 2 );
+
+    image.reset( );
+    CHECK( FakeMmal::GetStats( ).LivePools == 1 );
+
+    // frames keep coming with the new pipeline
+    CHECK( FakeMmal::WaitForOutput( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, 0, 2000 ) );
+    CHECK( FakeMmal::DeliverFrame( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, 0, 1000, 2 ) );
+    image = listener.TakeImage( );
+    CHECK( !image );
+    CHECK( listener.ImagesCount == 2 );
+
+    // new JPEG quality restarts encoder's output only
+    listener.ImagesCount = 0;
+    CHECK( FakeMmal::DeliverFrame( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, 0, 1000, 3 ) );
+    image = listener.TakeImage( );
+    CHECK( image );
+
+    CHECK( camera->SetJpegQuality( 50 ) );
+    CHECK( WaitForReconfigurations( camera, 2 ) );
+    CHECK( FakeMmal::GetStats( ).PoolsCreated == 3 );
+
+    image.reset( );
+    CHECK( FakeMmal::WaitForOutput( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, 0, 2000 ) );
+    CHECK( FakeMmal::DeliverFrame( MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, 0, 1000, 4 ) );
+    CHECK( listener.ImagesCount == 2 );
+
+    camera->SignalToStop( );
+    camera->WaitForStop( );
+
+    stats = FakeMmal::GetStats( );
+    CHECK( stats.LiveComponents == 0 );
+    CHECK( stats.LivePools == 0 );
+    CHECK( stats.DeadPortUses == 0 );
+    CHECK( stats.DeadPoolUses == 0 );
+    CHECK( listener.Errors.empty( ) );
+
+    camera->SetListener( nullptr );
+}
+
+TEST( CameraRejectsOutOfRangeVideoFormat )
+{
+    shared_ptr<XRaspiCamera> camera = XRaspiCamera::Create( );
+
+    // every dimension is checked on its own and nothing changes on failure
+    CHECK( !camera->SetVideoSize( 63, 480 ) );
+    CHECK( !camera->SetVideoSize( 640, 1081 ) );
+    CHECK( ( camera->Width( ) == 640 ) && ( camera->Height( ) == 480 ) );
+    CHECK( camera->SetVideoSize( 1920, 64 ) );
+    CHECK( ( camera->Width( ) == 1920 ) && ( camera->Height( ) == 64 ) );
+
+    CHECK( !camera->SetFrameRate( 0 ) );
+    CHECK( !camera->SetFrameRate( 91 ) );
+    CHECK( camera->FrameRate( ) == 30 );
+    CHECK( camera->SetFrameRate( 90 ) );
+
+    CHECK( !camera->SetJpegQuality( 0 ) );
+    CHECK( !camera->SetJpegQuality( 101 ) );
+    CHECK( camera->JpegQuality( ) == 10 );
+    CHECK( camera->SetJpegQuality( 100 ) );
+}
+
+TEST( CameraConfigReportsVideoFormatFailures )
+{
+    shared_ptr<XRaspiCamera> camera = XRaspiCamera::Create( );
+    XRaspiCameraConfig       config( camera );
+    string                   value;
+
+    // video format properties are not clamped, but rejected instead
+    CHECK( !config.SetProperty( "width", "2000" ) );
+    CHECK( !config.SetProperty( "height", "32" ) );
+    CHECK( !config.SetProperty( "framerate", "31" ) );
+    CHECK( !config.SetProperty( "jpegquality", "0" ) );
+    CHECK( ( camera->Width( ) == 640 ) && ( camera->Height( ) == 480 ) );
+    CHECK( ( camera->FrameRate( ) == 30 ) && ( camera->JpegQuality( ) == 10 ) );
+
+    CHECK( config.SetProperty( "width", "1920" ) );
+    CHECK( config.SetProperty( "height", "1080" ) );
+    CHECK( config.GetProperty( "width", value ) );
+    CHECK( value == "1920" );
+    CHECK( camera->Height( ) == 1080 );
+
+    // other integer properties are still clamped
+    CHECK( config.SetProperty( "brightness", "1000" ) );
+    CHECK( camera->GetBrightness( ) == 100 );
+}
@@ -0,0 +1,210 @@
+/*
+    tests - unit tests of PiRexBot core classes
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdarg.h>
+#include <string>
+#include <map>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+#include "Tests.hpp"
+#include "XObjectConfigurationRequestHandler.hpp"
+#include "XSimpleJsonParser.hpp"
+
+using namespace std;
+
+namespace
+{
+    // Request with the specified method and variables
+    class FakeRequest : public IWebRequest
+    {
+    public:
+        string              MethodName;
+        map<string, string> Variables;
+
+        FakeRequest( const string& method ) : MethodName( method ), Variables( ) { }
+
+        string Uri( )    const { return "/test"; }
+        string Method( ) const { return MethodName; }
+        string Proto( )  const { return "HTTP/1.1"; }
+        string Query( )  const { return ""; }
+        string Body( )   const { return ""; }
+
+        string GetVariable( const string& name ) const
+        {
+            auto it = Variables.find( name );
+            return ( it != Variables.end( ) ) ? it->second : string( );
+        }
+        string GetHeader( const string& ) const { return ""; }
+        map<string, string> Headers( ) const { return map<string, string>( ); }
+    };
+
+    // Response collecting everything sent
+    class FakeResponse : public IWebResponse
+    {
+    public:
+        string Sent;
+        string Messages;
+
+        size_t ToSendDataLength( ) const { return 0; }
+
+        void Send( const uint8_t* buffer, size_t length ) { Sent.append( reinterpret_cast<const char*>( buffer ), length ); }
+        void Printf( const char* fmt, ... )
+        {
+            char    buffer[512];
+            va_list args;
+
+            va_start( args, fmt );
+            vsnprintf( buffer, sizeof( buffer ), fmt, args );
+            va_end( args );
+
+            Sent += buffer;
+        }
+        void SendShared( const shared_ptr<const void>&, const uint8_t* buffer, size_t length ) { Send( buffer, length ); }
+        void SendChunk( const uint8_t* buffer, size_t length ) { Send( buffer, length ); }
+        void PrintfChunk( const char*, ... ) { }
+        void SendError( int, const char* ) { Sent += "error"; }
+        void SendWebSocketMessage( const uint8_t* buffer, size_t length, bool )
+        {
+            Messages.assign( reinterpret_cast<const char*>( buffer ), length );
+        }
+        void CloseConnection( ) { }
+        void SetTimer( uint32_t ) { }
+
+        shared_ptr<void> UserData( ) const { return Data; }
+        void SetUserData( const shared_ptr<void>& userData ) { Data = userData; }
+
+        // body of the reply (after headers)
+        string Body( ) const
+        {
+            size_t pos = Sent.find( "\r\n\r\n" );
+            return ( pos != string::npos ) ? Sent.substr( pos + 4 ) : string( );
+        }
+
+    private:
+        shared_ptr<void> Data;
+    };
+
+    // Information object, which properties can be changed
+    class ChangingInformation : public IObjectInformation
+    {
+    public:
+        PropertyMap Values;
+
+        XError GetProperty( const string& name, string& value ) const
+        {
+            XError ret = XError::UnknownProperty;
+            auto   it  = Values.find( name );
+
+            if ( it != Values.end( ) )
+            {
+                value = it->second;
+                ret   = XError::Success;
+            }
+
+            return ret;
+        }
+        PropertyMap GetAllProperties( ) const { return Values; }
+    };
+
+    // Get members of JSON object
+    map<string, string> Members( const string& json )
+    {
+        map<string, string> values;
+
+        XSimpleJsonParser( json, values );
+
+        return values;
+    }
+}
+
+TEST( BatchInformationProvidesChangesSinceVersion )
+{
+    auto                            info    = make_shared<ChangingInformation>( );
+    XBatchInformationRequestHandler handler( "/test" );
+    FakeRequest                     request( "GET" );
+    FakeResponse                    first, second, third;
+    map<string, string>             reply, values;
+
+    info->Values["a"] = "1";
+    info->Values["b"] = "{\"x\":1}";
+    handler.AddObject( "obj", info );
+
+    handler.HandleHttpRequest( request, first );
+    reply  = Members( first.Body( ) );
+    values = Members( Members( reply["objects"] )["obj"] );
+
+    CHECK( reply["status"] == "OK" );
+    CHECK( values.size( ) == 2 );
+    CHECK( values["a"] == "1" );
+    // serialized JSON values are provided as objects
+    CHECK( values["b"] == "{\"x\":1}" );
+
+    // nothing changed since the version reported - the object is not included
+    request.Variables["since"] = reply["version"];
+    handler.HandleHttpRequest( request, second );
+    CHECK( Members( Members( second.Body( ) )["objects"] ).empty( ) );
+
+    // only changed property is provided
+    info->Values["a"] = "2";
+    handler.HandleHttpRequest( request, third );
+    values = Members( Members( Members( third.Body( ) )["objects"] )["obj"] );
+
+    CHECK( values.size( ) == 1 );
+    CHECK( values["a"] == "2" );
+}
+
+TEST( ObjectsStreamSendsOnlyChanges )
+{
+    auto                         info = make_shared<ChangingInformation>( );
+    XObjectsStreamRequestHandler handler( "/test" );
+    FakeRequest                  request( "GET" );
+    FakeResponse                 response;
+    map<string, string>          values;
+
+    info->Values["a"] = "1";
+    info->Values["b"] = "2";
+    handler.AddObject( "obj", info );
+
+    handler.HandleWebSocketConnect( request, response );
+    handler.HandleTimer( response );
+
+    values = Members( Members( response.Messages )["obj"] );
+    CHECK( values.size( ) == 2 );
+
+    // the first update is sent already - the next one comes after interval regardless of changes
+    info->Values["b"] = "3";
+    info->Values["c"] = "4";
+    response.Messages.clear( );
+    this_thread::sleep_for( chrono::milliseconds( 150 ) );
+    handler.HandleTimer( response );
+
+    values = Members( Members( response.Messages )["obj"] );
+    CHECK( values.size( ) == 2 );
+    CHECK( values["b"] == "3" );
+    CHECK( values["c"] == "4" );
+
+    // nothing changed - no message
+    response.Messages.clear( );
+    this_thread::sleep_for( chrono::milliseconds( 150 ) );
+    handler.HandleTimer( response );
+    CHECK( response.Messages.empty( ) );
+}
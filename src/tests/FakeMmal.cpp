@@ -0,0 +1,770 @@
+/*
+    tests - unit tests of PiRexBot core classes
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include <bcm_host.h>
+#include "FakeMmal.hpp"
+
+using namespace std;
+
+// Queue of free buffers of a pool
+struct MMAL_QUEUE_T
+{
+    deque<MMAL_BUFFER_HEADER_T*> Buffers;
+    bool                         Alive;  // false once the pool is destroyed
+};
+
+namespace
+{
+    struct FakePool;
+
+    struct FakePort
+    {
+        MMAL_PORT_T                  Port;
+        MMAL_ES_FORMAT_T             Format;
+        MMAL_ES_SPECIFIC_FORMAT_T    EsFormat;
+        MMAL_PORT_BH_CB_T            Callback;
+        deque<MMAL_BUFFER_HEADER_T*> Buffers;  // sent to the port to be filled
+        string                       Name;
+        bool                         Alive;
+    };
+
+    struct FakeComponent
+    {
+        MMAL_COMPONENT_T             Component;
+        string                       Name;
+        vector<unique_ptr<FakePort>> Ports;  // control, inputs, outputs
+        vector<MMAL_PORT_T*>         Inputs;
+        vector<MMAL_PORT_T*>         Outputs;
+        bool                         Alive;
+    };
+
+    struct FakeBuffer
+    {
+        MMAL_BUFFER_HEADER_T Header;
+        FakePool*            Pool;
+        uint32_t             RefCount;
+        vector<uint8_t>      Data;
+    };
+
+    struct FakePool
+    {
+        MMAL_POOL_T                    Pool;
+        MMAL_QUEUE_T                   Queue;
+        vector<unique_ptr<FakeBuffer>> Buffers;
+        vector<MMAL_BUFFER_HEADER_T*>  Headers;
+    };
+
+    // Components/ports/connections are guarded by one lock and pools/buffers by another, which is
+    // never held while taking the first one. Destroyed objects are kept till Reset().
+    recursive_mutex                   PortsSync;
+    mutex                             PoolsSync;
+    vector<unique_ptr<FakeComponent>> Components;
+    vector<unique_ptr<FakePool>>      Pools;
+
+    atomic<uint32_t>                  PoolsCreated( 0 );
+    atomic<uint32_t>                  DeadPortUses( 0 );
+    atomic<uint32_t>                  DeadPoolUses( 0 );
+
+    // Add a port to the component
+    MMAL_PORT_T* AddPort( FakeComponent* component, const char* type, uint32_t index )
+    {
+        FakePort* port = new FakePort( );
+
+        port->Name  = component->Name + ":" + type + ":" + to_string( index );
+        port->Alive = true;
+
+        port->Port.priv                    = port;
+        port->Port.name                    = port->Name.c_str( );
+        port->Port.index                   = static_cast<uint16_t>( index );
+        port->Port.format                  = &port->Format;
+        port->Port.buffer_num_min          = 1;
+        port->Port.buffer_num_recommended  = 3;
+        port->Port.buffer_size_min         = 1024;
+        port->Port.buffer_size_recommended = 4096;
+        port->Port.buffer_num              = port->Port.buffer_num_recommended;
+        port->Port.buffer_size             = port->Port.buffer_size_recommended;
+        port->Port.component               = &component->Component;
+        port->Format.es                    = &port->EsFormat;
+
+        component->Ports.push_back( unique_ptr<FakePort>( port ) );
+
+        return &port->Port;
+    }
+
+    // Get fake port of the specified one, counting its use if the port was destroyed (caller holds PortsSync)
+    FakePort* LivePort( MMAL_PORT_T* port )
+    {
+        FakePort* fakePort = ( port != nullptr ) ? static_cast<FakePort*>( port->priv ) : nullptr;
+
+        if ( ( fakePort == nullptr ) || ( !fakePort->Alive ) )
+        {
+            DeadPortUses++;
+            fakePort = nullptr;
+        }
+
+        return fakePort;
+    }
+
+    // Find output port of the most recently created live component with the specified name (caller holds PortsSync)
+    FakePort* FindOutput( const char* componentName, uint32_t outputIndex )
+    {
+        FakePort* port = nullptr;
+
+        for ( auto it = Components.rbegin( ); ( it != Components.rend( ) ) && ( port == nullptr ); ++it )
+        {
+            FakeComponent* component = it->get( );
+
+            if ( ( component->Alive ) && ( component->Name == componentName ) && ( outputIndex < component->Outputs.size( ) ) )
+            {
+                port = static_cast<FakePort*>( component->Outputs[outputIndex]->priv );
+            }
+        }
+
+        return port;
+    }
+
+    // Create pool of the specified number of buffers
+    MMAL_POOL_T* CreatePool( unsigned int headers, uint32_t payloadSize )
+    {
+        lock_guard<mutex> lock( PoolsSync );
+        FakePool*         pool = new FakePool( );
+
+        pool->Queue.Alive = true;
+
+        for ( unsigned int i = 0; i < headers; i++ )
+        {
+            FakeBuffer* buffer = new FakeBuffer( );
+
+            buffer->Pool = pool;
+            buffer->Data.resize( std::max( payloadSize, 1u ) );
+            buffer->Header.priv       = buffer;
+            buffer->Header.data       = buffer->Data.data( );
+            buffer->Header.alloc_size = payloadSize;
+
+            pool->Buffers.push_back( unique_ptr<FakeBuffer>( buffer ) );
+            pool->Headers.push_back( &buffer->Header );
+            pool->Queue.Buffers.push_back( &buffer->Header );
+        }
+
+        pool->Pool.queue       = &pool->Queue;
+        pool->Pool.headers_num = headers;
+        pool->Pool.header      = pool->Headers.data( );
+
+        Pools.push_back( unique_ptr<FakePool>( pool ) );
+        PoolsCreated++;
+
+        return &pool->Pool;
+    }
+
+    // Destroy the pool (its memory is kept, so buffers released later are counted as dead pool uses)
+    void DestroyPool( MMAL_POOL_T* pool )
+    {
+        lock_guard<mutex> lock( PoolsSync );
+
+        if ( ( pool == nullptr ) || ( !pool->queue->Alive ) )
+        {
+            DeadPoolUses++;
+        }
+        else
+        {
+            pool->queue->Alive = false;
+        }
+    }
+
+    // Get fake buffer of the specified one, counting its use if its pool was destroyed (caller holds PoolsSync)
+    FakeBuffer* LiveBuffer( MMAL_BUFFER_HEADER_T* buffer )
+    {
+        FakeBuffer* fakeBuffer = static_cast<FakeBuffer*>( buffer->priv );
+
+        if ( !fakeBuffer->Pool->Queue.Alive )
+        {
+            DeadPoolUses++;
+            fakeBuffer = nullptr;
+        }
+
+        return fakeBuffer;
+    }
+}
+
+/* ================================================================= */
+/* Fake host/MMAL API                                                */
+/* ================================================================= */
+
+void bcm_host_init( void )
+{
+}
+
+MMAL_STATUS_T mmal_component_create( const char* name, MMAL_COMPONENT_T** component )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+    FakeComponent*              fakeComponent = new FakeComponent( );
+    string                      componentName( name );
+    uint32_t                    inputs  = 1;
+    uint32_t                    outputs = 1;
+
+    if ( componentName == MMAL_COMPONENT_DEFAULT_CAMERA )
+    {
+        // preview, video and still ports
+        inputs  = 0;
+        outputs = 3;
+    }
+    else if ( componentName == MMAL_COMPONENT_DEFAULT_VIDEO_SPLITTER )
+    {
+        outputs = 4;
+    }
+
+    fakeComponent->Name  = componentName;
+    fakeComponent->Alive = true;
+
+    fakeComponent->Component.priv    = fakeComponent;
+    fakeComponent->Component.name    = fakeComponent->Name.c_str( );
+    fakeComponent->Component.control = AddPort( fakeComponent, "control", 0 );
+
+    for ( uint32_t i = 0; i < inputs; i++ )
+    {
+        fakeComponent->Inputs.push_back( AddPort( fakeComponent, "in", i ) );
+    }
+    for ( uint32_t i = 0; i < outputs; i++ )
+    {
+        fakeComponent->Outputs.push_back( AddPort( fakeComponent, "out", i ) );
+    }
+
+    fakeComponent->Component.input_num  = inputs;
+    fakeComponent->Component.input      = fakeComponent->Inputs.data( );
+    fakeComponent->Component.output_num = outputs;
+    fakeComponent->Component.output     = fakeComponent->Outputs.data( );
+
+    Components.push_back( unique_ptr<FakeComponent>( fakeComponent ) );
+    *component = &fakeComponent->Component;
+
+    return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_component_destroy( MMAL_COMPONENT_T* component )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+    FakeComponent*              fakeComponent = static_cast<FakeComponent*>( component->priv );
+    MMAL_STATUS_T               status        = MMAL_SUCCESS;
+
+    if ( !fakeComponent->Alive )
+    {
+        DeadPortUses++;
+        status = MMAL_EINVAL;
+    }
+    else
+    {
+        // buffers still sent to ports are lost, same as their callbacks
+        for ( auto& port : fakeComponent->Ports )
+        {
+            port->Alive           = false;
+            port->Port.is_enabled = 0;
+            port->Callback        = nullptr;
+            port->Buffers.clear( );
+        }
+
+        fakeComponent->Alive = false;
+    }
+
+    return status;
+}
+
+MMAL_STATUS_T mmal_component_enable( MMAL_COMPONENT_T* component )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+
+    component->is_enabled = 1;
+
+    return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_component_disable( MMAL_COMPONENT_T* component )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+
+    component->is_enabled = 0;
+
+    return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_port_enable( MMAL_PORT_T* port, MMAL_PORT_BH_CB_T callback )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+    FakePort*                   fakePort = LivePort( port );
+    MMAL_STATUS_T               status   = MMAL_SUCCESS;
+
+    if ( fakePort == nullptr )
+    {
+        status = MMAL_EINVAL;
+    }
+    else if ( port->is_enabled )
+    {
+        status = MMAL_EISCONN;
+    }
+    else
+    {
+        fakePort->Callback = callback;
+        port->is_enabled   = 1;
+    }
+
+    return status;
+}
+
+MMAL_STATUS_T mmal_port_disable( MMAL_PORT_T* port )
+{
+    deque<MMAL_BUFFER_HEADER_T*> buffers;
+    MMAL_PORT_BH_CB_T            callback = nullptr;
+    MMAL_STATUS_T                status   = MMAL_SUCCESS;
+
+    {
+        lock_guard<recursive_mutex> lock( PortsSync );
+        FakePort*                   fakePort = LivePort( port );
+
+        if ( ( fakePort == nullptr ) || ( !port->is_enabled ) )
+        {
+            status = MMAL_EINVAL;
+        }
+        else
+        {
+            port->is_enabled   = 0;
+            callback           = fakePort->Callback;
+            fakePort->Callback = nullptr;
+            buffers.swap( fakePort->Buffers );
+        }
+    }
+
+    // buffers sent to the port are given back without data
+    for ( MMAL_BUFFER_HEADER_T* buffer : buffers )
+    {
+        buffer->length = 0;
+
+        if ( callback != nullptr )
+        {
+            callback( port, buffer );
+        }
+    }
+
+    return status;
+}
+
+MMAL_STATUS_T mmal_port_format_commit( MMAL_PORT_T* port )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+
+    return ( LivePort( port ) != nullptr ) ? MMAL_SUCCESS : MMAL_EINVAL;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set( MMAL_PORT_T* port, const MMAL_PARAMETER_HEADER_T* /* param */ )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+
+    return ( LivePort( port ) != nullptr ) ? MMAL_SUCCESS : MMAL_EINVAL;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set_boolean( MMAL_PORT_T* port, uint32_t /* id */, MMAL_BOOL_T /* value */ )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+
+    return ( LivePort( port ) != nullptr ) ? MMAL_SUCCESS : MMAL_EINVAL;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set_uint32( MMAL_PORT_T* port, uint32_t /* id */, uint32_t /* value */ )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+
+    return ( LivePort( port ) != nullptr ) ? MMAL_SUCCESS : MMAL_EINVAL;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set_rational( MMAL_PORT_T* port, uint32_t /* id */, MMAL_RATIONAL_T /* value */ )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+
+    return ( LivePort( port ) != nullptr ) ? MMAL_SUCCESS : MMAL_EINVAL;
+}
+
+MMAL_STATUS_T mmal_port_send_buffer( MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+    FakePort*                   fakePort = LivePort( port );
+    MMAL_STATUS_T               status   = MMAL_SUCCESS;
+
+    if ( ( fakePort == nullptr ) || ( !port->is_enabled ) )
+    {
+        status = MMAL_EINVAL;
+    }
+    else
+    {
+        fakePort->Buffers.push_back( buffer );
+    }
+
+    return status;
+}
+
+MMAL_STATUS_T mmal_port_flush( MMAL_PORT_T* port )
+{
+    deque<MMAL_BUFFER_HEADER_T*> buffers;
+    MMAL_PORT_BH_CB_T            callback = nullptr;
+    MMAL_STATUS_T                status   = MMAL_SUCCESS;
+
+    {
+        lock_guard<recursive_mutex> lock( PortsSync );
+        FakePort*                   fakePort = LivePort( port );
+
+        if ( fakePort == nullptr )
+        {
+            status = MMAL_EINVAL;
+        }
+        else
+        {
+            callback = fakePort->Callback;
+            buffers.swap( fakePort->Buffers );
+        }
+    }
+
+    for ( MMAL_BUFFER_HEADER_T* buffer : buffers )
+    {
+        buffer->length = 0;
+
+        if ( callback != nullptr )
+        {
+            callback( port, buffer );
+        }
+    }
+
+    return status;
+}
+
+void mmal_format_copy( MMAL_ES_FORMAT_T* to, MMAL_ES_FORMAT_T* from )
+{
+    MMAL_ES_SPECIFIC_FORMAT_T* es = to->es;
+
+    *es    = *from->es;
+    *to    = *from;
+    to->es = es;
+}
+
+MMAL_STATUS_T mmal_format_full_copy( MMAL_ES_FORMAT_T* to, MMAL_ES_FORMAT_T* from )
+{
+    mmal_format_copy( to, from );
+
+    return MMAL_SUCCESS;
+}
+
+MMAL_POOL_T* mmal_port_pool_create( MMAL_PORT_T* port, unsigned int headers, uint32_t payloadSize )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+
+    return ( LivePort( port ) != nullptr ) ? CreatePool( headers, payloadSize ) : nullptr;
+}
+
+void mmal_port_pool_destroy( MMAL_PORT_T* port, MMAL_POOL_T* pool )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+
+    // the real pool is freed by its port, so the port must still be alive
+    LivePort( port );
+    DestroyPool( pool );
+}
+
+MMAL_POOL_T* mmal_pool_create( unsigned int headers, uint32_t payloadSize )
+{
+    return CreatePool( headers, payloadSize );
+}
+
+void mmal_pool_destroy( MMAL_POOL_T* pool )
+{
+    DestroyPool( pool );
+}
+
+MMAL_BUFFER_HEADER_T* mmal_queue_get( MMAL_QUEUE_T* queue )
+{
+    lock_guard<mutex>     lock( PoolsSync );
+    MMAL_BUFFER_HEADER_T* buffer = nullptr;
+
+    if ( !queue->Alive )
+    {
+        DeadPoolUses++;
+    }
+    else if ( !queue->Buffers.empty( ) )
+    {
+        buffer = queue->Buffers.front( );
+        queue->Buffers.pop_front( );
+
+        static_cast<FakeBuffer*>( buffer->priv )->RefCount = 1;
+    }
+
+    return buffer;
+}
+
+unsigned int mmal_queue_length( MMAL_QUEUE_T* queue )
+{
+    lock_guard<mutex> lock( PoolsSync );
+
+    if ( !queue->Alive )
+    {
+        DeadPoolUses++;
+    }
+
+    return static_cast<unsigned int>( queue->Buffers.size( ) );
+}
+
+MMAL_STATUS_T mmal_buffer_header_mem_lock( MMAL_BUFFER_HEADER_T* buffer )
+{
+    lock_guard<mutex> lock( PoolsSync );
+
+    return ( LiveBuffer( buffer ) != nullptr ) ? MMAL_SUCCESS : MMAL_EINVAL;
+}
+
+void mmal_buffer_header_mem_unlock( MMAL_BUFFER_HEADER_T* buffer )
+{
+    lock_guard<mutex> lock( PoolsSync );
+
+    LiveBuffer( buffer );
+}
+
+void mmal_buffer_header_acquire( MMAL_BUFFER_HEADER_T* buffer )
+{
+    lock_guard<mutex> lock( PoolsSync );
+    FakeBuffer*       fakeBuffer = LiveBuffer( buffer );
+
+    if ( fakeBuffer != nullptr )
+    {
+        fakeBuffer->RefCount++;
+    }
+}
+
+void mmal_buffer_header_release( MMAL_BUFFER_HEADER_T* buffer )
+{
+    lock_guard<mutex> lock( PoolsSync );
+    FakeBuffer*       fakeBuffer = LiveBuffer( buffer );
+
+    // the last reference puts buffer back into the queue of its pool
+    if ( ( fakeBuffer != nullptr ) && ( fakeBuffer->RefCount != 0 ) && ( --fakeBuffer->RefCount == 0 ) )
+    {
+        buffer->length = 0;
+        buffer->offset = 0;
+        buffer->flags  = 0;
+
+        fakeBuffer->Pool->Queue.Buffers.push_back( buffer );
+    }
+}
+
+MMAL_STATUS_T mmal_connection_create( MMAL_CONNECTION_T** connection, MMAL_PORT_T* out, MMAL_PORT_T* in, uint32_t flags )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+    MMAL_STATUS_T               status = MMAL_SUCCESS;
+
+    if ( ( LivePort( out ) == nullptr ) || ( LivePort( in ) == nullptr ) )
+    {
+        status = MMAL_EINVAL;
+    }
+    else
+    {
+        *connection = new MMAL_CONNECTION_T( );
+
+        ( *connection )->out   = out;
+        ( *connection )->in    = in;
+        ( *connection )->flags = flags;
+    }
+
+    return status;
+}
+
+MMAL_STATUS_T mmal_connection_enable( MMAL_CONNECTION_T* connection )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+    MMAL_STATUS_T               status = MMAL_SUCCESS;
+
+    if ( ( LivePort( connection->out ) == nullptr ) || ( LivePort( connection->in ) == nullptr ) )
+    {
+        status = MMAL_EINVAL;
+    }
+    else if ( connection->is_enabled )
+    {
+        status = MMAL_EISCONN;
+    }
+    else
+    {
+        // tunnelled ports pass buffers between themselves
+        connection->out->is_enabled = 1;
+        connection->in->is_enabled  = 1;
+        connection->is_enabled      = 1;
+    }
+
+    return status;
+}
+
+MMAL_STATUS_T mmal_connection_disable( MMAL_CONNECTION_T* connection )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+    MMAL_STATUS_T               status = MMAL_SUCCESS;
+
+    if ( ( LivePort( connection->out ) == nullptr ) || ( LivePort( connection->in ) == nullptr ) )
+    {
+        status = MMAL_EINVAL;
+    }
+    else if ( !connection->is_enabled )
+    {
+        status = MMAL_ENOTCONN;
+    }
+    else
+    {
+        connection->out->is_enabled = 0;
+        connection->in->is_enabled  = 0;
+        connection->is_enabled      = 0;
+    }
+
+    return status;
+}
+
+MMAL_STATUS_T mmal_connection_destroy( MMAL_CONNECTION_T* connection )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+
+    if ( connection->is_enabled )
+    {
+        mmal_connection_disable( connection );
+    }
+
+    delete connection;
+
+    return MMAL_SUCCESS;
+}
+
+/* ================================================================= */
+/* Helpers for tests                                                 */
+/* ================================================================= */
+
+// Free everything and clear statistics
+void FakeMmal::Reset( )
+{
+    lock_guard<recursive_mutex> portsLock( PortsSync );
+    lock_guard<mutex>           poolsLock( PoolsSync );
+
+    Components.clear( );
+    Pools.clear( );
+
+    PoolsCreated = 0;
+    DeadPortUses = 0;
+    DeadPoolUses = 0;
+}
+
+FakeMmal::Stats FakeMmal::GetStats( )
+{
+    Stats stats = { 0, 0, PoolsCreated, DeadPortUses, DeadPoolUses };
+
+    {
+        lock_guard<recursive_mutex> lock( PortsSync );
+
+        for ( const auto& component : Components )
+        {
+            if ( component->Alive )
+            {
+                stats.LiveComponents++;
+            }
+        }
+    }
+    {
+        lock_guard<mutex> lock( PoolsSync );
+
+        for ( const auto& pool : Pools )
+        {
+            if ( pool->Queue.Alive )
+            {
+                stats.LivePools++;
+            }
+        }
+    }
+
+    return stats;
+}
+
+// Wait till the output port of the component is enabled and has a buffer to fill
+bool FakeMmal::WaitForOutput( const char* componentName, uint32_t outputIndex, uint32_t timeoutMs )
+{
+    bool ready = false;
+
+    for ( uint32_t waited = 0; ( !ready ) && ( waited <= timeoutMs ); waited += 5 )
+    {
+        {
+            lock_guard<recursive_mutex> lock( PortsSync );
+            FakePort*                   port = FindOutput( componentName, outputIndex );
+
+            ready = ( ( port != nullptr ) && ( port->Port.is_enabled ) && ( port->Callback != nullptr ) && ( !port->Buffers.empty( ) ) );
+        }
+
+        if ( !ready )
+        {
+            this_thread::sleep_for( chrono::milliseconds( 5 ) );
+        }
+    }
+
+    return ready;
+}
+
+// Fill a buffer sent to the output port of the component and give it back to the port's callback
+bool FakeMmal::DeliverFrame( const char* componentName, uint32_t outputIndex, uint32_t length, uint8_t fill )
+{
+    // port can not be disabled or destroyed till its callback is done, same as with the real one
+    lock_guard<recursive_mutex> lock( PortsSync );
+    FakePort*                   port = FindOutput( componentName, outputIndex );
+    bool                        ret  = ( ( port != nullptr ) && ( port->Port.is_enabled ) &&
+                                         ( port->Callback != nullptr ) && ( !port->Buffers.empty( ) ) );
+
+    if ( ret )
+    {
+        MMAL_BUFFER_HEADER_T* buffer = port->Buffers.front( );
+
+        port->Buffers.pop_front( );
+
+        buffer->length = std::min( length, buffer->alloc_size );
+        buffer->offset = 0;
+        buffer->flags  = MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+        memset( buffer->data, fill, buffer->length );
+
+        port->Callback( &port->Port, buffer );
+    }
+
+    return ret;
+}
+
+// Get video format committed to the output port of the component
+bool FakeMmal::GetOutputFormat( const char* componentName, uint32_t outputIndex, MMAL_VIDEO_FORMAT_T& format )
+{
+    lock_guard<recursive_mutex> lock( PortsSync );
+    FakePort*                   port = FindOutput( componentName, outputIndex );
+
+    if ( port != nullptr )
+    {
+        format = port->EsFormat.video;
+    }
+
+    return ( port != nullptr );
+}
@@ -0,0 +1,61 @@
+/*
+    tests - unit tests of PiRexBot core classes
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef FAKE_MMAL_HPP
+#define FAKE_MMAL_HPP
+
+#include <interface/mmal/mmal.h>
+
+/* ================================================================= */
+/* Fake MMAL implementation, which lets camera run on a host without */
+/* Raspberry Pi. Video frames are delivered by tests, while memory   */
+/* of destroyed ports/pools is kept till Reset(), so any use of them */
+/* is counted instead of crashing.                                   */
+/* ================================================================= */
+
+namespace FakeMmal
+{
+    struct Stats
+    {
+        uint32_t LiveComponents;
+        uint32_t LivePools;
+        uint32_t PoolsCreated;
+        uint32_t DeadPortUses;  // calls with ports of destroyed components
+        uint32_t DeadPoolUses;  // calls with destroyed pools or their buffers
+    };
+
+    // Free everything and clear statistics - must be called only when no camera is running
+    void Reset( );
+
+    Stats GetStats( );
+
+    // Wait till the output port of the (live) component is enabled and has a buffer to fill
+    bool WaitForOutput( const char* componentName, uint32_t outputIndex, uint32_t timeoutMs );
+
+    // Fill a buffer sent to the output port of the component and give it back to the port's
+    // callback (returns false if the port has no buffer to fill)
+    bool DeliverFrame( const char* componentName, uint32_t outputIndex, uint32_t length, uint8_t fill );
+
+    // Get video format committed to the output port of the component
+    bool GetOutputFormat( const char* componentName, uint32_t outputIndex, MMAL_VIDEO_FORMAT_T& format );
+}
+
+#endif // FAKE_MMAL_HPP
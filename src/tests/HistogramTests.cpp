@@ -0,0 +1,81 @@
+/*
+    tests - unit tests of PiRexBot core classes
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <vector>
+
+#include "Tests.hpp"
+#include "XHistogram.hpp"
+#include "XWebServer.hpp"
+
+using namespace std;
+
+TEST( HistogramBoundsAreInclusive )
+{
+    XHistogram       histogram( { 10, 20 } );
+    vector<uint64_t> counts;
+
+    // bound itself goes into its bucket, the next value into the next one
+    for ( uint64_t value : { 0, 10, 11, 20, 21, 1000 } )
+    {
+        histogram.Add( value );
+    }
+
+    counts = histogram.Counts( );
+
+    CHECK( counts.size( ) == 3 );
+    CHECK( counts[0] == 2 );
+    CHECK( counts[1] == 2 );
+    CHECK( counts[2] == 2 );
+    CHECK( histogram.Count( ) == 6 );
+    CHECK( histogram.Sum( ) == 1062 );
+}
+
+TEST( HistogramToPrometheusIsCumulative )
+{
+    XHistogram  histogram( { 1000, 2000 } );
+    PropertyMap properties;
+
+    histogram.Add( 1000 );
+    histogram.Add( 1001 );
+    histogram.Add( 5000 );
+    histogram.ToPrometheus( properties, "t", "", 1000.0 );
+
+    CHECK( properties["t_bucket{le=\"1\"}"] == "1" );
+    CHECK( properties["t_bucket{le=\"2\"}"] == "2" );
+    CHECK( properties["t_bucket{le=\"+Inf\"}"] == "3" );
+    CHECK( properties["t_count"] == "3" );
+}
+
+TEST( HandlerLatencyBucketsAreInclusive )
+{
+    const uint32_t lastBucket = XWebHandlerStats::LatencyBucketsCount - 1;
+
+    CHECK( XWebHandlerStats::LatencyBucket( 0 ) == 0 );
+
+    for ( uint32_t i = 0; i < lastBucket; i++ )
+    {
+        uint64_t bound = XWebHandlerStats::LatencyBucketBounds[i];
+
+        CHECK( XWebHandlerStats::LatencyBucket( bound ) == i );
+        CHECK( XWebHandlerStats::LatencyBucket( bound + 1 ) == i + 1 );
+    }
+
+    CHECK( XWebHandlerStats::LatencyBucket( UINT64_MAX ) == lastBucket );
+}
@@ -0,0 +1,93 @@
+/*
+    tests - unit tests of PiRexBot core classes
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include <string>
+#include <map>
+
+#include "Tests.hpp"
+#include "XSimpleJsonParser.hpp"
+
+using namespace std;
+
+static bool IsObject( const char* json )
+{
+    return XSimpleJsonIsObject( json, strlen( json ) );
+}
+
+TEST( JsonParserValues )
+{
+    map<string, string> values;
+
+    CHECK( XSimpleJsonParser( "{ \"int\":10, \"neg\" : -2.5, \"str\":\"a\\\"b\\\\c\\n\", \"t\":true, \"n\":null }", values ) );
+    CHECK( values.size( ) == 5 );
+    CHECK( values["int"] == "10" );
+    CHECK( values["neg"] == "-2.5" );
+    CHECK( values["str"] == "a\"b\\c\n" );
+    CHECK( values["t"] == "true" );
+    CHECK( values["n"] == "null" );
+
+    CHECK( XSimpleJsonParser( "{}", values ) );
+    CHECK( values.empty( ) );
+}
+
+TEST( JsonParserNestedValues )
+{
+    map<string, string> values;
+
+    // nested objects/arrays are provided as their source text, which is valid JSON
+    CHECK( XSimpleJsonParser( "{\"obj\":{ \"a\": \"x y\", \"b\":[1, 2] },\"arr\":[ \"s\", {\"c\":3} ]}", values ) );
+    CHECK( values["obj"] == "{ \"a\": \"x y\", \"b\":[1, 2] }" );
+    CHECK( values["arr"] == "[ \"s\", {\"c\":3} ]" );
+    CHECK( IsObject( values["obj"].c_str( ) ) );
+}
+
+TEST( JsonParserTrailingComma )
+{
+    map<string, string> values;
+
+    CHECK( XSimpleJsonParser( "{\"a\":1,}", values ) );
+    CHECK( values.size( ) == 1 );
+    CHECK( values["a"] == "1" );
+
+    CHECK( XSimpleJsonParser( "{\"a\":[1,2,],\"b\":{\"c\":1, },}", values ) );
+    CHECK( values["a"] == "[1,2,]" );
+    CHECK( values["b"] == "{\"c\":1, }" );
+
+    CHECK( IsObject( "{ \"a\" : 1 , }" ) );
+    CHECK( !IsObject( "{,}" ) );
+    CHECK( !IsObject( "{\"a\":1,,}" ) );
+    CHECK( !IsObject( "{\"a\":[,]}" ) );
+}
+
+TEST( JsonParserInvalid )
+{
+    map<string, string> values;
+
+    CHECK( !XSimpleJsonParser( "", values ) );
+    CHECK( !XSimpleJsonParser( "[1]", values ) );
+    CHECK( !XSimpleJsonParser( "{\"a\"}", values ) );
+    CHECK( !XSimpleJsonParser( "{\"a\":tru}", values ) );
+    CHECK( !XSimpleJsonParser( "{\"a\":\"b\\x\"}", values ) );
+    CHECK( !XSimpleJsonParser( "{\"a\":{\"b\":1}", values ) );
+
+    CHECK( !IsObject( "{\"a\":1} x" ) );
+    CHECK( !IsObject( "{\"a\":1" ) );
+}
@@ -0,0 +1,71 @@
+/*
+    tests - unit tests of PiRexBot core classes
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include <vector>
+#include <utility>
+
+#include "Tests.hpp"
+
+using namespace std;
+
+static vector<pair<const char*, TestFunction>>& RegisteredTests( )
+{
+    static vector<pair<const char*, TestFunction>> tests;
+
+    return tests;
+}
+
+TestRegistration::TestRegistration( const char* name, TestFunction function )
+{
+    RegisteredTests( ).push_back( make_pair( name, function ) );
+}
+
+// Run all tests or only those having the specified string in their names
+int main( int argc, char* argv[] )
+{
+    const char* filter = ( argc > 1 ) ? argv[1] : nullptr;
+    int         run    = 0;
+    int         failed = 0;
+
+    for ( const auto& test : RegisteredTests( ) )
+    {
+        bool testFailed = false;
+
+        if ( ( filter != nullptr ) && ( strstr( test.first, filter ) == nullptr ) )
+        {
+            continue;
+        }
+
+        test.second( testFailed );
+
+        printf( "%s %s\n", ( testFailed ) ? "FAILED" : "passed", test.first );
+
+        run++;
+        if ( testFailed )
+        {
+            failed++;
+        }
+    }
+
+    printf( "\n%d tests run, %d failed\n", run, failed );
+
+    return ( failed == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+/*
+    tests - unit tests of PiRexBot core classes
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef TESTS_HPP
+#define TESTS_HPP
+
+#include <stdio.h>
+
+/* ================================================================= */
+/* Minimal test harness - every TEST registers itself with the       */
+/* runner, while CHECK reports failed condition and fails the test   */
+/* without stopping it.                                              */
+/* ================================================================= */
+
+typedef void ( *TestFunction )( bool& failed );
+
+struct TestRegistration
+{
+    TestRegistration( const char* name, TestFunction function );
+};
+
+#define TEST(name) \
+    static void Test_##name( bool& testFailed ); \
+    static TestRegistration Registration_##name( #name, Test_##name ); \
+    static void Test_##name( bool& testFailed )
+
+#define CHECK(condition) \
+    do { if ( !( condition ) ) { printf( "  %s:%d: CHECK( %s ) failed\n", __FILE__, __LINE__, #condition ); testFailed = true; } } while ( 0 )
+
+#endif // TESTS_HPP
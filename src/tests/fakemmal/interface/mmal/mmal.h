@@ -0,0 +1,438 @@
+/*
+    tests - unit tests of PiRexBot core classes
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+// Fake MMAL API used to test camera code on a host without Raspberry Pi. It declares only what the
+// camera uses and keeps the names of the real API, while layout of the structures is simplified.
+
+#ifndef FAKE_MMAL_H
+#define FAKE_MMAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef enum
+{
+    MMAL_SUCCESS = 0,
+    MMAL_ENOMEM,
+    MMAL_ENOSPC,
+    MMAL_EINVAL,
+    MMAL_ENOSYS,
+    MMAL_ENOENT,
+    MMAL_ENXIO,
+    MMAL_EIO,
+    MMAL_ESPIPE,
+    MMAL_ECORRUPT,
+    MMAL_ENOTREADY,
+    MMAL_ECONFIG,
+    MMAL_EISCONN,
+    MMAL_ENOTCONN,
+    MMAL_EAGAIN,
+    MMAL_EFAULT
+} MMAL_STATUS_T;
+
+typedef int32_t  MMAL_BOOL_T;
+typedef uint32_t MMAL_FOURCC_T;
+
+#define MMAL_FOURCC( a, b, c, d ) ( ( a ) | ( ( b ) << 8 ) | ( ( c ) << 16 ) | ( ( d ) << 24 ) )
+
+#define MMAL_ENCODING_I420   MMAL_FOURCC( 'I', '4', '2', '0' )
+#define MMAL_ENCODING_RGB24  MMAL_FOURCC( 'R', 'G', 'B', '3' )
+#define MMAL_ENCODING_JPEG   MMAL_FOURCC( 'J', 'P', 'E', 'G' )
+#define MMAL_ENCODING_H264   MMAL_FOURCC( 'H', '2', '6', '4' )
+#define MMAL_ENCODING_OPAQUE MMAL_FOURCC( 'O', 'P', 'Q', 'V' )
+
+#define MMAL_COMPONENT_DEFAULT_CAMERA         "vc.ril.camera"
+#define MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER  "vc.ril.image_encode"
+#define MMAL_COMPONENT_DEFAULT_VIDEO_ENCODER  "vc.ril.video_encode"
+#define MMAL_COMPONENT_DEFAULT_VIDEO_SPLITTER "vc.ril.video_splitter"
+#define MMAL_COMPONENT_DEFAULT_RESIZER        "vc.ril.resize"
+#define MMAL_COMPONENT_DEFAULT_ISP            "vc.ril.isp"
+
+#define MMAL_BUFFER_HEADER_FLAG_FRAME_END (1 << 2)
+#define MMAL_BUFFER_HEADER_FLAG_KEYFRAME  (1 << 3)
+#define MMAL_BUFFER_HEADER_FLAG_CONFIG    (1 << 5)
+
+#define MMAL_TIME_UNKNOWN (INT64_C( 1 ) << 63)
+
+#define MMAL_CONNECTION_FLAG_TUNNELLING          (0x1)
+#define MMAL_CONNECTION_FLAG_ALLOCATION_ON_INPUT (0x2)
+
+typedef struct
+{
+    int32_t num;
+    int32_t den;
+} MMAL_RATIONAL_T;
+
+typedef struct
+{
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+} MMAL_RECT_T;
+
+typedef struct
+{
+    uint32_t        width;
+    uint32_t        height;
+    MMAL_RECT_T     crop;
+    MMAL_RATIONAL_T frame_rate;
+    MMAL_RATIONAL_T par;
+    uint32_t        color_space;
+} MMAL_VIDEO_FORMAT_T;
+
+typedef union
+{
+    MMAL_VIDEO_FORMAT_T video;
+} MMAL_ES_SPECIFIC_FORMAT_T;
+
+typedef struct
+{
+    int                        type;
+    MMAL_FOURCC_T              encoding;
+    MMAL_FOURCC_T              encoding_variant;
+    MMAL_ES_SPECIFIC_FORMAT_T* es;
+    uint32_t                   bitrate;
+    uint32_t                   flags;
+    uint32_t                   extradata_size;
+    uint8_t*                   extradata;
+} MMAL_ES_FORMAT_T;
+
+typedef struct MMAL_PORT_USERDATA_T MMAL_PORT_USERDATA_T;
+typedef struct MMAL_QUEUE_T         MMAL_QUEUE_T;
+
+typedef struct MMAL_BUFFER_HEADER_T
+{
+    struct MMAL_BUFFER_HEADER_T* next;
+    void*                        priv;
+    uint32_t                     cmd;
+    uint8_t*                     data;
+    uint32_t                     alloc_size;
+    uint32_t                     length;
+    uint32_t                     offset;
+    uint32_t                     flags;
+    int64_t                      pts;
+    int64_t                      dts;
+    void*                        type;
+    void*                        user_data;
+} MMAL_BUFFER_HEADER_T;
+
+typedef struct
+{
+    MMAL_QUEUE_T*          queue;
+    uint32_t               headers_num;
+    MMAL_BUFFER_HEADER_T** header;
+} MMAL_POOL_T;
+
+typedef struct MMAL_PORT_T
+{
+    void*                    priv;
+    const char*              name;
+    int                      type;
+    uint16_t                 index;
+    uint16_t                 index_all;
+    uint32_t                 is_enabled;
+    MMAL_ES_FORMAT_T*        format;
+    uint32_t                 buffer_num_min;
+    uint32_t                 buffer_size_min;
+    uint32_t                 buffer_alignment_min;
+    uint32_t                 buffer_num_recommended;
+    uint32_t                 buffer_size_recommended;
+    uint32_t                 buffer_num;
+    uint32_t                 buffer_size;
+    struct MMAL_COMPONENT_T* component;
+    MMAL_PORT_USERDATA_T*    userdata;
+    uint32_t                 capabilities;
+} MMAL_PORT_T;
+
+typedef struct MMAL_COMPONENT_T
+{
+    void*         priv;
+    void*         userdata;
+    const char*   name;
+    uint32_t      is_enabled;
+    MMAL_PORT_T*  control;
+    uint32_t      input_num;
+    MMAL_PORT_T** input;
+    uint32_t      output_num;
+    MMAL_PORT_T** output;
+} MMAL_COMPONENT_T;
+
+typedef struct MMAL_CONNECTION_T
+{
+    void*         user_data;
+    void*         callback;
+    uint32_t      is_enabled;
+    uint32_t      flags;
+    MMAL_PORT_T*  in;
+    MMAL_PORT_T*  out;
+    MMAL_POOL_T*  pool;
+    MMAL_QUEUE_T* queue;
+} MMAL_CONNECTION_T;
+
+typedef void ( *MMAL_PORT_BH_CB_T )( MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer );
+
+/* ================================================================= */
+/* Parameters                                                        */
+/* ================================================================= */
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t size;
+} MMAL_PARAMETER_HEADER_T;
+
+enum
+{
+    MMAL_PARAMETER_CAMERA_CONFIG = 1,
+    MMAL_PARAMETER_CAPTURE,
+    MMAL_PARAMETER_MIRROR,
+    MMAL_PARAMETER_VIDEO_STABILISATION,
+    MMAL_PARAMETER_SHARPNESS,
+    MMAL_PARAMETER_CONTRAST,
+    MMAL_PARAMETER_BRIGHTNESS,
+    MMAL_PARAMETER_SATURATION,
+    MMAL_PARAMETER_AWB_MODE,
+    MMAL_PARAMETER_EXPOSURE_MODE,
+    MMAL_PARAMETER_EXP_METERING_MODE,
+    MMAL_PARAMETER_IMAGE_EFFECT,
+    MMAL_PARAMETER_ANNOTATE,
+    MMAL_PARAMETER_JPEG_Q_FACTOR,
+    MMAL_PARAMETER_PROFILE,
+    MMAL_PARAMETER_INTRAPERIOD,
+    MMAL_PARAMETER_VIDEO_ENCODE_INLINE_HEADER,
+    MMAL_PARAMETER_VIDEO_BIT_RATE,
+    MMAL_PARAMETER_VIDEO_REQUEST_I_FRAME,
+    MMAL_PARAMETER_FRAME_RATE,
+    MMAL_PARAMETER_VIDEO_ENCODE_RC_MODEL
+};
+
+typedef enum
+{
+    MMAL_PARAM_TIMESTAMP_MODE_RESET_STC = 1
+} MMAL_PARAM_TIMESTAMP_MODE_T;
+
+typedef struct
+{
+    MMAL_PARAMETER_HEADER_T     hdr;
+    uint32_t                    max_stills_w;
+    uint32_t                    max_stills_h;
+    uint32_t                    stills_yuv422;
+    uint32_t                    one_shot_stills;
+    uint32_t                    max_preview_video_w;
+    uint32_t                    max_preview_video_h;
+    uint32_t                    num_preview_video_frames;
+    uint32_t                    stills_capture_circular_buffer_height;
+    uint32_t                    fast_preview_resume;
+    MMAL_PARAM_TIMESTAMP_MODE_T use_stc_timestamp;
+} MMAL_PARAMETER_CAMERA_CONFIG_T;
+
+typedef enum
+{
+    MMAL_PARAM_MIRROR_NONE,
+    MMAL_PARAM_MIRROR_VERTICAL,
+    MMAL_PARAM_MIRROR_HORIZONTAL,
+    MMAL_PARAM_MIRROR_BOTH
+} MMAL_PARAM_MIRROR_T;
+
+typedef struct
+{
+    MMAL_PARAMETER_HEADER_T hdr;
+    MMAL_PARAM_MIRROR_T     value;
+} MMAL_PARAMETER_MIRROR_T;
+
+typedef enum
+{
+    MMAL_PARAM_AWBMODE_OFF,
+    MMAL_PARAM_AWBMODE_AUTO,
+    MMAL_PARAM_AWBMODE_SUNLIGHT,
+    MMAL_PARAM_AWBMODE_CLOUDY,
+    MMAL_PARAM_AWBMODE_SHADE,
+    MMAL_PARAM_AWBMODE_TUNGSTEN,
+    MMAL_PARAM_AWBMODE_FLUORESCENT,
+    MMAL_PARAM_AWBMODE_INCANDESCENT,
+    MMAL_PARAM_AWBMODE_FLASH,
+    MMAL_PARAM_AWBMODE_HORIZON
+} MMAL_PARAM_AWBMODE_T;
+
+typedef struct
+{
+    MMAL_PARAMETER_HEADER_T hdr;
+    MMAL_PARAM_AWBMODE_T    value;
+} MMAL_PARAMETER_AWBMODE_T;
+
+typedef enum
+{
+    MMAL_PARAM_EXPOSUREMODE_OFF,
+    MMAL_PARAM_EXPOSUREMODE_AUTO,
+    MMAL_PARAM_EXPOSUREMODE_NIGHT,
+    MMAL_PARAM_EXPOSUREMODE_NIGHTPREVIEW,
+    MMAL_PARAM_EXPOSUREMODE_BACKLIGHT,
+    MMAL_PARAM_EXPOSUREMODE_SPOTLIGHT,
+    MMAL_PARAM_EXPOSUREMODE_SPORTS,
+    MMAL_PARAM_EXPOSUREMODE_SNOW,
+    MMAL_PARAM_EXPOSUREMODE_BEACH,
+    MMAL_PARAM_EXPOSUREMODE_VERYLONG,
+    MMAL_PARAM_EXPOSUREMODE_FIXEDFPS,
+    MMAL_PARAM_EXPOSUREMODE_ANTISHAKE,
+    MMAL_PARAM_EXPOSUREMODE_FIREWORKS
+} MMAL_PARAM_EXPOSUREMODE_T;
+
+typedef struct
+{
+    MMAL_PARAMETER_HEADER_T   hdr;
+    MMAL_PARAM_EXPOSUREMODE_T value;
+} MMAL_PARAMETER_EXPOSUREMODE_T;
+
+typedef enum
+{
+    MMAL_PARAM_EXPOSUREMETERINGMODE_AVERAGE,
+    MMAL_PARAM_EXPOSUREMETERINGMODE_SPOT,
+    MMAL_PARAM_EXPOSUREMETERINGMODE_BACKLIT,
+    MMAL_PARAM_EXPOSUREMETERINGMODE_MATRIX
+} MMAL_PARAM_EXPOSUREMETERINGMODE_T;
+
+typedef struct
+{
+    MMAL_PARAMETER_HEADER_T           hdr;
+    MMAL_PARAM_EXPOSUREMETERINGMODE_T value;
+} MMAL_PARAMETER_EXPOSUREMETERINGMODE_T;
+
+typedef enum
+{
+    MMAL_PARAM_IMAGEFX_NONE,
+    MMAL_PARAM_IMAGEFX_NEGATIVE,
+    MMAL_PARAM_IMAGEFX_SOLARIZE,
+    MMAL_PARAM_IMAGEFX_POSTERIZE,
+    MMAL_PARAM_IMAGEFX_WHITEBOARD,
+    MMAL_PARAM_IMAGEFX_BLACKBOARD,
+    MMAL_PARAM_IMAGEFX_SKETCH,
+    MMAL_PARAM_IMAGEFX_DENOISE,
+    MMAL_PARAM_IMAGEFX_EMBOSS,
+    MMAL_PARAM_IMAGEFX_OILPAINT,
+    MMAL_PARAM_IMAGEFX_HATCH,
+    MMAL_PARAM_IMAGEFX_GPEN,
+    MMAL_PARAM_IMAGEFX_PASTEL,
+    MMAL_PARAM_IMAGEFX_WATERCOLOUR,
+    MMAL_PARAM_IMAGEFX_FILM,
+    MMAL_PARAM_IMAGEFX_BLUR,
+    MMAL_PARAM_IMAGEFX_SATURATION,
+    MMAL_PARAM_IMAGEFX_COLOURSWAP,
+    MMAL_PARAM_IMAGEFX_WASHEDOUT,
+    MMAL_PARAM_IMAGEFX_POSTERISE,
+    MMAL_PARAM_IMAGEFX_COLOURPOINT,
+    MMAL_PARAM_IMAGEFX_COLOURBALANCE,
+    MMAL_PARAM_IMAGEFX_CARTOON
+} MMAL_PARAM_IMAGEFX_T;
+
+typedef struct
+{
+    MMAL_PARAMETER_HEADER_T hdr;
+    MMAL_PARAM_IMAGEFX_T    value;
+} MMAL_PARAMETER_IMAGEFX_T;
+
+#define MMAL_CAMERA_ANNOTATE_MAX_TEXT_LEN_V2 (256)
+
+typedef struct
+{
+    MMAL_PARAMETER_HEADER_T hdr;
+    MMAL_BOOL_T             enable;
+    MMAL_BOOL_T             show_shutter;
+    MMAL_BOOL_T             show_analog_gain;
+    MMAL_BOOL_T             show_lens;
+    MMAL_BOOL_T             show_caf;
+    MMAL_BOOL_T             show_motion;
+    MMAL_BOOL_T             show_frame_num;
+    MMAL_BOOL_T             black_text_background;
+    char                    text[MMAL_CAMERA_ANNOTATE_MAX_TEXT_LEN_V2];
+} MMAL_PARAMETER_CAMERA_ANNOTATE_V2_T;
+
+typedef enum
+{
+    MMAL_VIDEO_PROFILE_H264_BASELINE,
+    MMAL_VIDEO_PROFILE_H264_MAIN,
+    MMAL_VIDEO_PROFILE_H264_HIGH
+} MMAL_VIDEO_PROFILE_T;
+
+typedef enum
+{
+    MMAL_VIDEO_LEVEL_H264_4
+} MMAL_VIDEO_LEVEL_T;
+
+typedef struct
+{
+    MMAL_VIDEO_PROFILE_T profile;
+    MMAL_VIDEO_LEVEL_T   level;
+} MMAL_PARAMETER_VIDEO_PROFILE_S;
+
+typedef struct
+{
+    MMAL_PARAMETER_HEADER_T        hdr;
+    MMAL_PARAMETER_VIDEO_PROFILE_S profile[1];
+} MMAL_PARAMETER_VIDEO_PROFILE_T;
+
+typedef struct
+{
+    MMAL_PARAMETER_HEADER_T hdr;
+    MMAL_RATIONAL_T         frame_rate;
+} MMAL_PARAMETER_FRAME_RATE_T;
+
+/* ================================================================= */
+/* Functions                                                         */
+/* ================================================================= */
+
+MMAL_STATUS_T mmal_component_create( const char* name, MMAL_COMPONENT_T** component );
+MMAL_STATUS_T mmal_component_destroy( MMAL_COMPONENT_T* component );
+MMAL_STATUS_T mmal_component_enable( MMAL_COMPONENT_T* component );
+MMAL_STATUS_T mmal_component_disable( MMAL_COMPONENT_T* component );
+
+MMAL_STATUS_T mmal_port_enable( MMAL_PORT_T* port, MMAL_PORT_BH_CB_T callback );
+MMAL_STATUS_T mmal_port_disable( MMAL_PORT_T* port );
+MMAL_STATUS_T mmal_port_format_commit( MMAL_PORT_T* port );
+MMAL_STATUS_T mmal_port_parameter_set( MMAL_PORT_T* port, const MMAL_PARAMETER_HEADER_T* param );
+MMAL_STATUS_T mmal_port_parameter_set_boolean( MMAL_PORT_T* port, uint32_t id, MMAL_BOOL_T value );
+MMAL_STATUS_T mmal_port_parameter_set_uint32( MMAL_PORT_T* port, uint32_t id, uint32_t value );
+MMAL_STATUS_T mmal_port_parameter_set_rational( MMAL_PORT_T* port, uint32_t id, MMAL_RATIONAL_T value );
+MMAL_STATUS_T mmal_port_send_buffer( MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer );
+MMAL_STATUS_T mmal_port_flush( MMAL_PORT_T* port );
+
+void mmal_format_copy( MMAL_ES_FORMAT_T* to, MMAL_ES_FORMAT_T* from );
+MMAL_STATUS_T mmal_format_full_copy( MMAL_ES_FORMAT_T* to, MMAL_ES_FORMAT_T* from );
+
+MMAL_POOL_T* mmal_port_pool_create( MMAL_PORT_T* port, unsigned int headers, uint32_t payloadSize );
+void mmal_port_pool_destroy( MMAL_PORT_T* port, MMAL_POOL_T* pool );
+MMAL_POOL_T* mmal_pool_create( unsigned int headers, uint32_t payloadSize );
+void mmal_pool_destroy( MMAL_POOL_T* pool );
+
+MMAL_BUFFER_HEADER_T* mmal_queue_get( MMAL_QUEUE_T* queue );
+unsigned int mmal_queue_length( MMAL_QUEUE_T* queue );
+
+MMAL_STATUS_T mmal_buffer_header_mem_lock( MMAL_BUFFER_HEADER_T* buffer );
+void mmal_buffer_header_mem_unlock( MMAL_BUFFER_HEADER_T* buffer );
+void mmal_buffer_header_acquire( MMAL_BUFFER_HEADER_T* buffer );
+void mmal_buffer_header_release( MMAL_BUFFER_HEADER_T* buffer );
+
+MMAL_STATUS_T mmal_connection_create( MMAL_CONNECTION_T** connection, MMAL_PORT_T* out, MMAL_PORT_T* in, uint32_t flags );
+MMAL_STATUS_T mmal_connection_enable( MMAL_CONNECTION_T* connection );
+MMAL_STATUS_T mmal_connection_disable( MMAL_CONNECTION_T* connection );
+MMAL_STATUS_T mmal_connection_destroy( MMAL_CONNECTION_T* connection );
+
+#endif // FAKE_MMAL_H
@@ -0,0 +1,597 @@
+/*
+    pipebench - benchmark of PiRexBot camera to web streaming pipeline
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "SyntheticVideoSource.hpp"
+
+#include <string.h>
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <jpeglib.h>
+
+#include "XJpegEncoder.hpp"
+#include "XManualResetEvent.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Number of different frames to cycle through (so encoder does not deal with same image all the time)
+    #define PATTERNS_COUNT     (8)
+
+    // Frame number is put into top-left corner of RGB/YUV frames as a row of black/white blocks
+    #define FRAME_NUMBER_BITS  (20)
+    #define FRAME_NUMBER_BLOCK (16)
+
+    // JPEG frames get their number as a comment right after the start of image marker
+    #define FRAME_NUMBER_COMMENT_SIZE (10)
+
+    class JpegDecodeException : public exception
+    {
+    public:
+        virtual const char* what( ) const throw( )
+        {
+            return "JPEG decoding failure";
+        }
+    };
+
+    static void decode_error_exit( j_common_ptr /* cinfo */ )
+    {
+        throw JpegDecodeException( );
+    }
+
+    static void decode_output_message( j_common_ptr /* cinfo */ )
+    {
+    }
+
+    // Private implementation details for the SyntheticVideoSource
+    class SyntheticVideoSourceData
+    {
+    public:
+        uint32_t                  Width;
+        uint32_t                  Height;
+        uint32_t                  FrameRate;
+        XPixelFormat              Format;
+        bool                      ZeroCopy;
+        uint16_t                  JpegQuality;
+
+        recursive_mutex           Sync;
+        thread                    ControlThread;
+        XManualResetEvent         NeedToStop;
+        IVideoSourceListener*     Listener;
+        function<void( uint32_t )> FrameHandler;
+        bool                      Running;
+        volatile bool             CaptureSuspended;
+        volatile uint32_t         FramesGenerated;
+
+        // frames to cycle through - RGB/YUV images or their JPEG encoded copies
+        vector<shared_ptr<XImage>> Patterns;
+        vector<vector<uint8_t>>    JpegPatterns;
+
+    public:
+        SyntheticVideoSourceData( uint32_t width, uint32_t height, uint32_t frameRate, XPixelFormat format,
+                                  bool zeroCopy, uint16_t jpegQuality ) :
+            Width( width ), Height( height ), FrameRate( frameRate ), Format( format ),
+            ZeroCopy( zeroCopy ), JpegQuality( jpegQuality ),
+            Sync( ), ControlThread( ), NeedToStop( ), Listener( nullptr ), FrameHandler( ), Running( false ),
+            CaptureSuspended( false ), FramesGenerated( 0 ), Patterns( ), JpegPatterns( )
+        {
+            if ( Width < FRAME_NUMBER_BITS * FRAME_NUMBER_BLOCK )
+            {
+                Width = FRAME_NUMBER_BITS * FRAME_NUMBER_BLOCK;
+            }
+            if ( Height < FRAME_NUMBER_BLOCK )
+            {
+                Height = FRAME_NUMBER_BLOCK;
+            }
+            if ( FrameRate == 0 )
+            {
+                FrameRate = 1;
+            }
+        }
+
+        bool Start( );
+        void SignalToStop( );
+        void WaitForStop( );
+        bool IsRunning( );
+
+    private:
+        bool GeneratePatterns( );
+        shared_ptr<XImage> ConvertToYUV420( const shared_ptr<XImage>& rgbImage );
+        shared_ptr<XImage> CreateFrame( uint32_t frameNumber, shared_ptr<XImage>& rawBuffer, vector<uint8_t>& jpegBuffer );
+        void NotifyNewImage( const shared_ptr<const XImage>& image );
+        void NotifyError( const string& errorMessage, bool fatal );
+
+        static void ControlThreadHanlder( SyntheticVideoSourceData* me );
+    };
+}
+
+SyntheticVideoSource::SyntheticVideoSource( uint32_t width, uint32_t height, uint32_t frameRate, XPixelFormat format,
+                                            bool zeroCopy, uint16_t jpegQuality ) :
+    mData( new Private::SyntheticVideoSourceData( width, height, frameRate, format, zeroCopy, jpegQuality ) )
+{
+}
+
+SyntheticVideoSource::~SyntheticVideoSource( )
+{
+    mData->SignalToStop( );
+    mData->WaitForStop( );
+    delete mData;
+}
+
+// Set handler to call with frame number right before the frame is given to listener
+void SyntheticVideoSource::SetFrameHandler( const function<void( uint32_t )>& handler )
+{
+    lock_guard<recursive_mutex> lock( mData->Sync );
+    mData->FrameHandler = handler;
+}
+
+// Start video source so it initializes and begins providing video frames
+bool SyntheticVideoSource::Start( )
+{
+    return mData->Start( );
+}
+
+// Signal video to stop, so it could finalize and clean-up
+void SyntheticVideoSource::SignalToStop( )
+{
+    mData->SignalToStop( );
+}
+
+// Wait till video source (its thread) stops
+void SyntheticVideoSource::WaitForStop( )
+{
+    mData->WaitForStop( );
+}
+
+// Check if video source is still running
+bool SyntheticVideoSource::IsRunning( )
+{
+    return mData->IsRunning( );
+}
+
+// Get number of frames generated since the start of the video source
+uint32_t SyntheticVideoSource::FramesReceived( )
+{
+    return mData->FramesGenerated;
+}
+
+// Suspend/Resume generation of video frames
+void SyntheticVideoSource::SuspendCapture( bool suspend )
+{
+    mData->CaptureSuspended = suspend;
+}
+bool SyntheticVideoSource::IsCaptureSuspended( )
+{
+    return mData->CaptureSuspended;
+}
+
+// Set video source listener returning the old one
+IVideoSourceListener* SyntheticVideoSource::SetListener( IVideoSourceListener* listener )
+{
+    lock_guard<recursive_mutex> lock( mData->Sync );
+    IVideoSourceListener*       oldListener = mData->Listener;
+
+    mData->Listener = listener;
+
+    return oldListener;
+}
+
+// Get number of the frame from its JPEG image
+bool SyntheticVideoSource::GetFrameNumber( const uint8_t* jpegData, uint32_t jpegSize, uint32_t* frameNumber )
+{
+    bool ret = false;
+
+    if ( ( jpegSize > FRAME_NUMBER_COMMENT_SIZE ) && ( jpegData[2] == 0xFF ) && ( jpegData[3] == 0xFE ) )
+    {
+        // frame provided as JPEG by the source itself
+        *frameNumber = ( static_cast<uint32_t>( jpegData[6] ) << 24 ) | ( static_cast<uint32_t>( jpegData[7] ) << 16 ) |
+                       ( static_cast<uint32_t>( jpegData[8] ) << 8  ) |   static_cast<uint32_t>( jpegData[9] );
+        ret = true;
+    }
+    else if ( jpegSize > 2 )
+    {
+        // frame encoded from RGB/YUV image - decode only the first row of blocks at 1/8 scale, which gives
+        // average values of 8x8 blocks (i.e. DC coefficients only), and read the blocks of frame number
+        struct jpeg_decompress_struct cinfo;
+        struct jpeg_error_mgr         jerr;
+
+        cinfo.err           = jpeg_std_error( &jerr );
+        jerr.error_exit     = Private::decode_error_exit;
+        jerr.output_message = Private::decode_output_message;
+
+        jpeg_create_decompress( &cinfo );
+
+        try
+        {
+            jpeg_mem_src( &cinfo, const_cast<uint8_t*>( jpegData ), jpegSize );
+            jpeg_read_header( &cinfo, TRUE );
+
+            cinfo.out_color_space = JCS_GRAYSCALE;
+            cinfo.scale_num       = 1;
+            cinfo.scale_denom     = 8;
+
+            jpeg_start_decompress( &cinfo );
+
+            if ( cinfo.output_width >= FRAME_NUMBER_BITS * FRAME_NUMBER_BLOCK / 8 )
+            {
+                vector<uint8_t> row( cinfo.output_width * cinfo.output_components );
+                JSAMPROW        rowPtr = row.data( );
+
+                jpeg_read_scanlines( &cinfo, &rowPtr, 1 );
+
+                *frameNumber = 0;
+
+                for ( uint32_t bit = 0; bit < FRAME_NUMBER_BITS; bit++ )
+                {
+                    if ( row[bit * FRAME_NUMBER_BLOCK / 8] >= 128 )
+                    {
+                        *frameNumber |= ( 1u << bit );
+                    }
+                }
+
+                ret = true;
+            }
+
+            jpeg_abort_decompress( &cinfo );
+        }
+        catch ( const Private::JpegDecodeException& )
+        {
+            ret = false;
+        }
+
+        jpeg_destroy_decompress( &cinfo );
+    }
+
+    return ret;
+}
+
+namespace Private
+{
+
+// Start video source thread
+bool SyntheticVideoSourceData::Start( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+    bool                        ret = true;
+
+    if ( !IsRunning( ) )
+    {
+        ret = GeneratePatterns( );
+
+        if ( ret )
+        {
+            NeedToStop.Reset( );
+            Running         = true;
+            FramesGenerated = 0;
+
+            ControlThread = thread( ControlThreadHanlder, this );
+        }
+    }
+
+    return ret;
+}
+
+// Signal video to stop
+void SyntheticVideoSourceData::SignalToStop( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( IsRunning( ) )
+    {
+        NeedToStop.Signal( );
+    }
+}
+
+// Wait till video source stops
+void SyntheticVideoSourceData::WaitForStop( )
+{
+    SignalToStop( );
+
+    if ( ( IsRunning( ) ) || ( ControlThread.joinable( ) ) )
+    {
+        ControlThread.join( );
+    }
+}
+
+// Check if video source is still running
+bool SyntheticVideoSourceData::IsRunning( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( ( !Running ) && ( ControlThread.joinable( ) ) )
+    {
+        ControlThread.join( );
+    }
+
+    return Running;
+}
+
+// Generate images to cycle through - some texture moving from one frame to another
+bool SyntheticVideoSourceData::GeneratePatterns( )
+{
+    XJpegEncoder encoder( JpegQuality );
+    bool         ret = true;
+
+    Patterns.clear( );
+    JpegPatterns.clear( );
+
+    for ( uint32_t i = 0; ( i < PATTERNS_COUNT ) && ( ret ); i++ )
+    {
+        shared_ptr<XImage> image = XImage::Allocate( Width, Height, XPixelFormat::RGB24 );
+
+        if ( !image )
+        {
+            ret = false;
+        }
+        else
+        {
+            for ( uint32_t y = 0; y < Height; y++ )
+            {
+                uint8_t* row = image->Data( ) + y * image->Stride( );
+
+                for ( uint32_t x = 0; x < Width; x++, row += 3 )
+                {
+                    row[RedIndex]   = static_cast<uint8_t>( x + i * 4 );
+                    row[GreenIndex] = static_cast<uint8_t>( y * 2 + i * 4 );
+                    row[BlueIndex]  = static_cast<uint8_t>( ( x ^ y ) + i * 8 );
+                }
+            }
+
+            if ( Format == XPixelFormat::YUV420 )
+            {
+                image = ConvertToYUV420( image );
+                ret   = static_cast<bool>( image );
+            }
+
+            Patterns.push_back( image );
+
+            if ( ( ret ) && ( Format == XPixelFormat::JPEG ) )
+            {
+                uint32_t size      = Width * Height * 3;
+                uint8_t* buffer = static_cast<uint8_t*>( malloc( size ) );
+
+                ret = ( ( buffer != nullptr ) && ( encoder.EncodeToMemory( image, &buffer, &size ) == XError::Success ) );
+
+                if ( ret )
+                {
+                    JpegPatterns.push_back( vector<uint8_t>( buffer, buffer + size ) );
+                }
+
+                free( buffer );
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Convert RGB image to YUV420 (JFIF's full range YCbCr, chroma is averaged over 2x2 pixels)
+shared_ptr<XImage> SyntheticVideoSourceData::ConvertToYUV420( const shared_ptr<XImage>& rgbImage )
+{
+    shared_ptr<XImage> yuvImage = XImage::Allocate( Width, Height, XPixelFormat::YUV420, true );
+
+    if ( yuvImage )
+    {
+        for ( uint32_t y = 0; y < Height; y++ )
+        {
+            const uint8_t* rgbRow = rgbImage->Data( ) + y * rgbImage->Stride( );
+            uint8_t*       yRow   = yuvImage->PlaneData( 0 ) + y * yuvImage->PlaneStride( 0 );
+            uint8_t*       uRow   = yuvImage->PlaneData( 1 ) + ( y / 2 ) * yuvImage->PlaneStride( 1 );
+            uint8_t*       vRow   = yuvImage->PlaneData( 2 ) + ( y / 2 ) * yuvImage->PlaneStride( 2 );
+
+            for ( uint32_t x = 0; x < Width; x++, rgbRow += 3 )
+            {
+                int r = rgbRow[RedIndex];
+                int g = rgbRow[GreenIndex];
+                int b = rgbRow[BlueIndex];
+
+                yRow[x] = static_cast<uint8_t>( ( 19595 * r + 38470 * g + 7471 * b + 32768 ) >> 16 );
+
+                // each chroma sample gets a quarter of four pixels' values (pre-filled with zeros)
+                uRow[x / 2] += static_cast<uint8_t>( ( ( -11059 * r - 21709 * g + 32768 * b ) / 65536 + 128 ) / 4 );
+                vRow[x / 2] += static_cast<uint8_t>( ( ( 32768 * r - 27439 * g - 5329 * b ) / 65536 + 128 ) / 4 );
+            }
+        }
+    }
+
+    return yuvImage;
+}
+
+// Create the frame of the specified number using provided buffers (if zero copy is not enabled)
+shared_ptr<XImage> SyntheticVideoSourceData::CreateFrame( uint32_t frameNumber, shared_ptr<XImage>& rawBuffer,
+                                                          vector<uint8_t>& jpegBuffer )
+{
+    uint32_t           patternIndex = frameNumber % PATTERNS_COUNT;
+    shared_ptr<XImage> frame;
+
+    if ( Format == XPixelFormat::JPEG )
+    {
+        const vector<uint8_t>&     pattern = JpegPatterns[patternIndex];
+        shared_ptr<vector<uint8_t>> ownBuffer;
+        vector<uint8_t>*           buffer  = &jpegBuffer;
+
+        if ( ZeroCopy )
+        {
+            ownBuffer = make_shared<vector<uint8_t>>( );
+            buffer    = ownBuffer.get( );
+        }
+
+        // SOI, COM marker with frame number, then the rest of the pattern
+        buffer->resize( pattern.size( ) + FRAME_NUMBER_COMMENT_SIZE - 2 );
+
+        uint8_t* data = buffer->data( );
+
+        data[0] = 0xFF; data[1] = 0xD8;
+        data[2] = 0xFF; data[3] = 0xFE;
+        data[4] = 0x00; data[5] = 0x06;
+        data[6] = static_cast<uint8_t>( frameNumber >> 24 );
+        data[7] = static_cast<uint8_t>( frameNumber >> 16 );
+        data[8] = static_cast<uint8_t>( frameNumber >> 8 );
+        data[9] = static_cast<uint8_t>( frameNumber );
+
+        memcpy( data + FRAME_NUMBER_COMMENT_SIZE, pattern.data( ) + 2, pattern.size( ) - 2 );
+
+        if ( ZeroCopy )
+        {
+            frame = XImage::Create( data, buffer->size( ), 1, buffer->size( ), XPixelFormat::JPEG, [ownBuffer]( ) { } );
+        }
+        else
+        {
+            frame = XImage::Create( data, buffer->size( ), 1, buffer->size( ), XPixelFormat::JPEG );
+        }
+    }
+    else
+    {
+        if ( ( ZeroCopy ) || ( !rawBuffer ) )
+        {
+            rawBuffer = XImage::Allocate( Width, Height, Format );
+        }
+
+        if ( rawBuffer )
+        {
+            // luma blocks of YUV frames are surrounded by neutral chroma
+            uint32_t bytesPerPixel = ( Format == XPixelFormat::YUV420 ) ? 1 : 3;
+
+            Patterns[patternIndex]->CopyData( rawBuffer );
+
+            // put frame number as a row of black/white blocks
+            for ( uint32_t y = 0; y < FRAME_NUMBER_BLOCK; y++ )
+            {
+                uint8_t* row = rawBuffer->Data( ) + y * rawBuffer->Stride( );
+
+                for ( uint32_t bit = 0; bit < FRAME_NUMBER_BITS; bit++ )
+                {
+                    memset( row + bit * FRAME_NUMBER_BLOCK * bytesPerPixel, ( frameNumber & ( 1u << bit ) ) ? 255 : 0,
+                            FRAME_NUMBER_BLOCK * bytesPerPixel );
+                }
+            }
+
+            if ( Format == XPixelFormat::YUV420 )
+            {
+                for ( int32_t plane = 1; plane < 3; plane++ )
+                {
+                    for ( uint32_t y = 0; y < FRAME_NUMBER_BLOCK / 2; y++ )
+                    {
+                        memset( rawBuffer->PlaneData( plane ) + y * rawBuffer->PlaneStride( plane ), 128,
+                                FRAME_NUMBER_BITS * FRAME_NUMBER_BLOCK / 2 );
+                    }
+                }
+            }
+
+            frame = ( ZeroCopy ) ? rawBuffer :
+                    XImage::Create( rawBuffer->Data( ), Width, Height, rawBuffer->Stride( ), Format );
+        }
+    }
+
+    return frame;
+}
+
+// Notify listener with a new image
+void SyntheticVideoSourceData::NotifyNewImage( const shared_ptr<const XImage>& image )
+{
+    IVideoSourceListener* myListener;
+
+    {
+        lock_guard<recursive_mutex> lock( Sync );
+        myListener = Listener;
+    }
+
+    if ( myListener != nullptr )
+    {
+        myListener->OnNewImage( image );
+    }
+}
+
+// Notify listener about error
+void SyntheticVideoSourceData::NotifyError( const string& errorMessage, bool fatal )
+{
+    IVideoSourceListener* myListener;
+
+    {
+        lock_guard<recursive_mutex> lock( Sync );
+        myListener = Listener;
+    }
+
+    if ( myListener != nullptr )
+    {
+        myListener->OnError( errorMessage, fatal );
+    }
+}
+
+// Generate frames at the configured rate
+void SyntheticVideoSourceData::ControlThreadHanlder( SyntheticVideoSourceData* me )
+{
+    steady_clock::duration   frameInterval = duration_cast<steady_clock::duration>( microseconds( 1000000 / me->FrameRate ) );
+    steady_clock::time_point nextFrameTime = steady_clock::now( );
+    shared_ptr<XImage>       rawBuffer;
+    vector<uint8_t>          jpegBuffer;
+    uint32_t                 frameNumber   = 0;
+
+    while ( !me->NeedToStop.IsSignaled( ) )
+    {
+        this_thread::sleep_until( nextFrameTime );
+        nextFrameTime += frameInterval;
+
+        if ( !me->CaptureSuspended )
+        {
+            shared_ptr<XImage>         frame = me->CreateFrame( frameNumber, rawBuffer, jpegBuffer );
+            function<void( uint32_t )> frameHandler;
+
+            if ( !frame )
+            {
+                me->NotifyError( "Failed allocating an image", false );
+            }
+            else
+            {
+                {
+                    lock_guard<recursive_mutex> lock( me->Sync );
+                    frameHandler = me->FrameHandler;
+                }
+
+                if ( frameHandler )
+                {
+                    frameHandler( frameNumber );
+                }
+
+                me->FramesGenerated++;
+                me->NotifyNewImage( frame );
+            }
+
+            frameNumber = ( frameNumber + 1 ) % ( 1u << FRAME_NUMBER_BITS );
+        }
+
+        // don't try catching up if frames got late too much
+        if ( steady_clock::now( ) - nextFrameTime > frameInterval * 2 )
+        {
+            nextFrameTime = steady_clock::now( );
+        }
+    }
+
+    {
+        lock_guard<recursive_mutex> lock( me->Sync );
+        me->Running = false;
+    }
+}
+
+} // namespace Private
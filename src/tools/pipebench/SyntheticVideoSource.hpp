@@ -0,0 +1,66 @@
+/*
+    pipebench - benchmark of PiRexBot camera to web streaming pipeline
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef SYNTHETIC_VIDEO_SOURCE_HPP
+#define SYNTHETIC_VIDEO_SOURCE_HPP
+
+#include <functional>
+
+#include "IVideoSource.hpp"
+#include "XImage.hpp"
+
+namespace Private
+{
+    class SyntheticVideoSourceData;
+}
+
+// Video source replaying generated RGB24, YUV420 or JPEG frames at the specified rate. Every frame carries
+// its sequence number, which can be recovered from JPEG image of the frame (see GetFrameNumber).
+class SyntheticVideoSource : public IVideoSource
+{
+public:
+    // Create source of the specified frame size (at least 320x240) and format (RGB24, YUV420 or JPEG). When zero
+    // copy is enabled, listeners may keep frames; otherwise they must copy those to keep them.
+    SyntheticVideoSource( uint32_t width, uint32_t height, uint32_t frameRate, XPixelFormat format,
+                          bool zeroCopy = false, uint16_t jpegQuality = 85 );
+    ~SyntheticVideoSource( );
+
+    // Set handler to call with frame number right before the frame is given to listener
+    void SetFrameHandler( const std::function<void( uint32_t )>& handler );
+
+    // IVideoSource implementation
+    bool Start( );
+    void SignalToStop( );
+    void WaitForStop( );
+    bool IsRunning( );
+    uint32_t FramesReceived( );
+    void SuspendCapture( bool suspend );
+    bool IsCaptureSuspended( );
+    IVideoSourceListener* SetListener( IVideoSourceListener* listener );
+
+public:
+    // Get number of the frame from its JPEG image
+    static bool GetFrameNumber( const uint8_t* jpegData, uint32_t jpegSize, uint32_t* frameNumber );
+
+private:
+    Private::SyntheticVideoSourceData* mData;
+};
+
+#endif // SYNTHETIC_VIDEO_SOURCE_HPP
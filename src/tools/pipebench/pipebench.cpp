@@ -0,0 +1,856 @@
+/*
+    pipebench - benchmark of PiRexBot camera to web streaming pipeline
+
+    Copyright (C) 2018, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "XWebServer.hpp"
+#include "XVideoSourceToWeb.hpp"
+#include "SyntheticVideoSource.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// Number of frames to remember generation time of, to calculate latency of the frames received by clients
+#define FRAME_TIMES_LENGTH   (1024)
+
+// Time (ms) given to clients' process to connect to web server
+#define CONNECT_TIMEOUT      (5000)
+// Timeout (ms) of socket read operations, after which clients check if it is time to stop
+#define SOCKET_READ_TIMEOUT  (250)
+
+// Benchmark settings
+struct
+{
+    uint32_t     FrameWidth;
+    uint32_t     FrameHeight;
+    uint32_t     FrameRate;
+    XPixelFormat Format;
+    bool         ZeroCopy;
+    uint16_t     JpegQuality;
+    uint32_t     EncoderThreads;
+    uint32_t     MjpegClients;
+    uint32_t     JpegClients;
+    uint32_t     Duration;
+    uint32_t     Warmup;
+    uint16_t     WebPort;
+    uint32_t     WebThreads;
+}
+Settings;
+
+// Benchmark phases clients' process goes through
+enum
+{
+    PhaseStarting = 0,
+    PhaseWarmup,
+    PhaseMeasuring,
+    PhaseDone
+};
+
+// Data shared between web server's and clients' processes
+struct SharedData
+{
+    atomic<uint32_t> Phase;
+    // generation time (steady clock, microseconds) of the recent frames
+    atomic<uint32_t> FrameNumbers[FRAME_TIMES_LENGTH];
+    atomic<int64_t>  FrameTimes[FRAME_TIMES_LENGTH];
+};
+
+// Statistics collected by a client
+struct ClientStats
+{
+    bool             IsMjpeg;
+    uint32_t         Frames;
+    uint64_t         Bytes;
+    uint32_t         UnknownFrames;
+    uint32_t         Reconnects;
+    vector<uint32_t> Latencies;
+};
+
+// Current time in microseconds (same clock in both processes)
+static int64_t NowUs( )
+{
+    return duration_cast<microseconds>( steady_clock::now( ).time_since_epoch( ) ).count( );
+}
+
+// Total CPU time (microseconds) used by the process
+static int64_t ProcessCpuTimeUs( )
+{
+    struct rusage usage;
+
+    getrusage( RUSAGE_SELF, &usage );
+
+    return static_cast<int64_t>( usage.ru_utime.tv_sec + usage.ru_stime.tv_sec ) * 1000000 +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// Set default values for settings
+static void SetDefaultSettings( )
+{
+    Settings.FrameWidth     = 640;
+    Settings.FrameHeight    = 480;
+    Settings.FrameRate      = 30;
+    Settings.Format         = XPixelFormat::RGB24;
+    Settings.ZeroCopy       = true;
+    Settings.JpegQuality    = 85;
+    Settings.EncoderThreads = 1;
+    Settings.MjpegClients   = 4;
+    Settings.JpegClients    = 0;
+    Settings.Duration       = 10;
+    Settings.Warmup         = 2;
+    Settings.WebPort        = 8090;
+    Settings.WebThreads     = 0;
+}
+
+// Parse command line and override default settings
+static bool ParseCommandLine( int argc, char* argv[] )
+{
+    bool ret = true;
+    int  i;
+
+    for ( i = 1; i < argc; i++ )
+    {
+        char* ptrDelimiter = strchr( argv[i], ':' );
+
+        if ( ( ptrDelimiter == nullptr ) || ( argv[i][0] != '-' ) )
+        {
+            break;
+        }
+
+        string   key   = string( argv[i] + 1, ptrDelimiter - argv[i] - 1 );
+        string   value = string( ptrDelimiter + 1 );
+        uint32_t number;
+
+        if ( key == "size" )
+        {
+            if ( sscanf( value.c_str( ), "%ux%u", &Settings.FrameWidth, &Settings.FrameHeight ) != 2 )
+                break;
+            if ( ( Settings.FrameWidth < 320 ) || ( Settings.FrameHeight < 240 ) )
+                break;
+        }
+        else if ( key == "fps" )
+        {
+            if ( ( sscanf( value.c_str( ), "%u", &Settings.FrameRate ) != 1 ) || ( Settings.FrameRate < 1 ) || ( Settings.FrameRate > 120 ) )
+                break;
+        }
+        else if ( key == "format" )
+        {
+            if ( value == "rgb" )
+                Settings.Format = XPixelFormat::RGB24;
+            else if ( value == "yuv" )
+                Settings.Format = XPixelFormat::YUV420;
+            else if ( value == "jpeg" )
+                Settings.Format = XPixelFormat::JPEG;
+            else
+                break;
+        }
+        else if ( key == "zerocopy" )
+        {
+            if ( ( value != "0" ) && ( value != "1" ) )
+                break;
+
+            Settings.ZeroCopy = ( value == "1" );
+        }
+        else if ( key == "quality" )
+        {
+            if ( ( sscanf( value.c_str( ), "%u", &number ) != 1 ) || ( number < 1 ) || ( number > 100 ) )
+                break;
+
+            Settings.JpegQuality = static_cast<uint16_t>( number );
+        }
+        else if ( key == "encthreads" )
+        {
+            if ( ( sscanf( value.c_str( ), "%u", &Settings.EncoderThreads ) != 1 ) ||
+                 ( Settings.EncoderThreads < 1 ) || ( Settings.EncoderThreads > 16 ) )
+                break;
+        }
+        else if ( key == "mjpeg" )
+        {
+            if ( sscanf( value.c_str( ), "%u", &Settings.MjpegClients ) != 1 )
+                break;
+        }
+        else if ( key == "jpeg" )
+        {
+            if ( sscanf( value.c_str( ), "%u", &Settings.JpegClients ) != 1 )
+                break;
+        }
+        else if ( key == "time" )
+        {
+            if ( ( sscanf( value.c_str( ), "%u", &Settings.Duration ) != 1 ) || ( Settings.Duration < 1 ) )
+                break;
+        }
+        else if ( key == "warmup" )
+        {
+            if ( sscanf( value.c_str( ), "%u", &Settings.Warmup ) != 1 )
+                break;
+        }
+        else if ( key == "port" )
+        {
+            if ( ( sscanf( value.c_str( ), "%u", &number ) != 1 ) || ( number < 1 ) || ( number > 65535 ) )
+                break;
+
+            Settings.WebPort = static_cast<uint16_t>( number );
+        }
+        else if ( key == "webthreads" )
+        {
+            if ( ( sscanf( value.c_str( ), "%u", &Settings.WebThreads ) != 1 ) || ( Settings.WebThreads > 4 ) )
+                break;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if ( ( i != argc ) || ( Settings.MjpegClients + Settings.JpegClients == 0 ) )
+    {
+        printf( "pipebench - benchmark of camera to web streaming pipeline \n\n" );
+        printf( "Available command line options: \n" );
+        printf( "  -size:<WxH>   Size of video frames, at least 320x240. \n" );
+        printf( "                Default is 640x480. \n" );
+        printf( "  -fps:<1-120>  Frame rate of the synthetic video source. \n" );
+        printf( "                Default is 30. \n" );
+        printf( "  -format:<?>   Format of frames provided by video source: rgb or yuv \n" );
+        printf( "                (encoded by web streaming) or jpeg (already encoded, as \n" );
+        printf( "                by camera). \n" );
+        printf( "                Default is rgb. \n" );
+        printf( "  -zerocopy:<0|1> Provide frames to web streaming without copying. \n" );
+        printf( "                Default is 1. \n" );
+        printf( "  -quality:<1-100> JPEG quality. \n" );
+        printf( "                Default is 85. \n" );
+        printf( "  -encthreads:<1-16> Number of threads to encode a JPEG with. \n" );
+        printf( "                Default is 1. \n" );
+        printf( "  -mjpeg:<num>  Number of clients receiving MJPEG stream. \n" );
+        printf( "                Default is 4. \n" );
+        printf( "  -jpeg:<num>   Number of clients polling JPEG images. \n" );
+        printf( "                Default is 0. \n" );
+        printf( "  -time:<sec>   Duration of measurements. \n" );
+        printf( "                Default is 10. \n" );
+        printf( "  -warmup:<sec> Time to run before starting measurements. \n" );
+        printf( "                Default is 2. \n" );
+        printf( "  -port:<num>   Port number for web server to listen on. \n" );
+        printf( "                Default is 8090. \n" );
+        printf( "  -webthreads:<0-4> Number of web server's worker threads. \n" );
+        printf( "                Default is 0. \n" );
+        printf( "\n" );
+
+        ret = false;
+    }
+
+    return ret;
+}
+
+/* ================================================================= */
+/* Clients' side of the benchmark                                    */
+/* ================================================================= */
+
+// Blocking HTTP connection reading headers and bodies of responses
+class HttpConnection
+{
+public:
+    HttpConnection( atomic<bool>& needToStop ) :
+        mSocket( -1 ), mBuffer( 64 * 1024 ), mStart( 0 ), mEnd( 0 ), mNeedToStop( needToStop )
+    {
+    }
+
+    ~HttpConnection( )
+    {
+        Close( );
+    }
+
+    // Connect to web server on local host
+    bool Connect( uint16_t port )
+    {
+        struct sockaddr_in address = { 0 };
+        struct timeval     timeout = { 0, SOCKET_READ_TIMEOUT * 1000 };
+        int                noDelay = 1;
+
+        Close( );
+
+        address.sin_family      = AF_INET;
+        address.sin_port        = htons( port );
+        address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+        mSocket = socket( AF_INET, SOCK_STREAM, 0 );
+
+        if ( ( mSocket != -1 ) && ( connect( mSocket, (struct sockaddr*) &address, sizeof( address ) ) == 0 ) )
+        {
+            setsockopt( mSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+            setsockopt( mSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof( noDelay ) );
+        }
+        else
+        {
+            Close( );
+        }
+
+        return ( mSocket != -1 );
+    }
+
+    void Close( )
+    {
+        if ( mSocket != -1 )
+        {
+            close( mSocket );
+            mSocket = -1;
+        }
+        mStart = mEnd = 0;
+    }
+
+    bool Send( const string& data )
+    {
+        return ( send( mSocket, data.c_str( ), data.length( ), MSG_NOSIGNAL ) == static_cast<ssize_t>( data.length( ) ) );
+    }
+
+    // Read everything up to an empty line
+    bool ReadHeaders( string& headers )
+    {
+        bool ret   = true;
+        bool found = false;
+
+        headers.clear( );
+
+        while ( ( ret ) && ( !found ) )
+        {
+            const char* data = mBuffer.data( ) + mStart;
+            const char* end  = static_cast<const char*>( memmem( data, mEnd - mStart, "\r\n\r\n", 4 ) );
+
+            if ( end != nullptr )
+            {
+                headers.assign( data, end + 4 - data );
+                mStart += end + 4 - data;
+                found   = true;
+            }
+            else
+            {
+                ret = Receive( );
+            }
+        }
+
+        return ret;
+    }
+
+    // Read body of the specified length
+    bool ReadBody( size_t length, vector<uint8_t>& body )
+    {
+        bool ret = true;
+
+        body.resize( length );
+
+        for ( size_t copied = 0; ( ret ) && ( copied < length ); )
+        {
+            if ( mStart == mEnd )
+            {
+                ret = Receive( );
+            }
+            else
+            {
+                size_t toCopy = min( length - copied, mEnd - mStart );
+
+                memcpy( body.data( ) + copied, mBuffer.data( ) + mStart, toCopy );
+                mStart += toCopy;
+                copied += toCopy;
+            }
+        }
+
+        return ret;
+    }
+
+private:
+    // Receive more data into the buffer
+    bool Receive( )
+    {
+        bool ret = false;
+
+        if ( mStart == mEnd )
+        {
+            mStart = mEnd = 0;
+        }
+        else if ( mEnd == mBuffer.size( ) )
+        {
+            if ( mStart != 0 )
+            {
+                memmove( mBuffer.data( ), mBuffer.data( ) + mStart, mEnd - mStart );
+                mEnd  -= mStart;
+                mStart = 0;
+            }
+            else
+            {
+                mBuffer.resize( mBuffer.size( ) * 2 );
+            }
+        }
+
+        while ( ( !ret ) && ( !mNeedToStop ) && ( mSocket != -1 ) )
+        {
+            ssize_t received = recv( mSocket, mBuffer.data( ) + mEnd, mBuffer.size( ) - mEnd, 0 );
+
+            if ( received > 0 )
+            {
+                mEnd += received;
+                ret   = true;
+            }
+            else if ( ( received == 0 ) || ( ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) && ( errno != EINTR ) ) )
+            {
+                Close( );
+            }
+        }
+
+        return ret;
+    }
+
+private:
+    int           mSocket;
+    vector<char>  mBuffer;
+    size_t        mStart;
+    size_t        mEnd;
+    atomic<bool>& mNeedToStop;
+};
+
+// Get value of the "Content-Length" header
+static size_t GetContentLength( const string& headers )
+{
+    string lowerHeaders = headers;
+    size_t length       = 0;
+
+    transform( lowerHeaders.begin( ), lowerHeaders.end( ), lowerHeaders.begin( ), ::tolower );
+
+    size_t pos = lowerHeaders.find( "content-length:" );
+
+    if ( pos != string::npos )
+    {
+        length = strtoul( lowerHeaders.c_str( ) + pos + 15, nullptr, 10 );
+    }
+
+    return length;
+}
+
+// Account the received frame (if measurements are on)
+static void AccountFrame( const vector<uint8_t>& frame, SharedData* shared, ClientStats& stats )
+{
+    int64_t  now = NowUs( );
+    uint32_t frameNumber;
+
+    if ( shared->Phase == PhaseMeasuring )
+    {
+        stats.Frames++;
+        stats.Bytes += frame.size( );
+
+        if ( SyntheticVideoSource::GetFrameNumber( frame.data( ), frame.size( ), &frameNumber ) )
+        {
+            uint32_t index = frameNumber % FRAME_TIMES_LENGTH;
+            int64_t  time  = shared->FrameTimes[index].load( );
+
+            if ( shared->FrameNumbers[index].load( ) == frameNumber )
+            {
+                stats.Latencies.push_back( static_cast<uint32_t>( now - time ) );
+            }
+            else
+            {
+                stats.UnknownFrames++;
+            }
+        }
+        else
+        {
+            stats.UnknownFrames++;
+        }
+    }
+}
+
+// Client receiving MJPEG stream (restarting it if server refuses or closes it)
+static void MjpegClient( SharedData* shared, atomic<bool>* needToStop, ClientStats* stats )
+{
+    HttpConnection  connection( *needToStop );
+    string          headers;
+    vector<uint8_t> frame;
+    bool            started = false;
+
+    while ( !*needToStop )
+    {
+        if ( ( connection.Connect( Settings.WebPort ) ) &&
+             ( connection.Send( "GET /camera/mjpeg HTTP/1.1\r\nHost: localhost\r\n\r\n" ) ) &&
+             ( connection.ReadHeaders( headers ) ) &&
+             ( headers.compare( 0, 12, "HTTP/1.1 200" ) == 0 ) )
+        {
+            started = true;
+
+            // every part of the stream starts with its own headers
+            while ( ( connection.ReadHeaders( headers ) ) && ( connection.ReadBody( GetContentLength( headers ), frame ) ) )
+            {
+                AccountFrame( frame, shared, *stats );
+            }
+        }
+
+        if ( ( started ) && ( !*needToStop ) && ( shared->Phase == PhaseMeasuring ) )
+        {
+            stats->Reconnects++;
+        }
+
+        connection.Close( );
+
+        if ( !*needToStop )
+        {
+            this_thread::sleep_for( milliseconds( 10 ) );
+        }
+    }
+}
+
+// Client polling JPEG images over persistent connection (reconnecting if needed)
+static void JpegClient( SharedData* shared, atomic<bool>* needToStop, ClientStats* stats )
+{
+    HttpConnection  connection( *needToStop );
+    string          headers;
+    vector<uint8_t> frame;
+    bool            connected = false;
+
+    while ( !*needToStop )
+    {
+        if ( !connected )
+        {
+            connected = connection.Connect( Settings.WebPort );
+        }
+
+        if ( ( connected ) &&
+             ( connection.Send( "GET /camera/jpeg HTTP/1.1\r\nHost: localhost\r\n\r\n" ) ) &&
+             ( connection.ReadHeaders( headers ) ) &&
+             ( connection.ReadBody( GetContentLength( headers ), frame ) ) )
+        {
+            if ( headers.compare( 0, 12, "HTTP/1.1 200" ) == 0 )
+            {
+                AccountFrame( frame, shared, *stats );
+            }
+            else
+            {
+                this_thread::sleep_for( milliseconds( 10 ) );
+            }
+        }
+        else
+        {
+            if ( ( connected ) && ( !*needToStop ) && ( shared->Phase == PhaseMeasuring ) )
+            {
+                stats->Reconnects++;
+            }
+
+            connected = false;
+            this_thread::sleep_for( milliseconds( 10 ) );
+        }
+    }
+}
+
+// Wait till web server accepts connections
+static bool WaitForServer( )
+{
+    atomic<bool>             needToStop( false );
+    HttpConnection           connection( needToStop );
+    steady_clock::time_point start = steady_clock::now( );
+    bool                     ret   = false;
+
+    while ( ( !ret ) && ( duration_cast<milliseconds>( steady_clock::now( ) - start ).count( ) < CONNECT_TIMEOUT ) )
+    {
+        ret = connection.Connect( Settings.WebPort );
+
+        if ( !ret )
+        {
+            this_thread::sleep_for( milliseconds( 50 ) );
+        }
+    }
+
+    return ret;
+}
+
+// Print statistics of the specified type of clients - their frame rate and latency of received frames
+static void PrintClientsStats( const char* title, const vector<ClientStats>& allStats, bool mjpeg )
+{
+    vector<double>   fps;
+    vector<uint32_t> latencies;
+
+    for ( const auto& stats : allStats )
+    {
+        if ( stats.IsMjpeg == mjpeg )
+        {
+            fps.push_back( static_cast<double>( stats.Frames ) / Settings.Duration );
+            latencies.insert( latencies.end( ), stats.Latencies.begin( ), stats.Latencies.end( ) );
+        }
+    }
+
+    if ( !fps.empty( ) )
+    {
+        double sum = 0;
+
+        for ( auto value : fps )
+        {
+            sum += value;
+        }
+
+        printf( "%-5s clients FPS     : min %.1f, avg %.1f, max %.1f \n", title,
+                *min_element( fps.begin( ), fps.end( ) ), sum / fps.size( ), *max_element( fps.begin( ), fps.end( ) ) );
+    }
+
+    if ( !latencies.empty( ) )
+    {
+        double sum = 0;
+
+        for ( auto latency : latencies )
+        {
+            sum += latency;
+        }
+
+        sort( latencies.begin( ), latencies.end( ) );
+
+        printf( "%-5s latency, ms     : avg %.2f, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f \n", title,
+                sum / latencies.size( ) / 1000,
+                latencies[latencies.size( ) / 2] / 1000.0,
+                latencies[latencies.size( ) * 95 / 100] / 1000.0,
+                latencies[latencies.size( ) * 99 / 100] / 1000.0,
+                latencies.back( ) / 1000.0 );
+    }
+}
+
+// Run clients and report what they got
+static int RunClients( SharedData* shared )
+{
+    vector<ClientStats> allStats( Settings.MjpegClients + Settings.JpegClients );
+    vector<thread>      clients;
+    atomic<bool>        needToStop( false );
+    int                 ret = 0;
+
+    if ( !WaitForServer( ) )
+    {
+        printf( "Failed connecting to web server \n" );
+        ret = 1;
+    }
+    else
+    {
+        shared->Phase = PhaseWarmup;
+
+        for ( uint32_t i = 0; i < allStats.size( ); i++ )
+        {
+            allStats[i].IsMjpeg = ( i < Settings.MjpegClients );
+            clients.push_back( thread( ( allStats[i].IsMjpeg ) ? MjpegClient : JpegClient, shared, &needToStop, &allStats[i] ) );
+        }
+
+        this_thread::sleep_for( seconds( Settings.Warmup ) );
+        shared->Phase = PhaseMeasuring;
+        this_thread::sleep_for( seconds( Settings.Duration ) );
+        shared->Phase = PhaseDone;
+
+        needToStop = true;
+
+        for ( auto& client : clients )
+        {
+            client.join( );
+        }
+
+        // summarize all clients
+        uint64_t frames     = 0;
+        uint64_t bytes      = 0;
+        uint32_t unknown    = 0;
+        uint32_t reconnects = 0;
+
+        for ( const auto& stats : allStats )
+        {
+            frames     += stats.Frames;
+            bytes      += stats.Bytes;
+            unknown    += stats.UnknownFrames;
+            reconnects += stats.Reconnects;
+
+            if ( stats.Frames == 0 )
+            {
+                ret = 1;
+            }
+        }
+
+        printf( "Clients               : %u MJPEG, %u JPEG \n", Settings.MjpegClients, Settings.JpegClients );
+        printf( "Throughput            : %.1f frames/s, %.2f MB/s \n",
+                static_cast<double>( frames ) / Settings.Duration, static_cast<double>( bytes ) / Settings.Duration / ( 1024 * 1024 ) );
+
+        PrintClientsStats( "MJPEG", allStats, true );
+        PrintClientsStats( "JPEG", allStats, false );
+
+        if ( unknown != 0 )
+        {
+            printf( "Frames without latency: %u \n", unknown );
+        }
+        if ( reconnects != 0 )
+        {
+            printf( "Clients reconnected   : %u times \n", reconnects );
+        }
+        if ( ret != 0 )
+        {
+            printf( "Some clients did not receive any frames \n" );
+        }
+    }
+
+    return ret;
+}
+
+/* ================================================================= */
+/* Web server's side of the benchmark                                */
+/* ================================================================= */
+
+// Wait for clients' process to reach the specified phase (returns false if it is gone)
+static bool WaitForPhase( SharedData* shared, pid_t clientsPid, uint32_t phase )
+{
+    bool ret = true;
+
+    while ( ( ret ) && ( shared->Phase < phase ) )
+    {
+        int status;
+
+        this_thread::sleep_for( milliseconds( 10 ) );
+        ret = ( waitpid( clientsPid, &status, WNOHANG ) == 0 );
+    }
+
+    return ret;
+}
+
+// Run web server streaming frames of synthetic video source
+static int RunServer( SharedData* shared, pid_t clientsPid )
+{
+    XWebServer           server( "", Settings.WebPort );
+    XVideoSourceToWeb    video2web( Settings.JpegQuality );
+    SyntheticVideoSource videoSource( Settings.FrameWidth, Settings.FrameHeight, Settings.FrameRate,
+                                      Settings.Format, Settings.ZeroCopy, Settings.JpegQuality );
+    int                  ret = 1;
+    int                  status;
+
+    video2web.SetJpegEncoderThreadsCount( Settings.EncoderThreads );
+    server.SetWorkerThreadsCount( Settings.WebThreads );
+    server.AddHandler( video2web.CreateJpegHandler( "/camera/jpeg" ) ).
+           AddHandler( video2web.CreateMjpegHandler( "/camera/mjpeg", Settings.FrameRate ) );
+
+    videoSource.SetListener( video2web.VideoSourceListener( ) );
+    videoSource.SetFrameHandler( [shared]( uint32_t frameNumber )
+    {
+        uint32_t index = frameNumber % FRAME_TIMES_LENGTH;
+
+        shared->FrameTimes[index]   = NowUs( );
+        shared->FrameNumbers[index] = frameNumber;
+    } );
+
+    if ( !server.Start( ) )
+    {
+        printf( "Failed starting web server on port %u \n", Settings.WebPort );
+        kill( clientsPid, SIGTERM );
+    }
+    else if ( !videoSource.Start( ) )
+    {
+        printf( "Failed starting video source \n" );
+        kill( clientsPid, SIGTERM );
+    }
+    else if ( WaitForPhase( shared, clientsPid, PhaseMeasuring ) )
+    {
+        int64_t  cpuStart     = ProcessCpuTimeUs( );
+        uint32_t framesStart  = videoSource.FramesReceived( );
+        uint64_t encodedStart = video2web.EncodeTimeHistogram( ).Count( );
+        uint64_t encodeTime   = video2web.EncodeTimeHistogram( ).Sum( );
+
+        if ( WaitForPhase( shared, clientsPid, PhaseDone ) )
+        {
+            int64_t  cpuTime = ProcessCpuTimeUs( ) - cpuStart;
+            uint32_t frames  = videoSource.FramesReceived( ) - framesStart;
+            uint64_t encoded = video2web.EncodeTimeHistogram( ).Count( ) - encodedStart;
+
+            encodeTime = video2web.EncodeTimeHistogram( ).Sum( ) - encodeTime;
+
+            // let clients' process print its report first
+            waitpid( clientsPid, &status, 0 );
+
+            printf( "Source frames         : %u (%.1f fps), %s %ux%u, zero copy %s \n", frames,
+                    static_cast<double>( frames ) / Settings.Duration,
+                    ( Settings.Format == XPixelFormat::JPEG ) ? "JPEG" :
+                    ( Settings.Format == XPixelFormat::YUV420 ) ? "YUV420" : "RGB24",
+                    Settings.FrameWidth, Settings.FrameHeight, ( Settings.ZeroCopy ) ? "on" : "off" );
+            printf( "Encoded/copied frames : %u, avg %.2f ms, %u encoder thread(s) \n", static_cast<uint32_t>( encoded ),
+                    ( encoded == 0 ) ? 0.0 : static_cast<double>( encodeTime ) / encoded / 1000, Settings.EncoderThreads );
+            printf( "Server CPU            : %.1f%%, %.2f ms per source frame \n",
+                    static_cast<double>( cpuTime ) / ( Settings.Duration * 10000.0 ),
+                    ( frames == 0 ) ? 0.0 : static_cast<double>( cpuTime ) / frames / 1000 );
+
+            ret = ( ( WIFEXITED( status ) ) && ( WEXITSTATUS( status ) == 0 ) ) ? 0 : 1;
+        }
+    }
+
+    videoSource.SignalToStop( );
+    videoSource.WaitForStop( );
+    server.Stop( );
+
+    return ret;
+}
+
+int main( int argc, char* argv[] )
+{
+    SharedData* shared;
+    pid_t       clientsPid;
+    int         ret = 1;
+
+    SetDefaultSettings( );
+
+    if ( ParseCommandLine( argc, argv ) )
+    {
+        // clients run in their own process, so they don't affect CPU usage of the web server's one
+        shared = static_cast<SharedData*>( mmap( nullptr, sizeof( SharedData ), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 ) );
+
+        if ( shared == MAP_FAILED )
+        {
+            printf( "Failed allocating shared memory \n" );
+        }
+        else
+        {
+            new ( shared ) SharedData( );
+
+            fflush( stdout );
+            clientsPid = fork( );
+
+            if ( clientsPid == 0 )
+            {
+                ret = RunClients( shared );
+                fflush( stdout );
+                _exit( ret );
+            }
+            else if ( clientsPid > 0 )
+            {
+                ret = RunServer( shared, clientsPid );
+            }
+            else
+            {
+                printf( "Failed starting clients' process \n" );
+            }
+        }
+    }
+
+    return ret;
+}
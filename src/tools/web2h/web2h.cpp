@@ -22,10 +22,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using namespace std;
 
 void ShowUsage( );
 int GenerateHeaderFile( const char* inputFileName, const char* outputFileName, const char* mimeType );
 const char* ResolveMimeType( const char* fileName );
+bool GzipCompress( const vector<uint8_t>& data, vector<uint8_t>& compressed );
+uint64_t CalculateHash( const vector<uint8_t>& data );
+void WriteArray( FILE* outputFile, const char* varName, const vector<uint8_t>& data );
 
 // suported MIME types
 const char* STR_TEXT_HTML  = "text/html";
@@ -164,11 +172,25 @@ int GenerateHeaderFile( const char* inputFileName, const char* outputFileName, c
                 }
             }
 
-            // get input file's size
+            // read input file
             fseek( inputFile, 0L, SEEK_END );
             int inputFileSize = ftell( inputFile );
             rewind( inputFile );
 
+            vector<uint8_t> data( inputFileSize );
+            vector<uint8_t> gzipData;
+
+            if ( ( inputFileSize > 0 ) && ( fread( data.data( ), 1, inputFileSize, inputFile ) != static_cast<size_t>( inputFileSize ) ) )
+            {
+                printf( "Warning: failed reading the complete input file \n" );
+            }
+
+            // provide compressed variant only if it makes any difference (not for images, for example)
+            if ( ( GzipCompress( data, gzipData ) ) && ( gzipData.size( ) >= data.size( ) * 9 / 10 ) )
+            {
+                gzipData.clear( );
+            }
+
             // write output file
             fprintf( outputFile, "/*\n" );
             fprintf( outputFile, " * Auto generated header file to be used with web2cam\n" );
@@ -181,32 +203,29 @@ int GenerateHeaderFile( const char* inputFileName, const char* outputFileName, c
 
             fprintf( outputFile, "#include \"XWebServer.hpp\"\n\n" );
 
-            fprintf( outputFile, "uint8_t %s_data[]\n", outVarName );
-            fprintf( outputFile, "{\n" );
-
-            uint8_t buffer[20];
-            size_t  read;
+            WriteArray( outputFile, ( string( outVarName ) + "_data" ).c_str( ), data );
 
-            while ( ( read = fread( buffer, 1, 20, inputFile ) ) != 0 )
+            if ( !gzipData.empty( ) )
             {
-                fprintf( outputFile, "    " );
-
-                for ( size_t i = 0; i < read; i++ )
-                {
-                    fprintf( outputFile, "0x%02X, ", buffer[i] );
-                }
-
-                fprintf( outputFile, "\n" );
+                WriteArray( outputFile, ( string( outVarName ) + "_gzip_data" ).c_str( ), gzipData );
             }
 
-            fprintf( outputFile, "};\n\n" );
-
-
             fprintf( outputFile, "XEmbeddedContent web_%s =\n", outVarName );
             fprintf( outputFile, "{\n" );
             fprintf( outputFile, "    %d,\n", inputFileSize );
             fprintf( outputFile, "    \"%s\",\n", mimeType );
             fprintf( outputFile, "    %s_data,\n", outVarName );
+            if ( gzipData.empty( ) )
+            {
+                fprintf( outputFile, "    0,\n" );
+                fprintf( outputFile, "    nullptr,\n" );
+            }
+            else
+            {
+                fprintf( outputFile, "    %u,\n", static_cast<unsigned int>( gzipData.size( ) ) );
+                fprintf( outputFile, "    %s_gzip_data,\n", outVarName );
+            }
+            fprintf( outputFile, "    \"%016llx\",\n", static_cast<unsigned long long>( CalculateHash( data ) ) );
             fprintf( outputFile, "};\n\n" );
 
             fprintf( outputFile, "#endif\n" );
@@ -223,6 +242,76 @@ int GenerateHeaderFile( const char* inputFileName, const char* outputFileName, c
     return ret;
 }
 
+// Write C array definition with the specified data
+void WriteArray( FILE* outputFile, const char* varName, const vector<uint8_t>& data )
+{
+    fprintf( outputFile, "uint8_t %s[]\n", varName );
+    fprintf( outputFile, "{\n" );
+
+    for ( size_t offset = 0; offset < data.size( ); offset += 20 )
+    {
+        fprintf( outputFile, "    " );
+
+        for ( size_t i = offset; ( i < offset + 20 ) && ( i < data.size( ) ); i++ )
+        {
+            fprintf( outputFile, "0x%02X, ", data[i] );
+        }
+
+        fprintf( outputFile, "\n" );
+    }
+
+    fprintf( outputFile, "};\n\n" );
+}
+
+// Compress data into gzip format, so it could be sent with "Content-Encoding: gzip"
+bool GzipCompress( const vector<uint8_t>& data, vector<uint8_t>& compressed )
+{
+    z_stream stream;
+    bool     ret = false;
+
+    memset( &stream, 0, sizeof( stream ) );
+
+    // window bits of 15 + 16 tells zlib to write gzip header/trailer instead of zlib's
+    if ( deflateInit2( &stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY ) == Z_OK )
+    {
+        compressed.resize( deflateBound( &stream, static_cast<uLong>( data.size( ) ) ) + 32 );
+
+        stream.next_in   = const_cast<Bytef*>( data.data( ) );
+        stream.avail_in  = static_cast<uInt>( data.size( ) );
+        stream.next_out  = compressed.data( );
+        stream.avail_out = static_cast<uInt>( compressed.size( ) );
+
+        if ( deflate( &stream, Z_FINISH ) == Z_STREAM_END )
+        {
+            compressed.resize( stream.total_out );
+            ret = true;
+        }
+
+        deflateEnd( &stream );
+    }
+
+    if ( !ret )
+    {
+        compressed.clear( );
+    }
+
+    return ret;
+}
+
+// Calculate 64-bit FNV-1a hash of the data to be used as its entity tag
+uint64_t CalculateHash( const vector<uint8_t>& data )
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for ( uint8_t byte : data )
+    {
+        hash ^= byte;
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
 const char* ResolveMimeType( const char* fileName )
 {
     const char* ret = nullptr;